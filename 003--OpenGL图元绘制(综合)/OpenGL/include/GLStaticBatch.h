@@ -0,0 +1,418 @@
+// GLStaticBatch.h
+// Scenery that never moves, merged at load time.
+//
+// Each small GLBatch costs its own vertex array bind, shader setup and draw
+// call every frame. GLStaticBatch takes the same geometry as parts. Begin()
+// and Vertex3f() work the way they do on GLBatch, but each part also gives
+// its world matrix, stock shader and color. Build() moves every part into
+// world space and groups the parts by (primitive, shader, color). All
+// groups share one vertex buffer. Strips, loops and fans become plain
+// lines and triangles so they can join a group.
+//
+// Each part keeps its range in the group, so SetPartEnabled() can hide it.
+// Neighbouring enabled parts are drawn as one range, and each group is one
+// glMultiDrawArrays() call.
+//
+// Only positions are stored (GLT_ATTRIBUTE_VERTEX). There are no normals,
+// colors or texture coordinates, so the lit, shaded and textured stock
+// shaders cannot be used; the color of a group is a uniform.
+//
+// As a GLBatchBase it can go into a GLRenderQueue packet. Draw(void) then
+// draws every enabled group with the packet's program and color, which is
+// right when all parts share them.
+
+#ifndef __GLT_STATIC_BATCH
+#define __GLT_STATIC_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLShaderManager.h"
+#include <vector>
+#include <algorithm>
+
+class GLStaticBatch : public GLBatchBase
+	{
+	public:
+		GLStaticBatch(void) {
+			uiVertexBuffer = 0;
+			vertexArrayObject = 0;
+			nBuilding = -1;
+			bRangesDirty = true;
+			m3dLoadIdentity44(mBuilding);
+			}
+
+		~GLStaticBatch(void) {
+			if(uiVertexBuffer != 0) glDeleteBuffers(1, &uiVertexBuffer);
+			if(vertexArrayObject != 0) glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		// Start a part. Returns its index, or -1 for a primitive that cannot
+		// be merged (anything but points, lines and triangles and their
+		// strips, loops and fans). mWorld is applied to every vertex.
+		// A part still open from an earlier Begin() is ended first.
+		int Begin(GLenum primitive, GLT_STOCK_SHADER shader, const M3DVector4f vColor, const M3DMatrix44f mWorld);
+		void Vertex3f(GLfloat x, GLfloat y, GLfloat z);
+		inline void Vertex3fv(const M3DVector3f vVertex) { Vertex3f(vVertex[0], vVertex[1], vVertex[2]); }
+		void CopyVertexData3f(const M3DVector3f *pVerts, GLuint nVerts);
+		void End(void);
+
+		// Merge and upload everything added so far, ending an open part.
+		// Parts cannot be added after.
+		void Build(void);
+
+		// Out of range parts, such as -1 from a failed Begin(), are ignored
+		inline void SetPartEnabled(int nPart, bool bEnabled) {
+			if(nPart < 0 || nPart >= int(parts.size()))
+				return;
+			if(parts[nPart].bEnabled != bEnabled) {
+				parts[nPart].bEnabled = bEnabled;
+				bRangesDirty = true;
+				}
+			}
+		inline bool IsPartEnabled(int nPart) const {
+			return (nPart >= 0 && nPart < int(parts.size())) ? parts[nPart].bEnabled : false;
+			}
+		inline int GetPartCount(void) const { return int(parts.size()); }
+
+		// Draw every group whose shader is GLT_SHADER_FLAT or GLT_SHADER_IDENTITY,
+		// setting the shader up with the group's color. Since the vertices
+		// are already in world space, mvpMatrix is view projection only.
+		void Draw(GLShaderManager &shaderManager, const M3DMatrix44f mvpMatrix);
+
+		// Every group with the program already bound, see above
+		virtual void Draw(void);
+
+		// One group with the program already bound, e.g. to draw it again in
+		// another color. The shader must take positions only.
+		inline int GetGroupCount(void) const { return int(groups.size()); }
+		inline GLT_STOCK_SHADER GetGroupShader(int nGroup) const { return groups[nGroup].shader; }
+		inline const GLfloat *GetGroupColor(int nGroup) const { return groups[nGroup].vColor; }
+		void DrawGroup(int nGroup);
+
+		// One draw call per group with anything enabled
+		GLuint GetDrawCallCount(void);
+
+	protected:
+		struct Part
+			{
+			GLenum				primitive;		// After conversion: points, lines or triangles
+			GLT_STOCK_SHADER	shader;
+			M3DVector4f			vColor;
+			std::vector<GLfloat>	vVerts;		// World space, until Build()
+			int					nGroup;
+			GLint				nFirst;			// Range in the vertex buffer
+			GLsizei				nCount;
+			bool				bEnabled;
+			};
+
+		struct Group
+			{
+			GLenum				primitive;
+			GLT_STOCK_SHADER	shader;
+			M3DVector4f			vColor;
+			std::vector<int>	vParts;			// In buffer order
+			std::vector<GLint>		vFirsts;	// Enabled ranges
+			std::vector<GLsizei>	vCounts;
+			};
+
+		void UpdateRanges(void);
+		static bool BasePrimitive(GLenum primitive, GLenum &base);
+
+		GLuint	uiVertexBuffer;
+		GLuint	vertexArrayObject;
+		std::vector<Part>	parts;
+		std::vector<Group>	groups;
+		bool	bRangesDirty;
+
+		// Part being built
+		int				nBuilding;
+		GLenum			buildingPrimitive;
+		M3DMatrix44f	mBuilding;
+		std::vector<GLfloat>	vBuilding;
+
+	private:
+		GLStaticBatch(const GLStaticBatch&);
+		GLStaticBatch &operator=(const GLStaticBatch&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GL_POINTS is 0, so the answer comes back in base
+inline bool GLStaticBatch::BasePrimitive(GLenum primitive, GLenum &base)
+	{
+	switch(primitive) {
+		case GL_POINTS:
+			base = GL_POINTS;
+			return true;
+		case GL_LINES:
+		case GL_LINE_STRIP:
+		case GL_LINE_LOOP:
+			base = GL_LINES;
+			return true;
+		case GL_TRIANGLES:
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			base = GL_TRIANGLES;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline int GLStaticBatch::Begin(GLenum primitive, GLT_STOCK_SHADER shader, const M3DVector4f vColor, const M3DMatrix44f mWorld)
+	{
+	Part part;
+	if(!BasePrimitive(primitive, part.primitive) || vertexArrayObject != 0)
+		return -1;
+
+	End();
+
+	part.shader = shader;
+	m3dCopyVector4(part.vColor, vColor);
+	part.nGroup = -1;
+	part.nFirst = 0;
+	part.nCount = 0;
+	part.bEnabled = true;
+	parts.push_back(part);
+
+	nBuilding = int(parts.size()) - 1;
+	buildingPrimitive = primitive;
+	m3dCopyMatrix44(mBuilding, mWorld);
+	vBuilding.clear();
+	return nBuilding;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::Vertex3f(GLfloat x, GLfloat y, GLfloat z)
+	{
+	if(nBuilding < 0)
+		return;
+
+	M3DVector3f vIn = { x, y, z };
+	M3DVector3f vOut;
+	m3dTransformVector3(vOut, vIn, mBuilding);
+	vBuilding.insert(vBuilding.end(), vOut, vOut + 3);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::CopyVertexData3f(const M3DVector3f *pVerts, GLuint nVerts)
+	{
+	for(GLuint i = 0; i < nVerts; i++)
+		Vertex3fv(pVerts[i]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Unroll the part into its base primitive
+inline void GLStaticBatch::End(void)
+	{
+	if(nBuilding < 0)
+		return;
+
+	std::vector<GLfloat> &vOut = parts[nBuilding].vVerts;
+	const GLfloat *pIn = vBuilding.empty() ? NULL : &vBuilding[0];
+	GLuint n = GLuint(vBuilding.size() / 3);
+	std::vector<GLuint> vIndexes;
+
+	switch(buildingPrimitive) {
+		case GL_LINE_STRIP:
+		case GL_LINE_LOOP:
+			for(GLuint i = 0; i + 1 < n; i++) {
+				vIndexes.push_back(i);
+				vIndexes.push_back(i + 1);
+				}
+			if(buildingPrimitive == GL_LINE_LOOP && n > 2) {
+				vIndexes.push_back(n - 1);
+				vIndexes.push_back(0);
+				}
+			break;
+
+		case GL_TRIANGLE_STRIP:
+			// Every other triangle is wound the other way round
+			for(GLuint i = 0; i + 2 < n; i++) {
+				vIndexes.push_back((i & 1) ? i + 1 : i);
+				vIndexes.push_back((i & 1) ? i : i + 1);
+				vIndexes.push_back(i + 2);
+				}
+			break;
+
+		case GL_TRIANGLE_FAN:
+			for(GLuint i = 1; i + 1 < n; i++) {
+				vIndexes.push_back(0);
+				vIndexes.push_back(i);
+				vIndexes.push_back(i + 1);
+				}
+			break;
+
+		default: {
+			// Lists drop an incomplete trailing primitive, as GL would
+			GLuint nPer = (buildingPrimitive == GL_POINTS) ? 1 : (buildingPrimitive == GL_LINES) ? 2 : 3;
+			for(GLuint i = 0; i < n - n % nPer; i++)
+				vIndexes.push_back(i);
+			}
+		}
+
+	vOut.resize(vIndexes.size() * 3);
+	for(size_t i = 0; i < vIndexes.size(); i++)
+		memcpy(&vOut[i * 3], pIn + vIndexes[i] * 3, sizeof(GLfloat) * 3);
+
+	nBuilding = -1;
+	vBuilding.clear();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::Build(void)
+	{
+	if(vertexArrayObject != 0)
+		return;
+
+	End();
+
+	// Group parts on their key. Groups are kept sorted by shader so Draw()
+	// changes programs as little as it can.
+	groups.clear();
+	for(size_t p = 0; p < parts.size(); p++) {
+		Part &part = parts[p];
+		size_t g;
+		for(g = 0; g < groups.size(); g++)
+			if(groups[g].primitive == part.primitive && groups[g].shader == part.shader &&
+			   memcmp(groups[g].vColor, part.vColor, sizeof(M3DVector4f)) == 0)
+				break;
+
+		if(g == groups.size()) {
+			Group group;
+			group.primitive = part.primitive;
+			group.shader = part.shader;
+			m3dCopyVector4(group.vColor, part.vColor);
+			groups.push_back(group);
+			}
+		groups[g].vParts.push_back(int(p));
+		}
+
+	std::stable_sort(groups.begin(), groups.end(),
+					 [](const Group &a, const Group &b) { return a.shader < b.shader; });
+
+	// Lay the groups out one after another, parts in the order they came
+	std::vector<GLfloat> vAll;
+	for(size_t g = 0; g < groups.size(); g++)
+		for(size_t i = 0; i < groups[g].vParts.size(); i++) {
+			Part &part = parts[groups[g].vParts[i]];
+			part.nGroup = int(g);
+			part.nFirst = GLint(vAll.size() / 3);
+			part.nCount = GLsizei(part.vVerts.size() / 3);
+			vAll.insert(vAll.end(), part.vVerts.begin(), part.vVerts.end());
+			std::vector<GLfloat>().swap(part.vVerts);
+			}
+
+	glGenVertexArrays(1, &vertexArrayObject);
+	glBindVertexArray(vertexArrayObject);
+
+	glGenBuffers(1, &uiVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uiVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vAll.size(), vAll.empty() ? NULL : &vAll[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	bRangesDirty = true;
+	std::vector<GLfloat>().swap(vBuilding);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Coalesce each group's enabled parts into as few ranges as possible
+inline void GLStaticBatch::UpdateRanges(void)
+	{
+	for(size_t g = 0; g < groups.size(); g++) {
+		Group &group = groups[g];
+		group.vFirsts.clear();
+		group.vCounts.clear();
+
+		for(size_t i = 0; i < group.vParts.size(); i++) {
+			const Part &part = parts[group.vParts[i]];
+			if(!part.bEnabled || part.nCount == 0)
+				continue;
+
+			if(!group.vFirsts.empty() && group.vFirsts.back() + group.vCounts.back() == part.nFirst)
+				group.vCounts.back() += part.nCount;
+			else {
+				group.vFirsts.push_back(part.nFirst);
+				group.vCounts.push_back(part.nCount);
+				}
+			}
+		}
+	bRangesDirty = false;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::DrawGroup(int nGroup)
+	{
+	if(bRangesDirty)
+		UpdateRanges();
+
+	const Group &group = groups[nGroup];
+	if(group.vFirsts.empty())
+		return;
+
+	glBindVertexArray(vertexArrayObject);
+	if(group.vFirsts.size() == 1)
+		glDrawArrays(group.primitive, group.vFirsts[0], group.vCounts[0]);
+	else
+		glMultiDrawArrays(group.primitive, &group.vFirsts[0], &group.vCounts[0], GLsizei(group.vFirsts.size()));
+	glBindVertexArray(0);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::Draw(GLShaderManager &shaderManager, const M3DMatrix44f mvpMatrix)
+	{
+	if(bRangesDirty)
+		UpdateRanges();
+
+	for(size_t g = 0; g < groups.size(); g++) {
+		Group &group = groups[g];
+		if(group.vFirsts.empty())
+			continue;
+
+		if(group.shader == GLT_SHADER_FLAT)
+			shaderManager.UseStockShader(GLT_SHADER_FLAT, mvpMatrix, group.vColor);
+		else if(group.shader == GLT_SHADER_IDENTITY)
+			shaderManager.UseStockShader(GLT_SHADER_IDENTITY, group.vColor);
+		else
+			continue;
+
+		DrawGroup(int(g));
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStaticBatch::Draw(void)
+	{
+	for(size_t g = 0; g < groups.size(); g++)
+		DrawGroup(int(g));
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLuint GLStaticBatch::GetDrawCallCount(void)
+	{
+	if(bRangesDirty)
+		UpdateRanges();
+
+	GLuint nCalls = 0;
+	for(size_t g = 0; g < groups.size(); g++)
+		if(!groups[g].vFirsts.empty())
+			nCalls++;
+	return nCalls;
+	}
+
+#endif
@@ -3,6 +3,8 @@
 #include "GLMatrixStack.h"
 #include "GLShaderManager.h"
 #include "GLGeometryTransform.h"
+#include "GLStateTracker.h"
+#include "GLStaticBatch.h"
 #include <GLUT/GLUT.h>
 
 // 着色管理器
@@ -26,14 +28,11 @@ GLFrame                cameraFrame;
 // 参考帧，用于生成模型变换矩阵（平移旋转缩放）
 GLFrame                objectFrame;
 
-// 容器类（7种不同的图元对应7种容器对象）
-GLBatch                pointBatch;
-GLBatch                lineBatch;
-GLBatch                lineStripBatch;
-GLBatch                lineLoopBatch;
-GLBatch                triangleBatch;
-GLBatch                triangleStripBatch;
-GLBatch                triangleFanBatch;
+// 7种图元合并在一个静态批次里，共用一个顶点缓冲区。
+// 条带、环、扇形在合并时展开成线段和三角形，点和线为黑色，三角形为绿色
+GLStaticBatch          primitiveBatch;
+// 每种图元在批次中的部件编号，按 nStep 的顺序；只显示当前这一个
+int                    primitiveParts[7];
 
 // 填充颜色
 GLfloat vGreen[] = { 0.0f, 1.0f, 0.0f, 1.0f };
@@ -43,6 +42,9 @@ GLfloat vBlack[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 // 跟踪效果步骤，按空格切换
 int nStep = 0;
 
+// 渲染状态缓存：只有真正改变的状态才调用OpenGL，并统计省掉的调用次数
+GLStateTracker         renderState;
+
 /// 在窗口大小改变时，接收新的宽度&高度。
 void changeSize(int w,int h) {
     // 修改视口
@@ -90,33 +92,39 @@ void keyPressFunc(unsigned char key, int x, int y) {
 }
 
 // 画边框和颜色
-void drawWireFramedBatch(GLBatch* pBatch) {
+// 每次绘制前只声明需要的状态，不再在画完后逐项复原；
+// 与当前状态相同的设置由 renderState 跳过
+void drawWireFramedBatch(const M3DMatrix44f mvp) {
     // 开启深度测试
-    glEnable(GL_DEPTH_TEST);
+    renderState.Enable(GL_DEPTH_TEST);
     
     /*-----------填充颜色部分-------------------*/
-    // 使用平面着色器，给图形填充绿色
-    shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vGreen);
-    pBatch->Draw();
+    // 实心填充，不偏移、不混合、不反锯齿
+    renderState.PolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    renderState.Disable(GL_POLYGON_OFFSET_LINE);
+    renderState.Disable(GL_BLEND);
+    renderState.Disable(GL_LINE_SMOOTH);
+    // 使用平面着色器，给图形填充绿色（三角形部件的颜色）
+    primitiveBatch.Draw(shaderManager, mvp);
     
     /*-----------边框部分-------------------*/
     // 开启多边形偏移
-    glPolygonOffset(-1.0f, -1.0f);
-    glEnable(GL_POLYGON_OFFSET_LINE);
+    renderState.PolygonOffset(-1.0f, -1.0f);
+    renderState.Enable(GL_POLYGON_OFFSET_LINE);
     
     // 开启反锯齿
-    glEnable(GL_LINE_SMOOTH);
+    renderState.Enable(GL_LINE_SMOOTH);
     
     // 开启混合
-    glEnable(GL_BLEND);
+    renderState.Enable(GL_BLEND);
     // 混合方法
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    renderState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
     //绘制线框几何黑色版 三种模式，实心，边框，点，可以作用在正面，背面，或者两面
     //通过调用glPolygonMode将多边形正面或者背面设为线框模式，实现线框渲染
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    renderState.PolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     //设置线条宽度
-    glLineWidth(2.5f);
+    renderState.LineWidth(2.5f);
     
     /* GLShaderManager 中的Uniform 值——平面着色器
      参数1：平面着色器
@@ -125,17 +133,18 @@ void drawWireFramedBatch(GLBatch* pBatch) {
           GetMatrix函数就可以获得矩阵堆栈顶部的值
      参数3：颜色值（黑色）
      */
-    shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vBlack);
-    pBatch->Draw();
+    shaderManager.UseStockShader(GLT_SHADER_FLAT, mvp, vBlack);
+    // 同样的三角形再画一遍，着色器已经设好，不用部件自己的颜色
+    for (int i = 0; i < primitiveBatch.GetGroupCount(); i++)
+        primitiveBatch.DrawGroup(i);
+}
 
-    // 复原原本的设置
-    //通过调用glPolygonMode将多边形正面或者背面设为全部填充模式
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glDisable(GL_POLYGON_OFFSET_LINE);
-    glLineWidth(1.0f);
-    glDisable(GL_BLEND);
-    glDisable(GL_LINE_SMOOTH);
-    glDisable(GL_DEPTH_TEST);
+// 点和线：不需要深度测试、混合和反锯齿（线框绘制后会留下这些状态）
+void drawPlainBatch(const M3DMatrix44f mvp) {
+    renderState.Disable(GL_DEPTH_TEST);
+    renderState.Disable(GL_BLEND);
+    renderState.Disable(GL_LINE_SMOOTH);
+    primitiveBatch.Draw(shaderManager, mvp);
 }
 
 
@@ -160,41 +169,32 @@ void renderScene(void) {
     //矩阵乘以矩阵堆栈的顶部矩阵，相乘的结果随后简存储在堆栈的顶部
     modelViewMatrix.MultMatrix(mObjectFrame);
     
-    // 传递矩阵和颜色到平面着色器
-    shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vBlack);
+    // 部件在合并时没有乘模型矩阵（单位矩阵），所以这里传完整的模型视图投影矩阵；
+    // 颜色由各部件自带
+    const float *mvp = transformPipeline.GetModelViewProjectionMatrix();
+    
+    // 只打开当前图元对应的部件
+    for (int i = 0; i < 7; i++)
+        primitiveBatch.SetPartEnabled(primitiveParts[i], i == nStep);
     
     switch(nStep) {
         case 0:
             //设置点的大小
-            glPointSize(4.0f);
-            pointBatch.Draw();
-            glPointSize(1.0f);
+            renderState.PointSize(4.0f);
+            drawPlainBatch(mvp);
             break;
         case 1:
+        case 2:
+        case 3:
             //设置线的宽度
-            glLineWidth(2.0f);
-            lineBatch.Draw();
-            glLineWidth(1.0f);
+            renderState.LineWidth(2.0f);
+            drawPlainBatch(mvp);
+            break;
+        case 4:
+        case 5:
+        case 6:
+            drawWireFramedBatch(mvp);
             break;
-         case 2:
-             glLineWidth(2.0f);
-             lineStripBatch.Draw();
-             glLineWidth(1.0f);
-             break;
-         case 3:
-             glLineWidth(2.0f);
-             lineLoopBatch.Draw();
-             glLineWidth(1.0f);
-             break;
-         case 4:
-             drawWireFramedBatch(&triangleBatch);
-             break;
-         case 5:
-             drawWireFramedBatch(&triangleStripBatch);
-             break;
-         case 6:
-             drawWireFramedBatch(&triangleFanBatch);
-             break;
         default:
             break;
      }
@@ -215,32 +215,36 @@ void setupRC() {
     
     cameraFrame.MoveForward(-15.0f);
     
+    // 部件不移动，世界矩阵用单位矩阵
+    M3DMatrix44f mIdentity;
+    m3dLoadIdentity44(mIdentity);
+    
     // 定义三个点
-    GLfloat vCoast[] = {
+    GLfloat vCoast[3][3] = {
         3,3,0,
         0,3,0,
         3,0,0
     };
     
     // 画点
-    pointBatch.Begin(GL_POINTS, 3);
-    pointBatch.CopyVertexData3f(vCoast);
-    pointBatch.End();
+    primitiveParts[0] = primitiveBatch.Begin(GL_POINTS, GLT_SHADER_FLAT, vBlack, mIdentity);
+    primitiveBatch.CopyVertexData3f(vCoast, 3);
+    primitiveBatch.End();
     
     // 画线
-    lineBatch.Begin(GL_LINES, 3);
-    lineBatch.CopyVertexData3f(vCoast);
-    lineBatch.End();
+    primitiveParts[1] = primitiveBatch.Begin(GL_LINES, GLT_SHADER_FLAT, vBlack, mIdentity);
+    primitiveBatch.CopyVertexData3f(vCoast, 3);
+    primitiveBatch.End();
     
     // 画连续线段
-    lineStripBatch.Begin(GL_LINE_STRIP, 3);
-    lineStripBatch.CopyVertexData3f(vCoast);
-    lineStripBatch.End();
+    primitiveParts[2] = primitiveBatch.Begin(GL_LINE_STRIP, GLT_SHADER_FLAT, vBlack, mIdentity);
+    primitiveBatch.CopyVertexData3f(vCoast, 3);
+    primitiveBatch.End();
     
     // 画闭合线段
-    lineLoopBatch.Begin(GL_LINE_LOOP, 3);
-    lineLoopBatch.CopyVertexData3f(vCoast);
-    lineLoopBatch.End();
+    primitiveParts[3] = primitiveBatch.Begin(GL_LINE_LOOP, GLT_SHADER_FLAT, vBlack, mIdentity);
+    primitiveBatch.CopyVertexData3f(vCoast, 3);
+    primitiveBatch.End();
     
     // 3个三角形，构成金字塔形状
     GLfloat vPyramid[12][3] = {
@@ -260,9 +264,9 @@ void setupRC() {
         -2.0f, 0.0f, -2.0f,
         0.0f, 4.0f, 0.0f
     };
-    triangleBatch.Begin(GL_TRIANGLES, 12);
-    triangleBatch.CopyVertexData3f(vPyramid);
-    triangleBatch.End();
+    primitiveParts[4] = primitiveBatch.Begin(GL_TRIANGLES, GLT_SHADER_FLAT, vGreen, mIdentity);
+    primitiveBatch.CopyVertexData3f(vPyramid, 12);
+    primitiveBatch.End();
 
     // 三角形扇形--六边形
     GLfloat vPoints[100][3];
@@ -299,9 +303,9 @@ void setupRC() {
     vPoints[nVerts][2] = 0.0f;
     
     // 加载！GL_TRIANGLE_FAN 以一个圆心为中心呈扇形排列，共用相邻顶点的一组三角形
-    triangleFanBatch.Begin(GL_TRIANGLE_FAN, 8);
-    triangleFanBatch.CopyVertexData3f(vPoints);
-    triangleFanBatch.End();
+    primitiveParts[6] = primitiveBatch.Begin(GL_TRIANGLE_FAN, GLT_SHADER_FLAT, vGreen, mIdentity);
+    primitiveBatch.CopyVertexData3f(vPoints, 8);
+    primitiveBatch.End();
        
     // 三角形条带，一个小环或圆柱段
     // 顶点下标
@@ -338,9 +342,12 @@ void setupRC() {
     iCounter++;
     
     // GL_TRIANGLE_STRIP 共用一个条带（strip）上的顶点的一组三角形
-    triangleStripBatch.Begin(GL_TRIANGLE_STRIP, iCounter);
-    triangleStripBatch.CopyVertexData3f(vPoints);
-    triangleStripBatch.End();
+    primitiveParts[5] = primitiveBatch.Begin(GL_TRIANGLE_STRIP, GLT_SHADER_FLAT, vGreen, mIdentity);
+    primitiveBatch.CopyVertexData3f(vPoints, iCounter);
+    primitiveBatch.End();
+    
+    // 合并上传，之后不能再加部件
+    primitiveBatch.Build();
 }
 
 int main(int argc,char *argv[]) {
@@ -0,0 +1,181 @@
+// GLStateTracker.h
+// Cached copy of the fixed function state the demos toggle around draws.
+//
+// Every setter compares with what it last set and only calls GL when the
+// value really changes. Code that restores state after each object can
+// instead set what the next draw needs, and the calls that would set a
+// value already in place are skipped and counted.
+//
+// Nothing is known after construction or Invalidate(), so the first call
+// for each piece of state always goes through. Call Invalidate() after
+// code that changes this state behind the tracker's back.
+// GLShaderManager::UseStockShader() does not touch any of it.
+
+#ifndef __GLT_STATE_TRACKER
+#define __GLT_STATE_TRACKER
+
+#include "GLTools.h"
+
+#define GLT_STATE_TRACKER_CAPS	10
+
+class GLStateTracker
+	{
+	public:
+		GLStateTracker(void) {
+			// Capabilities tracked. Anything else passes straight through.
+			static const GLenum trackedCaps[GLT_STATE_TRACKER_CAPS] = {
+				GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_LINE_SMOOTH, GL_POLYGON_SMOOTH,
+				GL_POLYGON_OFFSET_FILL, GL_POLYGON_OFFSET_LINE, GL_POLYGON_OFFSET_POINT,
+				GL_SCISSOR_TEST, GL_STENCIL_TEST };
+			for(int i = 0; i < GLT_STATE_TRACKER_CAPS; i++)
+				caps[i] = trackedCaps[i];
+
+			bRecordOnly = false;
+			ResetCounters();
+			Invalidate();
+			}
+
+		// Forget everything, the next call for each piece of state goes to GL
+		void Invalidate(void) {
+			for(int i = 0; i < GLT_STATE_TRACKER_CAPS; i++)
+				capState[i] = -1;
+			polygonMode[0] = polygonMode[1] = GL_NONE;
+			bLineWidthKnown = bPointSizeKnown = bBlendFuncKnown = bPolygonOffsetKnown = false;
+			}
+
+		void Enable(GLenum cap) { Set(cap, true); }
+		void Disable(GLenum cap) { Set(cap, false); }
+		void Set(GLenum cap, bool bEnabled);
+
+		void PolygonMode(GLenum face, GLenum mode);
+		void LineWidth(GLfloat fWidth);
+		void PointSize(GLfloat fSize);
+		void BlendFunc(GLenum sfactor, GLenum dfactor);
+		void PolygonOffset(GLfloat fFactor, GLfloat fUnits);
+
+		inline GLuint GetCallsMade(void) const { return nCallsMade; }
+		inline GLuint GetCallsSkipped(void) const { return nCallsSkipped; }
+		inline void ResetCounters(void) { nCallsMade = nCallsSkipped = 0; }
+
+		// Track and count without calling GL, to measure what a sequence of
+		// state changes would cost
+		inline void SetRecordOnly(bool bRecord) { bRecordOnly = bRecord; }
+
+	protected:
+		inline bool Skip(bool bSame) {
+			if(bSame)
+				nCallsSkipped++;
+			else
+				nCallsMade++;
+			return bSame;
+			}
+
+		GLenum		caps[GLT_STATE_TRACKER_CAPS];
+		signed char	capState[GLT_STATE_TRACKER_CAPS];		// -1 unknown, 0 off, 1 on
+		GLenum		polygonMode[2];							// Front, back. GL_NONE is unknown.
+		GLfloat		fLineWidth;
+		GLfloat		fPointSize;
+		GLenum		blendSrc, blendDst;
+		GLfloat		fOffsetFactor, fOffsetUnits;
+		bool		bLineWidthKnown, bPointSizeKnown, bBlendFuncKnown, bPolygonOffsetKnown;
+
+		GLuint		nCallsMade;
+		GLuint		nCallsSkipped;
+		bool		bRecordOnly;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::Set(GLenum cap, bool bEnabled)
+	{
+	int i;
+	for(i = 0; i < GLT_STATE_TRACKER_CAPS; i++)
+		if(caps[i] == cap)
+			break;
+
+	if(i < GLT_STATE_TRACKER_CAPS) {
+		if(Skip(capState[i] == (bEnabled ? 1 : 0)))
+			return;
+		capState[i] = bEnabled ? 1 : 0;
+		}
+	else
+		Skip(false);
+
+	if(bRecordOnly)
+		return;
+	if(bEnabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::PolygonMode(GLenum face, GLenum mode)
+	{
+	bool bFront = (face == GL_FRONT || face == GL_FRONT_AND_BACK);
+	bool bBack = (face == GL_BACK || face == GL_FRONT_AND_BACK);
+	if(Skip((!bFront || polygonMode[0] == mode) && (!bBack || polygonMode[1] == mode)))
+		return;
+
+	if(bFront) polygonMode[0] = mode;
+	if(bBack) polygonMode[1] = mode;
+	if(!bRecordOnly)
+		glPolygonMode(face, mode);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::LineWidth(GLfloat fWidth)
+	{
+	if(Skip(bLineWidthKnown && fLineWidth == fWidth))
+		return;
+
+	fLineWidth = fWidth;
+	bLineWidthKnown = true;
+	if(!bRecordOnly)
+		glLineWidth(fWidth);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::PointSize(GLfloat fSize)
+	{
+	if(Skip(bPointSizeKnown && fPointSize == fSize))
+		return;
+
+	fPointSize = fSize;
+	bPointSizeKnown = true;
+	if(!bRecordOnly)
+		glPointSize(fSize);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::BlendFunc(GLenum sfactor, GLenum dfactor)
+	{
+	if(Skip(bBlendFuncKnown && blendSrc == sfactor && blendDst == dfactor))
+		return;
+
+	blendSrc = sfactor;
+	blendDst = dfactor;
+	bBlendFuncKnown = true;
+	if(!bRecordOnly)
+		glBlendFunc(sfactor, dfactor);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStateTracker::PolygonOffset(GLfloat fFactor, GLfloat fUnits)
+	{
+	if(Skip(bPolygonOffsetKnown && fOffsetFactor == fFactor && fOffsetUnits == fUnits))
+		return;
+
+	fOffsetFactor = fFactor;
+	fOffsetUnits = fUnits;
+	bPolygonOffsetKnown = true;
+	if(!bRecordOnly)
+		glPolygonOffset(fFactor, fUnits);
+	}
+
+#endif
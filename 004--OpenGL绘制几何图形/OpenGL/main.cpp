@@ -3,6 +3,7 @@
 #include "GLMatrixStack.h"
 #include "GLShaderManager.h"
 #include "GLGeometryTransform.h"
+#include "GLStateTracker.h"
 #include <GLUT/GLUT.h>
 
 //定义一个，着色管理器
@@ -45,6 +46,9 @@ GLfloat vBlack[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 // 跟踪效果步骤
 int nStep = 0;
 
+// 渲染状态缓存：只有真正改变的状态才调用OpenGL，并统计省掉的调用次数
+GLStateTracker      renderState;
+
 /// 在窗口大小改变时，接收新的宽度&高度。
 void changeSize(int w,int h) {
     glViewport(0, 0, w, h);
@@ -93,44 +97,41 @@ void keyPressFunc(unsigned char key, int x, int y) {
 }
 
 // 画边框和颜色
+// 每次绘制前只声明需要的状态，不再在画完后逐项复原；
+// 与当前状态相同的设置由 renderState 跳过
 void drawWireFramedBatch(GLBatchBase* pBatch) {
     // 开启深度测试
-    glEnable(GL_DEPTH_TEST);
+    renderState.Enable(GL_DEPTH_TEST);
     
-    // 画填充颜色
+    // 画填充颜色（实心填充，不偏移、不混合、不反锯齿）
+    renderState.PolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    renderState.Disable(GL_POLYGON_OFFSET_LINE);
+    renderState.Disable(GL_BLEND);
+    renderState.Disable(GL_LINE_SMOOTH);
     shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vGreen);
     pBatch->Draw();
     
     // 画边框
     // 开启多边形偏移
-    glPolygonOffset(-1.0f, -1.0f);
-    glEnable(GL_POLYGON_OFFSET_LINE);
+    renderState.PolygonOffset(-1.0f, -1.0f);
+    renderState.Enable(GL_POLYGON_OFFSET_LINE);
     
     // 开启反锯齿
-    glEnable(GL_LINE_SMOOTH);
+    renderState.Enable(GL_LINE_SMOOTH);
     
     // 开启混合
-    glEnable(GL_BLEND);
+    renderState.Enable(GL_BLEND);
     // 混合方法
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    renderState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
     //绘制线框几何黑色版 三种模式，实心，边框，点，可以作用在正面，背面，或者两面
     //通过调用glPolygonMode将多边形正面或者背面设为线框模式，实现线框渲染
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    renderState.PolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     //设置线条宽度
-    glLineWidth(2.5f);
+    renderState.LineWidth(2.5f);
     
     shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vBlack);
     pBatch->Draw();
-
-    // 复原原本的设置
-    //通过调用glPolygonMode将多边形正面或者背面设为全部填充模式
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glDisable(GL_POLYGON_OFFSET_LINE);
-    glLineWidth(1.0f);
-    glDisable(GL_BLEND);
-    glDisable(GL_LINE_SMOOTH);
-    glDisable(GL_DEPTH_TEST);
 }
 
 void renderScene(void) {
@@ -0,0 +1,212 @@
+// GLCommandBuffer.h
+// Frame preparation recorded on worker threads, replayed on the GL thread.
+//
+// A GLCommandBuffer is a plain byte stream of commands. It is filled by
+// one thread at a time and needs no locking. GLCommandRecorder owns one
+// buffer per thread. Record() splits a range of objects over the threads,
+// and each thread does its own matrix products, culling and uniform packing
+// into its own buffer. Replay() then runs on the thread that owns the GL
+// context and feeds the results to a GLRenderQueue or GLMeshArena. Only
+// Replay() touches GL or the shared objects.
+//
+// Commands from different buffers are not replayed in the order they were
+// recorded. GLRenderQueue sorts its packets anyway, and the order of arena
+// draws does not matter.
+
+#ifndef __GLT_COMMAND_BUFFER
+#define __GLT_COMMAND_BUFFER
+
+#include "GLTools.h"
+#include "GLRenderQueue.h"
+#include "GLMeshArena.h"
+#include "GLMeshGenerators.h"
+#include <vector>
+#include <thread>
+
+enum GLT_COMMAND { GLT_COMMAND_DRAW, GLT_COMMAND_ARENA_DRAW };
+
+// Draw packet for GLRenderQueue::Submit()
+struct GLTDrawCommand
+	{
+	GLBatchBase		*pBatch;
+	GLuint			program;
+	GLuint			nState;
+	bool			bTranslucent;
+	bool			bLight;
+	M3DMatrix44f	mvMatrix;
+	M3DMatrix44f	pMatrix;
+	M3DVector4f		vColor;
+	M3DVector3f		vLightPos;
+	};
+
+// Entry for GLMeshArena::AddDraw()
+struct GLTArenaDrawCommand
+	{
+	GLMeshArena		*pArena;
+	int				nMesh;
+	M3DVector4f		vData;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLCommandBuffer
+	{
+	public:
+		GLCommandBuffer(void) { nCommands = 0; }
+
+		inline void Reset(void) { vBytes.clear(); nCommands = 0; }
+		inline GLuint GetCommandCount(void) const { return nCommands; }
+		inline size_t GetSize(void) const { return vBytes.size(); }
+
+		// Draw pBatch with mvMatrix = mView * mModel, as GLMatrixStack would
+		// leave it after PushMatrix(mView) and MultMatrix(mModel).
+		// vLightPos may be NULL.
+		void RecordDraw(GLBatchBase *pBatch, GLuint program, const M3DMatrix44f mView, const M3DMatrix44f mModel,
+						const M3DMatrix44f pMatrix, const M3DVector4f vColor, const M3DVector3f vLightPos,
+						GLuint nState, bool bTranslucent = false) {
+			GLTDrawCommand *pCmd = Allocate<GLTDrawCommand>(GLT_COMMAND_DRAW);
+			pCmd->pBatch = pBatch;
+			pCmd->program = program;
+			pCmd->nState = nState;
+			pCmd->bTranslucent = bTranslucent;
+			pCmd->bLight = (vLightPos != NULL);
+			m3dMatrixMultiply44(pCmd->mvMatrix, mView, mModel);
+			m3dCopyMatrix44(pCmd->pMatrix, pMatrix);
+			m3dCopyVector4(pCmd->vColor, vColor);
+			if(vLightPos != NULL)
+				m3dCopyVector3(pCmd->vLightPos, vLightPos);
+			}
+
+		void RecordArenaDraw(GLMeshArena *pArena, int nMesh, GLfloat x, GLfloat y, GLfloat z, GLfloat w = 1.0f) {
+			GLTArenaDrawCommand *pCmd = Allocate<GLTArenaDrawCommand>(GLT_COMMAND_ARENA_DRAW);
+			pCmd->pArena = pArena;
+			pCmd->nMesh = nMesh;
+			m3dLoadVector4(pCmd->vData, x, y, z, w);
+			}
+
+		// GL thread only
+		void Replay(GLRenderQueue &queue) const;
+
+	protected:
+		// Each command is a header followed by its payload, both kept 16 byte
+		// aligned from the start of the stream
+		struct Header
+			{
+			GLuint	nType;
+			GLuint	nSize;			// Payload bytes
+			GLuint	nPad[2];
+			};
+
+		template <class T>
+		T *Allocate(GLT_COMMAND nType) {
+			size_t nPayload = (sizeof(T) + 15) & ~size_t(15);
+			size_t nOffset = vBytes.size();
+			vBytes.resize(nOffset + sizeof(Header) + nPayload);
+
+			Header *pHeader = (Header *)&vBytes[nOffset];
+			pHeader->nType = nType;
+			pHeader->nSize = GLuint(nPayload);
+			nCommands++;
+			return (T *)&vBytes[nOffset + sizeof(Header)];
+			}
+
+		std::vector<unsigned char>	vBytes;
+		GLuint	nCommands;
+		char	pad[64];			// Keep the next buffer's members off this one's cache line
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLCommandBuffer::Replay(GLRenderQueue &queue) const
+	{
+	size_t nOffset = 0;
+	while(nOffset < vBytes.size()) {
+		const Header *pHeader = (const Header *)&vBytes[nOffset];
+		const unsigned char *pPayload = &vBytes[nOffset + sizeof(Header)];
+
+		switch(pHeader->nType) {
+			case GLT_COMMAND_DRAW: {
+				const GLTDrawCommand *pCmd = (const GLTDrawCommand *)pPayload;
+				queue.Submit(pCmd->pBatch, pCmd->program, pCmd->mvMatrix, pCmd->pMatrix, pCmd->vColor,
+							 pCmd->bLight ? pCmd->vLightPos : NULL, pCmd->nState, pCmd->bTranslucent);
+				break;
+				}
+
+			case GLT_COMMAND_ARENA_DRAW: {
+				const GLTArenaDrawCommand *pCmd = (const GLTArenaDrawCommand *)pPayload;
+				pCmd->pArena->AddDraw(pCmd->nMesh, pCmd->vData[0], pCmd->vData[1], pCmd->vData[2], pCmd->vData[3]);
+				break;
+				}
+			}
+
+		nOffset += sizeof(Header) + pHeader->nSize;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLCommandRecorder
+	{
+	public:
+		// nThreads of 0 uses one per core
+		GLCommandRecorder(int nThreads = 0) {
+			if(nThreads <= 0)
+				nThreads = int(std::thread::hardware_concurrency());
+			if(nThreads <= 0)
+				nThreads = 1;
+
+			// One allocation each; the pad in GLCommandBuffer keeps two threads'
+			// members a full cache line apart wherever the allocator puts them
+			for(int i = 0; i < nThreads; i++)
+				buffers.push_back(new GLCommandBuffer);
+			}
+
+		~GLCommandRecorder(void) {
+			for(size_t i = 0; i < buffers.size(); i++)
+				delete buffers[i];
+			}
+
+		// Call fn(buffer, first, last) over [0, nItems), in contiguous ranges of
+		// at least nGrain items, one range per thread. Below two ranges'
+		// worth everything runs on the calling thread.
+		template <class F>
+		void Record(GLuint nItems, GLuint nGrain, F fn) {
+			GLint nThreads = GLint(buffers.size());
+			if(nGrain < 1)
+				nGrain = 1;
+			if(GLint((nItems + nGrain - 1) / nGrain) < nThreads)
+				nThreads = GLint((nItems + nGrain - 1) / nGrain);
+			if(nThreads < 1)
+				nThreads = 1;
+
+			GLuint nPerThread = (nItems + nThreads - 1) / nThreads;
+			gltParallelRows(nThreads, nThreads, [&](GLint iFirst, GLint iLast) {
+				for(GLint t = iFirst; t < iLast; t++) {
+					GLuint nFirst = t * nPerThread;
+					GLuint nLast = (nFirst + nPerThread < nItems) ? nFirst + nPerThread : nItems;
+					if(nFirst < nLast)
+						fn(*buffers[t], nFirst, nLast);
+					}
+				});
+			}
+
+		// GL thread only. Replays every buffer, then empties them.
+		void Replay(GLRenderQueue &queue) {
+			for(size_t i = 0; i < buffers.size(); i++) {
+				buffers[i]->Replay(queue);
+				buffers[i]->Reset();
+				}
+			}
+
+		inline int GetThreadCount(void) const { return int(buffers.size()); }
+		inline GLCommandBuffer &GetBuffer(int nThread) { return *buffers[nThread]; }
+
+	protected:
+		std::vector<GLCommandBuffer *>	buffers;
+
+	private:
+		GLCommandRecorder(const GLCommandRecorder&);
+		GLCommandRecorder &operator=(const GLCommandRecorder&);
+	};
+
+#endif
@@ -0,0 +1,632 @@
+// GLCompactBatch.h
+// Indexed triangle batch with packed vertex attributes.
+//
+// GLTriangleBatch stores 32 bytes a vertex: three floats of position,
+// three of normal and two of texture coordinate. GLCompactBatch packs
+// the same data into 16 bytes:
+//	position	three 16 bit values, either half floats or signed normalized
+//				shorts relative to the mesh's bounding cube (8 bytes, padded)
+//	normal		GL_INT_2_10_10_10_REV, or two signed normalized shorts holding
+//				an octahedral encoding (4 bytes)
+//	texcoord	two half floats (4 bytes)
+//
+// Everything except the octahedral normal is a format vertex fetch
+// decodes on its own, so the stock shaders draw these batches unchanged.
+// The one thing they cannot undo is the bounding cube. Quantized
+// positions come out in [-1, 1], and GetDecodeMatrix() maps them back.
+// Multiply it onto the modelview before setting up the shader. The cube
+// has the same scale on every axis so lighting is not affected.
+// Octahedral normals need GLT_SHADER_OCT_DECODE in a custom shader.
+//
+// When the context lacks a format, End() falls back to the nearest one it
+// has: shorts for half positions, bytes for 10_10_10_2 normals, floats for
+// half texture coordinates. GetFormat() reports what was used.
+//
+// Signed normalized attributes decode two ways. GL 4.2 and later use
+// max(c / (2^(b-1) - 1), -1), which hits 0 exactly. Older contexts, like the
+// 2.1 context these demos create, use (2c + 1) / (2^b - 1), which reaches
+// both -1 and 1 but never 0. End() encodes for the rule the context uses.
+//
+// End() also decodes what it encoded and keeps the largest error of each
+// attribute, for checking a format against a mesh. It works out what the
+// format promises too: half the quantization step of the bounding cube for
+// snorm positions, half a half float ulp at the largest coordinate for half
+// positions and texture coordinates, and the angle half a step can turn a
+// normal by. IsWithinTolerance() compares the two, gltReportCompactBatch()
+// prints them, and gltCheckCompactFormats() runs every format over a few
+// meshes.
+
+#ifndef __GLT_COMPACT_BATCH
+#define __GLT_COMPACT_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLShaderManager.h"
+#include "GLMeshGenerators.h"
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+// Decode for GLT_NORMAL_OCTAHEDRAL16. Normals arrive as a vec2 in [-1, 1].
+#define GLT_SHADER_OCT_DECODE \
+	"vec3 octDecode(vec2 e) {" \
+	" vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));" \
+	" if(v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);" \
+	" return normalize(v);" \
+	"}"
+
+enum GLT_POSITION_FORMAT { GLT_POSITION_FLOAT, GLT_POSITION_HALF, GLT_POSITION_SNORM16 };
+enum GLT_NORMAL_FORMAT { GLT_NORMAL_FLOAT, GLT_NORMAL_INT_2_10_10_10, GLT_NORMAL_SNORM8, GLT_NORMAL_OCTAHEDRAL16 };
+enum GLT_TEXCOORD_FORMAT { GLT_TEXCOORD_FLOAT, GLT_TEXCOORD_HALF };
+
+struct GLTVertexFormat
+	{
+	GLT_POSITION_FORMAT		position;
+	GLT_NORMAL_FORMAT		normal;
+	GLT_TEXCOORD_FORMAT		texCoord;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar conversions. Half floats round to nearest even.
+inline GLushort gltFloatToHalf(float f)
+	{
+	union { float f; GLuint u; } v;
+	v.f = f;
+	GLuint sign = (v.u >> 16) & 0x8000;
+	GLuint exp8 = (v.u >> 23) & 0xff;
+	GLuint mant = v.u & 0x7fffff;
+
+	if(exp8 == 0xff)								// Inf or NaN
+		return GLushort(sign | 0x7c00 | (mant ? 0x200 : 0));
+
+	GLint exp = GLint(exp8) - 127 + 15;
+	if(exp >= 31)
+		return GLushort(sign | 0x7c00);
+
+	if(exp <= 0) {									// Denormal or zero
+		if(exp < -10)
+			return GLushort(sign);
+		mant |= 0x800000;
+		GLuint shift = GLuint(14 - exp);
+		GLuint h = mant >> shift;
+		GLuint rem = mant & ((1u << shift) - 1);
+		GLuint halfway = 1u << (shift - 1);
+		if(rem > halfway || (rem == halfway && (h & 1)))
+			h++;
+		return GLushort(sign | h);
+		}
+
+	// A carry out of the mantissa correctly bumps the exponent
+	GLuint h = (GLuint(exp) << 10) | (mant >> 13);
+	GLuint rem = mant & 0x1fff;
+	if(rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+		h++;
+	return GLushort(sign | h);
+	}
+
+inline float gltHalfToFloat(GLushort h)
+	{
+	GLuint sign = GLuint(h & 0x8000) << 16;
+	GLuint exp = (h >> 10) & 0x1f;
+	GLuint mant = h & 0x3ff;
+
+	union { float f; GLuint u; } v;
+	if(exp == 0) {
+		v.f = float(mant) * (1.0f / 16777216.0f);
+		v.u |= sign;
+		}
+	else if(exp == 31)
+		v.u = sign | 0x7f800000 | (mant << 13);
+	else
+		v.u = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+	return v.f;
+	}
+
+// Signed normalized with nMax = 2^(bits-1) - 1. bLegacy picks the pre 4.2
+// decode, (2n + 1) / (2 nMax + 1), over max(n / nMax, -1).
+inline GLint gltFloatToSnorm(float f, GLint nMax, bool bLegacy)
+	{
+	if(f > 1.0f) f = 1.0f;
+	if(f < -1.0f) f = -1.0f;
+	if(!bLegacy)
+		return GLint(floorf(f * float(nMax) + 0.5f));
+
+	GLint n = GLint(floorf(f * float(2 * nMax + 1) * 0.5f));
+	return std::min(std::max(n, -nMax - 1), nMax);
+	}
+
+inline float gltSnormToFloat(GLint n, GLint nMax, bool bLegacy)
+	{
+	if(bLegacy)
+		return float(2 * n + 1) / float(2 * nMax + 1);
+	float f = float(n) / float(nMax);
+	return (f < -1.0f) ? -1.0f : f;
+	}
+
+// Half of one snorm step, the most a rounded component is off by
+inline float gltSnormHalfStep(GLint nMax, bool bLegacy)
+	{
+	return bLegacy ? 1.0f / float(2 * nMax + 1) : 0.5f / float(nMax);
+	}
+
+// x in the low bits, w (unused) in the top two
+inline GLuint gltPackSnorm2_10_10_10(const M3DVector3f v, bool bLegacy)
+	{
+	return  (GLuint(gltFloatToSnorm(v[0], 511, bLegacy)) & 0x3ff) |
+		   ((GLuint(gltFloatToSnorm(v[1], 511, bLegacy)) & 0x3ff) << 10) |
+		   ((GLuint(gltFloatToSnorm(v[2], 511, bLegacy)) & 0x3ff) << 20);
+	}
+
+inline void gltUnpackSnorm2_10_10_10(GLuint n, M3DVector3f v, bool bLegacy)
+	{
+	for(int i = 0; i < 3; i++) {
+		GLint c = GLint((n >> (i * 10)) & 0x3ff);
+		if(c & 0x200)
+			c -= 0x400;
+		v[i] = gltSnormToFloat(c, 511, bLegacy);
+		}
+	}
+
+// Octahedral encoding. Project onto the octahedron |x|+|y|+|z| = 1, then
+// fold the lower half over the diagonals of the upper half. A zero vector
+// has no direction and is stored as +z.
+inline void gltOctEncode(const M3DVector3f n, GLshort *pOut, bool bLegacy)
+	{
+	float fL1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	if(!(fL1 > 0.0f)) {
+		pOut[0] = pOut[1] = GLshort(gltFloatToSnorm(0.0f, 32767, bLegacy));
+		return;
+		}
+
+	float fInvL1 = 1.0f / fL1;
+	float x = n[0] * fInvL1;
+	float y = n[1] * fInvL1;
+	if(n[2] < 0.0f) {
+		float ox = x;
+		x = (1.0f - fabsf(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - fabsf(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+	pOut[0] = GLshort(gltFloatToSnorm(x, 32767, bLegacy));
+	pOut[1] = GLshort(gltFloatToSnorm(y, 32767, bLegacy));
+	}
+
+inline void gltOctDecode(const GLshort *pIn, M3DVector3f n, bool bLegacy)
+	{
+	float x = gltSnormToFloat(pIn[0], 32767, bLegacy);
+	float y = gltSnormToFloat(pIn[1], 32767, bLegacy);
+	n[0] = x;
+	n[1] = y;
+	n[2] = 1.0f - fabsf(x) - fabsf(y);
+	if(n[2] < 0.0f) {
+		n[0] = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		n[1] = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+	m3dNormalizeVector3(n);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLCompactBatch : public GLBatchBase
+	{
+	public:
+		GLCompactBatch(void) {
+			uiVertexBuffer = 0;
+			uiIndexBuffer = 0;
+			vertexArrayObject = 0;
+			nNumVerts = 0;
+			nNumIndexes = 0;
+			nStride = 0;
+			format.position = GLT_POSITION_SNORM16;
+			format.normal = GLT_NORMAL_INT_2_10_10_10;
+			format.texCoord = GLT_TEXCOORD_HALF;
+			m3dLoadIdentity44(mDecode);
+			bLegacySnorm = true;
+			fPositionError = fNormalError = fTexCoordError = 0.0f;
+			fPositionTolerance = fNormalTolerance = fTexCoordTolerance = 0.0f;
+			}
+
+		virtual ~GLCompactBatch(void) {
+			if(uiVertexBuffer != 0) glDeleteBuffers(1, &uiVertexBuffer);
+			if(uiIndexBuffer != 0) glDeleteBuffers(1, &uiIndexBuffer);
+			if(vertexArrayObject != 0) glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		// Float arrays to fill, for instance with gltWriteSphere()
+		GLTMeshArrays BeginMesh(GLuint nVerts, GLuint nIndexes) {
+			nNumVerts = nVerts;
+			nNumIndexes = nIndexes;
+			vVerts.assign(nVerts * 3, 0.0f);
+			vNorms.assign(nVerts * 3, 0.0f);
+			vTexCoords.assign(nVerts * 2, 0.0f);
+			vIndexes.assign(nIndexes, 0);
+
+			GLTMeshArrays mesh;
+			mesh.pVerts = (M3DVector3f *)&vVerts[0];
+			mesh.pNorms = (M3DVector3f *)&vNorms[0];
+			mesh.pTexCoords = (M3DVector2f *)&vTexCoords[0];
+			mesh.pIndexes = &vIndexes[0];
+			return mesh;
+			}
+
+		// Pack and upload. The client arrays are freed.
+		void End(void) { End(format); }
+		void End(const GLTVertexFormat &requested);
+
+		virtual void Draw(void) {
+			glBindVertexArray(vertexArrayObject);
+			glDrawElements(GL_TRIANGLES, nNumIndexes, GL_UNSIGNED_SHORT, 0);
+			glBindVertexArray(0);
+			}
+
+		// Maps quantized positions back to model space (identity otherwise)
+		inline const M3DMatrix44f &GetDecodeMatrix(void) const { return mDecode; }
+
+		inline const GLTVertexFormat &GetFormat(void) const { return format; }
+		inline bool IsLegacySnorm(void) const { return bLegacySnorm; }
+		inline GLuint GetStride(void) const { return nStride; }
+		inline GLuint GetVertexCount(void) const { return nNumVerts; }
+		inline GLuint GetIndexCount(void) const { return nNumIndexes; }
+
+		// Largest error End() introduced: model units, degrees, texture units
+		inline float GetPositionError(void) const { return fPositionError; }
+		inline float GetNormalError(void) const { return fNormalError; }
+		inline float GetTexCoordError(void) const { return fTexCoordError; }
+
+		// Largest error the format allows for this mesh, same units
+		inline float GetPositionTolerance(void) const { return fPositionTolerance; }
+		inline float GetNormalTolerance(void) const { return fNormalTolerance; }
+		inline float GetTexCoordTolerance(void) const { return fTexCoordTolerance; }
+
+		inline bool IsWithinTolerance(void) const {
+			return fPositionError <= fPositionTolerance && fNormalError <= fNormalTolerance &&
+				   fTexCoordError <= fTexCoordTolerance;
+			}
+
+		// Fit the requested format to what the context supports
+		static GLTVertexFormat Supported(const GLTVertexFormat &requested) {
+			GLTVertexFormat out = requested;
+			bool bHalf = GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex;
+			if(out.position == GLT_POSITION_HALF && !bHalf)
+				out.position = GLT_POSITION_SNORM16;
+			if(out.normal == GLT_NORMAL_INT_2_10_10_10 && !(GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev))
+				out.normal = GLT_NORMAL_SNORM8;
+			if(out.texCoord == GLT_TEXCOORD_HALF && !bHalf)
+				out.texCoord = GLT_TEXCOORD_FLOAT;
+			return out;
+			}
+
+	protected:
+		// Pack one vertex at pDst, and measure what it decodes to
+		void PackVertex(GLuint v, const M3DVector3f vCenter, float fScale, GLubyte *pDst);
+
+		// Rounding error of a half float no larger than fMaxAbs
+		static float HalfTolerance(float fMaxAbs) {
+			int nExponent;
+			frexpf(std::max(fMaxAbs, 6.1035156e-5f), &nExponent);		// Subnormals step like the smallest normal
+			return ldexpf(1.0f, nExponent - 12);
+			}
+
+		void SetTolerances(const M3DVector3f vMin, const M3DVector3f vMax, float fScale);
+
+		GLuint			uiVertexBuffer;
+		GLuint			uiIndexBuffer;
+		GLuint			vertexArrayObject;
+		GLuint			nNumVerts;
+		GLuint			nNumIndexes;
+		GLuint			nStride;
+		GLTVertexFormat	format;
+		M3DMatrix44f	mDecode;
+		bool			bLegacySnorm;		// Context decodes snorm as (2c + 1) / (2^b - 1)
+
+		float			fPositionError;
+		float			fNormalError;
+		float			fTexCoordError;
+		float			fPositionTolerance;
+		float			fNormalTolerance;
+		float			fTexCoordTolerance;
+
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNorms;
+		std::vector<GLfloat>	vTexCoords;
+		std::vector<GLushort>	vIndexes;
+
+	private:
+		GLCompactBatch(const GLCompactBatch&);
+		GLCompactBatch &operator=(const GLCompactBatch&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Position, normal and texture coordinate sizes for each format, in bytes
+inline GLuint gltPositionSize(GLT_POSITION_FORMAT f) { return (f == GLT_POSITION_FLOAT) ? 12 : 8; }
+inline GLuint gltNormalSize(GLT_NORMAL_FORMAT f) { return (f == GLT_NORMAL_FLOAT) ? 12 : 4; }
+inline GLuint gltTexCoordSize(GLT_TEXCOORD_FORMAT f) { return (f == GLT_TEXCOORD_FLOAT) ? 8 : 4; }
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLCompactBatch::PackVertex(GLuint v, const M3DVector3f vCenter, float fScale, GLubyte *pDst)
+	{
+	const GLfloat *pPos = &vVerts[v * 3];
+	const GLfloat *pNorm = &vNorms[v * 3];
+	const GLfloat *pTex = &vTexCoords[v * 2];
+	M3DVector3f vDecoded;
+
+	// Position
+	switch(format.position) {
+		case GLT_POSITION_FLOAT:
+			memcpy(pDst, pPos, 12);
+			m3dCopyVector3(vDecoded, pPos);
+			break;
+
+		case GLT_POSITION_HALF:
+			for(int i = 0; i < 3; i++) {
+				GLushort h = gltFloatToHalf(pPos[i]);
+				((GLushort *)pDst)[i] = h;
+				vDecoded[i] = gltHalfToFloat(h);
+				}
+			((GLushort *)pDst)[3] = 0;
+			break;
+
+		default:
+			for(int i = 0; i < 3; i++) {
+				GLshort s = GLshort(gltFloatToSnorm((pPos[i] - vCenter[i]) / fScale, 32767, bLegacySnorm));
+				((GLshort *)pDst)[i] = s;
+				vDecoded[i] = gltSnormToFloat(s, 32767, bLegacySnorm) * fScale + vCenter[i];
+				}
+			((GLshort *)pDst)[3] = 0;
+			break;
+		}
+	float fError = sqrtf(m3dGetDistanceSquared3(vDecoded, pPos));
+	if(fError > fPositionError)
+		fPositionError = fError;
+	pDst += gltPositionSize(format.position);
+
+	// Normal. A zero one is taken as +z, as gltOctEncode() does.
+	M3DVector3f vNorm;
+	m3dCopyVector3(vNorm, pNorm);
+	if(m3dGetVectorLengthSquared3(vNorm) > 0.0f)
+		m3dNormalizeVector3(vNorm);
+	else
+		m3dLoadVector3(vNorm, 0.0f, 0.0f, 1.0f);
+	switch(format.normal) {
+		case GLT_NORMAL_FLOAT:
+			memcpy(pDst, pNorm, 12);
+			m3dCopyVector3(vDecoded, vNorm);
+			break;
+
+		case GLT_NORMAL_INT_2_10_10_10: {
+			GLuint n = gltPackSnorm2_10_10_10(vNorm, bLegacySnorm);
+			memcpy(pDst, &n, 4);
+			gltUnpackSnorm2_10_10_10(n, vDecoded, bLegacySnorm);
+			m3dNormalizeVector3(vDecoded);
+			break;
+			}
+
+		case GLT_NORMAL_SNORM8:
+			for(int i = 0; i < 3; i++) {
+				GLbyte b = GLbyte(gltFloatToSnorm(vNorm[i], 127, bLegacySnorm));
+				((GLbyte *)pDst)[i] = b;
+				vDecoded[i] = gltSnormToFloat(b, 127, bLegacySnorm);
+				}
+			((GLbyte *)pDst)[3] = 0;
+			m3dNormalizeVector3(vDecoded);
+			break;
+
+		default:
+			gltOctEncode(vNorm, (GLshort *)pDst, bLegacySnorm);
+			gltOctDecode((GLshort *)pDst, vDecoded, bLegacySnorm);
+			break;
+		}
+	// acos() of a float dot product cannot resolve angles this small
+	M3DVector3f vCross;
+	m3dCrossProduct3(vCross, vDecoded, vNorm);
+	fError = float(m3dRadToDeg(atan2(m3dGetVectorLength3(vCross), m3dDotProduct3(vDecoded, vNorm))));
+	if(fError > fNormalError)
+		fNormalError = fError;
+	pDst += gltNormalSize(format.normal);
+
+	// Texture coordinate
+	if(format.texCoord == GLT_TEXCOORD_FLOAT)
+		memcpy(pDst, pTex, 8);
+	else
+		for(int i = 0; i < 2; i++) {
+			GLushort h = gltFloatToHalf(pTex[i]);
+			((GLushort *)pDst)[i] = h;
+			fError = fabsf(gltHalfToFloat(h) - pTex[i]);
+			if(fError > fTexCoordError)
+				fTexCoordError = fError;
+			}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Called after packing, while the float arrays are still there. Each bound
+// gets a little slack for the float arithmetic of the decode itself.
+inline void GLCompactBatch::SetTolerances(const M3DVector3f vMin, const M3DVector3f vMax, float fScale)
+	{
+	const float fRoot3 = 1.7320508f;
+	float fMaxAbs = 0.0f;
+	for(int i = 0; i < 3; i++)
+		fMaxAbs = std::max(fMaxAbs, std::max(fabsf(vMin[i]), fabsf(vMax[i])));
+	float fSlack = fMaxAbs * 4.0f * FLT_EPSILON;
+
+	// A vector of three rounded components is off by up to root 3 halves
+	switch(format.position) {
+		case GLT_POSITION_FLOAT: fPositionTolerance = 0.0f; break;
+		case GLT_POSITION_HALF: fPositionTolerance = fRoot3 * HalfTolerance(fMaxAbs) + fSlack; break;
+		default: fPositionTolerance = fRoot3 * fScale * gltSnormHalfStep(32767, bLegacySnorm) + fSlack; break;
+		}
+
+	// The angle a unit vector turns when its components move that far.
+	// Octahedral coordinates move two components; z follows by up to their
+	// sum, and a point on the octahedron can be as short as 1 / root 3, which
+	// makes three root 2 halves steps in all.
+	float fStep;
+	switch(format.normal) {
+		case GLT_NORMAL_FLOAT: fStep = 0.0f; break;
+		case GLT_NORMAL_INT_2_10_10_10: fStep = fRoot3 * gltSnormHalfStep(511, bLegacySnorm); break;
+		case GLT_NORMAL_SNORM8: fStep = fRoot3 * gltSnormHalfStep(127, bLegacySnorm); break;
+		default: fStep = 3.0f * 1.4142136f * gltSnormHalfStep(32767, bLegacySnorm); break;
+		}
+	fNormalTolerance = float(m3dRadToDeg(asinf(std::min(fStep / (1.0f - fStep), 1.0f)))) + 1e-3f;
+
+	fTexCoordTolerance = 0.0f;
+	if(format.texCoord == GLT_TEXCOORD_HALF) {
+		float fMaxTex = 0.0f;
+		for(size_t i = 0; i < vTexCoords.size(); i++)
+			fMaxTex = std::max(fMaxTex, fabsf(vTexCoords[i]));
+		fTexCoordTolerance = HalfTolerance(fMaxTex);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Print the packed size and the errors against what the format allows.
+// Returns IsWithinTolerance().
+inline bool gltReportCompactBatch(const GLCompactBatch &batch, const char *szName)
+	{
+	bool bOk = batch.IsWithinTolerance();
+	printf("%s: %u vertices, %u bytes each (32 unpacked)%s\n", szName, batch.GetVertexCount(), batch.GetStride(),
+		   bOk ? "" : ", ERROR OVER TOLERANCE");
+	printf("    position %g of %g, normal %g of %g degrees, texcoord %g of %g\n",
+		   batch.GetPositionError(), batch.GetPositionTolerance(), batch.GetNormalError(), batch.GetNormalTolerance(),
+		   batch.GetTexCoordError(), batch.GetTexCoordTolerance());
+	return bOk;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLCompactBatch::End(const GLTVertexFormat &requested)
+	{
+	format = Supported(requested);
+	bLegacySnorm = !GLEW_VERSION_4_2;
+	nStride = gltPositionSize(format.position) + gltNormalSize(format.normal) + gltTexCoordSize(format.texCoord);
+	fPositionError = fNormalError = fTexCoordError = 0.0f;
+
+	// Bounding cube, the same scale on every axis
+	M3DVector3f vMin = { 0.0f, 0.0f, 0.0f }, vMax = { 0.0f, 0.0f, 0.0f };
+	for(GLuint v = 0; v < nNumVerts; v++)
+		for(int i = 0; i < 3; i++) {
+			float f = vVerts[v * 3 + i];
+			if(v == 0 || f < vMin[i]) vMin[i] = f;
+			if(v == 0 || f > vMax[i]) vMax[i] = f;
+			}
+	M3DVector3f vCenter;
+	float fScale = 0.0f;
+	for(int i = 0; i < 3; i++) {
+		vCenter[i] = (vMin[i] + vMax[i]) * 0.5f;
+		if((vMax[i] - vMin[i]) * 0.5f > fScale)
+			fScale = (vMax[i] - vMin[i]) * 0.5f;
+		}
+	if(fScale == 0.0f)
+		fScale = 1.0f;
+
+	m3dLoadIdentity44(mDecode);
+	if(format.position == GLT_POSITION_SNORM16) {
+		mDecode[0] = mDecode[5] = mDecode[10] = fScale;
+		mDecode[12] = vCenter[0];
+		mDecode[13] = vCenter[1];
+		mDecode[14] = vCenter[2];
+		}
+
+	std::vector<GLubyte> vPacked(nNumVerts * nStride);
+	for(GLuint v = 0; v < nNumVerts; v++)
+		PackVertex(v, vCenter, fScale, &vPacked[v * nStride]);
+	SetTolerances(vMin, vMax, fScale);
+
+	if(vertexArrayObject == 0) {
+		glGenVertexArrays(1, &vertexArrayObject);
+		glGenBuffers(1, &uiVertexBuffer);
+		glGenBuffers(1, &uiIndexBuffer);
+		}
+	glBindVertexArray(vertexArrayObject);
+
+	glBindBuffer(GL_ARRAY_BUFFER, uiVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vPacked.size(), vPacked.empty() ? NULL : &vPacked[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * nNumIndexes, vIndexes.empty() ? NULL : &vIndexes[0], GL_STATIC_DRAW);
+
+	GLubyte *pOffset = NULL;
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	if(format.position == GLT_POSITION_FLOAT)
+		glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nStride, pOffset);
+	else if(format.position == GLT_POSITION_HALF)
+		glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_HALF_FLOAT, GL_FALSE, nStride, pOffset);
+	else
+		glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_SHORT, GL_TRUE, nStride, pOffset);
+	pOffset += gltPositionSize(format.position);
+
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+	switch(format.normal) {
+		case GLT_NORMAL_FLOAT:
+			glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nStride, pOffset);
+			break;
+		case GLT_NORMAL_INT_2_10_10_10:
+			glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, nStride, pOffset);
+			break;
+		case GLT_NORMAL_SNORM8:
+			glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_BYTE, GL_TRUE, nStride, pOffset);
+			break;
+		default:
+			glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 2, GL_SHORT, GL_TRUE, nStride, pOffset);
+			break;
+		}
+	pOffset += gltNormalSize(format.normal);
+
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0);
+	if(format.texCoord == GLT_TEXCOORD_FLOAT)
+		glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_FLOAT, GL_FALSE, nStride, pOffset);
+	else
+		glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_HALF_FLOAT, GL_FALSE, nStride, pOffset);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	std::vector<GLfloat>().swap(vVerts);
+	std::vector<GLfloat>().swap(vNorms);
+	std::vector<GLfloat>().swap(vTexCoords);
+	std::vector<GLushort>().swap(vIndexes);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Pack a sphere and a torus in every format and report each against its
+// tolerance. Needs a current context for the buffers, and checks the
+// formats and snorm rule that context gives. Returns false if any error is
+// over.
+inline bool gltCheckCompactFormats(void)
+	{
+	static const GLTVertexFormat formats[] = {
+		{ GLT_POSITION_FLOAT, GLT_NORMAL_FLOAT, GLT_TEXCOORD_FLOAT },
+		{ GLT_POSITION_HALF, GLT_NORMAL_INT_2_10_10_10, GLT_TEXCOORD_HALF },
+		{ GLT_POSITION_SNORM16, GLT_NORMAL_INT_2_10_10_10, GLT_TEXCOORD_HALF },
+		{ GLT_POSITION_SNORM16, GLT_NORMAL_SNORM8, GLT_TEXCOORD_HALF },
+		{ GLT_POSITION_SNORM16, GLT_NORMAL_OCTAHEDRAL16, GLT_TEXCOORD_HALF } };
+	static const char *szPositions[] = { "float", "half", "snorm16" };
+	static const char *szNormals[] = { "float", "2_10_10_10", "snorm8", "octahedral16" };
+	static const char *szTexCoords[] = { "float", "half" };
+
+	bool bOk = true;
+	for(size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		GLuint nVerts, nIndexes;
+		GLCompactBatch sphere, torus;
+		gltSphereMeshSize(100, 200, &nVerts, &nIndexes);
+		gltWriteSphere(sphere.BeginMesh(nVerts, nIndexes), 0.4f, 100, 200);
+		sphere.End(formats[f]);
+		gltTorusMeshSize(120, 60, &nVerts, &nIndexes);
+		gltWriteTorus(torus.BeginMesh(nVerts, nIndexes), 10.0f, 2.0f, 120, 60);
+		torus.End(formats[f]);
+
+		const GLTVertexFormat &used = sphere.GetFormat();
+		printf("%s positions, %s normals, %s texcoords%s\n", szPositions[used.position], szNormals[used.normal],
+			   szTexCoords[used.texCoord], sphere.IsLegacySnorm() ? ", pre 4.2 snorm" : "");
+		bOk = gltReportCompactBatch(sphere, "  sphere") && bOk;
+		bOk = gltReportCompactBatch(torus, "  torus") && bOk;
+		}
+	printf(bOk ? "compact formats: all within tolerance\n" : "compact formats: FAILED\n");
+	return bOk;
+	}
+
+#endif
@@ -0,0 +1,508 @@
+// GLDepthRaster.h
+// Depth only triangle rasterizer with a hierarchical Z buffer.
+//
+// This is the inner loop of a software occlusion system. It writes no color,
+// only the depth of triangles, into a small float depth buffer. The buffer is
+// stored in 8x8 pixel blocks, 64 floats each, so that one block row is one
+// 8 wide AVX register.
+//
+// For each block a triangle covers, the three edge functions are first
+// evaluated at the block's corners:
+//  - If any edge is negative over the whole block, the block is skipped.
+//  - If every edge is positive over the whole block, it is trivially
+//    accepted and needs no per pixel coverage test.
+// Every block also keeps the nearest and farthest depth it holds. A triangle
+// whose nearest depth is at or behind the farthest depth of a block is hidden
+// there and the block is skipped. A triangle entirely in front of the nearest
+// depth of a block also needs no per pixel depth test.
+//
+// The AVX2 path is chosen at run time when the CPU has it, so no special
+// compiler flags are needed. Otherwise the same block logic runs in scalar
+// code. Coverage is inclusive (pixels exactly on an edge belong to both
+// triangles). Together with edges set up in a fixed vertex order, as in
+// GLSoftRasterizer, that leaves no cracks in an occluder.
+//
+// Depth is window depth, 0 near and 1 far, as GL_LESS with glDepthRange(0, 1).
+
+#ifndef __GLT_DEPTH_RASTER
+#define __GLT_DEPTH_RASTER
+
+#include "GLTools.h"
+#include "GLSoftRaster.h"
+#include "StopWatch.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define GLT_DEPTH_RASTER_AVX2
+#define GLT_TARGET_AVX2		__attribute__((target("avx2,fma")))
+#endif
+
+#define GLT_DEPTH_BLOCK		8			// Block width and height in pixels
+
+// Block level results since the last ResetStats()
+struct GLTDepthRasterStats
+	{
+	GLuint	nTriangles;			// Rasterized, after clipping and culling
+	GLuint	nBlocksOutside;		// Rejected by an edge function
+	GLuint	nBlocksHidden;		// Rejected by the hierarchical Z
+	GLuint	nBlocksAccepted;	// Fully covered, no coverage test
+	GLuint	nBlocksPartial;		// Tested per pixel
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLDepthRaster
+	{
+	public:
+		GLDepthRaster(void) {
+			nWidth = nHeight = 0;
+			nBlocksX = nBlocksY = 0;
+			bCullBackFaces = true;
+#ifdef GLT_DEPTH_RASTER_AVX2
+			bAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+			bAVX2 = false;
+#endif
+			ResetStats();
+			}
+
+		// Rounded up to whole blocks
+		void SetSize(int nWidthPixels, int nHeightPixels);
+		inline int GetWidth(void) const { return nWidth; }
+		inline int GetHeight(void) const { return nHeight; }
+		inline int GetBlocksX(void) const { return nBlocksX; }
+		inline int GetBlocksY(void) const { return nBlocksY; }
+
+		void Clear(GLfloat fDepth = 1.0f);
+
+		// Occluders are closed, so their back faces are hidden anyway
+		inline void SetCullBackFaces(bool bCull) { bCullBackFaces = bCull; }
+
+		// Use the AVX2 path if the CPU has it. Returns whether it is in use.
+		inline bool SetAVX2(bool bEnable) {
+#ifdef GLT_DEPTH_RASTER_AVX2
+			bAVX2 = bEnable && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+			(void)bEnable;
+#endif
+			return bAVX2;
+			}
+
+		// Indexed triangles, as GLTriangleBatch stores them (GetVertexArray()
+		// and GetIndexArray() before End()) or as the gltWrite*() generators
+		// write them
+		void DrawTriangles(const M3DVector3f *pVerts, GLuint nVerts, const GLushort *pIndexes, GLuint nIndexes,
+						   const M3DMatrix44f mvp);
+		// Triangle primitives of a GLSoftMesh. Points and lines are ignored.
+		void DrawMesh(const GLSoftMesh &mesh, const M3DMatrix44f mvp);
+
+		// One triangle in window coordinates (pixels, depth 0..1)
+		void RasterTriangle(const GLfloat v0[3], const GLfloat v1[3], const GLfloat v2[3]);
+
+		inline GLfloat GetDepth(int x, int y) const { return vDepth[PixelIndex(x, y)]; }
+		// Farthest and nearest depth in a block
+		inline GLfloat GetBlockMaxZ(int bx, int by) const { return vBlockMax[by * nBlocksX + bx]; }
+		inline GLfloat GetBlockMinZ(int bx, int by) const { return vBlockMin[by * nBlocksX + bx]; }
+
+		inline const GLTDepthRasterStats &GetStats(void) const { return stats; }
+		inline void ResetStats(void) { memset(&stats, 0, sizeof(stats)); }
+
+	protected:
+		// Edge functions and the depth plane, all of the form a x + b y + c
+		struct Setup
+			{
+			GLfloat	A[3], B[3], C[3];
+			GLfloat	zA, zB, zC;
+			GLfloat	fMinZ, fMaxZ;
+			GLint	nMinBX, nMinBY, nMaxBX, nMaxBY;
+			};
+
+		inline size_t PixelIndex(int x, int y) const {
+			return (size_t((y >> 3) * nBlocksX + (x >> 3)) << 6) + ((y & 7) << 3) + (x & 7);
+			}
+
+		// Vertex stage output. Bits of nOutCode are the frustum planes the
+		// vertex is outside of, bit 0 the near plane. Only vertices inside
+		// the near plane are projected.
+		struct Vertex
+			{
+			GLfloat	clip[4];
+			GLfloat	screen[3];
+			GLuint	nOutCode;
+			};
+
+		void TransformVertices(const GLfloat *pVerts, GLuint nVerts, const M3DMatrix44f mvp);
+		void ClipTriangle(const Vertex &a, const Vertex &b, const Vertex &c);
+		void Project(const GLfloat p[4], GLfloat out[3]) const;
+
+		void RasterBlockScalar(const Setup &s, int bx, int by, bool bCovered, bool bInFront);
+#ifdef GLT_DEPTH_RASTER_AVX2
+		GLT_TARGET_AVX2 void RasterBlockAVX2(const Setup &s, int bx, int by, bool bCovered, bool bInFront);
+#endif
+
+		int		nWidth, nHeight;
+		int		nBlocksX, nBlocksY;
+		std::vector<GLfloat>	vDepth;			// Block linear
+		std::vector<GLfloat>	vBlockMax;		// Farthest depth per block
+		std::vector<GLfloat>	vBlockMin;		// Nearest depth per block
+		std::vector<Vertex>		vVertices;		// Of the current draw
+		bool	bCullBackFaces;
+		bool	bAVX2;
+
+		GLTDepthRasterStats	stats;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::SetSize(int nWidthPixels, int nHeightPixels)
+	{
+	nBlocksX = (nWidthPixels + GLT_DEPTH_BLOCK - 1) / GLT_DEPTH_BLOCK;
+	nBlocksY = (nHeightPixels + GLT_DEPTH_BLOCK - 1) / GLT_DEPTH_BLOCK;
+	nWidth = nBlocksX * GLT_DEPTH_BLOCK;
+	nHeight = nBlocksY * GLT_DEPTH_BLOCK;
+
+	vDepth.resize(size_t(nWidth) * nHeight);
+	vBlockMax.resize(nBlocksX * nBlocksY);
+	vBlockMin.resize(nBlocksX * nBlocksY);
+	Clear();
+	}
+
+
+inline void GLDepthRaster::Clear(GLfloat fDepth)
+	{
+	std::fill(vDepth.begin(), vDepth.end(), fDepth);
+	std::fill(vBlockMax.begin(), vBlockMax.end(), fDepth);
+	std::fill(vBlockMin.begin(), vBlockMin.end(), fDepth);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::Project(const GLfloat p[4], GLfloat out[3]) const
+	{
+	GLfloat fInvW = 1.0f / p[3];
+	out[0] = (p[0] * fInvW * 0.5f + 0.5f) * nWidth;
+	out[1] = (p[1] * fInvW * 0.5f + 0.5f) * nHeight;
+	out[2] = p[2] * fInvW * 0.5f + 0.5f;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::DrawTriangles(const M3DVector3f *pVerts, GLuint nVerts, const GLushort *pIndexes, GLuint nIndexes,
+										 const M3DMatrix44f mvp)
+	{
+	if(nWidth == 0)
+		return;
+
+	TransformVertices(&pVerts[0][0], nVerts, mvp);
+	for(GLuint i = 0; i + 2 < nIndexes; i += 3)
+		ClipTriangle(vVertices[pIndexes[i]], vVertices[pIndexes[i + 1]], vVertices[pIndexes[i + 2]]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::DrawMesh(const GLSoftMesh &mesh, const M3DMatrix44f mvp)
+	{
+	GLenum primitive = mesh.GetPrimitive();
+	if(nWidth == 0 || mesh.GetVerts() == NULL ||
+	   (primitive != GL_TRIANGLES && primitive != GL_TRIANGLE_STRIP && primitive != GL_TRIANGLE_FAN))
+		return;
+
+	TransformVertices(mesh.GetVerts(), mesh.GetVertexCount(), mvp);
+
+	GLuint nElements = mesh.GetElementCount();
+	for(GLuint i = 0; i + 2 < nElements; ) {
+		GLuint a, b, c;
+		if(primitive == GL_TRIANGLES) {
+			a = mesh.GetElement(i); b = mesh.GetElement(i + 1); c = mesh.GetElement(i + 2);
+			i += 3;
+			}
+		else if(primitive == GL_TRIANGLE_STRIP) {
+			a = mesh.GetElement(i); b = mesh.GetElement(i + 1); c = mesh.GetElement(i + 2);
+			if(i & 1) { GLuint t = a; a = b; b = t; }
+			i++;
+			}
+		else {
+			a = mesh.GetElement(0); b = mesh.GetElement(i + 1); c = mesh.GetElement(i + 2);
+			i++;
+			}
+		ClipTriangle(vVertices[a], vVertices[b], vVertices[c]);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::TransformVertices(const GLfloat *pVerts, GLuint nVerts, const M3DMatrix44f mvp)
+	{
+	vVertices.resize(nVerts);
+	for(GLuint i = 0; i < nVerts; i++) {
+		const GLfloat *v = pVerts + i * 3;
+		Vertex &out = vVertices[i];
+		GLfloat *p = out.clip;
+		for(int r = 0; r < 4; r++)
+			p[r] = mvp[r] * v[0] + mvp[4 + r] * v[1] + mvp[8 + r] * v[2] + mvp[12 + r];
+
+		out.nOutCode = (p[2] < -p[3]) | ((p[2] > p[3]) << 1) | ((p[0] < -p[3]) << 2) | ((p[0] > p[3]) << 3) |
+					   ((p[1] < -p[3]) << 4) | ((p[1] > p[3]) << 5);
+		if((out.nOutCode & 1) == 0)
+			Project(p, out.screen);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Triangles entirely outside one frustum plane are dropped. The rest are
+// clipped only at the near plane; the block range clamps x and y.
+inline void GLDepthRaster::ClipTriangle(const Vertex &a, const Vertex &b, const Vertex &c)
+	{
+	if(a.nOutCode & b.nOutCode & c.nOutCode)
+		return;
+	if(((a.nOutCode | b.nOutCode | c.nOutCode) & 1) == 0) {
+		RasterTriangle(a.screen, b.screen, c.screen);
+		return;
+		}
+
+	// Near plane crossing, one or two triangles result
+	const GLfloat *v[3] = { a.clip, b.clip, c.clip };
+	GLfloat screen[4][3];
+	int nCount = 0;
+	for(int i = 0; i < 3; i++) {
+		const GLfloat *p = v[i], *q = v[(i + 1) % 3];
+		GLfloat dp = p[3] + p[2], dq = q[3] + q[2];
+		if(dp >= 0.0f)
+			Project(p, screen[nCount++]);
+		if((dp >= 0.0f) != (dq >= 0.0f)) {
+			GLfloat t = dp / (dp - dq), clip[4];
+			for(int k = 0; k < 4; k++)
+				clip[k] = p[k] + (q[k] - p[k]) * t;
+			Project(clip, screen[nCount++]);
+			}
+		}
+
+	for(int i = 1; i + 1 < nCount; i++)
+		RasterTriangle(screen[0], screen[i], screen[i + 1]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::RasterTriangle(const GLfloat v0[3], const GLfloat v1[3], const GLfloat v2[3])
+	{
+	const GLfloat *v[3] = { v0, v1, v2 };
+	GLfloat fArea = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+	if(fArea == 0.0f || (bCullBackFaces && fArea < 0.0f))
+		return;
+	if(fArea < 0.0f) {
+		v[1] = v2;
+		v[2] = v1;
+		fArea = -fArea;
+		}
+
+	Setup s;
+	GLfloat fMinX = v[0][0], fMaxX = v[0][0], fMinY = v[0][1], fMaxY = v[0][1];
+	s.fMinZ = s.fMaxZ = v[0][2];
+	for(int i = 0; i < 3; i++) {
+		const GLfloat *p = v[(i + 1) % 3], *q = v[(i + 2) % 3];
+		if((q[1] < p[1]) || (q[1] == p[1] && q[0] < p[0])) {
+			GLfloat fA = q[1] - p[1], fB = p[0] - q[0];
+			s.A[i] = -fA;
+			s.B[i] = -fB;
+			s.C[i] = fA * q[0] + fB * q[1];
+			}
+		else {
+			s.A[i] = p[1] - q[1];
+			s.B[i] = q[0] - p[0];
+			s.C[i] = -(s.A[i] * p[0] + s.B[i] * p[1]);
+			}
+
+		// std::min() and std::max() compile to single instructions, fminf() and
+		// fmaxf() to library calls unless NaNs are ruled out
+		fMinX = std::min(fMinX, v[i][0]); fMaxX = std::max(fMaxX, v[i][0]);
+		fMinY = std::min(fMinY, v[i][1]); fMaxY = std::max(fMaxY, v[i][1]);
+		s.fMinZ = std::min(s.fMinZ, v[i][2]); s.fMaxZ = std::max(s.fMaxZ, v[i][2]);
+		}
+
+	// Depth plane from the barycentric weights of vertices 1 and 2
+	GLfloat fInvArea = 1.0f / fArea;
+	GLfloat dz1 = (v[1][2] - v[0][2]) * fInvArea, dz2 = (v[2][2] - v[0][2]) * fInvArea;
+	s.zA = dz1 * s.A[1] + dz2 * s.A[2];
+	s.zB = dz1 * s.B[1] + dz2 * s.B[2];
+	s.zC = v[0][2] + dz1 * s.C[1] + dz2 * s.C[2];
+
+	// Pixel centers are at +0.5. Clamped to the buffer first, the rounding
+	// below only sees values from -0.5 up, where truncation is cheap to fix.
+	if(fMaxX < 0.0f || fMaxY < 0.0f || fMinX > GLfloat(nWidth) || fMinY > GLfloat(nHeight))
+		return;
+	fMinX = std::max(fMinX, 0.0f) - 0.5f; fMaxX = std::min(fMaxX, GLfloat(nWidth)) - 0.5f;
+	fMinY = std::max(fMinY, 0.0f) - 0.5f; fMaxY = std::min(fMaxY, GLfloat(nHeight)) - 0.5f;
+	GLint nMinX = GLint(fMinX), nMaxX = GLint(fMaxX), nMinY = GLint(fMinY), nMaxY = GLint(fMaxY);
+	nMinX += (GLfloat(nMinX) < fMinX); nMaxX -= (GLfloat(nMaxX) > fMaxX);
+	nMinY += (GLfloat(nMinY) < fMinY); nMaxY -= (GLfloat(nMaxY) > fMaxY);
+	if(nMaxX > nWidth - 1) nMaxX = nWidth - 1;
+	if(nMaxY > nHeight - 1) nMaxY = nHeight - 1;
+	if(nMinX > nMaxX || nMinY > nMaxY)
+		return;
+	s.nMinBX = nMinX >> 3; s.nMaxBX = nMaxX >> 3;
+	s.nMinBY = nMinY >> 3; s.nMaxBY = nMaxY >> 3;
+	stats.nTriangles++;
+
+	for(int by = s.nMinBY; by <= s.nMaxBY; by++)
+		for(int bx = s.nMinBX; bx <= s.nMaxBX; bx++) {
+			int nBlock = by * nBlocksX + bx;
+			if(s.fMinZ >= vBlockMax[nBlock]) {
+				stats.nBlocksHidden++;
+				continue;
+				}
+
+			// Smallest and largest edge values over the block's pixel centers
+			GLfloat fX = GLfloat(bx * GLT_DEPTH_BLOCK) + 0.5f, fY = GLfloat(by * GLT_DEPTH_BLOCK) + 0.5f;
+			const GLfloat fSpan = GLfloat(GLT_DEPTH_BLOCK - 1);
+			bool bOutside = false, bCovered = true;
+			for(int e = 0; e < 3 && !bOutside; e++) {
+				GLfloat fCorner = s.A[e] * fX + s.B[e] * fY + s.C[e];
+				GLfloat fStepX = s.A[e] * fSpan, fStepY = s.B[e] * fSpan;
+				GLfloat fMax = fCorner + std::max(fStepX, 0.0f) + std::max(fStepY, 0.0f);
+				GLfloat fMin = fCorner + std::min(fStepX, 0.0f) + std::min(fStepY, 0.0f);
+				bOutside = fMax < 0.0f;
+				bCovered = bCovered && fMin >= 0.0f;
+				}
+			if(bOutside) {
+				stats.nBlocksOutside++;
+				continue;
+				}
+
+			bool bInFront = s.fMaxZ < vBlockMin[nBlock];
+#ifdef GLT_DEPTH_RASTER_AVX2
+			if(bAVX2)
+				RasterBlockAVX2(s, bx, by, bCovered, bInFront);
+			else
+#endif
+				RasterBlockScalar(s, bx, by, bCovered, bInFront);
+
+			if(bCovered)
+				stats.nBlocksAccepted++;
+			else
+				stats.nBlocksPartial++;
+			}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLDepthRaster::RasterBlockScalar(const Setup &s, int bx, int by, bool bCovered, bool bInFront)
+	{
+	int nBlock = by * nBlocksX + bx;
+	GLfloat *pBlock = &vDepth[size_t(nBlock) << 6];
+	GLfloat fX0 = GLfloat(bx * GLT_DEPTH_BLOCK) + 0.5f, fY0 = GLfloat(by * GLT_DEPTH_BLOCK) + 0.5f;
+	GLfloat fMax = -FLT_MAX, fMin = FLT_MAX;
+
+	for(int r = 0; r < GLT_DEPTH_BLOCK; r++) {
+		GLfloat fY = fY0 + GLfloat(r);
+		for(int c = 0; c < GLT_DEPTH_BLOCK; c++) {
+			GLfloat fX = fX0 + GLfloat(c);
+			GLfloat &fDepth = pBlock[r * GLT_DEPTH_BLOCK + c];
+
+			bool bInside = bCovered;
+			if(!bInside)
+				bInside = (s.A[0] * fX + s.B[0] * fY + s.C[0] >= 0.0f) &&
+						  (s.A[1] * fX + s.B[1] * fY + s.C[1] >= 0.0f) &&
+						  (s.A[2] * fX + s.B[2] * fY + s.C[2] >= 0.0f);
+			if(bInside) {
+				// Clamped, the plane can overshoot slightly outside the triangle
+				GLfloat z = std::min(std::max(s.zA * fX + s.zB * fY + s.zC, s.fMinZ), s.fMaxZ);
+				if(bInFront || z < fDepth)
+					fDepth = z;
+				}
+			fMax = std::max(fMax, fDepth);
+			fMin = std::min(fMin, fDepth);
+			}
+		}
+
+	vBlockMax[nBlock] = fMax;
+	vBlockMin[nBlock] = fMin;
+	}
+
+
+#ifdef GLT_DEPTH_RASTER_AVX2
+///////////////////////////////////////////////////////////////////////////////
+// One block row per iteration, edge values stepped by B per row
+GLT_TARGET_AVX2 inline void GLDepthRaster::RasterBlockAVX2(const Setup &s, int bx, int by, bool bCovered, bool bInFront)
+	{
+	int nBlock = by * nBlocksX + bx;
+	GLfloat *pBlock = &vDepth[size_t(nBlock) << 6];
+	GLfloat fX0 = GLfloat(bx * GLT_DEPTH_BLOCK) + 0.5f, fY0 = GLfloat(by * GLT_DEPTH_BLOCK) + 0.5f;
+
+	const __m256 vX = _mm256_add_ps(_mm256_set1_ps(fX0), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	const __m256 vZero = _mm256_setzero_ps();
+	const __m256 vMinZ = _mm256_set1_ps(s.fMinZ), vMaxZ = _mm256_set1_ps(s.fMaxZ);
+
+	__m256 vE[3], vStepE[3];
+	for(int e = 0; e < 3; e++) {
+		vE[e] = _mm256_fmadd_ps(_mm256_set1_ps(s.A[e]), vX, _mm256_set1_ps(s.B[e] * fY0 + s.C[e]));
+		vStepE[e] = _mm256_set1_ps(s.B[e]);
+		}
+	__m256 vZ = _mm256_fmadd_ps(_mm256_set1_ps(s.zA), vX, _mm256_set1_ps(s.zB * fY0 + s.zC));
+	const __m256 vStepZ = _mm256_set1_ps(s.zB);
+
+	__m256 vBlockMaxZ = _mm256_set1_ps(-FLT_MAX), vBlockMinZ = _mm256_set1_ps(FLT_MAX);
+
+	for(int r = 0; r < GLT_DEPTH_BLOCK; r++) {
+		__m256 vOld = _mm256_loadu_ps(pBlock + r * GLT_DEPTH_BLOCK);
+		__m256 vNew = _mm256_min_ps(_mm256_max_ps(vZ, vMinZ), vMaxZ);
+
+		__m256 vMask;
+		if(bCovered)
+			vMask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		else
+			vMask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(vE[0], vZero, _CMP_GE_OQ), _mm256_cmp_ps(vE[1], vZero, _CMP_GE_OQ)),
+								  _mm256_cmp_ps(vE[2], vZero, _CMP_GE_OQ));
+		if(!bInFront)
+			vMask = _mm256_and_ps(vMask, _mm256_cmp_ps(vNew, vOld, _CMP_LT_OQ));
+
+		__m256 vResult = _mm256_blendv_ps(vOld, vNew, vMask);
+		_mm256_storeu_ps(pBlock + r * GLT_DEPTH_BLOCK, vResult);
+
+		vBlockMaxZ = _mm256_max_ps(vBlockMaxZ, vResult);
+		vBlockMinZ = _mm256_min_ps(vBlockMinZ, vResult);
+		for(int e = 0; e < 3; e++)
+			vE[e] = _mm256_add_ps(vE[e], vStepE[e]);
+		vZ = _mm256_add_ps(vZ, vStepZ);
+		}
+
+	// Horizontal max and min of the eight lanes
+	__m128 vMax4 = _mm_max_ps(_mm256_castps256_ps128(vBlockMaxZ), _mm256_extractf128_ps(vBlockMaxZ, 1));
+	__m128 vMin4 = _mm_min_ps(_mm256_castps256_ps128(vBlockMinZ), _mm256_extractf128_ps(vBlockMinZ, 1));
+	vMax4 = _mm_max_ps(vMax4, _mm_movehl_ps(vMax4, vMax4));
+	vMin4 = _mm_min_ps(vMin4, _mm_movehl_ps(vMin4, vMin4));
+	vMax4 = _mm_max_ss(vMax4, _mm_shuffle_ps(vMax4, vMax4, 1));
+	vMin4 = _mm_min_ss(vMin4, _mm_shuffle_ps(vMin4, vMin4, 1));
+	vBlockMax[nBlock] = _mm_cvtss_f32(vMax4);
+	vBlockMin[nBlock] = _mm_cvtss_f32(vMin4);
+	}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Micro-benchmark. Clears and draws mesh once per matrix in pMVPs, nFrames
+// times. Returns the time per frame; stats are those of the last frame.
+// Compare SetAVX2(true) with SetAVX2(false), and front to back with back to
+// front order, to see the block rejection and the hierarchical Z at work.
+inline float gltDepthRasterBenchmark(GLDepthRaster &raster, const GLSoftMesh &mesh, const M3DMatrix44f *pMVPs, int nInstances,
+									 int nFrames, GLTDepthRasterStats *pStats = NULL)
+	{
+	CStopWatch timer;
+	for(int f = 0; f < nFrames; f++) {
+		raster.Clear();
+		raster.ResetStats();
+		for(int i = 0; i < nInstances; i++)
+			raster.DrawMesh(mesh, pMVPs[i]);
+		}
+	float fSeconds = timer.GetElapsedSeconds() / float(nFrames > 0 ? nFrames : 1);
+
+	if(pStats != NULL)
+		*pStats = raster.GetStats();
+	return fSeconds;
+	}
+
+#endif
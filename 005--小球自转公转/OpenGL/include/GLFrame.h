@@ -180,7 +180,9 @@ class GLFrame
 
 
        ////////////////////////////////////////////////////////////////////////
-       // Assemble the camera matrix
+       // Assemble the camera matrix. This is the inverse of a rigid transform,
+       // so the rotation is the transpose and the translation is just three
+       // dot products. No matrix multiply needed.
         void GetCameraMatrix(M3DMatrix44f m, bool bRotationOnly = false)
             {
             M3DVector3f x, z;
@@ -194,39 +196,51 @@ class GLFrame
 			// X vector = Y cross Z 
 			m3dCrossProduct3(x, vUp, z);
 
-			// Matrix has no translation information and is
-			// transposed.... (rows instead of columns)
+			// Rotation is transposed.... (rows instead of columns)
 			#define M(row,col)  m[col*4+row]
 			   M(0, 0) = x[0];
 			   M(0, 1) = x[1];
 			   M(0, 2) = x[2];
-			   M(0, 3) = 0.0;
 			   M(1, 0) = vUp[0];
 			   M(1, 1) = vUp[1];
 			   M(1, 2) = vUp[2];
-			   M(1, 3) = 0.0;
 			   M(2, 0) = z[0];
 			   M(2, 1) = z[1];
 			   M(2, 2) = z[2];
-			   M(2, 3) = 0.0;
 			   M(3, 0) = 0.0;
 			   M(3, 1) = 0.0;
 			   M(3, 2) = 0.0;
 			   M(3, 3) = 1.0;
+
+            if(bRotationOnly) {
+			   M(0, 3) = 0.0;
+			   M(1, 3) = 0.0;
+			   M(2, 3) = 0.0;
+               }
+            else {
+               // Rotated, negated origin
+			   M(0, 3) = -m3dDotProduct3(x, vOrigin);
+			   M(1, 3) = -m3dDotProduct3(vUp, vOrigin);
+			   M(2, 3) = -m3dDotProduct3(z, vOrigin);
+               }
 			#undef M
+            }
 
-			
-            if(bRotationOnly)
-                return;
-                
-            // Apply translation too
-            M3DMatrix44f trans, M;
-            m3dTranslationMatrix44(trans, -vOrigin[0], -vOrigin[1], -vOrigin[2]);  
-			
-            m3dMatrixMultiply44(M, m, trans);
-        
-            // Copy result back into m
-            memcpy(m, M, sizeof(float)*16);
+
+        // Camera matrices for many views at once (cube map faces, split
+        // screen...). Optionally premultiplied by a projection matrix.
+        static void GetCameraMatrices(GLFrame *pFrames, int nFrames, M3DMatrix44f *pMatrices,
+                                      const float *pProjection = NULL)
+            {
+            for(int i = 0; i < nFrames; i++) {
+                if(pProjection == NULL)
+                    pFrames[i].GetCameraMatrix(pMatrices[i]);
+                else {
+                    M3DMatrix44f mCamera;
+                    pFrames[i].GetCameraMatrix(mCamera);
+                    m3dMatrixMultiply44(pMatrices[i], pProjection, mCamera);
+                    }
+                }
             }
 
 
@@ -0,0 +1,773 @@
+// GLFrameCapture.h
+// Framebuffer capture that does not stall the GL pipeline.
+//
+// gltGrabScreenTGA() reads the screen with glReadPixels() into client memory
+// and writes the file before it returns. The read waits for every queued GL
+// command, and the write then waits on the disk. GLFrameCapture splits that up:
+//	- Capture() starts a glReadPixels() into one of a ring of pixel buffer
+//	  objects and fences it. The copy happens on the GPU side, and the call
+//	  returns at once.
+//	- A later Capture() or Poll() finds the fence signalled, maps the buffer
+//	  and hands the pixels to the encoder threads. With a ring of N buffers
+//	  this is up to N - 1 frames later. Only a full ring waits for the oldest
+//	  readback.
+//	- The encoder threads convert and write the frames, several at a time.
+//	  At most nMaxQueued frames are held between readback and disk. When
+//	  the encoders fall that far behind, the next frame waits for them, and
+//	  GetStats() reports how often and for how long.
+//
+// The mode depends on what the context offers, as in GLStreamBuffer:
+//	- MODE_FENCED_PBO: pixel buffer objects and sync objects.
+//	- MODE_PBO: pixel buffer objects only. A buffer is mapped when the ring
+//	  comes back around to it, and the map waits if the copy is not done yet.
+//	- MODE_SYNC: neither. Capture() reads into client memory as
+//	  gltGrabScreenTGA() does, but the file is still written in the
+//	  background.
+//
+// Output formats:
+//	- Capture() writes one file per frame. Names ending in .qoi are QOI
+//	  (lossless and usually a third or less of the size of a TGA, see
+//	  qoiformat.org). Anything else is a 24 bit uncompressed TGA, as written by
+//	  gltGrabScreenTGA().
+//	- OpenStream() starts a YUV4MPEG2 (.y4m) stream, 4:2:0 with full range
+//	  BT.601 colour. The header says so with XCOLORRANGE=FULL, which ffmpeg
+//	  reads; a reader that ignores it assumes limited range and shows the
+//	  blacks crushed and the whites clipped. Each
+//	  CaptureStream() adds a frame. Frames are converted in parallel but
+//	  written in the order they were captured.
+//
+// Capture() reads the current read buffer, so call it after the frame is
+// drawn and before glutSwapBuffers(). All calls are GL thread only.
+
+#ifndef __GLT_FRAME_CAPTURE
+#define __GLT_FRAME_CAPTURE
+
+#include "GLTools.h"
+#include "StopWatch.h"
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GLT_CAPTURE_MAX_SLOTS		8
+#define GLT_CAPTURE_MAX_ENCODERS	8
+
+enum GLT_CAPTURE_FORMAT { GLT_CAPTURE_TGA, GLT_CAPTURE_QOI, GLT_CAPTURE_Y4M };
+
+struct GLTCaptureStats
+	{
+	GLuint		nCaptured;			// Frames accepted
+	GLuint		nWritten;			// Frames written
+	GLuint		nFailed;			// Frames that could not be written
+	GLuint		nReadbackWaits;		// Ring full, waited for the oldest readback
+	GLuint		nWriterWaits;		// Encoders behind, waited for them to catch up
+	GLuint		nPeakQueued;		// Most frames held at once
+	float		fWaitSeconds;		// Total time spent in those waits
+	float		fEncodeSeconds;		// Encoder time, summed over the threads
+	double		dBytesWritten;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLFrameCapture
+	{
+	public:
+		enum MODE { MODE_NONE, MODE_FENCED_PBO, MODE_PBO, MODE_SYNC };
+
+		GLFrameCapture(void) {
+			nMode = MODE_NONE;
+			nWidth = nHeight = 0;
+			nSlots = 0;
+			nNext = 0;
+			nOldest = 0;
+			nInFlight = 0;
+			nMaxQueued = 0;
+			nHeld = 0;
+			bQuit = false;
+			pStream = NULL;
+			nStreamNext = 0;
+			nStreamWrite = 0;
+			bStreamWriting = false;
+			memset(&stats, 0, sizeof(stats));
+			for(int i = 0; i < GLT_CAPTURE_MAX_SLOTS; i++) {
+				slots[i].uiBuffer = 0;
+				slots[i].fence = 0;
+				}
+			}
+
+		~GLFrameCapture(void) { Shutdown(); }
+
+		// Capture the lower left nWidth x nHeight pixels, usually the window.
+		// nSlots readbacks can be in flight, and at most nMaxQueued frames
+		// wait for or are in the encoders. nEncoders of 0 uses one thread per
+		// core beyond the first.
+		bool Init(int nWidth, int nHeight, int nSlots = 3, int nMaxQueued = 8, int nEncoders = 0);
+
+		// Closes the stream and writes everything still pending, then frees
+		// the buffers
+		void Shutdown(void);
+
+		// Start reading this frame. It is written to szFileName later.
+		bool Capture(const char *szFileName);
+
+		// Start a .y4m stream, replacing any open one
+		bool OpenStream(const char *szFileName, int nFramesPerSecond = 60);
+
+		// Start reading this frame as the next frame of the stream
+		bool CaptureStream(void);
+
+		// Write the rest of the stream and close it
+		void CloseStream(void);
+
+		// Hand finished readbacks to the encoders without waiting.
+		// Capture() does this too.
+		void Poll(void);
+
+		// Wait until every captured frame is written
+		void Flush(void);
+
+		inline MODE GetMode(void) const { return nMode; }
+		inline int GetWidth(void) const { return nWidth; }
+		inline int GetHeight(void) const { return nHeight; }
+		inline bool IsStreamOpen(void) const { return pStream != NULL; }
+		GLTCaptureStats GetStats(void);
+
+	protected:
+		struct Slot
+			{
+			GLuint				uiBuffer;
+			GLsync				fence;
+			GLT_CAPTURE_FORMAT	nFormat;
+			GLuint				nSequence;		// Position in the stream
+			std::string			sFileName;
+			};
+
+		struct Frame
+			{
+			GLT_CAPTURE_FORMAT			nFormat;
+			GLuint						nSequence;
+			std::string					sFileName;
+			std::vector<unsigned char>	vPixels;		// BGRA, bottom row first
+			std::vector<unsigned char>	vEncoded;		// Kept to reuse its capacity
+			};
+
+		bool Start(GLT_CAPTURE_FORMAT nFormat, GLuint nSequence, const char *szFileName);
+		bool IsReady(Slot &slot);
+		void Retire(Slot &slot);
+		Frame *NewFrame(void);
+		void Queue(Frame *pFrame);
+		void Recycle(Frame *pFrame);
+		void WriteStream(std::unique_lock<std::mutex> &guard);
+		void EncoderMain(void);
+
+		static void EncodeTGA(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut);
+		static void EncodeQOI(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut);
+		static void EncodeY4M(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut);
+
+		MODE			nMode;
+		int				nWidth;
+		int				nHeight;
+		int				nSlots;
+		int				nNext;			// Slot the next Capture() uses
+		int				nOldest;		// Oldest slot in flight
+		int				nInFlight;
+		Slot			slots[GLT_CAPTURE_MAX_SLOTS];
+		GLuint			nStreamNext;	// Sequence number of the next stream frame
+
+		// Shared with the encoder threads
+		std::vector<std::thread>	encoders;
+		std::mutex					lock;
+		std::condition_variable		wakeEncoder;
+		std::condition_variable		wakeCapture;
+		std::deque<Frame *>			pending;
+		std::vector<Frame *>		freeFrames;
+		int							nMaxQueued;
+		int							nHeld;			// Queued, encoding or waiting for the stream
+		bool						bQuit;
+		GLTCaptureStats				stats;
+
+		// Stream frames that are encoded but not yet written, by sequence.
+		// The thread that sets bStreamWriting is the only one writing pStream.
+		FILE						*pStream;
+		std::map<GLuint, Frame *>	streamReady;
+		GLuint						nStreamWrite;	// Next sequence to write
+		bool						bStreamWriting;
+
+	private:
+		GLFrameCapture(const GLFrameCapture&);
+		GLFrameCapture &operator=(const GLFrameCapture&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::Init(int nWidthPixels, int nHeightPixels, int nSlotCount, int nMaxQueuedFrames, int nEncoders)
+	{
+	Shutdown();
+	if(nWidthPixels <= 0 || nHeightPixels <= 0)
+		return false;
+
+	if(nSlotCount < 1)
+		nSlotCount = 1;
+	if(nSlotCount > GLT_CAPTURE_MAX_SLOTS)
+		nSlotCount = GLT_CAPTURE_MAX_SLOTS;
+
+	if(nEncoders <= 0)
+		nEncoders = int(std::thread::hardware_concurrency()) - 1;
+	if(nEncoders < 1)
+		nEncoders = 1;
+	if(nEncoders > GLT_CAPTURE_MAX_ENCODERS)
+		nEncoders = GLT_CAPTURE_MAX_ENCODERS;
+
+	nWidth = nWidthPixels;
+	nHeight = nHeightPixels;
+	nSlots = nSlotCount;
+	nNext = nOldest = nInFlight = 0;
+	nMaxQueued = (nMaxQueuedFrames < 1) ? 1 : nMaxQueuedFrames;
+	nHeld = 0;
+	bQuit = false;
+	memset(&stats, 0, sizeof(stats));
+
+	if(GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) {
+		GLsizeiptr nBytes = GLsizeiptr(nWidth) * nHeight * 4;
+		for(int i = 0; i < nSlots; i++) {
+			glGenBuffers(1, &slots[i].uiBuffer);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].uiBuffer);
+			glBufferData(GL_PIXEL_PACK_BUFFER, nBytes, NULL, GL_STREAM_READ);
+			}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		nMode = (GLEW_VERSION_3_2 || GLEW_ARB_sync) ? MODE_FENCED_PBO : MODE_PBO;
+		}
+	else
+		nMode = MODE_SYNC;
+
+	// Own threads rather than the job system, since they block on the disk
+	for(int i = 0; i < nEncoders; i++)
+		encoders.push_back(std::thread(&GLFrameCapture::EncoderMain, this));
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLFrameCapture::Shutdown(void)
+	{
+	if(nMode == MODE_NONE)
+		return;
+
+	CloseStream();
+	Flush();
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	bQuit = true;
+	}
+	wakeEncoder.notify_all();
+	for(size_t i = 0; i < encoders.size(); i++)
+		encoders[i].join();
+	encoders.clear();
+
+	for(int i = 0; i < GLT_CAPTURE_MAX_SLOTS; i++) {
+		if(slots[i].fence != 0)
+			glDeleteSync(slots[i].fence);
+		if(slots[i].uiBuffer != 0)
+			glDeleteBuffers(1, &slots[i].uiBuffer);
+		slots[i].fence = 0;
+		slots[i].uiBuffer = 0;
+		}
+
+	for(size_t i = 0; i < freeFrames.size(); i++)
+		delete freeFrames[i];
+	freeFrames.clear();
+	nMode = MODE_NONE;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::Capture(const char *szFileName)
+	{
+	if(nMode == MODE_NONE)
+		return false;
+
+	size_t nLength = strlen(szFileName);
+	bool bQOI = nLength >= 4 && (strcmp(szFileName + nLength - 4, ".qoi") == 0 || strcmp(szFileName + nLength - 4, ".QOI") == 0);
+	return Start(bQOI ? GLT_CAPTURE_QOI : GLT_CAPTURE_TGA, 0, szFileName);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::CaptureStream(void)
+	{
+	if(nMode == MODE_NONE || pStream == NULL)
+		return false;
+
+	return Start(GLT_CAPTURE_Y4M, nStreamNext++, "");
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::Start(GLT_CAPTURE_FORMAT nFormat, GLuint nSequence, const char *szFileName)
+	{
+	stats.nCaptured++;
+
+	if(nMode == MODE_SYNC) {
+		Frame *pFrame = NewFrame();
+		pFrame->nFormat = nFormat;
+		pFrame->nSequence = nSequence;
+		pFrame->sFileName = szFileName;
+		glReadPixels(0, 0, nWidth, nHeight, GL_BGRA, GL_UNSIGNED_BYTE, &pFrame->vPixels[0]);
+		Queue(pFrame);
+		return true;
+		}
+
+	Poll();
+
+	// Ring full, the oldest readback (in the slot about to be reused) has to
+	// finish first
+	if(nInFlight == nSlots) {
+		if(nMode == MODE_FENCED_PBO && !IsReady(slots[nOldest]))
+			stats.nReadbackWaits++;
+		Retire(slots[nOldest]);
+		}
+
+	Slot &slot = slots[nNext];
+	slot.nFormat = nFormat;
+	slot.nSequence = nSequence;
+	slot.sFileName = szFileName;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.uiBuffer);
+	glReadPixels(0, 0, nWidth, nHeight, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if(nMode == MODE_FENCED_PBO)
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	nNext = (nNext + 1) % nSlots;
+	nInFlight++;
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::OpenStream(const char *szFileName, int nFramesPerSecond)
+	{
+	if(nMode == MODE_NONE)
+		return false;
+
+	CloseStream();
+	pStream = fopen(szFileName, "wb");
+	if(pStream == NULL)
+		return false;
+
+	// Ip progressive, A1:1 square pixels, C420jpeg 4:2:0 with chroma centred
+	// between the luma samples. The range is a separate X tag.
+	fprintf(pStream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", nWidth, nHeight, nFramesPerSecond);
+	nStreamNext = 0;
+	nStreamWrite = 0;
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLFrameCapture::CloseStream(void)
+	{
+	if(pStream == NULL)
+		return;
+
+	Flush();
+	bool bOk = fclose(pStream) == 0;
+	pStream = NULL;
+	if(!bOk) {
+		std::lock_guard<std::mutex> guard(lock);
+		stats.nFailed++;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Oldest first, so frames reach the encoders in the order they were captured.
+// Without fences there is no way to ask, so nothing is retired early.
+inline void GLFrameCapture::Poll(void)
+	{
+	if(nMode != MODE_FENCED_PBO)
+		return;
+
+	while(nInFlight > 0 && IsReady(slots[nOldest]))
+		Retire(slots[nOldest]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLFrameCapture::Flush(void)
+	{
+	if(nMode == MODE_NONE)
+		return;
+
+	while(nInFlight > 0)
+		Retire(slots[nOldest]);
+
+	std::unique_lock<std::mutex> guard(lock);
+	wakeCapture.wait(guard, [this]() { return nHeld == 0; });
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLTCaptureStats GLFrameCapture::GetStats(void)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLFrameCapture::IsReady(Slot &slot)
+	{
+	if(slot.fence == 0)
+		return true;
+
+	// The first check flushes, or a fence still in the command queue would
+	// never signal
+	GLenum nResult = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	return nResult == GL_ALREADY_SIGNALED || nResult == GL_CONDITION_SATISFIED;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy the oldest readback out of its buffer and pass it on, waiting for the
+// copy if it is still running
+inline void GLFrameCapture::Retire(Slot &slot)
+	{
+	if(slot.fence != 0) {
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while(glClientWaitSync(slot.fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		}
+
+	Frame *pFrame = NewFrame();
+	pFrame->nFormat = slot.nFormat;
+	pFrame->nSequence = slot.nSequence;
+	pFrame->sFileName.swap(slot.sFileName);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.uiBuffer);
+	const void *pPixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if(pPixels != NULL) {
+		memcpy(&pFrame->vPixels[0], pPixels, pFrame->vPixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+	else
+		pFrame->vPixels.clear();		// Counted as failed by the encoder
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	nOldest = (nOldest + 1) % nSlots;
+	nInFlight--;
+	Queue(pFrame);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames are recycled, so a steady capture allocates nothing
+inline GLFrameCapture::Frame *GLFrameCapture::NewFrame(void)
+	{
+	Frame *pFrame = NULL;
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	if(!freeFrames.empty()) {
+		pFrame = freeFrames.back();
+		freeFrames.pop_back();
+		}
+	}
+
+	if(pFrame == NULL)
+		pFrame = new Frame;
+	pFrame->vPixels.resize(size_t(nWidth) * nHeight * 4);
+	return pFrame;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Back pressure: wait while nMaxQueued frames are already held
+inline void GLFrameCapture::Queue(Frame *pFrame)
+	{
+	std::unique_lock<std::mutex> guard(lock);
+	if(nHeld >= nMaxQueued) {
+		stats.nWriterWaits++;
+		CStopWatch timer;
+		wakeCapture.wait(guard, [this]() { return nHeld < nMaxQueued; });
+		stats.fWaitSeconds += timer.GetElapsedSeconds();
+		}
+
+	nHeld++;
+	if(GLuint(nHeld) > stats.nPeakQueued)
+		stats.nPeakQueued = GLuint(nHeld);
+	pending.push_back(pFrame);
+	guard.unlock();
+	wakeEncoder.notify_one();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Called with the lock held
+inline void GLFrameCapture::Recycle(Frame *pFrame)
+	{
+	freeFrames.push_back(pFrame);
+	nHeld--;
+	wakeCapture.notify_all();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Write the stream frames that are next in sequence. Called with the lock
+// held, which is dropped around each write. A thread finding another one
+// writing leaves its frame in streamReady for that thread to pick up.
+inline void GLFrameCapture::WriteStream(std::unique_lock<std::mutex> &guard)
+	{
+	while(!bStreamWriting) {
+		std::map<GLuint, Frame *>::iterator it = streamReady.find(nStreamWrite);
+		if(it == streamReady.end())
+			return;
+
+		Frame *pFrame = it->second;
+		streamReady.erase(it);
+		bStreamWriting = true;
+		guard.unlock();
+
+		bool bOk = !pFrame->vEncoded.empty() && pStream != NULL &&
+				   fwrite(&pFrame->vEncoded[0], pFrame->vEncoded.size(), 1, pStream) == 1;
+
+		guard.lock();
+		bStreamWriting = false;
+		nStreamWrite++;
+		if(bOk) {
+			stats.nWritten++;
+			stats.dBytesWritten += double(pFrame->vEncoded.size());
+			}
+		else
+			stats.nFailed++;
+		Recycle(pFrame);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLFrameCapture::EncoderMain(void)
+	{
+	CStopWatch timer;
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		wakeEncoder.wait(guard, [this]() { return !pending.empty() || bQuit; });
+		if(pending.empty())
+			return;
+
+		Frame *pFrame = pending.front();
+		pending.pop_front();
+		guard.unlock();
+
+		timer.Reset();
+		pFrame->vEncoded.clear();
+		if(!pFrame->vPixels.empty()) {
+			switch(pFrame->nFormat) {
+				case GLT_CAPTURE_QOI:
+					EncodeQOI(*pFrame, nWidth, nHeight, pFrame->vEncoded);
+					break;
+				case GLT_CAPTURE_Y4M:
+					EncodeY4M(*pFrame, nWidth, nHeight, pFrame->vEncoded);
+					break;
+				default:
+					EncodeTGA(*pFrame, nWidth, nHeight, pFrame->vEncoded);
+					break;
+				}
+			}
+
+		// Files are independent and written here. Stream frames go in order.
+		bool bOk = false;
+		if(pFrame->nFormat != GLT_CAPTURE_Y4M && !pFrame->vEncoded.empty()) {
+			FILE *pFile = fopen(pFrame->sFileName.c_str(), "wb");
+			if(pFile != NULL) {
+				bOk = fwrite(&pFrame->vEncoded[0], pFrame->vEncoded.size(), 1, pFile) == 1;
+				if(fclose(pFile) != 0)
+					bOk = false;
+				}
+			}
+		float fSeconds = timer.GetElapsedSeconds();
+
+		guard.lock();
+		stats.fEncodeSeconds += fSeconds;
+		if(pFrame->nFormat == GLT_CAPTURE_Y4M) {
+			streamReady[pFrame->nSequence] = pFrame;
+			WriteStream(guard);
+			}
+		else {
+			if(bOk) {
+				stats.nWritten++;
+				stats.dBytesWritten += double(pFrame->vEncoded.size());
+				}
+			else
+				stats.nFailed++;
+			Recycle(pFrame);
+			}
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// BGRA to 24 bit BGR, rows stay bottom first as TGA expects
+inline void GLFrameCapture::EncodeTGA(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut)
+	{
+	vOut.resize(18 + size_t(nWidth) * nHeight * 3);
+	unsigned char *pOut = &vOut[0];
+	memset(pOut, 0, 18);
+	pOut[2] = 2;									// Uncompressed true color
+	pOut[12] = (unsigned char)(nWidth & 0xFF);
+	pOut[13] = (unsigned char)(nWidth >> 8);
+	pOut[14] = (unsigned char)(nHeight & 0xFF);
+	pOut[15] = (unsigned char)(nHeight >> 8);
+	pOut[16] = 24;
+	pOut += 18;
+
+	const unsigned char *pIn = &frame.vPixels[0];
+	for(size_t i = 0, n = size_t(nWidth) * nHeight; i < n; i++, pIn += 4, pOut += 3) {
+		pOut[0] = pIn[0];
+		pOut[1] = pIn[1];
+		pOut[2] = pIn[2];
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// QOI, three channels. Rows are written top first, so they are taken from
+// the end of the readback.
+inline void GLFrameCapture::EncodeQOI(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut)
+	{
+	// Worst case is four bytes a pixel, plus header and end marker
+	vOut.resize(14 + size_t(nWidth) * nHeight * 4 + 8);
+	unsigned char *pOut = &vOut[0];
+	const unsigned char header[14] = { 'q', 'o', 'i', 'f',
+									   (unsigned char)(nWidth >> 24), (unsigned char)(nWidth >> 16),
+									   (unsigned char)(nWidth >> 8), (unsigned char)nWidth,
+									   (unsigned char)(nHeight >> 24), (unsigned char)(nHeight >> 16),
+									   (unsigned char)(nHeight >> 8), (unsigned char)nHeight,
+									   3, 0 };
+	memcpy(pOut, header, sizeof(header));
+	pOut += sizeof(header);
+
+	// Pixels packed as 0xRRGGBB, alpha is always 255
+	// Empty index entries can never match, since a packed pixel fits in 24 bits
+	GLuint index[64];
+	memset(index, 0xFF, sizeof(index));
+	GLuint nPrev = 0;
+	int nRun = 0;
+
+	for(int y = nHeight - 1; y >= 0; y--) {
+		const unsigned char *pRow = &frame.vPixels[size_t(y) * nWidth * 4];
+		for(int x = 0; x < nWidth; x++) {
+			int r = pRow[x * 4 + 2], g = pRow[x * 4 + 1], b = pRow[x * 4 + 0];
+			GLuint nPixel = GLuint(r << 16 | g << 8 | b);
+
+			if(nPixel == nPrev) {
+				if(++nRun == 62) {
+					*pOut++ = (unsigned char)(0xC0 | (nRun - 1));
+					nRun = 0;
+					}
+				continue;
+				}
+
+			if(nRun > 0) {
+				*pOut++ = (unsigned char)(0xC0 | (nRun - 1));
+				nRun = 0;
+				}
+
+			int nHash = (r * 3 + g * 5 + b * 7 + 255 * 11) & 63;
+			if(index[nHash] == nPixel)
+				*pOut++ = (unsigned char)nHash;
+			else {
+				index[nHash] = nPixel;
+				int dr = (signed char)(r - int(nPrev >> 16 & 0xFF));
+				int dg = (signed char)(g - int(nPrev >> 8 & 0xFF));
+				int db = (signed char)(b - int(nPrev & 0xFF));
+				int dr_dg = dr - dg, db_dg = db - dg;
+
+				if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					*pOut++ = (unsigned char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				else if(dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+					*pOut++ = (unsigned char)(0x80 | (dg + 32));
+					*pOut++ = (unsigned char)((dr_dg + 8) << 4 | (db_dg + 8));
+					}
+				else {
+					*pOut++ = 0xFE;
+					*pOut++ = (unsigned char)r;
+					*pOut++ = (unsigned char)g;
+					*pOut++ = (unsigned char)b;
+					}
+				}
+			nPrev = nPixel;
+			}
+		}
+
+	// The previous pixel starts out black with alpha 255, which the packed
+	// value 0 stands for, so a leading black run is encoded correctly too
+	if(nRun > 0)
+		*pOut++ = (unsigned char)(0xC0 | (nRun - 1));
+
+	const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(pOut, end, sizeof(end));
+	pOut += sizeof(end);
+	vOut.resize(size_t(pOut - &vOut[0]));
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// One FRAME of 4:2:0 full range BT.601, top row first. Chroma is the average
+// of each 2x2 block, with the last row and column repeated for odd sizes.
+// Fixed point with 8 fractional bits.
+inline void GLFrameCapture::EncodeY4M(const Frame &frame, int nWidth, int nHeight, std::vector<unsigned char> &vOut)
+	{
+	static const char szFrame[] = "FRAME\n";
+	int nChromaWidth = (nWidth + 1) / 2, nChromaHeight = (nHeight + 1) / 2;
+	size_t nLuma = size_t(nWidth) * nHeight, nChroma = size_t(nChromaWidth) * nChromaHeight;
+	vOut.resize(6 + nLuma + nChroma * 2);
+	memcpy(&vOut[0], szFrame, 6);
+	unsigned char *pY = &vOut[6];
+	unsigned char *pU = pY + nLuma;
+	unsigned char *pV = pU + nChroma;
+
+	for(int cy = 0; cy < nChromaHeight; cy++) {
+		// Output rows 2cy and 2cy + 1 are readback rows nHeight - 1 - 2cy and the one below
+		int y0 = nHeight - 1 - 2 * cy;
+		int y1 = (y0 > 0) ? y0 - 1 : y0;
+		const unsigned char *pRow0 = &frame.vPixels[size_t(y0) * nWidth * 4];
+		const unsigned char *pRow1 = &frame.vPixels[size_t(y1) * nWidth * 4];
+		unsigned char *pYRow0 = pY + size_t(2 * cy) * nWidth;
+		unsigned char *pYRow1 = (y1 != y0) ? pYRow0 + nWidth : NULL;
+
+		for(int cx = 0; cx < nChromaWidth; cx++) {
+			int x0 = 2 * cx, x1 = (x0 + 1 < nWidth) ? x0 + 1 : x0;
+			const unsigned char *p[4] = { pRow0 + x0 * 4, pRow0 + x1 * 4, pRow1 + x0 * 4, pRow1 + x1 * 4 };
+
+			int r = 0, g = 0, b = 0;
+			for(int i = 0; i < 4; i++) {
+				r += p[i][2];
+				g += p[i][1];
+				b += p[i][0];
+				}
+
+			pYRow0[x0] = (unsigned char)((77 * p[0][2] + 150 * p[0][1] + 29 * p[0][0] + 128) >> 8);
+			if(x1 != x0)
+				pYRow0[x1] = (unsigned char)((77 * p[1][2] + 150 * p[1][1] + 29 * p[1][0] + 128) >> 8);
+			if(pYRow1 != NULL) {
+				pYRow1[x0] = (unsigned char)((77 * p[2][2] + 150 * p[2][1] + 29 * p[2][0] + 128) >> 8);
+				if(x1 != x0)
+					pYRow1[x1] = (unsigned char)((77 * p[3][2] + 150 * p[3][1] + 29 * p[3][0] + 128) >> 8);
+				}
+
+			// Sums of four, so shift by 10 and offset 128 << 10
+			int u = (-43 * r - 85 * g + 128 * b + (128 << 10) + 512) >> 10;
+			int v = (128 * r - 107 * g - 21 * b + (128 << 10) + 512) >> 10;
+			pU[size_t(cy) * nChromaWidth + cx] = (unsigned char)((u < 0) ? 0 : (u > 255) ? 255 : u);
+			pV[size_t(cy) * nChromaWidth + cx] = (unsigned char)((v < 0) ? 0 : (v > 255) ? 255 : v);
+			}
+		}
+	}
+
+#endif
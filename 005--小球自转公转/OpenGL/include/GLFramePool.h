@@ -0,0 +1,353 @@
+// GLFramePool.h
+// Structure of arrays storage for many GLFrames.
+//
+// An array of GLFrame objects stores nine floats per object, and building
+// every object's matrix means one GetMatrix() call each, with a cross product
+// inside. GLFramePool keeps each component (origin x, origin y, ...) in its
+// own array so four frames at a time can be turned into matrices with SSE.
+// The matrices land in one contiguous, 16 byte aligned buffer, which is the
+// layout an instanced draw or a uniform buffer upload wants.
+//
+// The same goes for camera (view) matrices when the pool holds many viewpoints,
+// such as the six faces of a cube map shadow or the players of a split screen.
+//
+// The work can optionally be split over several threads of the shared job
+// pool. Each job writes its own range of the output, so no locking is needed.
+
+#include "math3d.h"
+#include "GLFrame.h"
+#include "GLJobSystem.h"
+
+#ifndef __GL_FRAME_POOL__
+#define __GL_FRAME_POOL__
+
+#include <stdlib.h>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLT_FRAME_POOL_SSE
+#endif
+
+class GLFramePool
+    {
+    public:
+        GLFramePool(void) {
+			nCount = 0;
+			nCapacity = 0;
+			for(int i = 0; i < COMPONENT_COUNT; i++)
+				pComponents[i] = NULL;
+			pMatrices = NULL;
+			}
+
+        ~GLFramePool(void) {
+			for(int i = 0; i < COMPONENT_COUNT; i++)
+				AlignedFree(pComponents[i]);
+			AlignedFree(pMatrices);
+			}
+
+		inline int GetCount(void) const { return nCount; }
+
+		// Make room for at least this many frames without reallocating
+		void Reserve(int nFrames)
+			{
+			// Keep the capacity a multiple of four so the SIMD loop never
+			// needs a scalar tail
+			int nNewCapacity = (nFrames + 3) & ~3;
+			if(nNewCapacity <= nCapacity)
+				return;
+
+			for(int i = 0; i < COMPONENT_COUNT; i++) {
+				float *pNew = (float *)AlignedAlloc(sizeof(float) * nNewCapacity);
+				if(nCapacity > 0)
+					memcpy(pNew, pComponents[i], sizeof(float) * nCapacity);
+				AlignedFree(pComponents[i]);
+				pComponents[i] = pNew;
+				}
+
+			AlignedFree(pMatrices);
+			pMatrices = (M3DMatrix44f *)AlignedAlloc(sizeof(M3DMatrix44f) * nNewCapacity);
+
+			// Padding lanes hold default frames so they always produce valid numbers
+			int nOldCapacity = nCapacity;
+			nCapacity = nNewCapacity;
+			for(int i = nOldCapacity; i < nCapacity; i++)
+				SetDefault(i);
+			}
+
+		// Add a frame, returns its index. The default frame is the same as
+		// a default constructed GLFrame.
+		int Add(void)
+			{
+			if(nCount == nCapacity)
+				Reserve(nCapacity == 0 ? 16 : nCapacity * 2);
+			SetDefault(nCount);
+			return nCount++;
+			}
+
+		int Add(GLFrame& frame)
+			{
+			int i = Add();
+			SetFrame(i, frame);
+			return i;
+			}
+
+		// Drop all frames but keep the memory
+		inline void Clear(void) { nCount = 0; }
+
+
+        /////////////////////////////////////////////////////////////
+		// Per frame access, same meaning as the GLFrame functions
+		inline void SetOrigin(int i, float x, float y, float z)
+			{ pComponents[ORIGIN_X][i] = x; pComponents[ORIGIN_Y][i] = y; pComponents[ORIGIN_Z][i] = z; }
+
+		inline void SetForwardVector(int i, float x, float y, float z)
+			{ pComponents[FORWARD_X][i] = x; pComponents[FORWARD_Y][i] = y; pComponents[FORWARD_Z][i] = z; }
+
+		inline void SetUpVector(int i, float x, float y, float z)
+			{ pComponents[UP_X][i] = x; pComponents[UP_Y][i] = y; pComponents[UP_Z][i] = z; }
+
+		inline void GetOrigin(int i, M3DVector3f vPoint) const
+			{ vPoint[0] = pComponents[ORIGIN_X][i]; vPoint[1] = pComponents[ORIGIN_Y][i]; vPoint[2] = pComponents[ORIGIN_Z][i]; }
+
+		inline void GetForwardVector(int i, M3DVector3f vVector) const
+			{ vVector[0] = pComponents[FORWARD_X][i]; vVector[1] = pComponents[FORWARD_Y][i]; vVector[2] = pComponents[FORWARD_Z][i]; }
+
+		inline void GetUpVector(int i, M3DVector3f vVector) const
+			{ vVector[0] = pComponents[UP_X][i]; vVector[1] = pComponents[UP_Y][i]; vVector[2] = pComponents[UP_Z][i]; }
+
+		inline void TranslateWorld(int i, float x, float y, float z)
+			{ pComponents[ORIGIN_X][i] += x; pComponents[ORIGIN_Y][i] += y; pComponents[ORIGIN_Z][i] += z; }
+
+		inline void MoveForward(int i, float fDelta)
+			{
+			pComponents[ORIGIN_X][i] += pComponents[FORWARD_X][i] * fDelta;
+			pComponents[ORIGIN_Y][i] += pComponents[FORWARD_Y][i] * fDelta;
+			pComponents[ORIGIN_Z][i] += pComponents[FORWARD_Z][i] * fDelta;
+			}
+
+		void SetFrame(int i, GLFrame& frame)
+			{
+			M3DVector3f v;
+			frame.GetOrigin(v);         SetOrigin(i, v[0], v[1], v[2]);
+			frame.GetForwardVector(v);  SetForwardVector(i, v[0], v[1], v[2]);
+			frame.GetUpVector(v);       SetUpVector(i, v[0], v[1], v[2]);
+			}
+
+		void GetFrame(int i, GLFrame& frame) const
+			{
+			M3DVector3f v;
+			GetOrigin(i, v);         frame.SetOrigin(v);
+			GetForwardVector(i, v);  frame.SetForwardVector(v);
+			GetUpVector(i, v);       frame.SetUpVector(v);
+			}
+
+		// Raw component arrays, for bulk updates
+		inline float *GetOriginArray(int iAxis)  { return pComponents[ORIGIN_X + iAxis]; }
+		inline float *GetForwardArray(int iAxis) { return pComponents[FORWARD_X + iAxis]; }
+		inline float *GetUpArray(int iAxis)      { return pComponents[UP_X + iAxis]; }
+
+
+		///////////////////////////////////////////////////////////////////////
+		// Bulk matrix generation. The results are the same as GLFrame::GetMatrix()
+		// for every frame. With a view-projection matrix the results are
+		// viewProjection * frameMatrix, ready for GLT_SHADER_FLAT and friends.
+
+		// Into the pool's own buffer, see GetMatrices()
+		inline void UpdateMatrices(int nThreads = 1)
+			{ Compute(NULL, pMatrices, nThreads); }
+
+		inline void UpdateMatrices(const M3DMatrix44f mViewProjection, int nThreads = 1)
+			{ Compute(mViewProjection, pMatrices, nThreads); }
+
+		// Into a caller supplied buffer of at least GetCount() rounded up to a
+		// multiple of four matrices, aligned to 16 bytes
+		inline void ComputeMatrices(M3DMatrix44f *pOut, int nThreads = 1) const
+			{ Compute(NULL, pOut, nThreads); }
+
+		inline void ComputeMatrices(const M3DMatrix44f mViewProjection, M3DMatrix44f *pOut, int nThreads = 1) const
+			{ Compute(mViewProjection, pOut, nThreads); }
+
+		// Same as GLFrame::GetCameraMatrix() for every frame, optionally
+		// premultiplied by a projection matrix
+		inline void UpdateCameraMatrices(int nThreads = 1)
+			{ Compute(NULL, pMatrices, nThreads, true); }
+
+		inline void UpdateCameraMatrices(const M3DMatrix44f mProjection, int nThreads = 1)
+			{ Compute(mProjection, pMatrices, nThreads, true); }
+
+		inline void ComputeCameraMatrices(M3DMatrix44f *pOut, int nThreads = 1) const
+			{ Compute(NULL, pOut, nThreads, true); }
+
+		inline void ComputeCameraMatrices(const M3DMatrix44f mProjection, M3DMatrix44f *pOut, int nThreads = 1) const
+			{ Compute(mProjection, pOut, nThreads, true); }
+
+		// Results of the last UpdateMatrices() call
+		inline const M3DMatrix44f *GetMatrices(void) const { return pMatrices; }
+		inline const M3DMatrix44f& GetMatrix(int i) const { return pMatrices[i]; }
+
+
+		// 16 byte aligned allocation, for the component arrays and for
+		// caller owned output buffers
+		static void *AlignedAlloc(size_t nBytes)
+			{
+			#ifdef WIN32
+			return _aligned_malloc(nBytes, 16);
+			#else
+			void *pMem = NULL;
+			if(posix_memalign(&pMem, 16, nBytes) != 0)
+				return NULL;
+			return pMem;
+			#endif
+			}
+
+		static void AlignedFree(void *pMem)
+			{
+			#ifdef WIN32
+			_aligned_free(pMem);
+			#else
+			free(pMem);
+			#endif
+			}
+
+    protected:
+		enum { ORIGIN_X = 0, ORIGIN_Y, ORIGIN_Z, FORWARD_X, FORWARD_Y, FORWARD_Z,
+				UP_X, UP_Y, UP_Z, COMPONENT_COUNT };
+
+		float			*pComponents[COMPONENT_COUNT];
+		M3DMatrix44f	*pMatrices;
+		int				nCount;
+		int				nCapacity;
+
+		// Same as the GLFrame constructor
+		void SetDefault(int i)
+			{
+			SetOrigin(i, 0.0f, 0.0f, 0.0f);
+			SetForwardVector(i, 0.0f, 0.0f, -1.0f);
+			SetUpVector(i, 0.0f, 1.0f, 0.0f);
+			}
+
+		// Split the work in groups of four frames over the threads
+		void Compute(const float *pViewProjection, M3DMatrix44f *pOut, int nThreads, bool bCamera = false) const
+			{
+			int nGroups = (nCount + 3) / 4;
+			if(nThreads > nGroups)
+				nThreads = nGroups;
+
+			if(nThreads <= 1) {
+				ComputeRange(pViewProjection, pOut, 0, nGroups * 4, bCamera);
+				return;
+				}
+
+			// This thread takes the first range and helps with the rest
+			gltGetJobSystem().ParallelFor(nGroups, (nGroups + nThreads - 1) / nThreads, [&](int iFirst, int iLast) {
+				ComputeRange(pViewProjection, pOut, iFirst * 4, iLast * 4, bCamera);
+				});
+			}
+
+		// First and last are multiples of four. A camera matrix is the inverse
+		// of the frame matrix with X and Z flipped: the transposed axes and
+		// the origin dotted with each of them.
+		void ComputeRange(const float *vp, M3DMatrix44f *pOut, int nFirst, int nLast, bool bCamera) const
+			{
+			const float *ox = pComponents[ORIGIN_X],  *oy = pComponents[ORIGIN_Y],  *oz = pComponents[ORIGIN_Z];
+			const float *fx = pComponents[FORWARD_X], *fy = pComponents[FORWARD_Y], *fz = pComponents[FORWARD_Z];
+			const float *ux = pComponents[UP_X],      *uy = pComponents[UP_Y],      *uz = pComponents[UP_Z];
+
+#ifdef GLT_FRAME_POOL_SSE
+			for(int i = nFirst; i < nLast; i += 4) {
+				// Columns of the frame matrix, four frames per register
+				__m128 w[4][3];
+				w[2][0] = _mm_load_ps(fx + i); w[2][1] = _mm_load_ps(fy + i); w[2][2] = _mm_load_ps(fz + i);
+				w[1][0] = _mm_load_ps(ux + i); w[1][1] = _mm_load_ps(uy + i); w[1][2] = _mm_load_ps(uz + i);
+				w[3][0] = _mm_load_ps(ox + i); w[3][1] = _mm_load_ps(oy + i); w[3][2] = _mm_load_ps(oz + i);
+
+				// X = Up cross Forward
+				w[0][0] = _mm_sub_ps(_mm_mul_ps(w[1][1], w[2][2]), _mm_mul_ps(w[1][2], w[2][1]));
+				w[0][1] = _mm_sub_ps(_mm_mul_ps(w[1][2], w[2][0]), _mm_mul_ps(w[1][0], w[2][2]));
+				w[0][2] = _mm_sub_ps(_mm_mul_ps(w[1][0], w[2][1]), _mm_mul_ps(w[1][1], w[2][0]));
+
+				if(bCamera) {
+					__m128 zero = _mm_setzero_ps();
+					__m128 c[4][3];
+					for(int k = 0; k < 3; k++) {
+						c[k][0] = _mm_sub_ps(zero, w[0][k]);
+						c[k][1] = w[1][k];
+						c[k][2] = _mm_sub_ps(zero, w[2][k]);
+						}
+					for(int k = 0; k < 3; k++) {
+						__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[k][0], w[3][0]), _mm_mul_ps(w[k][1], w[3][1])),
+											  _mm_mul_ps(w[k][2], w[3][2]));
+						c[3][k] = (k == 1) ? _mm_sub_ps(zero, d) : d;
+						}
+					memcpy(w, c, sizeof(w));
+					}
+
+				for(int c = 0; c < 4; c++) {
+					__m128 r0, r1, r2, r3;
+					if(vp == NULL) {
+						r0 = w[c][0]; r1 = w[c][1]; r2 = w[c][2];
+						r3 = (c == 3) ? _mm_set1_ps(1.0f) : _mm_setzero_ps();
+						}
+					else {
+						// Row r of viewProjection * column c
+						__m128 *pRows[4] = { &r0, &r1, &r2, &r3 };
+						for(int r = 0; r < 4; r++) {
+							__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(vp[r]), w[c][0]),
+															 _mm_mul_ps(_mm_set1_ps(vp[4 + r]), w[c][1])),
+															 _mm_mul_ps(_mm_set1_ps(vp[8 + r]), w[c][2]));
+							if(c == 3)
+								v = _mm_add_ps(v, _mm_set1_ps(vp[12 + r]));
+							*pRows[r] = v;
+							}
+						}
+
+					// Rows across four frames -> one column of each matrix
+					_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+					_mm_store_ps(&pOut[i][c * 4], r0);
+					_mm_store_ps(&pOut[i + 1][c * 4], r1);
+					_mm_store_ps(&pOut[i + 2][c * 4], r2);
+					_mm_store_ps(&pOut[i + 3][c * 4], r3);
+					}
+				}
+#else
+			for(int i = nFirst; i < nLast; i++) {
+				M3DMatrix44f m;
+				m[0] = uy[i] * fz[i] - uz[i] * fy[i];
+				m[1] = uz[i] * fx[i] - ux[i] * fz[i];
+				m[2] = ux[i] * fy[i] - uy[i] * fx[i];
+				m[3] = 0.0f;
+				m[4] = ux[i]; m[5] = uy[i]; m[6] = uz[i]; m[7] = 0.0f;
+				m[8] = fx[i]; m[9] = fy[i]; m[10] = fz[i]; m[11] = 0.0f;
+				m[12] = ox[i]; m[13] = oy[i]; m[14] = oz[i]; m[15] = 1.0f;
+
+				if(bCamera) {
+					M3DMatrix44f c;
+					for(int k = 0; k < 3; k++) {
+						c[k * 4] = -m[k];
+						c[k * 4 + 1] = m[4 + k];
+						c[k * 4 + 2] = -m[8 + k];
+						c[k * 4 + 3] = 0.0f;
+						}
+					c[12] = m3dDotProduct3(&m[0], &m[12]);
+					c[13] = -m3dDotProduct3(&m[4], &m[12]);
+					c[14] = m3dDotProduct3(&m[8], &m[12]);
+					c[15] = 1.0f;
+					m3dCopyMatrix44(m, c);
+					}
+
+				if(vp == NULL)
+					m3dCopyMatrix44(pOut[i], m);
+				else
+					m3dMatrixMultiply44(pOut[i], vp, m);
+				}
+#endif
+			}
+
+	private:
+		GLFramePool(const GLFramePool&);
+		GLFramePool &operator=(const GLFramePool&);
+    };
+
+
+#endif
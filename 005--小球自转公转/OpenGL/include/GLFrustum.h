@@ -31,6 +31,7 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 */
 #include "math3d.h"
 #include "GLFrame.h"
+#include "GLQuatFrame.h"
 
 #ifndef __GL_FRAME_CLASS
 #define __GL_FRAME_CLASS
@@ -87,6 +88,8 @@ class GLFrustum
 
             // Far Lower Right
             farLR[0] = xMax; farLR[1] = yMin; farLR[2] = zMax; farLR[3] = 1.0f;
+
+            UpdateBasePlanes();
 			}
 
 
@@ -145,86 +148,35 @@ class GLFrustum
 
             // Far Lower Right
             farLR[0] = xFmax; farLR[1] = yFmin; farLR[2] = -fFar; farLR[3] = 1.0f;
+
+            UpdateBasePlanes();
             }
 
 
-        // Builds a transformation matrix and transforms the corners of the Frustum,
-        // then derives the plane equations
+        // Moves the frustum to the camera's position and orientation. The
+        // corners are placed with the camera axes directly, and the plane
+        // equations are the untransformed ones rotated and shifted, so there
+        // is no matrix to build and no plane to re-derive from points.
         void Transform(GLFrame& Camera)
             {
-            // Workspace
-   			M3DMatrix44f rotMat;
-            M3DVector3f vForward, vUp, vCross;
-            M3DVector3f   vOrigin;
-
-            ///////////////////////////////////////////////////////////////////
-            // Create the transformation matrix. This was the trickiest part
-            // for me. The default view from OpenGL is down the negative Z
-            // axis. However, building a transformation axis from these 
-            // directional vectors points the frustum the wrong direction. So
-            // You must reverse them here, or build the initial frustum
-            // backwards - which to do is purely a matter of taste. I chose to
-            // compensate here to allow better operability with some of my other
-            // legacy code and projects. RSW
+            M3DVector3f vForward, vUp, vOrigin;
             Camera.GetForwardVector(vForward);
-            vForward[0] = -vForward[0];
-            vForward[1] = -vForward[1];
-            vForward[2] = -vForward[2];
-
             Camera.GetUpVector(vUp);
             Camera.GetOrigin(vOrigin);
-   
-	   		// Calculate the right side (x) vector
-            m3dCrossProduct3(vCross, vUp, vForward);
-
-            // The Matrix
-   			// X Column
-	   		memcpy(rotMat, vCross, sizeof(float)*3);
-            rotMat[3] = 0.0f;
-           
-            // Y Column
-		   	memcpy(&rotMat[4], vUp, sizeof(float)*3);
-            rotMat[7] = 0.0f;       
-                                    
-            // Z Column
-		   	memcpy(&rotMat[8], vForward, sizeof(float)*3);
-            rotMat[11] = 0.0f;
-
-            // Translation
-			rotMat[12] = vOrigin[0];
-            rotMat[13] = vOrigin[1];
-            rotMat[14] = vOrigin[2];
-            rotMat[15] = 1.0f;
-
-            ////////////////////////////////////////////////////
-            // Transform the frustum corners
-            m3dTransformVector4(nearULT, nearUL, rotMat);
-            m3dTransformVector4(nearLLT, nearLL, rotMat);
-            m3dTransformVector4(nearURT, nearUR, rotMat);
-            m3dTransformVector4(nearLRT, nearLR, rotMat);
-            m3dTransformVector4(farULT, farUL, rotMat);
-            m3dTransformVector4(farLLT, farLL, rotMat);
-            m3dTransformVector4(farURT, farUR, rotMat);
-            m3dTransformVector4(farLRT, farLR, rotMat);
-
-            ////////////////////////////////////////////////////
-            // Derive Plane Equations from points... Points given in
-            // counter clockwise order to make normals point inside 
-            // the Frustum
-            // Near and Far Planes
-            m3dGetPlaneEquation(nearPlane, nearULT, nearLLT, nearLRT);
-            m3dGetPlaneEquation(farPlane, farULT, farURT, farLRT);
-            
-            // Top and Bottom Planes
-            m3dGetPlaneEquation(topPlane, nearULT, nearURT, farURT);
-            m3dGetPlaneEquation(bottomPlane, nearLLT, farLLT, farLRT);
+            TransformAxes(vForward, vUp, vOrigin);
+            }
 
-            // Left and right planes
-            m3dGetPlaneEquation(leftPlane, nearLLT, nearULT, farULT);
-            m3dGetPlaneEquation(rightPlane, nearLRT, farLRT, farURT);
+        // Same as above for the quaternion frame
+        void Transform(const GLQuatFrame& Camera)
+            {
+            M3DVector3f vForward, vUp, vOrigin;
+            Camera.GetForwardVector(vForward);
+            Camera.GetUpVector(vUp);
+            Camera.GetOrigin(vOrigin);
+            TransformAxes(vForward, vUp, vOrigin);
             }
 
-        
+
 
         // Allow expanded version of sphere test
         bool TestSphere(float x, float y, float z, float fRadius)
@@ -292,6 +244,69 @@ class GLFrustum
         // Base and Transformed plane equations
         M3DVector4f nearPlane, farPlane, leftPlane, rightPlane;
         M3DVector4f topPlane, bottomPlane;
+
+        // Plane equations of the untransformed frustum, same order as
+        // the transformed ones above
+        enum { PLANE_NEAR = 0, PLANE_FAR, PLANE_TOP, PLANE_BOTTOM, PLANE_LEFT, PLANE_RIGHT, PLANE_COUNT };
+        M3DVector4f basePlanes[PLANE_COUNT];
+
+        // Derive Plane Equations from points... Points given in
+        // counter clockwise order to make normals point inside
+        // the Frustum. Only needed when the projection changes.
+        void UpdateBasePlanes(void)
+            {
+            // Near and Far Planes
+            m3dGetPlaneEquation(basePlanes[PLANE_NEAR], nearUL, nearLL, nearLR);
+            m3dGetPlaneEquation(basePlanes[PLANE_FAR], farUL, farUR, farLR);
+
+            // Top and Bottom Planes
+            m3dGetPlaneEquation(basePlanes[PLANE_TOP], nearUL, nearUR, farUR);
+            m3dGetPlaneEquation(basePlanes[PLANE_BOTTOM], nearLL, farLL, farLR);
+
+            // Left and right planes
+            m3dGetPlaneEquation(basePlanes[PLANE_LEFT], nearLL, nearUL, farUL);
+            m3dGetPlaneEquation(basePlanes[PLANE_RIGHT], nearLR, farLR, farUR);
+            }
+
+        ///////////////////////////////////////////////////////////////////
+        // The default view from OpenGL is down the negative Z
+        // axis. However, building a transformation axis from these
+        // directional vectors points the frustum the wrong direction. So
+        // You must reverse them here, or build the initial frustum
+        // backwards - which to do is purely a matter of taste. I chose to
+        // compensate here to allow better operability with some of my other
+        // legacy code and projects. RSW
+        // The columns of the transform are X = Up cross Z, Up, Z and the origin.
+        void TransformAxes(const M3DVector3f vForward, const M3DVector3f vUp, const M3DVector3f vOrigin)
+            {
+            M3DVector3f vZ, vX;
+            vZ[0] = -vForward[0];
+            vZ[1] = -vForward[1];
+            vZ[2] = -vForward[2];
+            m3dCrossProduct3(vX, vUp, vZ);
+
+            // Corners, point = X * x + Up * y + Z * z + origin
+            const float *pSrc[8] = { nearUL, nearLL, nearUR, nearLR, farUL, farLL, farUR, farLR };
+            float *pDst[8] = { nearULT, nearLLT, nearURT, nearLRT, farULT, farLLT, farURT, farLRT };
+            for(int i = 0; i < 8; i++) {
+                const float *p = pSrc[i];
+                pDst[i][0] = vX[0] * p[0] + vUp[0] * p[1] + vZ[0] * p[2] + vOrigin[0];
+                pDst[i][1] = vX[1] * p[0] + vUp[1] * p[1] + vZ[1] * p[2] + vOrigin[1];
+                pDst[i][2] = vX[2] * p[0] + vUp[2] * p[1] + vZ[2] * p[2] + vOrigin[2];
+                pDst[i][3] = 1.0f;
+                }
+
+            // Planes, rotate the normal and move the distance along with the origin
+            float *pPlanes[PLANE_COUNT] = { nearPlane, farPlane, topPlane, bottomPlane, leftPlane, rightPlane };
+            for(int i = 0; i < PLANE_COUNT; i++) {
+                const float *n = basePlanes[i];
+                float *pPlane = pPlanes[i];
+                pPlane[0] = vX[0] * n[0] + vUp[0] * n[1] + vZ[0] * n[2];
+                pPlane[1] = vX[1] * n[0] + vUp[1] * n[1] + vZ[1] * n[2];
+                pPlane[2] = vX[2] * n[0] + vUp[2] * n[1] + vZ[2] * n[2];
+                pPlane[3] = n[3] - m3dDotProduct3(pPlane, vOrigin);
+                }
+            }
     };
 
 
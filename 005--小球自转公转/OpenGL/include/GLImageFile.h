@@ -0,0 +1,648 @@
+// GLImageFile.h
+// Memory mapped .tga and .bmp loading.
+//
+// gltReadTGABits() and gltReadBMPBits() read the whole file into a newly
+// allocated buffer, then fix it up in place. GLImageFile maps the file
+// instead. If the pixels in the file are already what glTexImage2D() wants,
+// GetPixels() points straight into the mapping and nothing is copied or
+// allocated. The driver's upload copy (or a memcpy into a PBO) is the only
+// pass over the data, and it pulls the pages in as it goes. That covers:
+//	- uncompressed 8, 24 and 32 bit TGAs stored bottom row first (the
+//	  default), uploaded as GL_LUMINANCE, GL_BGR or GL_BGRA
+//	- uncompressed 24 and 32 bit BMPs stored bottom row first. Rows keep
+//	  the file's 4 byte padding, which GetAlignment() reports for
+//	  GL_UNPACK_ALIGNMENT.
+//
+// Everything else is converted into a buffer from a shared pool, so loading
+// many textures in a row reuses the same few allocations:
+//	- run length encoded TGAs (types 10 and 11)
+//	- images stored top row first (TGA descriptor bit 5, BMP negative height)
+//	- 8 bit palettized BMPs, expanded to BGR
+//	- RGB order, when asked for with bRGB. OpenGL ES has no GL_BGR. The swap
+//	  uses SSSE3 (24 bit) and SSE2 (32 bit) where available.
+//
+// Formats and components follow gltReadTGABits(): GetComponents() is the
+// internal format, GetFormat() the pixel format. The pixels stay valid until
+// Close() or the next Open. GLImageFile has no GL state of its own, so it can
+// be opened and read on any thread, with only TexImage2D() on the GL thread.
+
+#ifndef __GLT_IMAGE_FILE
+#define __GLT_IMAGE_FILE
+
+#include "GLTools.h"
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLT_IMAGE_FILE_SSE
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <tmmintrin.h>
+#define GLT_IMAGE_FILE_SSSE3
+#define GLT_TARGET_SSSE3	__attribute__((target("ssse3")))
+#endif
+
+#define GLT_IMAGE_POOL_BUFFERS		8
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Read only view of a whole file
+class GLMappedFile
+	{
+	public:
+		GLMappedFile(void) {
+			pData = NULL;
+			nSize = 0;
+#ifdef WIN32
+			hFile = INVALID_HANDLE_VALUE;
+			hMapping = NULL;
+#endif
+			}
+
+		~GLMappedFile(void) { Close(); }
+
+		bool Open(const char *szFileName);
+		void Close(void);
+
+		inline const unsigned char *GetData(void) const { return pData; }
+		inline size_t GetSize(void) const { return nSize; }
+
+	protected:
+		const unsigned char		*pData;
+		size_t					nSize;
+#ifdef WIN32
+		HANDLE					hFile;
+		HANDLE					hMapping;
+#endif
+
+	private:
+		GLMappedFile(const GLMappedFile&);
+		GLMappedFile &operator=(const GLMappedFile&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLMappedFile::Open(const char *szFileName)
+	{
+	Close();
+
+#ifdef WIN32
+	hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(hFile, &size) || size.QuadPart == 0) {
+		Close();
+		return false;
+		}
+
+	hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(hMapping != NULL)
+		pData = (const unsigned char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if(pData == NULL) {
+		Close();
+		return false;
+		}
+	nSize = size_t(size.QuadPart);
+#else
+	int nFile = open(szFileName, O_RDONLY);
+	if(nFile < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(nFile, &info) != 0 || info.st_size == 0) {
+		close(nFile);
+		return false;
+		}
+
+	// The mapping holds its own reference to the file
+	void *pMapped = mmap(NULL, size_t(info.st_size), PROT_READ, MAP_PRIVATE, nFile, 0);
+	close(nFile);
+	if(pMapped == MAP_FAILED)
+		return false;
+
+	posix_madvise(pMapped, size_t(info.st_size), POSIX_MADV_SEQUENTIAL);
+	pData = (const unsigned char *)pMapped;
+	nSize = size_t(info.st_size);
+#endif
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLMappedFile::Close(void)
+	{
+#ifdef WIN32
+	if(pData != NULL)
+		UnmapViewOfFile(pData);
+	if(hMapping != NULL)
+		CloseHandle(hMapping);
+	if(hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+	hMapping = NULL;
+	hFile = INVALID_HANDLE_VALUE;
+#else
+	if(pData != NULL)
+		munmap((void *)pData, nSize);
+#endif
+	pData = NULL;
+	nSize = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Conversion buffers shared by every GLImageFile, on any thread
+class GLImageBufferPool
+	{
+	public:
+		~GLImageBufferPool(void) {
+			for(size_t i = 0; i < buffers.size(); i++)
+				delete buffers[i];
+			}
+
+		// At least nBytes. The smallest free buffer that is big enough is
+		// reused, else the largest one grows.
+		std::vector<unsigned char> *Acquire(size_t nBytes) {
+			std::vector<unsigned char> *pBuffer = NULL;
+			{
+			std::lock_guard<std::mutex> guard(lock);
+			size_t iBest = buffers.size();
+			for(size_t i = 0; i < buffers.size(); i++) {
+				if(iBest == buffers.size()) {
+					iBest = i;
+					continue;
+					}
+				size_t nHave = buffers[i]->capacity(), nBest = buffers[iBest]->capacity();
+				bool bFits = nHave >= nBytes, bBestFits = nBest >= nBytes;
+				if(bFits != bBestFits ? bFits : (bFits ? nHave < nBest : nHave > nBest))
+					iBest = i;
+				}
+			if(iBest < buffers.size()) {
+				pBuffer = buffers[iBest];
+				buffers.erase(buffers.begin() + iBest);
+				}
+			}
+
+			if(pBuffer == NULL)
+				pBuffer = new std::vector<unsigned char>;
+			pBuffer->resize(nBytes);
+			return pBuffer;
+			}
+
+		void Release(std::vector<unsigned char> *pBuffer) {
+			std::lock_guard<std::mutex> guard(lock);
+			if(buffers.size() < GLT_IMAGE_POOL_BUFFERS)
+				buffers.push_back(pBuffer);
+			else
+				delete pBuffer;
+			}
+
+	protected:
+		std::mutex									lock;
+		std::vector<std::vector<unsigned char> *>	buffers;
+	};
+
+inline GLImageBufferPool &gltGetImageBufferPool(void)
+	{
+	static GLImageBufferPool pool;
+	return pool;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Swap the first and third byte of each pixel. pIn may equal pOut.
+#ifdef GLT_IMAGE_FILE_SSSE3
+GLT_TARGET_SSSE3 inline size_t gltSwapRedBlue24SSSE3(const unsigned char *pIn, unsigned char *pOut, size_t nPixels)
+	{
+	// Five whole pixels per 16 bytes. Stepping by 15 keeps the loads
+	// overlapping, so the last byte of each store is rewritten by the next.
+	const __m128i vShuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+	size_t i = 0;
+	for(; i + 6 <= nPixels; i += 5) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(pIn + i * 3));
+		_mm_storeu_si128((__m128i *)(pOut + i * 3), _mm_shuffle_epi8(v, vShuffle));
+		}
+	return i;
+	}
+#endif
+
+inline void gltSwapRedBlue24(const unsigned char *pIn, unsigned char *pOut, size_t nPixels)
+	{
+	size_t i = 0;
+#ifdef GLT_IMAGE_FILE_SSSE3
+	static const bool bSSSE3 = __builtin_cpu_supports("ssse3");
+	if(bSSSE3)
+		i = gltSwapRedBlue24SSSE3(pIn, pOut, nPixels);
+#endif
+	for(; i < nPixels; i++) {
+		unsigned char b = pIn[i * 3], g = pIn[i * 3 + 1], r = pIn[i * 3 + 2];
+		pOut[i * 3] = r;
+		pOut[i * 3 + 1] = g;
+		pOut[i * 3 + 2] = b;
+		}
+	}
+
+inline void gltSwapRedBlue32(const unsigned char *pIn, unsigned char *pOut, size_t nPixels)
+	{
+	size_t i = 0;
+#ifdef GLT_IMAGE_FILE_SSE
+	const __m128i vKeep = _mm_set1_epi32(int(0xFF00FF00));
+	const __m128i vLow = _mm_set1_epi32(0x000000FF);
+	for(; i + 4 <= nPixels; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(pIn + i * 4));
+		__m128i vSwapped = _mm_or_si128(_mm_and_si128(v, vKeep),
+										_mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), vLow),
+													 _mm_slli_epi32(_mm_and_si128(v, vLow), 16)));
+		_mm_storeu_si128((__m128i *)(pOut + i * 4), vSwapped);
+		}
+#endif
+	for(; i < nPixels; i++) {
+		unsigned char b = pIn[i * 4], r = pIn[i * 4 + 2];
+		pOut[i * 4 + 1] = pIn[i * 4 + 1];
+		pOut[i * 4 + 3] = pIn[i * 4 + 3];
+		pOut[i * 4] = r;
+		pOut[i * 4 + 2] = b;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLImageFile
+	{
+	public:
+		GLImageFile(void) {
+			pBuffer = NULL;
+			Reset();
+			}
+
+		~GLImageFile(void) { Close(); }
+
+		// bRGB asks for red first (GL_RGB / GL_RGBA) instead of GL_BGR / GL_BGRA
+		bool OpenTGA(const char *szFileName, bool bRGB = false);
+		bool OpenBMP(const char *szFileName, bool bRGB = false);
+
+		// By extension, .bmp or else .tga
+		bool Open(const char *szFileName, bool bRGB = false);
+		void Close(void);
+
+		inline const GLbyte *GetPixels(void) const { return (const GLbyte *)pPixels; }
+		inline GLint GetWidth(void) const { return nWidth; }
+		inline GLint GetHeight(void) const { return nHeight; }
+		inline GLint GetComponents(void) const { return nComponents; }
+		inline GLenum GetFormat(void) const { return eFormat; }
+		inline GLint GetAlignment(void) const { return nAlignment; }
+		inline size_t GetSize(void) const { return size_t(nStride) * nHeight; }
+
+		// Pixels point into the file mapping, nothing was copied
+		inline bool IsMapped(void) const { return pPixels != NULL && pBuffer == NULL; }
+
+		// Upload to the bound texture. GL_UNPACK_ALIGNMENT is put back afterwards.
+		void TexImage2D(GLenum target = GL_TEXTURE_2D, GLint nLevel = 0) const;
+
+	protected:
+		static inline GLuint ReadDWORD(const unsigned char *p) {
+			return GLuint(p[0]) | GLuint(p[1]) << 8 | GLuint(p[2]) << 16 | GLuint(p[3]) << 24;
+			}
+
+		void Reset(void);
+		unsigned char *NewBuffer(void);
+		bool DecodeRLE(const unsigned char *pIn, const unsigned char *pEnd, int nBytes, bool bFlip);
+		void FlipCopy(const unsigned char *pIn, size_t nInStride, int nBytes, bool bFlip, bool bSwap);
+		void SwapRedBlue(int nBytes);
+
+		GLMappedFile				file;
+		std::vector<unsigned char>	*pBuffer;		// From the pool, when converted
+		const unsigned char			*pPixels;
+		GLint						nWidth;
+		GLint						nHeight;
+		GLint						nComponents;
+		GLenum						eFormat;
+		GLint						nAlignment;
+		GLint						nStride;		// Bytes per row, with padding
+
+	private:
+		GLImageFile(const GLImageFile&);
+		GLImageFile &operator=(const GLImageFile&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLImageFile::Reset(void)
+	{
+	pPixels = NULL;
+	nWidth = nHeight = 0;
+	nComponents = 0;
+	eFormat = 0;
+	nAlignment = 1;
+	nStride = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLImageFile::Close(void)
+	{
+	if(pBuffer != NULL) {
+		gltGetImageBufferPool().Release(pBuffer);
+		pBuffer = NULL;
+		}
+	file.Close();
+	Reset();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLImageFile::Open(const char *szFileName, bool bRGB)
+	{
+	size_t nLength = strlen(szFileName);
+	if(nLength >= 4 && (strcmp(szFileName + nLength - 4, ".bmp") == 0 || strcmp(szFileName + nLength - 4, ".BMP") == 0))
+		return OpenBMP(szFileName, bRGB);
+	return OpenTGA(szFileName, bRGB);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Tightly packed rows of nStride bytes
+inline unsigned char *GLImageFile::NewBuffer(void)
+	{
+	pBuffer = gltGetImageBufferPool().Acquire(size_t(nStride) * nHeight);
+	pPixels = &(*pBuffer)[0];
+	return &(*pBuffer)[0];
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLImageFile::OpenTGA(const char *szFileName, bool bRGB)
+	{
+	Close();
+	if(!file.Open(szFileName))
+		return false;
+
+	const unsigned char *pHeader = file.GetData();
+	const unsigned char *pEnd = pHeader + file.GetSize();
+	if(file.GetSize() < 18) {
+		Close();
+		return false;
+		}
+
+	int nType = pHeader[2];
+	int nBits = pHeader[16];
+	bool bFlip = (pHeader[17] & 0x20) != 0;			// Top row first
+	size_t nOffset = 18 + pHeader[0];
+	if(pHeader[1] != 0)								// Colour map, skipped
+		nOffset += size_t(pHeader[5] | pHeader[6] << 8) * ((pHeader[7] + 7) / 8);
+
+	nWidth = pHeader[12] | pHeader[13] << 8;
+	nHeight = pHeader[14] | pHeader[15] << 8;
+	bool bGray = (nType == 3 || nType == 11);
+	bool bRLE = (nType == 10 || nType == 11);
+	if((nType != 2 && nType != 3 && !bRLE) || nWidth == 0 || nHeight == 0 ||
+	   (bGray ? nBits != 8 : (nBits != 24 && nBits != 32))) {
+		Close();
+		return false;
+		}
+
+	int nBytes = nBits / 8;
+	nStride = nWidth * nBytes;
+	switch(nBytes) {
+		case 1: nComponents = GL_LUMINANCE; eFormat = GL_LUMINANCE; break;
+		case 3: nComponents = GL_RGB; eFormat = bRGB ? GL_RGB : GL_BGR; break;
+		default: nComponents = GL_RGBA; eFormat = bRGB ? GL_RGBA : GL_BGRA; break;
+		}
+
+	const unsigned char *pData = pHeader + nOffset;
+	if(nOffset > file.GetSize()) {
+		Close();
+		return false;
+		}
+
+	if(bRLE) {
+		NewBuffer();
+		if(!DecodeRLE(pData, pEnd, nBytes, bFlip)) {
+			Close();
+			return false;
+			}
+		}
+	else {
+		if(size_t(pEnd - pData) < GetSize()) {
+			Close();
+			return false;
+			}
+
+		bool bSwap = bRGB && nBytes > 1;
+		if(bFlip || bSwap)
+			FlipCopy(pData, nStride, nBytes, bFlip, bSwap);
+		else
+			pPixels = pData;
+		return true;
+		}
+
+	if(bRGB && nBytes > 1)
+		SwapRedBlue(nBytes);
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLImageFile::OpenBMP(const char *szFileName, bool bRGB)
+	{
+	Close();
+	if(!file.Open(szFileName))
+		return false;
+
+	const unsigned char *p = file.GetData();
+	size_t nSize = file.GetSize();
+	if(nSize < 54 || p[0] != 'B' || p[1] != 'M') {
+		Close();
+		return false;
+		}
+
+	// Read byte by byte, so no LITTLE_ENDIAN_DWORD() is needed
+	GLuint nOffset = ReadDWORD(p + 10);
+	GLuint nInfoSize = ReadDWORD(p + 14);
+	GLint nFileWidth = GLint(ReadDWORD(p + 18));
+	GLint nFileHeight = GLint(ReadDWORD(p + 22));
+	int nBits = p[28] | p[29] << 8;
+	GLuint nCompression = ReadDWORD(p + 30);
+	GLuint nColors = ReadDWORD(p + 46);
+
+	// BI_BITFIELDS is accepted when the masks are the plain BGRA layout
+	bool bMasksOk = (nCompression == 0);
+	if(nCompression == 3 && nBits == 32 && nSize >= 66)
+		bMasksOk = ReadDWORD(p + 54) == 0x00FF0000 && ReadDWORD(p + 58) == 0x0000FF00 && ReadDWORD(p + 62) == 0x000000FF;
+
+	bool bFlip = nFileHeight < 0;
+	nWidth = nFileWidth;
+	nHeight = bFlip ? -nFileHeight : nFileHeight;
+	if(!bMasksOk || nWidth <= 0 || nHeight <= 0 || (nBits != 8 && nBits != 24 && nBits != 32)) {
+		Close();
+		return false;
+		}
+
+	size_t nFileStride = ((size_t(nWidth) * nBits + 31) / 32) * 4;
+	if(nOffset > nSize || nSize - nOffset < nFileStride * nHeight) {
+		Close();
+		return false;
+		}
+	const unsigned char *pData = p + nOffset;
+
+	// 32 bit BI_RGB has no alpha, so the fourth byte is uploaded and ignored
+	nComponents = GL_RGB;
+	if(nBits == 32)
+		eFormat = bRGB ? GL_RGBA : GL_BGRA;
+	else
+		eFormat = bRGB ? GL_RGB : GL_BGR;
+
+	if(nBits == 8) {
+		if(nColors == 0 || nColors > 256)
+			nColors = 256;
+		const unsigned char *pPalette = p + 14 + nInfoSize;
+		if(size_t(pPalette - p) + nColors * 4 > nOffset) {
+			Close();
+			return false;
+			}
+
+		nStride = nWidth * 3;
+		unsigned char *pOut = NewBuffer();
+		for(int y = 0; y < nHeight; y++) {
+			const unsigned char *pRow = pData + nFileStride * (bFlip ? nHeight - 1 - y : y);
+			unsigned char *pDest = pOut + size_t(y) * nStride;
+			for(int x = 0; x < nWidth; x++) {
+				GLuint nIndex = (pRow[x] < nColors) ? pRow[x] : 0;
+				pDest[x * 3] = pPalette[nIndex * 4];
+				pDest[x * 3 + 1] = pPalette[nIndex * 4 + 1];
+				pDest[x * 3 + 2] = pPalette[nIndex * 4 + 2];
+				}
+			}
+
+		if(bRGB)
+			SwapRedBlue(3);
+		}
+	else {
+		int nBytes = nBits / 8;
+		if(bFlip || bRGB) {
+			nStride = nWidth * nBytes;
+			FlipCopy(pData, nFileStride, nBytes, bFlip, bRGB);
+			}
+		else {
+			// Straight from the file, padded rows and all
+			nStride = GLint(nFileStride);
+			nAlignment = (nFileStride == size_t(nWidth) * nBytes) ? 1 : 4;
+			pPixels = pData;
+			}
+		}
+
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy rows into a pooled buffer, reversing their order if bFlip and
+// swapping red and blue on the way if bSwap
+inline void GLImageFile::FlipCopy(const unsigned char *pIn, size_t nInStride, int nBytes, bool bFlip, bool bSwap)
+	{
+	unsigned char *pOut = NewBuffer();
+	size_t nRowBytes = size_t(nWidth) * nBytes;
+	for(int y = 0; y < nHeight; y++) {
+		const unsigned char *pRow = pIn + nInStride * (bFlip ? nHeight - 1 - y : y);
+		unsigned char *pDest = pOut + size_t(y) * nStride;
+		if(!bSwap)
+			memcpy(pDest, pRow, nRowBytes);
+		else if(nBytes == 3)
+			gltSwapRedBlue24(pRow, pDest, nWidth);
+		else
+			gltSwapRedBlue32(pRow, pDest, nWidth);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// In place on the pooled buffer
+inline void GLImageFile::SwapRedBlue(int nBytes)
+	{
+	unsigned char *pOut = &(*pBuffer)[0];
+	size_t nPixels = size_t(nWidth) * nHeight;
+	if(nBytes == 3)
+		gltSwapRedBlue24(pOut, pOut, nPixels);
+	else
+		gltSwapRedBlue32(pOut, pOut, nPixels);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// TGA run length packets: a count byte, then one pixel repeated (high bit set)
+// or that many raw pixels. Packets may run on across rows.
+inline bool GLImageFile::DecodeRLE(const unsigned char *pIn, const unsigned char *pEnd, int nBytes, bool bFlip)
+	{
+	unsigned char *pOut = &(*pBuffer)[0];
+	int x = 0, y = 0;
+
+	while(y < nHeight) {
+		if(pIn >= pEnd)
+			return false;
+
+		int nCount = (*pIn & 0x7F) + 1;
+		bool bRun = (*pIn & 0x80) != 0;
+		pIn++;
+		if(pEnd - pIn < (bRun ? nBytes : nCount * nBytes))
+			return false;
+
+		while(nCount > 0 && y < nHeight) {
+			int nSpan = (nCount < nWidth - x) ? nCount : nWidth - x;
+			unsigned char *pDest = pOut + size_t(bFlip ? nHeight - 1 - y : y) * nStride + size_t(x) * nBytes;
+
+			if(bRun) {
+				if(nBytes == 1)
+					memset(pDest, *pIn, nSpan);
+				else
+					for(int i = 0; i < nSpan; i++)
+						memcpy(pDest + i * nBytes, pIn, nBytes);
+				}
+			else {
+				memcpy(pDest, pIn, size_t(nSpan) * nBytes);
+				pIn += size_t(nSpan) * nBytes;
+				}
+
+			nCount -= nSpan;
+			x += nSpan;
+			if(x == nWidth) {
+				x = 0;
+				y++;
+				}
+			}
+
+		if(bRun)
+			pIn += nBytes;
+		else
+			pIn += size_t(nCount) * nBytes;		// Past the last row, ignored
+		}
+
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLImageFile::TexImage2D(GLenum target, GLint nLevel) const
+	{
+	if(pPixels == NULL)
+		return;
+
+	GLint nOldAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &nOldAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, nAlignment);
+	glTexImage2D(target, nLevel, nComponents, nWidth, nHeight, 0, eFormat, GL_UNSIGNED_BYTE, pPixels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, nOldAlignment);
+	}
+
+#endif
@@ -0,0 +1,381 @@
+// GLJobSystem.h
+// Work stealing job scheduler for frame and load time tasks.
+//
+// The pool owns one job deque per worker plus one for the threads outside
+// it, usually the main thread. A thread pushes and pops at the back of its
+// own deque, so it runs its newest (cache warm) job first. An idle worker
+// steals from the front of another deque, which takes the oldest and usually
+// largest piece of work. The deques are short and only locked for a push or
+// pop, so a plain mutex per deque is enough. Workers sleep when every deque
+// is empty.
+//
+// Jobs are grouped with a GLJobCounter. Run() increments the counter and the
+// job decrements it when it finishes. Wait() runs queued jobs on the calling
+// thread until the counter reaches zero, so the main thread is never idle
+// while it waits. A job can also be made to depend on a counter. It is held
+// back until that counter reaches zero and is then queued.
+//
+// gltParallelRows() (mesh generation), GLFramePool (matrices) and
+// GLCommandRecorder all run on the shared pool from gltGetJobSystem() rather
+// than starting their own threads for every call.
+
+#ifndef __GLT_JOB_SYSTEM
+#define __GLT_JOB_SYSTEM
+
+#include "GLTools.h"
+#include "GLFrustum.h"
+#include "StopWatch.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GLJobCounter;
+
+struct GLTJob
+	{
+	std::function<void()>	fn;
+	GLJobCounter			*pCounter;		// Decremented when fn returns, may be NULL
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts the unfinished jobs of a group and holds the jobs waiting on it.
+// Must outlive every job that references it; waiting on it is enough.
+class GLJobCounter
+	{
+	public:
+		GLJobCounter(void) : nPending(0) {}
+
+		inline bool IsDone(void) const { return nPending.load() == 0; }
+
+	protected:
+		friend class GLJobSystem;
+
+		std::atomic<int>		nPending;
+		std::mutex				lock;
+		std::vector<GLTJob>		continuations;
+
+	private:
+		GLJobCounter(const GLJobCounter&);
+		GLJobCounter &operator=(const GLJobCounter&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLJobSystem
+	{
+	public:
+		// nThreads counts the calling thread, so nThreads - 1 workers are
+		// started. 0 uses one thread per core.
+		GLJobSystem(int nThreads = 0);
+		~GLJobSystem(void);
+
+		inline int GetThreadCount(void) const { return nThreads; }
+
+		// Queue fn. pCounter, if given, is incremented now and decremented
+		// when fn returns. With pAfter, fn is not queued before pAfter is done.
+		void Run(std::function<void()> fn, GLJobCounter *pCounter = NULL, GLJobCounter *pAfter = NULL);
+
+		// Help with queued jobs until counter reaches zero
+		void Wait(GLJobCounter &counter);
+
+		// Call fn(first, last) over [0, nCount) in ranges of nGrain, and wait.
+		// One range runs on the calling thread without being queued.
+		template <class F>
+		void ParallelFor(GLint nCount, GLint nGrain, F fn);
+
+	protected:
+		struct WorkerQueue
+			{
+			std::mutex			lock;
+			std::deque<GLTJob>	jobs;
+			char				pad[64];			// Keep neighbouring locks off one cache line
+			};
+
+		// Queue of the calling thread, 0 for threads outside the pool
+		int CurrentQueue(void) const;
+		void Push(int nQueue, GLTJob &job);
+		bool RunOne(int nQueue);
+		void Finish(GLJobCounter *pCounter);
+		void WorkerMain(int nQueue);
+
+		int							nThreads;
+		std::vector<WorkerQueue *>	queues;
+		std::vector<std::thread>	workers;
+
+		std::atomic<int>			nQueued;
+		std::mutex					sleepLock;
+		std::condition_variable		wakeUp;
+		bool						bQuit;
+
+	private:
+		GLJobSystem(const GLJobSystem&);
+		GLJobSystem &operator=(const GLJobSystem&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Which pool and queue the current thread works for
+struct GLTJobThread
+	{
+	const GLJobSystem	*pSystem;
+	int					nQueue;
+	};
+
+inline GLTJobThread &gltJobThread(void)
+	{
+	static thread_local GLTJobThread current = { NULL, 0 };
+	return current;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLJobSystem::GLJobSystem(int nThreadCount)
+	{
+	if(nThreadCount <= 0)
+		nThreadCount = int(std::thread::hardware_concurrency());
+	if(nThreadCount <= 0)
+		nThreadCount = 1;
+
+	nThreads = nThreadCount;
+	nQueued = 0;
+	bQuit = false;
+
+	for(int i = 0; i < nThreads; i++)
+		queues.push_back(new WorkerQueue);
+
+	for(int i = 1; i < nThreads; i++)
+		workers.push_back(std::thread(&GLJobSystem::WorkerMain, this, i));
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLJobSystem::~GLJobSystem(void)
+	{
+	{
+	std::lock_guard<std::mutex> guard(sleepLock);
+	bQuit = true;
+	}
+	wakeUp.notify_all();
+
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for(size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline int GLJobSystem::CurrentQueue(void) const
+	{
+	const GLTJobThread &current = gltJobThread();
+	return (current.pSystem == this) ? current.nQueue : 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLJobSystem::Push(int nQueue, GLTJob &job)
+	{
+	{
+	std::lock_guard<std::mutex> guard(queues[nQueue]->lock);
+	queues[nQueue]->jobs.push_back(std::move(job));
+	}
+	nQueued++;
+
+	// Taking the lock orders this against a worker checking nQueued before
+	// it sleeps, so the wake up can not be lost
+	{
+	std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wakeUp.notify_one();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLJobSystem::Run(std::function<void()> fn, GLJobCounter *pCounter, GLJobCounter *pAfter)
+	{
+	GLTJob job;
+	job.fn = std::move(fn);
+	job.pCounter = pCounter;
+	if(pCounter != NULL)
+		pCounter->nPending++;
+
+	if(pAfter != NULL) {
+		std::lock_guard<std::mutex> guard(pAfter->lock);
+		if(pAfter->nPending.load() > 0) {
+			pAfter->continuations.push_back(std::move(job));
+			return;
+			}
+		}
+
+	Push(CurrentQueue(), job);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The decrement and the hand over of the held back jobs happen under the
+// counter's lock. Wait() takes the same lock before it returns, so the
+// counter is not touched after its owner may have destroyed it.
+inline void GLJobSystem::Finish(GLJobCounter *pCounter)
+	{
+	std::vector<GLTJob> vReady;
+	{
+	std::lock_guard<std::mutex> guard(pCounter->lock);
+	if(--pCounter->nPending == 0)
+		vReady.swap(pCounter->continuations);
+	}
+
+	int nQueue = CurrentQueue();
+	for(size_t i = 0; i < vReady.size(); i++)
+		Push(nQueue, vReady[i]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Own queue newest first, then the other queues oldest first
+inline bool GLJobSystem::RunOne(int nQueue)
+	{
+	GLTJob job;
+	bool bFound = false;
+
+	for(int i = 0; i < nThreads && !bFound; i++) {
+		WorkerQueue *pQueue = queues[(nQueue + i) % nThreads];
+		std::lock_guard<std::mutex> guard(pQueue->lock);
+		if(pQueue->jobs.empty())
+			continue;
+
+		if(i == 0) {
+			job = std::move(pQueue->jobs.back());
+			pQueue->jobs.pop_back();
+			}
+		else {
+			job = std::move(pQueue->jobs.front());
+			pQueue->jobs.pop_front();
+			}
+		bFound = true;
+		}
+
+	if(!bFound)
+		return false;
+
+	nQueued--;
+	job.fn();
+	if(job.pCounter != NULL)
+		Finish(job.pCounter);
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLJobSystem::WorkerMain(int nQueue)
+	{
+	gltJobThread().pSystem = this;
+	gltJobThread().nQueue = nQueue;
+
+	for(;;) {
+		if(RunOne(nQueue))
+			continue;
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wakeUp.wait(guard, [this]() { return nQueued.load() > 0 || bQuit; });
+		if(bQuit)
+			return;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLJobSystem::Wait(GLJobCounter &counter)
+	{
+	int nQueue = CurrentQueue();
+	while(counter.nPending.load() > 0)
+		if(!RunOne(nQueue))
+			std::this_thread::yield();
+
+	std::lock_guard<std::mutex> guard(counter.lock);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+template <class F>
+inline void GLJobSystem::ParallelFor(GLint nCount, GLint nGrain, F fn)
+	{
+	if(nGrain < 1)
+		nGrain = 1;
+
+	if(nThreads <= 1 || nCount <= nGrain) {
+		if(nCount > 0)
+			fn(0, nCount);
+		return;
+		}
+
+	GLJobCounter counter;
+	for(GLint iFirst = nGrain; iFirst < nCount; iFirst += nGrain) {
+		GLint iLast = (iFirst + nGrain < nCount) ? iFirst + nGrain : nCount;
+		Run([&fn, iFirst, iLast]() { fn(iFirst, iLast); }, &counter);
+		}
+
+	fn(0, nGrain);
+	Wait(counter);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared pool, one thread per core. Started on first use.
+inline GLJobSystem &gltGetJobSystem(void)
+	{
+	static GLJobSystem jobSystem;
+	return jobSystem;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Frustum test for nSpheres spheres (x, y, z, radius), split over the pool.
+// pVisible[i] is set to 1 for spheres that intersect the frustum, else 0.
+inline void gltCullSpheres(GLFrustum &frustum, const M3DVector4f *pSpheres, GLint nSpheres, unsigned char *pVisible,
+						   GLint nGrain = 256)
+	{
+	gltGetJobSystem().ParallelFor(nSpheres, nGrain, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			M3DVector3f vCenter;
+			m3dCopyVector3(vCenter, pSpheres[i]);
+			pVisible[i] = frustum.TestSphere(vCenter, pSpheres[i][3]) ? 1 : 0;
+			}
+		});
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scaling benchmark. Times fn(nThreads) for nThreads = 1 .. nMaxThreads,
+// keeping the best of nRepeats runs after one warm up run. fn should split
+// its work into nThreads parts, e.g. by passing nThreads on to a gltWrite*()
+// generator or GLFramePool::UpdateMatrices(). nMaxThreads is limited to the
+// size of the shared pool. vSeconds[n - 1] is the time for n threads.
+template <class F>
+inline void gltJobScaling(int nMaxThreads, int nRepeats, F fn, std::vector<float> &vSeconds)
+	{
+	if(nMaxThreads > gltGetJobSystem().GetThreadCount())
+		nMaxThreads = gltGetJobSystem().GetThreadCount();
+
+	vSeconds.clear();
+	CStopWatch timer;
+	for(int nThreadCount = 1; nThreadCount <= nMaxThreads; nThreadCount++) {
+		fn(nThreadCount);
+
+		float fBest = 0.0f;
+		for(int r = 0; r < nRepeats; r++) {
+			timer.Reset();
+			fn(nThreadCount);
+			float fSeconds = timer.GetElapsedSeconds();
+			if(r == 0 || fSeconds < fBest)
+				fBest = fSeconds;
+			}
+		vSeconds.push_back(fBest);
+		}
+	}
+
+#endif
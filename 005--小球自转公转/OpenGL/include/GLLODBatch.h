@@ -0,0 +1,188 @@
+// GLLODBatch.h
+// A chain of GLTriangleBatch levels of detail for one shape.
+//
+// Level 0 is the finest. Each level stores the largest projected radius,
+// in pixels, at which it still looks right. The draw code measures the
+// object's projected radius from its modelview and projection matrices
+// and draws the coarsest level that is good enough. Each instance keeps
+// its current level. A level only changes once the size has moved a
+// hysteresis margin past the boundary, so an object resting near a
+// boundary does not flicker between two levels.
+//
+// BuildSphere() and BuildTorus() fill the chain with gltGenerate* at
+// halved tessellations. The limit for each level comes from the chord
+// error of its coarsest ring, so the silhouette never drifts more than
+// fTolerance pixels from the true surface. Other shapes can call
+// AddLevel() directly and fill each batch however they like.
+
+#ifndef __GLT_LOD_BATCH
+#define __GLT_LOD_BATCH
+
+#include "GLTools.h"
+#include "GLMeshGenerators.h"
+#include <float.h>
+
+#define GLT_LOD_MAX_LEVELS	8
+
+class GLLODBatch
+	{
+	public:
+		GLLODBatch(void) { nLevels = 0; fBoundingRadius = 1.0f; fHysteresis = 0.15f; }
+		~GLLODBatch(void) { Clear(); }
+
+		// Drop all levels
+		void Clear(void) {
+			for(int i = 0; i < nLevels; i++)
+				delete pLevels[i];
+			nLevels = 0;
+			}
+
+		// Append a level, coarser than the ones before it. It is used while
+		// the object covers at most fMaxPixels of radius on screen. The first
+		// level is used for any size. Returns NULL when the chain is full.
+		GLTriangleBatch *AddLevel(float fMaxPixels) {
+			if(nLevels == GLT_LOD_MAX_LEVELS)
+				return NULL;
+
+			pLevels[nLevels] = new GLTriangleBatch;
+			fMaxPixelsForLevel[nLevels] = (nLevels == 0) ? FLT_MAX : fMaxPixels;
+			return pLevels[nLevels++];
+			}
+
+		// Radius of a sphere around the model's origin that holds the shape
+		inline void SetBoundingRadius(float fRadius) { fBoundingRadius = fRadius; }
+		inline float GetBoundingRadius(void) const { return fBoundingRadius; }
+
+		// Fraction of a boundary the size has to pass before the level changes
+		inline void SetHysteresis(float fFraction) { fHysteresis = fFraction; }
+
+		inline int GetLevelCount(void) const { return nLevels; }
+		inline GLTriangleBatch &GetLevel(int nLevel) { return *pLevels[nLevel]; }
+		inline float GetMaxPixels(int nLevel) const { return fMaxPixelsForLevel[nLevel]; }
+
+		// Radius in pixels of the bounding sphere once projected. mModelView
+		// places the model in eye space, and may scale it. nViewportHeight is
+		// in pixels. Returns FLT_MAX when the eye is inside the sphere.
+		float GetScreenRadius(const M3DMatrix44f mModelView, const M3DMatrix44f mProjection, int nViewportHeight) const {
+			// Largest scale along any model axis
+			float fScale2 = 0.0f;
+			for(int c = 0; c < 3; c++) {
+				const float *pCol = mModelView + c * 4;
+				float fLen2 = pCol[0] * pCol[0] + pCol[1] * pCol[1] + pCol[2] * pCol[2];
+				if(fLen2 > fScale2)
+					fScale2 = fLen2;
+				}
+			float fRadius2 = fBoundingRadius * fBoundingRadius * fScale2;
+
+			// Pixels per eye space unit at distance 1 (perspective) or anywhere (ortho)
+			float fPixelScale = mProjection[5] * 0.5f * float(nViewportHeight);
+			if(mProjection[15] != 0.0f)
+				return sqrtf(fRadius2) * fPixelScale;
+
+			// Use the distance to the center rather than depth so that turning the
+			// camera does not change the level. A sphere of radius r at distance d
+			// spans a half angle with tangent r / sqrt(d^2 - r^2).
+			float fDist2 = mModelView[12] * mModelView[12] + mModelView[13] * mModelView[13] + mModelView[14] * mModelView[14];
+			if(fDist2 <= fRadius2)
+				return FLT_MAX;
+
+			return sqrtf(fRadius2 / (fDist2 - fRadius2)) * fPixelScale;
+			}
+
+		// Coarsest level that is acceptable at fPixels, ignoring hysteresis
+		int LevelForSize(float fPixels) const {
+			int nLevel = nLevels - 1;
+			while(nLevel > 0 && fMaxPixelsForLevel[nLevel] < fPixels)
+				nLevel--;
+			return nLevel;
+			}
+
+		// Pick a level for an object currently drawn at nCurrent (-1 if none yet).
+		// Moves coarser only once the size is fHysteresis below a boundary, and
+		// finer only once it is fHysteresis above one.
+		int SelectLevel(float fPixels, int nCurrent) const {
+			if(nLevels == 0)
+				return -1;
+
+			if(nCurrent < 0 || nCurrent >= nLevels)
+				return LevelForSize(fPixels);
+
+			int nCoarsest = LevelForSize(fPixels * (1.0f + fHysteresis));
+			int nFinest = LevelForSize(fPixels * (1.0f - fHysteresis));
+			if(nCurrent < nCoarsest)
+				return nCoarsest;
+			if(nCurrent > nFinest)
+				return nFinest;
+			return nCurrent;
+			}
+
+		// Select with the object's matrices, store the new level in nLevel and draw it
+		void Draw(const M3DMatrix44f mModelView, const M3DMatrix44f mProjection, int nViewportHeight, int &nLevel) {
+			nLevel = SelectLevel(GetScreenRadius(mModelView, mProjection, nViewportHeight), nLevel);
+			if(nLevel >= 0)
+				pLevels[nLevel]->Draw();
+			}
+
+		inline void Draw(int nLevel) { pLevels[nLevel]->Draw(); }
+
+		// Sphere from iSlices x iStacks down, halving both each level
+		void BuildSphere(GLfloat fRadius, GLint iSlices, GLint iStacks, int nMaxLevels, float fTolerance = 0.5f) {
+			Clear();
+			SetBoundingRadius(fRadius);
+			for(int i = 0; i < nMaxLevels && iSlices >= 3 && iStacks >= 2; i++) {
+				// Slices step 2pi/n around, stacks step pi/m over the pole
+				float fError = ChordError(iSlices);
+				if(ChordError(iStacks * 2) > fError)
+					fError = ChordError(iStacks * 2);
+
+				GLTriangleBatch *pBatch = AddLevel(fTolerance / fError);
+				if(pBatch == NULL)
+					break;
+				gltGenerateSphere(*pBatch, fRadius, iSlices, iStacks);
+
+				iSlices /= 2;
+				iStacks /= 2;
+				}
+			}
+
+		// Torus from numMajor x numMinor down, halving both each level
+		void BuildTorus(GLfloat majorRadius, GLfloat minorRadius, GLint numMajor, GLint numMinor, int nMaxLevels, float fTolerance = 0.5f) {
+			Clear();
+			GLfloat fOuter = majorRadius + minorRadius;
+			SetBoundingRadius(fOuter);
+			for(int i = 0; i < nMaxLevels && numMajor >= 3 && numMinor >= 3; i++) {
+				// Errors are relative to the bounding radius
+				float fError = ChordError(numMajor);
+				float fMinorError = ChordError(numMinor) * minorRadius / fOuter;
+				if(fMinorError > fError)
+					fError = fMinorError;
+
+				GLTriangleBatch *pBatch = AddLevel(fTolerance / fError);
+				if(pBatch == NULL)
+					break;
+				gltGenerateTorus(*pBatch, majorRadius, minorRadius, numMajor, numMinor);
+
+				numMajor /= 2;
+				numMinor /= 2;
+				}
+			}
+
+	protected:
+		// Largest gap between a unit circle and a polygon of nSides inscribed in it
+		static float ChordError(GLint nSides) {
+			return 1.0f - float(cos(M3D_PI / double(nSides)));
+			}
+
+		GLTriangleBatch	*pLevels[GLT_LOD_MAX_LEVELS];
+		float			fMaxPixelsForLevel[GLT_LOD_MAX_LEVELS];
+		int				nLevels;
+		float			fBoundingRadius;
+		float			fHysteresis;
+
+	private:
+		// Owns its batches
+		GLLODBatch(const GLLODBatch&);
+		GLLODBatch &operator=(const GLLODBatch&);
+	};
+
+#endif
@@ -35,6 +35,7 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 #include "GLTools.h"
 #include "math3d.h"
 #include "GLFrame.h"
+#include "GLQuatFrame.h"
 
 enum GLT_STACK_ERROR { GLT_STACK_NOERROR = 0, GLT_STACK_OVERFLOW, GLT_STACK_UNDERFLOW }; 
 
@@ -68,6 +69,10 @@ class GLMatrixStack
             frame.GetMatrix(m);
             LoadMatrix(m);
             }
+
+        inline void LoadMatrix(const GLQuatFrame& frame) {
+            frame.GetMatrix(pStack[stackPointer]);
+            }
             
 		inline void MultMatrix(const M3DMatrix44f mMatrix) {
 			M3DMatrix44f mTemp;
@@ -80,6 +85,12 @@ class GLMatrixStack
             frame.GetMatrix(m);
             MultMatrix(m);
             }
+
+        inline void MultMatrix(const GLQuatFrame& frame) {
+            M3DMatrix44f m;
+            frame.GetMatrix(m);
+            MultMatrix(m);
+            }
             				
 		inline void PushMatrix(void) {
 			if(stackPointer < stackDepth) {
@@ -160,6 +171,12 @@ class GLMatrixStack
             frame.GetMatrix(m);
             PushMatrix(m);
             }
+
+        void PushMatrix(const GLQuatFrame& frame) {
+            M3DMatrix44f m;
+            frame.GetMatrix(m);
+            PushMatrix(m);
+            }
             
 		// Two different ways to get the matrix
 		const M3DMatrix44f& GetMatrix(void) { return pStack[stackPointer]; }
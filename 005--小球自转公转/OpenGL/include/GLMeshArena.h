@@ -0,0 +1,356 @@
+// GLMeshArena.h
+// Many triangle meshes in one vertex buffer, one index buffer and one
+// vertex array object, drawn from a list in a single call.
+//
+// Each GLTriangleBatch has its own buffers and vertex array, so a scene of
+// small shapes costs one bind and one draw per shape. The arena packs the
+// meshes together. Draws are queued with AddDraw() and submitted by Draw()
+// with one glMultiDrawElementsIndirect call. Each draw also carries a vec4
+// of per-draw data. It is fed to the vertex shader as an instanced
+// attribute at GLT_ARENA_ATTRIBUTE_DRAW, selected by the command's base
+// instance, so one shader can place every mesh in the list.
+// GLT_ARENA_SHADER_* is a point light diffuse shader that reads it as an
+// offset (xyz) and scale (w).
+//
+// Without multi draw indirect support the same list is drawn with one
+// glDrawElements per entry, setting the per-draw data as a constant
+// attribute. That still needs only a single vertex array bind.
+//
+// Index data is rebased when the arena is built, so no base vertex support
+// is needed on either path.
+
+#ifndef __GLT_MESH_ARENA
+#define __GLT_MESH_ARENA
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLShaderManager.h"
+#include "GLMeshGenerators.h"
+#include <vector>
+
+// Per-draw vec4, in the slot after the stock attributes' texture units 0 and 1
+#define GLT_ARENA_ATTRIBUTE_DRAW	GLT_ATTRIBUTE_TEXTURE2
+
+// Same as the stock GLT_SHADER_POINT_LIGHT_DIFF, with vDraw as offset and scale.
+// Load it with LoadShaderPairSrcWithAttributes(), binding vVertex, vNormal and
+// vDraw, then set mvMatrix, pMatrix, vLightPos and vColor.
+#define GLT_ARENA_SHADER_POINT_LIGHT_DIFF_VP \
+	"uniform mat4 mvMatrix;" \
+	"uniform mat4 pMatrix;" \
+	"uniform vec3 vLightPos;" \
+	"uniform vec4 vColor;" \
+	"attribute vec4 vVertex;" \
+	"attribute vec3 vNormal;" \
+	"attribute vec4 vDraw;" \
+	"varying vec4 vFragColor;" \
+	"void main(void) { " \
+	" mat3 mNormalMatrix;" \
+	" mNormalMatrix[0] = normalize(mvMatrix[0].xyz);" \
+	" mNormalMatrix[1] = normalize(mvMatrix[1].xyz);" \
+	" mNormalMatrix[2] = normalize(mvMatrix[2].xyz);" \
+	" vec3 vNorm = normalize(mNormalMatrix * vNormal);" \
+	" vec4 vPosition = vec4(vVertex.xyz * vDraw.w + vDraw.xyz, 1.0);" \
+	" vec4 ecPosition = mvMatrix * vPosition;" \
+	" vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);" \
+	" float fDot = max(0.0, dot(vNorm, vLightDir));" \
+	" vFragColor.rgb = vColor.rgb * fDot;" \
+	" vFragColor.a = vColor.a;" \
+	" gl_Position = pMatrix * ecPosition;" \
+	"}"
+
+#define GLT_ARENA_SHADER_POINT_LIGHT_DIFF_FP \
+	"varying vec4 vFragColor;" \
+	"void main(void) { " \
+	" gl_FragColor = vFragColor;" \
+	"}"
+
+class GLMeshArena : public GLBatchBase
+	{
+	public:
+		GLMeshArena(void) {
+			uiVertexBuffer = 0;
+			uiIndexBuffer = 0;
+			uiCommandBuffer = 0;
+			uiDrawDataBuffer = 0;
+			vertexArrayObject = 0;
+			bMultiDrawIndirect = false;
+			bBuilt = false;
+			nDrawCalls = 0;
+			}
+
+		virtual ~GLMeshArena(void) {
+			if(uiVertexBuffer != 0) glDeleteBuffers(1, &uiVertexBuffer);
+			if(uiIndexBuffer != 0) glDeleteBuffers(1, &uiIndexBuffer);
+			if(uiCommandBuffer != 0) glDeleteBuffers(1, &uiCommandBuffer);
+			if(uiDrawDataBuffer != 0) glDeleteBuffers(1, &uiDrawDataBuffer);
+			if(vertexArrayObject != 0) glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		// Make room for a new mesh and point mesh at it. Fill the arrays before
+		// the next AddMesh(), which may move them. Indexes are local to the
+		// mesh. Returns the mesh number, or -1 past GLT_MESH_MAX_VERTS.
+		int AddMesh(GLuint nVerts, GLuint nIndexes, GLTMeshArrays &mesh) {
+			if(bBuilt || nVerts > GLT_MESH_MAX_VERTS)
+				return -1;
+
+			Mesh m;
+			m.nFirstVert = GLuint(vVerts.size() / 3);
+			m.nVerts = nVerts;
+			m.nFirstIndex = GLuint(vIndexes.size());
+			m.nIndexes = nIndexes;
+			meshes.push_back(m);
+
+			vVerts.resize(vVerts.size() + nVerts * 3);
+			vNorms.resize(vNorms.size() + nVerts * 3);
+			vTexCoords.resize(vTexCoords.size() + nVerts * 2);
+			vIndexes.resize(vIndexes.size() + nIndexes);
+
+			mesh.pVerts = (M3DVector3f *)&vVerts[m.nFirstVert * 3];
+			mesh.pNorms = (M3DVector3f *)&vNorms[m.nFirstVert * 3];
+			mesh.pTexCoords = (M3DVector2f *)&vTexCoords[m.nFirstVert * 2];
+			mesh.pIndexes = &vIndexes[m.nFirstIndex];
+			return int(meshes.size()) - 1;
+			}
+
+		// The gltGenerate* shapes, added as meshes
+		int AddSphere(GLfloat fRadius, GLint iSlices, GLint iStacks) {
+			GLuint nVerts, nIndexes;
+			GLTMeshArrays mesh;
+			gltSphereMeshSize(iSlices, iStacks, &nVerts, &nIndexes);
+			int nMesh = AddMesh(nVerts, nIndexes, mesh);
+			if(nMesh >= 0)
+				gltWriteSphere(mesh, fRadius, iSlices, iStacks);
+			return nMesh;
+			}
+
+		int AddTorus(GLfloat majorRadius, GLfloat minorRadius, GLint numMajor, GLint numMinor) {
+			GLuint nVerts, nIndexes;
+			GLTMeshArrays mesh;
+			gltTorusMeshSize(numMajor, numMinor, &nVerts, &nIndexes);
+			int nMesh = AddMesh(nVerts, nIndexes, mesh);
+			if(nMesh >= 0)
+				gltWriteTorus(mesh, majorRadius, minorRadius, numMajor, numMinor);
+			return nMesh;
+			}
+
+		int AddDisk(GLfloat innerRadius, GLfloat outerRadius, GLint nSlices, GLint nStacks) {
+			GLuint nVerts, nIndexes;
+			GLTMeshArrays mesh;
+			gltDiskMeshSize(innerRadius, nSlices, nStacks, &nVerts, &nIndexes);
+			int nMesh = AddMesh(nVerts, nIndexes, mesh);
+			if(nMesh >= 0)
+				gltWriteDisk(mesh, innerRadius, outerRadius, nSlices, nStacks);
+			return nMesh;
+			}
+
+		int AddCylinder(GLfloat baseRadius, GLfloat topRadius, GLfloat fLength, GLint numSlices, GLint numStacks) {
+			GLuint nVerts, nIndexes;
+			GLTMeshArrays mesh;
+			gltCylinderMeshSize(numSlices, numStacks, &nVerts, &nIndexes);
+			int nMesh = AddMesh(nVerts, nIndexes, mesh);
+			if(nMesh >= 0)
+				gltWriteCylinder(mesh, baseRadius, topRadius, fLength, numSlices, numStacks);
+			return nMesh;
+			}
+
+		// Upload everything added so far and free the client copies.
+		// No meshes can be added afterwards.
+		void Build(void);
+
+		// Draw list. Draw() submits it and keeps it for the next frame.
+		inline void ClearDraws(void) { draws.clear(); drawData.clear(); }
+		// A mesh number AddMesh() refused (-1) draws nothing.
+		void AddDraw(int nMesh, GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f, GLfloat w = 1.0f) {
+			if(nMesh < 0 || nMesh >= int(meshes.size()))
+				return;
+
+			Command cmd;
+			cmd.nCount = meshes[nMesh].nIndexes;
+			cmd.nInstanceCount = 1;
+			cmd.nFirstIndex = meshes[nMesh].nFirstIndex;
+			cmd.nBaseVertex = 0;
+			cmd.nBaseInstance = GLuint(draws.size());
+			draws.push_back(cmd);
+
+			M3DVector4f vData = { x, y, z, w };
+			drawData.insert(drawData.end(), vData, vData + 4);
+			}
+
+		virtual void Draw(void);
+
+		// One mesh on its own, with the given per-draw data. Out of range
+		// mesh numbers are ignored, as in AddDraw().
+		void DrawMesh(int nMesh, GLfloat x = 0.0f, GLfloat y = 0.0f, GLfloat z = 0.0f, GLfloat w = 1.0f) {
+			if(nMesh < 0 || nMesh >= int(meshes.size()))
+				return;
+
+			glBindVertexArray(vertexArrayObject);
+			if(bMultiDrawIndirect)
+				glDisableVertexAttribArray(GLT_ARENA_ATTRIBUTE_DRAW);
+			glVertexAttrib4f(GLT_ARENA_ATTRIBUTE_DRAW, x, y, z, w);
+			glDrawElements(GL_TRIANGLES, meshes[nMesh].nIndexes, GL_UNSIGNED_INT,
+						   (const GLvoid *)(sizeof(GLuint) * meshes[nMesh].nFirstIndex));
+			if(bMultiDrawIndirect)
+				glEnableVertexAttribArray(GLT_ARENA_ATTRIBUTE_DRAW);
+			glBindVertexArray(0);
+			}
+
+		inline int GetMeshCount(void) const { return int(meshes.size()); }
+		inline GLuint GetIndexCount(int nMesh) const { return meshes[nMesh].nIndexes; }
+		inline int GetDrawCount(void) const { return int(draws.size()); }
+
+		// GL draw calls the last Draw() took
+		inline int GetDrawCalls(void) const { return nDrawCalls; }
+		inline bool IsMultiDrawIndirect(void) const { return bMultiDrawIndirect; }
+
+	protected:
+		struct Mesh {
+			GLuint	nFirstVert;
+			GLuint	nVerts;
+			GLuint	nFirstIndex;
+			GLuint	nIndexes;
+			};
+
+		// Layout fixed by GL_DRAW_INDIRECT_BUFFER
+		struct Command {
+			GLuint	nCount;
+			GLuint	nInstanceCount;
+			GLuint	nFirstIndex;
+			GLint	nBaseVertex;
+			GLuint	nBaseInstance;
+			};
+
+		std::vector<Mesh>		meshes;
+		std::vector<Command>	draws;
+		std::vector<GLfloat>	drawData;		// vec4 per draw
+
+		// Client copies until Build()
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNorms;
+		std::vector<GLfloat>	vTexCoords;
+		std::vector<GLushort>	vIndexes;
+
+		GLuint	uiVertexBuffer;
+		GLuint	uiIndexBuffer;
+		GLuint	uiCommandBuffer;
+		GLuint	uiDrawDataBuffer;
+		GLuint	vertexArrayObject;
+
+		bool	bMultiDrawIndirect;
+		bool	bBuilt;
+		int		nDrawCalls;
+
+	private:
+		GLMeshArena(const GLMeshArena&);
+		GLMeshArena &operator=(const GLMeshArena&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertices are interleaved position, normal, texture coordinate. Indexes
+// become 32 bit and absolute so any draw can use them as they are.
+inline void GLMeshArena::Build(void)
+	{
+	if(bBuilt)
+		return;
+	bBuilt = true;
+
+	GLuint nVerts = GLuint(vVerts.size() / 3);
+	std::vector<GLfloat> vInterleaved(nVerts * 8);
+	for(GLuint v = 0; v < nVerts; v++) {
+		GLfloat *pDst = &vInterleaved[v * 8];
+		pDst[0] = vVerts[v * 3 + 0];
+		pDst[1] = vVerts[v * 3 + 1];
+		pDst[2] = vVerts[v * 3 + 2];
+		pDst[3] = vNorms[v * 3 + 0];
+		pDst[4] = vNorms[v * 3 + 1];
+		pDst[5] = vNorms[v * 3 + 2];
+		pDst[6] = vTexCoords[v * 2 + 0];
+		pDst[7] = vTexCoords[v * 2 + 1];
+		}
+
+	std::vector<GLuint> vRebased(vIndexes.size());
+	for(size_t m = 0; m < meshes.size(); m++)
+		for(GLuint i = 0; i < meshes[m].nIndexes; i++)
+			vRebased[meshes[m].nFirstIndex + i] = meshes[m].nFirstVert + vIndexes[meshes[m].nFirstIndex + i];
+
+	std::vector<GLfloat>().swap(vVerts);
+	std::vector<GLfloat>().swap(vNorms);
+	std::vector<GLfloat>().swap(vTexCoords);
+	std::vector<GLushort>().swap(vIndexes);
+
+	bMultiDrawIndirect = GLEW_AMD_multi_draw_indirect && GLEW_ARB_draw_indirect && GLEW_ARB_base_instance &&
+						 (GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays);
+
+	glGenVertexArrays(1, &vertexArrayObject);
+	glBindVertexArray(vertexArrayObject);
+
+	glGenBuffers(1, &uiVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uiVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vInterleaved.size(), vInterleaved.empty() ? NULL : &vInterleaved[0], GL_STATIC_DRAW);
+
+	GLsizei nStride = sizeof(GLfloat) * 8;
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)0);
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+	glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0);
+	glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 6));
+
+	glGenBuffers(1, &uiIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * vRebased.size(), vRebased.empty() ? NULL : &vRebased[0], GL_STATIC_DRAW);
+
+	if(bMultiDrawIndirect) {
+		// One vec4 per instance. Each command's base instance picks its own.
+		glGenBuffers(1, &uiDrawDataBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, uiDrawDataBuffer);
+		glEnableVertexAttribArray(GLT_ARENA_ATTRIBUTE_DRAW);
+		glVertexAttribPointer(GLT_ARENA_ATTRIBUTE_DRAW, 4, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+		if(GLEW_VERSION_3_3)
+			glVertexAttribDivisor(GLT_ARENA_ATTRIBUTE_DRAW, 1);
+		else
+			glVertexAttribDivisorARB(GLT_ARENA_ATTRIBUTE_DRAW, 1);
+
+		glGenBuffers(1, &uiCommandBuffer);
+		}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLMeshArena::Draw(void)
+	{
+	nDrawCalls = 0;
+	if(draws.empty())
+		return;
+
+	glBindVertexArray(vertexArrayObject);
+
+	if(bMultiDrawIndirect) {
+		// Orphan and refill both lists, they change every frame
+		glBindBuffer(GL_ARRAY_BUFFER, uiDrawDataBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * drawData.size(), &drawData[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, uiCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Command) * draws.size(), &draws[0], GL_STREAM_DRAW);
+		glMultiDrawElementsIndirectAMD(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid *)0, GLsizei(draws.size()), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		nDrawCalls = 1;
+		}
+	else {
+		for(size_t i = 0; i < draws.size(); i++) {
+			glVertexAttrib4fv(GLT_ARENA_ATTRIBUTE_DRAW, &drawData[i * 4]);
+			glDrawElements(GL_TRIANGLES, draws[i].nCount, GL_UNSIGNED_INT,
+						   (const GLvoid *)(sizeof(GLuint) * draws[i].nFirstIndex));
+			}
+		nDrawCalls = int(draws.size());
+		}
+
+	glBindVertexArray(0);
+	}
+
+#endif
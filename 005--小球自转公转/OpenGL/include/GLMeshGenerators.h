@@ -0,0 +1,370 @@
+// GLMeshGenerators.h
+// Direct versions of gltMakeSphere(), gltMakeTorus(), gltMakeDisk() and
+// gltMakeCylinder().
+//
+// The stock generators hand every triangle to GLTriangleBatch::AddTriangle(),
+// which searches all previous vertices for a duplicate. That search makes
+// them quadratic in the vertex count. The shapes here are regular grids, so
+// the vertex and index counts and the index of every vertex are known in
+// advance. These functions write vertices and indexes straight into
+// preallocated arrays and split the rows across the shared job pool.
+// Rebuilding a shape at a different tessellation (for level of detail) then
+// costs about as much as writing the data once.
+//
+// The surfaces, normals and texture coordinates match the stock generators.
+// The only difference is that gltMakeTorus() emits one extra ring of quads
+// on top of the first one, which is not repeated here.
+
+#ifndef __GLT_MESH_GENERATORS
+#define __GLT_MESH_GENERATORS
+
+#include "GLTools.h"
+#include "GLJobSystem.h"
+#include <vector>
+
+// Destination arrays for a generator. The index array holds triangles.
+struct GLTMeshArrays
+	{
+	M3DVector3f	*pVerts;
+	M3DVector3f	*pNorms;
+	M3DVector2f	*pTexCoords;
+	GLushort	*pIndexes;
+	};
+
+// GLTriangleBatch uses 16 bit indexes
+#define GLT_MESH_MAX_VERTS	65536
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Run fn(first, last) over [0, nRows) split into nThreads contiguous ranges.
+// The ranges are jobs on the shared pool; the calling thread does the first
+// one and helps with the rest.
+template <class F>
+inline void gltParallelRows(GLint nRows, GLint nThreads, F fn)
+	{
+	if(nThreads > nRows)
+		nThreads = nRows;
+
+	if(nThreads <= 1) {
+		fn(0, nRows);
+		return;
+		}
+
+	gltGetJobSystem().ParallelFor(nRows, (nRows + nThreads - 1) / nThreads, fn);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared grid helpers. Vertex (row, column) lives at row * nColumns + column.
+
+// Two triangles per quad, in the same winding the stock generators use.
+// a = (row, col), b = (row + 1, col), c = (row, col + 1), d = (row + 1, col + 1)
+inline void gltWriteQuad(GLushort *pIndexes, GLuint a, GLuint b, GLuint c, GLuint d)
+	{
+	pIndexes[0] = GLushort(a); pIndexes[1] = GLushort(b); pIndexes[2] = GLushort(c);
+	pIndexes[3] = GLushort(b); pIndexes[4] = GLushort(d); pIndexes[5] = GLushort(c);
+	}
+
+// Sine and cosine of nSteps + 1 evenly spaced angles over a full circle.
+// The last entry wraps back to exactly angle zero, like the stock code.
+inline void gltMakeCircleTable(std::vector<float>& vSin, std::vector<float>& vCos, GLint nSteps, double dStep)
+	{
+	vSin.resize(nSteps + 1);
+	vCos.resize(nSteps + 1);
+	for(GLint i = 0; i < nSteps; i++) {
+		vSin[i] = float(sin(dStep * i));
+		vCos[i] = float(cos(dStep * i));
+		}
+	vSin[nSteps] = 0.0f;
+	vCos[nSteps] = 1.0f;
+	}
+
+// Fill a batch through a writer. Returns false if the mesh needs more
+// vertices than 16 bit indexes can address.
+template <class W>
+inline bool gltFillTriangleBatch(GLTriangleBatch& batch, GLuint nVerts, GLuint nIndexes, W writer)
+	{
+	if(nVerts > GLT_MESH_MAX_VERTS)
+		return false;
+
+	batch.BeginMesh(nIndexes > nVerts ? nIndexes : nVerts);
+
+	GLTMeshArrays mesh;
+	mesh.pVerts = batch.GetVertexArray();
+	mesh.pNorms = batch.GetNormalArray();
+	mesh.pTexCoords = batch.GetTexCoordArray();
+	mesh.pIndexes = batch.GetIndexArray();
+	writer(mesh);
+
+	batch.SetMeshCounts(nVerts, nIndexes);
+	batch.End();
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Sphere. Poles on the Z axis, rows run from +Z (t = 1) to -Z (t = 0).
+inline void gltSphereMeshSize(GLint iSlices, GLint iStacks, GLuint *nVerts, GLuint *nIndexes)
+	{
+	*nVerts = GLuint((iStacks + 1) * (iSlices + 1));
+	*nIndexes = GLuint(iStacks * iSlices * 6);
+	}
+
+inline void gltWriteSphere(const GLTMeshArrays& mesh, GLfloat fRadius, GLint iSlices, GLint iStacks, GLint nThreads = 1)
+	{
+	std::vector<float> vSin, vCos;
+	gltMakeCircleTable(vSin, vCos, iSlices, 2.0 * M3D_PI / iSlices);
+
+	const GLint nColumns = iSlices + 1;
+	const float *pSin = &vSin[0];
+	const float *pCos = &vCos[0];
+
+	gltParallelRows(iStacks + 1, nThreads, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			double rho = M3D_PI * i / iStacks;
+			float srho = float(sin(rho));
+			float crho = float(cos(rho));
+			float t = 1.0f - float(i) / float(iStacks);
+
+			for(GLint j = 0; j < nColumns; j++) {
+				GLuint v = i * nColumns + j;
+				float x = -pSin[j] * srho;
+				float y = pCos[j] * srho;
+				mesh.pNorms[v][0] = x;
+				mesh.pNorms[v][1] = y;
+				mesh.pNorms[v][2] = crho;
+				mesh.pVerts[v][0] = x * fRadius;
+				mesh.pVerts[v][1] = y * fRadius;
+				mesh.pVerts[v][2] = crho * fRadius;
+				mesh.pTexCoords[v][0] = float(j) / float(iSlices);
+				mesh.pTexCoords[v][1] = t;
+				}
+
+			if(i == iStacks)
+				continue;
+
+			GLushort *pIndex = mesh.pIndexes + i * iSlices * 6;
+			for(GLint j = 0; j < iSlices; j++, pIndex += 6) {
+				GLuint a = i * nColumns + j;
+				gltWriteQuad(pIndex, a, a + nColumns, a + 1, a + nColumns + 1);
+				}
+			}
+		});
+	}
+
+inline bool gltGenerateSphere(GLTriangleBatch& sphereBatch, GLfloat fRadius, GLint iSlices, GLint iStacks, GLint nThreads = 1)
+	{
+	GLuint nVerts, nIndexes;
+	gltSphereMeshSize(iSlices, iStacks, &nVerts, &nIndexes);
+	return gltFillTriangleBatch(sphereBatch, nVerts, nIndexes, [&](const GLTMeshArrays& mesh) {
+		gltWriteSphere(mesh, fRadius, iSlices, iStacks, nThreads);
+		});
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Torus around the Z axis. Rows follow the major circle.
+inline void gltTorusMeshSize(GLint numMajor, GLint numMinor, GLuint *nVerts, GLuint *nIndexes)
+	{
+	*nVerts = GLuint((numMajor + 1) * (numMinor + 1));
+	*nIndexes = GLuint(numMajor * numMinor * 6);
+	}
+
+inline void gltWriteTorus(const GLTMeshArrays& mesh, GLfloat majorRadius, GLfloat minorRadius, GLint numMajor, GLint numMinor, GLint nThreads = 1)
+	{
+	std::vector<float> vSin, vCos;
+	gltMakeCircleTable(vSin, vCos, numMinor, 2.0 * M3D_PI / numMinor);
+
+	const GLint nColumns = numMinor + 1;
+	const float *pSin = &vSin[0];
+	const float *pCos = &vCos[0];
+
+	gltParallelRows(numMajor + 1, nThreads, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			double a = 2.0 * M3D_PI * i / numMajor;
+			float x0 = float(cos(a));
+			float y0 = float(sin(a));
+			float s = float(i) / float(numMajor);
+
+			for(GLint j = 0; j < nColumns; j++) {
+				GLuint v = i * nColumns + j;
+				float c = pCos[j];
+				float r = minorRadius * c + majorRadius;
+				float z = minorRadius * pSin[j];
+
+				mesh.pNorms[v][0] = x0 * c;
+				mesh.pNorms[v][1] = y0 * c;
+				mesh.pNorms[v][2] = pSin[j];
+				m3dNormalizeVector3(mesh.pNorms[v]);
+				mesh.pVerts[v][0] = x0 * r;
+				mesh.pVerts[v][1] = y0 * r;
+				mesh.pVerts[v][2] = z;
+				mesh.pTexCoords[v][0] = s;
+				mesh.pTexCoords[v][1] = float(j) / float(numMinor);
+				}
+
+			if(i == numMajor)
+				continue;
+
+			// Walking the major circle is the "b" direction here
+			GLushort *pIndex = mesh.pIndexes + i * numMinor * 6;
+			for(GLint j = 0; j < numMinor; j++, pIndex += 6) {
+				GLuint a = i * nColumns + j;
+				gltWriteQuad(pIndex, a, a + nColumns, a + 1, a + nColumns + 1);
+				}
+			}
+		});
+	}
+
+inline bool gltGenerateTorus(GLTriangleBatch& torusBatch, GLfloat majorRadius, GLfloat minorRadius, GLint numMajor, GLint numMinor, GLint nThreads = 1)
+	{
+	GLuint nVerts, nIndexes;
+	gltTorusMeshSize(numMajor, numMinor, &nVerts, &nIndexes);
+	return gltFillTriangleBatch(torusBatch, nVerts, nIndexes, [&](const GLTMeshArrays& mesh) {
+		gltWriteTorus(mesh, majorRadius, minorRadius, numMajor, numMinor, nThreads);
+		});
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Disk in the XY plane facing +Z. Texture coordinates come from the
+// position, so the seam is shared and each ring has nSlices vertices. A
+// zero inner radius collapses the first ring into one center vertex.
+inline void gltDiskMeshSize(GLfloat innerRadius, GLint nSlices, GLint nStacks, GLuint *nVerts, GLuint *nIndexes)
+	{
+	GLuint nFirstRing = (innerRadius == 0.0f) ? 1 : nSlices;
+	*nVerts = nFirstRing + GLuint(nStacks * nSlices);
+	*nIndexes = GLuint(nStacks * nSlices * 6);
+	}
+
+inline void gltWriteDisk(const GLTMeshArrays& mesh, GLfloat innerRadius, GLfloat outerRadius, GLint nSlices, GLint nStacks, GLint nThreads = 1)
+	{
+	std::vector<float> vSin, vCos;
+	gltMakeCircleTable(vSin, vCos, nSlices, 2.0 * M3D_PI / nSlices);
+
+	GLfloat fStepSizeRadial = fabsf(outerRadius - innerRadius) / float(nStacks);
+	float fRadialScale = 1.0f / outerRadius;
+	bool bCenter = (innerRadius == 0.0f);
+	const float *pSin = &vSin[0];
+	const float *pCos = &vCos[0];
+
+	// First vertex of a ring, rings wrap around at nSlices
+	struct Ring {
+		GLuint nSlices;
+		bool bCenter;
+		inline GLuint Vertex(GLint i, GLint j) const {
+			if(bCenter)
+				return (i == 0) ? 0 : 1 + (i - 1) * nSlices + (j % nSlices);
+			return i * nSlices + (j % nSlices);
+			}
+		} ring = { GLuint(nSlices), bCenter };
+
+	gltParallelRows(nStacks + 1, nThreads, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			float fRadius = innerRadius + float(i) * fStepSizeRadial;
+			GLint nRingVerts = (bCenter && i == 0) ? 1 : nSlices;
+
+			for(GLint j = 0; j < nRingVerts; j++) {
+				GLuint v = ring.Vertex(i, j);
+				mesh.pVerts[v][0] = pCos[j] * fRadius;
+				mesh.pVerts[v][1] = pSin[j] * fRadius;
+				mesh.pVerts[v][2] = 0.0f;
+				mesh.pNorms[v][0] = 0.0f;
+				mesh.pNorms[v][1] = 0.0f;
+				mesh.pNorms[v][2] = 1.0f;
+				mesh.pTexCoords[v][0] = ((mesh.pVerts[v][0] * fRadialScale) + 1.0f) * 0.5f;
+				mesh.pTexCoords[v][1] = ((mesh.pVerts[v][1] * fRadialScale) + 1.0f) * 0.5f;
+				}
+
+			if(i == nStacks)
+				continue;
+
+			GLushort *pIndex = mesh.pIndexes + i * nSlices * 6;
+			for(GLint j = 0; j < nSlices; j++, pIndex += 6)
+				gltWriteQuad(pIndex, ring.Vertex(i, j), ring.Vertex(i + 1, j),
+							 ring.Vertex(i, j + 1), ring.Vertex(i + 1, j + 1));
+			}
+		});
+	}
+
+inline bool gltGenerateDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerRadius, GLint nSlices, GLint nStacks, GLint nThreads = 1)
+	{
+	GLuint nVerts, nIndexes;
+	gltDiskMeshSize(innerRadius, nSlices, nStacks, &nVerts, &nIndexes);
+	return gltFillTriangleBatch(diskBatch, nVerts, nIndexes, [&](const GLTMeshArrays& mesh) {
+		gltWriteDisk(mesh, innerRadius, outerRadius, nSlices, nStacks, nThreads);
+		});
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Cylinder (or cone) along +Z, from baseRadius at z = 0 to topRadius at
+// z = fLength. Open at both ends.
+inline void gltCylinderMeshSize(GLint numSlices, GLint numStacks, GLuint *nVerts, GLuint *nIndexes)
+	{
+	*nVerts = GLuint((numStacks + 1) * (numSlices + 1));
+	*nIndexes = GLuint(numStacks * numSlices * 6);
+	}
+
+inline void gltWriteCylinder(const GLTMeshArrays& mesh, GLfloat baseRadius, GLfloat topRadius, GLfloat fLength,
+							 GLint numSlices, GLint numStacks, GLint nThreads = 1)
+	{
+	std::vector<float> vSin, vCos;
+	gltMakeCircleTable(vSin, vCos, numSlices, 2.0 * M3D_PI / numSlices);
+
+	float fRadiusStep = (topRadius - baseRadius) / float(numStacks);
+	float zNormal = m3dCloseEnough(baseRadius - topRadius, 0.0f, 0.00001f) ? 0.0f : (baseRadius - topRadius);
+	const GLint nColumns = numSlices + 1;
+	const float *pSin = &vSin[0];
+	const float *pCos = &vCos[0];
+
+	gltParallelRows(numStacks + 1, nThreads, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			float fRadius = baseRadius + fRadiusStep * float(i);
+			float fZ = float(i) * (fLength / float(numStacks));
+			float t = (i == numStacks) ? 1.0f : float(i) / float(numStacks);
+
+			// A cone tip has no direction of its own, the stock code borrows
+			// the normal from the ring below
+			float fNormalRadius = fRadius;
+			if(i > 0 && m3dCloseEnough(fRadius, 0.0f, 0.00001f))
+				fNormalRadius = fRadius - fRadiusStep;
+
+			for(GLint j = 0; j < nColumns; j++) {
+				GLuint v = i * nColumns + j;
+				mesh.pVerts[v][0] = pCos[j] * fRadius;
+				mesh.pVerts[v][1] = pSin[j] * fRadius;
+				mesh.pVerts[v][2] = fZ;
+				mesh.pNorms[v][0] = pCos[j] * fNormalRadius;
+				mesh.pNorms[v][1] = pSin[j] * fNormalRadius;
+				mesh.pNorms[v][2] = zNormal;
+				m3dNormalizeVector3(mesh.pNorms[v]);
+				mesh.pTexCoords[v][0] = (j == numSlices) ? 1.0f : float(j) / float(numSlices);
+				mesh.pTexCoords[v][1] = t;
+				}
+
+			if(i == numStacks)
+				continue;
+
+			// The stock cylinder winds the other way round from the sphere
+			GLushort *pIndex = mesh.pIndexes + i * numSlices * 6;
+			for(GLint j = 0; j < numSlices; j++, pIndex += 6) {
+				GLuint a = i * nColumns + j;
+				gltWriteQuad(pIndex, a + nColumns, a, a + nColumns + 1, a + 1);
+				}
+			}
+		});
+	}
+
+inline bool gltGenerateCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat topRadius, GLfloat fLength,
+								GLint numSlices, GLint numStacks, GLint nThreads = 1)
+	{
+	GLuint nVerts, nIndexes;
+	gltCylinderMeshSize(numSlices, numStacks, &nVerts, &nIndexes);
+	return gltFillTriangleBatch(cylinderBatch, nVerts, nIndexes, [&](const GLTMeshArrays& mesh) {
+		gltWriteCylinder(mesh, baseRadius, topRadius, fLength, numSlices, numStacks, nThreads);
+		});
+	}
+
+
+#endif
@@ -0,0 +1,351 @@
+// GLMeshletBatch.h
+// Triangle batch split into small clusters (meshlets) that are culled one
+// by one on the CPU.
+//
+// GLFrustum::TestSphere() on a whole object keeps all of it as soon as any
+// part is on screen, and it never rejects the half facing away. End()
+// splits the mesh into meshlets of at most 64 vertices and 124 triangles.
+// Each gets a bounding sphere and a cone holding all its triangle normals.
+// Cull() tests every meshlet against the frustum and against its normal
+// cone, which rejects clusters whose triangles all face away from the
+// eye. The triangles that survive are copied into one index buffer that
+// Draw() draws in a single call.
+
+#ifndef __GLT_MESHLET_BATCH
+#define __GLT_MESHLET_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLFrustum.h"
+#include "GLShaderManager.h"
+#include "GLMeshGenerators.h"
+#include <vector>
+
+#define GLT_MESHLET_MAX_VERTS		64
+#define GLT_MESHLET_MAX_TRIANGLES	124
+
+struct GLTMeshlet
+	{
+	M3DVector3f	vCenter;		// Bounding sphere, model space
+	float		fRadius;
+	M3DVector3f	vConeAxis;		// Average facing
+	float		fConeCutoff;	// Sine of the cone's half angle, 1 if it is too wide to cull
+	GLuint		nFirstIndex;	// Triangles in the partitioned index list
+	GLuint		nIndexes;
+	GLuint		nVerts;			// Distinct vertices they use
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Split an indexed triangle list into meshlets, in order. A triangle goes
+// into the current meshlet unless it would push it past nMaxVerts distinct
+// vertices or nMaxTriangles. Generators and most exporters emit triangles
+// in strips of neighbours, so this already gives compact clusters.
+// vIndexes receives the same triangles grouped by meshlet.
+inline void gltBuildMeshlets(const M3DVector3f *pVerts, GLuint nVerts, const GLushort *pIndexes, GLuint nIndexes,
+							 std::vector<GLTMeshlet> &meshlets, std::vector<GLushort> &vIndexes,
+							 GLuint nMaxVerts = GLT_MESHLET_MAX_VERTS, GLuint nMaxTriangles = GLT_MESHLET_MAX_TRIANGLES)
+	{
+	meshlets.clear();
+	vIndexes.assign(pIndexes, pIndexes + nIndexes);
+
+	// Meshlet each vertex was last counted in, so membership is one lookup
+	std::vector<GLuint> vLastMeshlet(nVerts, GLuint(-1));
+
+	GLTMeshlet current;
+	memset(&current, 0, sizeof(current));
+	GLuint nMeshlet = 0;
+	for(GLuint t = 0; t + 2 < nIndexes; t += 3) {
+		// Marking as we count keeps a repeated index from counting twice. If the
+		// triangle starts a new meshlet, the marks left on the old one are
+		// never looked at again.
+		GLuint nNew = 0;
+		for(int k = 0; k < 3; k++)
+			if(vLastMeshlet[pIndexes[t + k]] != nMeshlet) {
+				vLastMeshlet[pIndexes[t + k]] = nMeshlet;
+				nNew++;
+				}
+
+		if(current.nIndexes > 0 &&
+		   (current.nVerts + nNew > nMaxVerts || current.nIndexes / 3 + 1 > nMaxTriangles)) {
+			meshlets.push_back(current);
+			memset(&current, 0, sizeof(current));
+			current.nFirstIndex = t;
+			nMeshlet++;
+
+			nNew = 0;
+			for(int k = 0; k < 3; k++)
+				if(vLastMeshlet[pIndexes[t + k]] != nMeshlet) {
+					vLastMeshlet[pIndexes[t + k]] = nMeshlet;
+					nNew++;
+					}
+			}
+
+		current.nVerts += nNew;
+		current.nIndexes += 3;
+		}
+	if(current.nIndexes > 0)
+		meshlets.push_back(current);
+
+	// Bounds and cones
+	for(size_t m = 0; m < meshlets.size(); m++) {
+		GLTMeshlet &ml = meshlets[m];
+		const GLushort *pTri = &vIndexes[ml.nFirstIndex];
+
+		M3DVector3f vMin, vMax;
+		m3dCopyVector3(vMin, pVerts[pTri[0]]);
+		m3dCopyVector3(vMax, pVerts[pTri[0]]);
+		for(GLuint i = 1; i < ml.nIndexes; i++)
+			for(int c = 0; c < 3; c++) {
+				if(pVerts[pTri[i]][c] < vMin[c]) vMin[c] = pVerts[pTri[i]][c];
+				if(pVerts[pTri[i]][c] > vMax[c]) vMax[c] = pVerts[pTri[i]][c];
+				}
+		for(int c = 0; c < 3; c++)
+			ml.vCenter[c] = (vMin[c] + vMax[c]) * 0.5f;
+
+		float fRadius2 = 0.0f;
+		for(GLuint i = 0; i < ml.nIndexes; i++) {
+			float fDist2 = m3dGetDistanceSquared3(ml.vCenter, pVerts[pTri[i]]);
+			if(fDist2 > fRadius2)
+				fRadius2 = fDist2;
+			}
+		ml.fRadius = sqrtf(fRadius2);
+
+		// Face normals from the winding, so the test matches what glCullFace sees
+		std::vector<float> vFaceNormals(ml.nIndexes);
+		M3DVector3f vAxis = { 0.0f, 0.0f, 0.0f };
+		GLuint nFaces = 0;
+		for(GLuint i = 0; i < ml.nIndexes; i += 3) {
+			M3DVector3f vNormal;
+			m3dFindNormal(vNormal, pVerts[pTri[i]], pVerts[pTri[i + 1]], pVerts[pTri[i + 2]]);
+			float fLength = m3dGetVectorLength3(vNormal);
+			if(fLength <= 0.0f)
+				continue;								// Degenerate, never drawn
+			m3dScaleVector3(vNormal, 1.0f / fLength);
+			memcpy(&vFaceNormals[nFaces * 3], vNormal, sizeof(M3DVector3f));
+			m3dAddVectors3(vAxis, vAxis, vNormal);
+			nFaces++;
+			}
+
+		ml.fConeCutoff = 1.0f;
+		m3dLoadVector3(ml.vConeAxis, 0.0f, 0.0f, 1.0f);
+		float fAxisLength = m3dGetVectorLength3(vAxis);
+		if(nFaces == 0 || fAxisLength <= 0.0f)
+			continue;
+
+		m3dScaleVector3(vAxis, 1.0f / fAxisLength);
+		m3dCopyVector3(ml.vConeAxis, vAxis);
+
+		float fMinDot = 1.0f;
+		for(GLuint f = 0; f < nFaces; f++) {
+			float fDot = m3dDotProduct3(vAxis, &vFaceNormals[f * 3]);
+			if(fDot < fMinDot)
+				fMinDot = fDot;
+			}
+
+		// A cone of 90 degrees or more has triangles facing every way
+		if(fMinDot > 0.0f)
+			ml.fConeCutoff = sqrtf(1.0f - fMinDot * fMinDot);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLMeshletBatch : public GLBatchBase
+	{
+	public:
+		GLMeshletBatch(void) {
+			uiVertexBuffer = 0;
+			uiIndexBuffer = 0;
+			vertexArrayObject = 0;
+			nNumVerts = 0;
+			nVisibleIndexes = 0;
+			nVisibleMeshlets = 0;
+			}
+
+		virtual ~GLMeshletBatch(void) {
+			if(uiVertexBuffer != 0) glDeleteBuffers(1, &uiVertexBuffer);
+			if(uiIndexBuffer != 0) glDeleteBuffers(1, &uiIndexBuffer);
+			if(vertexArrayObject != 0) glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		// Float arrays to fill, for instance with gltWriteSphere()
+		GLTMeshArrays BeginMesh(GLuint nVerts, GLuint nIndexes) {
+			nNumVerts = nVerts;
+			vVerts.assign(nVerts * 3, 0.0f);
+			vNorms.assign(nVerts * 3, 0.0f);
+			vTexCoords.assign(nVerts * 2, 0.0f);
+			vSource.assign(nIndexes, 0);
+
+			GLTMeshArrays mesh;
+			mesh.pVerts = (M3DVector3f *)&vVerts[0];
+			mesh.pNorms = (M3DVector3f *)&vNorms[0];
+			mesh.pTexCoords = (M3DVector2f *)&vTexCoords[0];
+			mesh.pIndexes = &vSource[0];
+			return mesh;
+			}
+
+		// Partition and upload the vertices. Until the first Cull() the whole
+		// mesh is drawn.
+		void End(void);
+
+		// Keep the meshlets that can be seen. frustum must already be
+		// Transform()ed by the camera. mModel places the mesh in the same
+		// space as the frustum and vEye, and may rotate, translate and scale.
+		// Returns the number of triangles kept.
+		GLuint Cull(GLFrustum &frustum, const M3DMatrix44f mModel, const M3DVector3f vEye);
+
+		virtual void Draw(void) {
+			if(nVisibleIndexes == 0)
+				return;
+			glBindVertexArray(vertexArrayObject);
+			glDrawElements(GL_TRIANGLES, nVisibleIndexes, GL_UNSIGNED_SHORT, 0);
+			glBindVertexArray(0);
+			}
+
+		inline GLuint GetMeshletCount(void) const { return GLuint(meshlets.size()); }
+		inline const GLTMeshlet &GetMeshlet(GLuint i) const { return meshlets[i]; }
+		inline GLuint GetVisibleMeshletCount(void) const { return nVisibleMeshlets; }
+		inline GLuint GetVisibleTriangleCount(void) const { return nVisibleIndexes / 3; }
+		inline GLuint GetTriangleCount(void) const { return GLuint(vPartitioned.size() / 3); }
+
+	protected:
+		GLuint	uiVertexBuffer;
+		GLuint	uiIndexBuffer;
+		GLuint	vertexArrayObject;
+		GLuint	nNumVerts;
+		GLuint	nVisibleIndexes;
+		GLuint	nVisibleMeshlets;
+
+		std::vector<GLTMeshlet>	meshlets;
+		std::vector<GLushort>	vPartitioned;	// All triangles, grouped by meshlet
+		std::vector<GLushort>	vVisible;		// This frame's survivors
+
+		// Client copies until End()
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNorms;
+		std::vector<GLfloat>	vTexCoords;
+		std::vector<GLushort>	vSource;
+
+	private:
+		GLMeshletBatch(const GLMeshletBatch&);
+		GLMeshletBatch &operator=(const GLMeshletBatch&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertices are interleaved position, normal, texture coordinate, as in
+// GLMeshArena.
+inline void GLMeshletBatch::End(void)
+	{
+	gltBuildMeshlets((const M3DVector3f *)&vVerts[0], nNumVerts, &vSource[0], GLuint(vSource.size()), meshlets, vPartitioned);
+	vVisible.resize(vPartitioned.size());
+
+	std::vector<GLfloat> vInterleaved(nNumVerts * 8);
+	for(GLuint v = 0; v < nNumVerts; v++) {
+		memcpy(&vInterleaved[v * 8], &vVerts[v * 3], sizeof(GLfloat) * 3);
+		memcpy(&vInterleaved[v * 8 + 3], &vNorms[v * 3], sizeof(GLfloat) * 3);
+		memcpy(&vInterleaved[v * 8 + 6], &vTexCoords[v * 2], sizeof(GLfloat) * 2);
+		}
+
+	if(vertexArrayObject == 0) {
+		glGenVertexArrays(1, &vertexArrayObject);
+		glGenBuffers(1, &uiVertexBuffer);
+		glGenBuffers(1, &uiIndexBuffer);
+		}
+	glBindVertexArray(vertexArrayObject);
+
+	glBindBuffer(GL_ARRAY_BUFFER, uiVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vInterleaved.size(), vInterleaved.empty() ? NULL : &vInterleaved[0], GL_STATIC_DRAW);
+
+	GLsizei nStride = sizeof(GLfloat) * 8;
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)0);
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+	glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0);
+	glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 6));
+
+	// Sized for the whole mesh, refilled by every Cull()
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * vPartitioned.size(), vPartitioned.empty() ? NULL : &vPartitioned[0], GL_STREAM_DRAW);
+	nVisibleIndexes = GLuint(vPartitioned.size());
+	nVisibleMeshlets = GLuint(meshlets.size());
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	std::vector<GLfloat>().swap(vVerts);
+	std::vector<GLfloat>().swap(vNorms);
+	std::vector<GLfloat>().swap(vTexCoords);
+	std::vector<GLushort>().swap(vSource);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A meshlet faces away when every point of its bounding sphere sees the
+// back of every triangle in its cone:
+//	dot(center - eye, axis) >= cutoff * |center - eye| + radius
+inline GLuint GLMeshletBatch::Cull(GLFrustum &frustum, const M3DMatrix44f mModel, const M3DVector3f vEye)
+	{
+	// Largest axis scale, for the radii
+	float fScale2 = 0.0f;
+	for(int c = 0; c < 3; c++) {
+		float fLen2 = mModel[c * 4] * mModel[c * 4] + mModel[c * 4 + 1] * mModel[c * 4 + 1] + mModel[c * 4 + 2] * mModel[c * 4 + 2];
+		if(fLen2 > fScale2)
+			fScale2 = fLen2;
+		}
+	float fScale = sqrtf(fScale2);
+
+	// Normals rotate with the inverse transpose. For rotation and uniform scale
+	// that is the upper 3x3 itself, renormalized. Non-uniform scale widens
+	// the cones, so leave cone culling off then.
+	M3DMatrix33f mRotation;
+	m3dExtractRotationMatrix33(mRotation, mModel);
+	bool bUniform = true;
+	for(int c = 0; c < 3; c++) {
+		float fLen = m3dGetVectorLength3(&mRotation[c * 3]);
+		if(fabsf(fLen - fScale) > fScale * 0.001f)
+			bUniform = false;
+		if(fLen > 0.0f)
+			m3dScaleVector3(&mRotation[c * 3], 1.0f / fLen);
+		}
+
+	GLuint nOut = 0;
+	nVisibleMeshlets = 0;
+	for(size_t m = 0; m < meshlets.size(); m++) {
+		const GLTMeshlet &ml = meshlets[m];
+		M3DVector3f vCenter;
+		m3dTransformVector3(vCenter, ml.vCenter, mModel);
+		float fRadius = ml.fRadius * fScale;
+
+		if(!frustum.TestSphere(vCenter, fRadius))
+			continue;
+
+		if(bUniform && ml.fConeCutoff < 1.0f) {
+			M3DVector3f vAxis, vToCenter;
+			m3dRotateVector(vAxis, ml.vConeAxis, mRotation);
+			m3dSubtractVectors3(vToCenter, vCenter, vEye);
+			if(m3dDotProduct3(vToCenter, vAxis) >= ml.fConeCutoff * m3dGetVectorLength3(vToCenter) + fRadius)
+				continue;
+			}
+
+		memcpy(&vVisible[nOut], &vPartitioned[ml.nFirstIndex], sizeof(GLushort) * ml.nIndexes);
+		nOut += ml.nIndexes;
+		nVisibleMeshlets++;
+		}
+	nVisibleIndexes = nOut;
+
+	// Orphan, then write only what is drawn. The index buffer binding belongs
+	// to the vertex array object, so go through it.
+	if(nOut > 0) {
+		glBindVertexArray(vertexArrayObject);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * vPartitioned.size(), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * nOut, &vVisible[0]);
+		glBindVertexArray(0);
+		}
+	return nOut / 3;
+	}
+
+#endif
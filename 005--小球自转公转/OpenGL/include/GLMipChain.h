@@ -0,0 +1,435 @@
+// GLMipChain.h
+// Mipmap chains built on the CPU.
+//
+// glGenerateMipmap() (glGenerateMipmapEXT on the Mac) leaves the filter to
+// the driver. With the usual GL_RGB and GL_RGBA formats it averages the
+// stored bytes, which are sRGB encoded, as if they were linear. That
+// darkens edges and fine detail in every smaller level.
+// GLMipChain builds the chain itself, for baking into asset files or for
+// contexts without glGenerateMipmap():
+//	- Input is what gltReadTGABits() and GLImageFile return: GL_BGR,
+//	  GL_BGRA, GL_RGB, GL_RGBA or GL_LUMINANCE bytes, bottom row first.
+//	- With bSRGB the colour channels are decoded to linear light through a
+//	  table, filtered, and encoded back. Alpha is always linear.
+//	- GLT_MIP_BOX averages 2 x 2 texels. A source size that is odd uses
+//	  the exact three tap box for that axis, so no texel is dropped or
+//	  counted twice (non power of two textures keep their full weight).
+//	  GLT_MIP_KAISER is a Kaiser windowed sinc reaching three texels of the
+//	  smaller level to each side. It keeps more detail, and can ring
+//	  slightly at hard edges.
+//	- Each level is filtered from the previous one while that is still in
+//	  linear floats, so rounding does not pile up down the chain. Pixels are
+//	  held as four floats and filtered with SSE, one pixel per register.
+//	- Rows of a level are split over the shared job pool. Each level needs
+//	  the one before it, so the levels themselves run in order.
+//
+// GetData() is every level back to back, rows tightly packed, in the
+// format that went in. TexImage2D() uploads the levels with the usual
+// unsized internal formats, so the bytes are still sRGB encoded.
+
+#ifndef __GLT_MIP_CHAIN
+#define __GLT_MIP_CHAIN
+
+#include "GLTools.h"
+#include "GLJobSystem.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLT_MIP_CHAIN_SSE
+#endif
+
+#define GLT_MIP_MAX_LEVELS		16
+#define GLT_MIP_KAISER_WIDTH	3.0f		// Half width, in texels of the smaller level
+#define GLT_MIP_KAISER_ALPHA	4.0f
+
+enum GLT_MIP_FILTER { GLT_MIP_BOX, GLT_MIP_KAISER };
+
+struct GLTMipLevel
+	{
+	int			nWidth;
+	int			nHeight;
+	size_t		nOffset;			// Into GetData()
+	size_t		nSize;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLMipChain
+	{
+	public:
+		GLMipChain(void) {
+			nLevels = 0;
+			nBytes = 0;
+			bColourSRGB = true;
+			eFormat = GL_RGBA;
+			nComponents = GL_RGBA;
+			}
+
+		// nMaxLevels of 0 goes down to 1 x 1. nThreads of 0 uses the whole
+		// job pool.
+		bool Build(const GLbyte *pBits, int nWidth, int nHeight, GLenum eFormat, int nAlignment = 1,
+				   GLT_MIP_FILTER filter = GLT_MIP_BOX, bool bSRGB = true, int nMaxLevels = 0, int nThreads = 0);
+
+		inline int GetLevelCount(void) const { return nLevels; }
+		inline const GLTMipLevel &GetLevel(int nLevel) const { return levels[nLevel]; }
+		inline const GLbyte *GetPixels(int nLevel) const { return (const GLbyte *)&vData[levels[nLevel].nOffset]; }
+		inline const std::vector<unsigned char> &GetData(void) const { return vData; }
+		inline GLenum GetFormat(void) const { return eFormat; }
+		inline GLint GetComponents(void) const { return nComponents; }
+
+		// Every level into the bound texture, and GL_TEXTURE_MAX_LEVEL to match
+		void TexImage2D(GLenum target = GL_TEXTURE_2D) const;
+
+	protected:
+		// Source texels and weights for each texel of the smaller size.
+		// Every texel has nTaps of them, unused ones weigh nothing.
+		struct Taps
+			{
+			int					nTaps;
+			std::vector<int>	vIndex;
+			std::vector<float>	vWeight;
+			};
+
+		static void MakeTaps(int nSource, int nDest, GLT_MIP_FILTER filter, Taps &taps);
+		static float BesselI0(float x);
+
+		void DecodeRow(const unsigned char *pIn, float *pOut, int nWidth) const;
+		void EncodeRow(const float *pIn, unsigned char *pOut, int nWidth) const;
+		void Downsample(const float *pSource, const unsigned char *pSourceBytes, size_t nSourceStride,
+						int nWidth, int nHeight, int nDestWidth, int nDestHeight,
+						float *pDest, unsigned char *pDestBytes, GLT_MIP_FILTER filter, int nThreads) const;
+
+		int							nLevels;
+		GLTMipLevel					levels[GLT_MIP_MAX_LEVELS];
+		std::vector<unsigned char>	vData;
+		GLenum						eFormat;
+		GLint						nComponents;
+		int							nBytes;			// Per texel
+		bool						bColourSRGB;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// sRGB <-> linear. Decoding is a straight table. Encoding indexes a table by
+// the square root of the linear value, which spreads the dark end out to
+// about the resolution sRGB itself has there.
+struct GLTSRGBTables
+	{
+	float			vToLinear[256];
+	float			vToFloat[256];		// Plain bytes, for alpha and non sRGB data
+	unsigned char	vToSRGB[4096];
+
+	GLTSRGBTables(void) {
+		for(int i = 0; i < 256; i++) {
+			float s = i / 255.0f;
+			vToLinear[i] = (s <= 0.04045f) ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+			vToFloat[i] = s;
+			}
+		for(int i = 0; i < 4096; i++) {
+			float r = i / 4095.0f, v = r * r;
+			float s = (v <= 0.0031308f) ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+			vToSRGB[i] = (unsigned char)std::min(std::max(int(s * 255.0f + 0.5f), 0), 255);
+			}
+		}
+	};
+
+inline const GLTSRGBTables &gltGetSRGBTables(void)
+	{
+	static const GLTSRGBTables tables;
+	return tables;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLMipChain::Build(const GLbyte *pBits, int nWidth, int nHeight, GLenum eFormatIn, int nAlignment,
+							  GLT_MIP_FILTER filter, bool bSRGB, int nMaxLevels, int nThreads)
+	{
+	nLevels = 0;
+	vData.clear();
+	if(pBits == NULL || nWidth <= 0 || nHeight <= 0)
+		return false;
+
+	switch(eFormatIn) {
+		case GL_LUMINANCE: nBytes = 1; nComponents = GL_LUMINANCE; break;
+		case GL_BGR: case GL_RGB: nBytes = 3; nComponents = GL_RGB; break;
+		case GL_BGRA: case GL_RGBA: nBytes = 4; nComponents = GL_RGBA; break;
+		default: return false;
+		}
+	eFormat = eFormatIn;
+	bColourSRGB = bSRGB;
+	if(nThreads <= 0)
+		nThreads = gltGetJobSystem().GetThreadCount();
+
+	if(nMaxLevels <= 0 || nMaxLevels > GLT_MIP_MAX_LEVELS)
+		nMaxLevels = GLT_MIP_MAX_LEVELS;
+
+	// Lay out the whole chain first, so vData is allocated once
+	int w = nWidth, h = nHeight;
+	size_t nTotal = 0;
+	for(;;) {
+		GLTMipLevel &level = levels[nLevels++];
+		level.nWidth = w;
+		level.nHeight = h;
+		level.nOffset = nTotal;
+		level.nSize = size_t(w) * h * nBytes;
+		nTotal += level.nSize;
+		if((w == 1 && h == 1) || nLevels == nMaxLevels)
+			break;
+		w = std::max(w / 2, 1);
+		h = std::max(h / 2, 1);
+		}
+	vData.resize(nTotal);
+
+	// Level 0 is the input with its row padding dropped
+	size_t nStride = ((size_t(nWidth) * nBytes + nAlignment - 1) / nAlignment) * nAlignment;
+	for(int y = 0; y < nHeight; y++)
+		memcpy(&vData[size_t(y) * nWidth * nBytes], (const unsigned char *)pBits + nStride * y, size_t(nWidth) * nBytes);
+
+	// Two linear float levels, the one being read and the one being written.
+	// Level 0 is decoded a row at a time as it is read instead.
+	std::vector<float> vSource, vDest;
+	for(int i = 1; i < nLevels; i++) {
+		const GLTMipLevel &from = levels[i - 1], &to = levels[i];
+		if(i + 1 < nLevels)
+			vDest.resize(size_t(to.nWidth) * to.nHeight * 4);
+		Downsample(i == 1 ? NULL : &vSource[0], i == 1 ? &vData[0] : NULL, size_t(from.nWidth) * nBytes,
+				   from.nWidth, from.nHeight, to.nWidth, to.nHeight,
+				   (i + 1 < nLevels) ? &vDest[0] : NULL, &vData[to.nOffset], filter, nThreads);
+		vSource.swap(vDest);
+		}
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline float GLMipChain::BesselI0(float x)
+	{
+	// Power series, converges quickly for the small arguments used here
+	float fSum = 1.0f, fTerm = 1.0f, fHalf = x * 0.5f;
+	for(int k = 1; k < 32; k++) {
+		fTerm *= (fHalf / k) * (fHalf / k);
+		fSum += fTerm;
+		if(fTerm < fSum * 1e-7f)
+			break;
+		}
+	return fSum;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLMipChain::MakeTaps(int nSource, int nDest, GLT_MIP_FILTER filter, Taps &taps)
+	{
+	// Nothing to filter along an axis that is already one texel
+	if(nSource == nDest) {
+		taps.nTaps = 1;
+		taps.vIndex.resize(nDest);
+		taps.vWeight.assign(nDest, 1.0f);
+		for(int i = 0; i < nDest; i++)
+			taps.vIndex[i] = i;
+		return;
+		}
+
+	if(filter == GLT_MIP_BOX) {
+		bool bOdd = (nSource & 1) != 0;
+		taps.nTaps = bOdd ? 3 : 2;
+		taps.vIndex.resize(size_t(nDest) * taps.nTaps);
+		taps.vWeight.resize(size_t(nDest) * taps.nTaps);
+		for(int i = 0; i < nDest; i++) {
+			int *pIndex = &taps.vIndex[size_t(i) * taps.nTaps];
+			float *pWeight = &taps.vWeight[size_t(i) * taps.nTaps];
+			pIndex[0] = 2 * i;
+			pIndex[1] = 2 * i + 1;
+			if(!bOdd) {
+				pWeight[0] = pWeight[1] = 0.5f;
+				continue;
+				}
+
+			// Texel i covers source texels [i * s, (i + 1) * s) with
+			// s = nSource / nDest, a little over two
+			float fScale = 1.0f / nSource;
+			pIndex[2] = 2 * i + 2;
+			pWeight[0] = float(nDest - i) * fScale;
+			pWeight[1] = float(nDest) * fScale;
+			pWeight[2] = float(i + 1) * fScale;
+			}
+		return;
+		}
+
+	// Kaiser windowed sinc, cut off at the smaller level's Nyquist limit
+	float fRatio = float(nSource) / nDest;
+	float fRadius = GLT_MIP_KAISER_WIDTH * fRatio;
+	float fNorm = 1.0f / BesselI0(GLT_MIP_KAISER_ALPHA);
+	taps.nTaps = int(ceilf(fRadius * 2.0f)) + 1;
+	taps.vIndex.resize(size_t(nDest) * taps.nTaps);
+	taps.vWeight.resize(size_t(nDest) * taps.nTaps);
+	for(int i = 0; i < nDest; i++) {
+		int *pIndex = &taps.vIndex[size_t(i) * taps.nTaps];
+		float *pWeight = &taps.vWeight[size_t(i) * taps.nTaps];
+		float fCenter = (i + 0.5f) * fRatio - 0.5f;
+		int nFirst = int(floorf(fCenter - fRadius)) + 1;
+		float fSum = 0.0f;
+		for(int k = 0; k < taps.nTaps; k++) {
+			float x = (nFirst + k - fCenter) / fRatio;
+			float fWeight = 0.0f;
+			if(fabsf(x) < GLT_MIP_KAISER_WIDTH) {
+				float fSinc = (fabsf(x) < 1e-5f) ? 1.0f : sinf(float(M3D_PI) * x) / (float(M3D_PI) * x);
+				float t = x / GLT_MIP_KAISER_WIDTH;
+				fWeight = fSinc * BesselI0(GLT_MIP_KAISER_ALPHA * sqrtf(1.0f - t * t)) * fNorm;
+				}
+
+			// Clamp to the edge, as the texture would sample it
+			pIndex[k] = std::min(std::max(nFirst + k, 0), nSource - 1);
+			pWeight[k] = fWeight;
+			fSum += fWeight;
+			}
+		for(int k = 0; k < taps.nTaps; k++)
+			pWeight[k] /= fSum;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Bytes to four linear floats per texel
+inline void GLMipChain::DecodeRow(const unsigned char *pIn, float *pOut, int nWidth) const
+	{
+	const GLTSRGBTables &tables = gltGetSRGBTables();
+	const float *pColour = bColourSRGB ? tables.vToLinear : tables.vToFloat;
+	for(int x = 0; x < nWidth; x++, pIn += nBytes, pOut += 4) {
+		pOut[0] = pColour[pIn[0]];
+		pOut[1] = (nBytes >= 3) ? pColour[pIn[1]] : 0.0f;
+		pOut[2] = (nBytes >= 3) ? pColour[pIn[2]] : 0.0f;
+		pOut[3] = (nBytes == 4) ? tables.vToFloat[pIn[3]] : 1.0f;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Four linear floats per texel back to bytes
+inline void GLMipChain::EncodeRow(const float *pIn, unsigned char *pOut, int nWidth) const
+	{
+	const unsigned char *pToSRGB = gltGetSRGBTables().vToSRGB;
+	for(int x = 0; x < nWidth; x++, pIn += 4, pOut += nBytes) {
+		int vColour[4], vPlain[4];
+#ifdef GLT_MIP_CHAIN_SSE
+		__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		_mm_storeu_si128((__m128i *)vColour, _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(v), _mm_set1_ps(4095.0f))));
+		_mm_storeu_si128((__m128i *)vPlain, _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f))));
+#else
+		for(int c = 0; c < 4; c++) {
+			float v = std::min(std::max(pIn[c], 0.0f), 1.0f);
+			vColour[c] = int(sqrtf(v) * 4095.0f + 0.5f);
+			vPlain[c] = int(v * 255.0f + 0.5f);
+			}
+#endif
+		int nColour = (nBytes >= 3) ? 3 : 1;
+		for(int c = 0; c < nColour; c++)
+			pOut[c] = bColourSRGB ? pToSRGB[vColour[c]] : (unsigned char)vPlain[c];
+		if(nBytes == 4)
+			pOut[3] = (unsigned char)vPlain[3];
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// One level from the previous. The source is pSource (linear floats) or,
+// for level 0, pSourceBytes. Each job takes a band of destination rows and
+// filters just the source rows the band needs across, then down.
+inline void GLMipChain::Downsample(const float *pSource, const unsigned char *pSourceBytes, size_t nSourceStride,
+								   int nWidth, int nHeight, int nDestWidth, int nDestHeight,
+								   float *pDest, unsigned char *pDestBytes, GLT_MIP_FILTER filter, int nThreads) const
+	{
+	Taps across, down;
+	MakeTaps(nWidth, nDestWidth, filter, across);
+	MakeTaps(nHeight, nDestHeight, filter, down);
+
+	// A few bands per thread to even out the load, but not so thin that the
+	// rows shared between bands dominate
+	GLint nGrain = std::max(nDestHeight / std::max(nThreads * 4, 1), 8);
+	if(nThreads <= 1)
+		nGrain = nDestHeight;
+
+	gltGetJobSystem().ParallelFor(nDestHeight, nGrain, [&](GLint iFirst, GLint iLast) {
+		int nFirstRow = nHeight, nLastRow = 0;
+		for(size_t t = size_t(iFirst) * down.nTaps; t < size_t(iLast) * down.nTaps; t++) {
+			nFirstRow = std::min(nFirstRow, down.vIndex[t]);
+			nLastRow = std::max(nLastRow, down.vIndex[t]);
+			}
+
+		std::vector<float> vAcross(size_t(nLastRow - nFirstRow + 1) * nDestWidth * 4);
+		std::vector<float> vDecoded(pSource == NULL ? size_t(nWidth) * 4 : 0);
+		std::vector<float> vRow(pDest == NULL ? size_t(nDestWidth) * 4 : 0);
+
+		for(int y = nFirstRow; y <= nLastRow; y++) {
+			const float *pIn;
+			if(pSource != NULL)
+				pIn = pSource + size_t(y) * nWidth * 4;
+			else {
+				DecodeRow(pSourceBytes + nSourceStride * y, &vDecoded[0], nWidth);
+				pIn = &vDecoded[0];
+				}
+
+			float *pOut = &vAcross[size_t(y - nFirstRow) * nDestWidth * 4];
+			for(int x = 0; x < nDestWidth; x++, pOut += 4) {
+				const int *pIndex = &across.vIndex[size_t(x) * across.nTaps];
+				const float *pWeight = &across.vWeight[size_t(x) * across.nTaps];
+#ifdef GLT_MIP_CHAIN_SSE
+				__m128 vSum = _mm_setzero_ps();
+				for(int k = 0; k < across.nTaps; k++)
+					vSum = _mm_add_ps(vSum, _mm_mul_ps(_mm_loadu_ps(pIn + pIndex[k] * 4), _mm_set1_ps(pWeight[k])));
+				_mm_storeu_ps(pOut, vSum);
+#else
+				pOut[0] = pOut[1] = pOut[2] = pOut[3] = 0.0f;
+				for(int k = 0; k < across.nTaps; k++)
+					for(int c = 0; c < 4; c++)
+						pOut[c] += pIn[pIndex[k] * 4 + c] * pWeight[k];
+#endif
+				}
+			}
+
+		for(GLint y = iFirst; y < iLast; y++) {
+			const int *pIndex = &down.vIndex[size_t(y) * down.nTaps];
+			const float *pWeight = &down.vWeight[size_t(y) * down.nTaps];
+			float *pOut = (pDest != NULL) ? pDest + size_t(y) * nDestWidth * 4 : &vRow[0];
+			for(int x = 0; x < nDestWidth; x++) {
+				const float *pIn = &vAcross[size_t(x) * 4];
+#ifdef GLT_MIP_CHAIN_SSE
+				__m128 vSum = _mm_setzero_ps();
+				for(int k = 0; k < down.nTaps; k++)
+					vSum = _mm_add_ps(vSum, _mm_mul_ps(_mm_loadu_ps(pIn + size_t(pIndex[k] - nFirstRow) * nDestWidth * 4),
+													   _mm_set1_ps(pWeight[k])));
+				_mm_storeu_ps(pOut + x * 4, vSum);
+#else
+				float *pTexel = pOut + x * 4;
+				pTexel[0] = pTexel[1] = pTexel[2] = pTexel[3] = 0.0f;
+				for(int k = 0; k < down.nTaps; k++)
+					for(int c = 0; c < 4; c++)
+						pTexel[c] += pIn[size_t(pIndex[k] - nFirstRow) * nDestWidth * 4 + c] * pWeight[k];
+#endif
+				}
+			EncodeRow(pOut, pDestBytes + size_t(y) * nDestWidth * nBytes, nDestWidth);
+			}
+		});
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLMipChain::TexImage2D(GLenum target) const
+	{
+	if(nLevels == 0)
+		return;
+
+	GLint nOldAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &nOldAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for(int i = 0; i < nLevels; i++)
+		glTexImage2D(target, i, nComponents, levels[i].nWidth, levels[i].nHeight, 0,
+					 eFormat, GL_UNSIGNED_BYTE, &vData[levels[i].nOffset]);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nLevels - 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, nOldAlignment);
+	}
+
+#endif
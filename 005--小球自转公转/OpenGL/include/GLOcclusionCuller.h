@@ -0,0 +1,145 @@
+// GLOcclusionCuller.h
+// Software occlusion culling with a small CPU depth buffer.
+//
+// GLFrustum only rejects objects outside the view volume. This class also
+// rejects objects hidden behind others. Each frame:
+//  1. BeginFrame() clears the depth buffer.
+//  2. AddOccluder() rasterizes simplified occluder meshes with GLDepthRaster.
+//  3. IsVisible() tests an object's bounding box against the result before
+//     its draw is submitted.
+// IsVisible() only reads, so the tests can run on worker threads (for
+// example inside GLCommandRecorder::Record()) once the occluders are in.
+//
+// The test is conservative except at occluder silhouettes. A box is
+// visible when any pixel under its screen rectangle is farther than the box's
+// nearest corner, and boxes crossing the near plane are always visible.
+// Occluders should lie inside the object they stand for. A low
+// tessellation of a sphere from gltWriteSphere() does, because its
+// vertices are on the sphere. The buffer is coarse, so a pixel whose center
+// is covered counts as fully covered. An object peeking out by less than
+// a pixel at an occluder's edge can therefore be culled; a larger buffer
+// makes that rarer.
+
+#ifndef __GLT_OCCLUSION_CULLER
+#define __GLT_OCCLUSION_CULLER
+
+#include "GLTools.h"
+#include "GLDepthRaster.h"
+#include <atomic>
+
+class GLOcclusionCuller
+	{
+	public:
+		GLOcclusionCuller(int nWidth = 256, int nHeight = 128) {
+			depthRaster.SetSize(nWidth, nHeight);
+			nOccluders = 0;
+			ResetStats();
+			}
+
+		inline void SetSize(int nWidth, int nHeight) { depthRaster.SetSize(nWidth, nHeight); }
+
+		inline void BeginFrame(void) {
+			depthRaster.Clear();
+			nOccluders = 0;
+			}
+
+		// Triangle meshes only. mvp takes the mesh to clip space.
+		inline void AddOccluder(const GLSoftMesh &mesh, const M3DMatrix44f mvp) {
+			depthRaster.DrawMesh(mesh, mvp);
+			nOccluders++;
+			}
+
+		// Axis aligned box in object space. Thread safe between
+		// AddOccluder() calls.
+		bool IsVisible(const M3DVector3f vMin, const M3DVector3f vMax, const M3DMatrix44f mvp) const;
+
+		inline GLuint GetOccluderCount(void) const { return nOccluders; }
+		inline const GLDepthRaster &GetDepthRaster(void) const { return depthRaster; }
+		inline GLDepthRaster &GetDepthRaster(void) { return depthRaster; }
+
+		inline GLuint GetTestCount(void) const { return nTests.load(); }
+		inline GLuint GetOccludedCount(void) const { return nOccluded.load(); }
+		inline void ResetStats(void) { nTests = 0; nOccluded = 0; }
+
+	protected:
+		bool TestRect(GLfloat fMinX, GLfloat fMinY, GLfloat fMaxX, GLfloat fMaxY, GLfloat fNearZ) const;
+
+		GLDepthRaster	depthRaster;
+		GLuint			nOccluders;
+
+		mutable std::atomic<GLuint>	nTests;
+		mutable std::atomic<GLuint>	nOccluded;
+
+	private:
+		GLOcclusionCuller(const GLOcclusionCuller&);
+		GLOcclusionCuller &operator=(const GLOcclusionCuller&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLOcclusionCuller::IsVisible(const M3DVector3f vMin, const M3DVector3f vMax, const M3DMatrix44f mvp) const
+	{
+	if(nOccluders == 0)
+		return true;
+	nTests++;
+
+	int nWidth = depthRaster.GetWidth(), nHeight = depthRaster.GetHeight();
+	GLfloat fMinX = GLfloat(nWidth), fMinY = GLfloat(nHeight), fMaxX = 0.0f, fMaxY = 0.0f, fNearZ = 1.0f;
+	for(int i = 0; i < 8; i++) {
+		GLfloat x = (i & 1) ? vMax[0] : vMin[0];
+		GLfloat y = (i & 2) ? vMax[1] : vMin[1];
+		GLfloat z = (i & 4) ? vMax[2] : vMin[2];
+		GLfloat p[4];
+		for(int r = 0; r < 4; r++)
+			p[r] = mvp[r] * x + mvp[4 + r] * y + mvp[8 + r] * z + mvp[12 + r];
+
+		// Crosses the near plane, the rectangle would be unbounded
+		if(p[2] < -p[3])
+			return true;
+
+		GLfloat fInvW = 1.0f / p[3];
+		GLfloat sx = (p[0] * fInvW * 0.5f + 0.5f) * nWidth;
+		GLfloat sy = (p[1] * fInvW * 0.5f + 0.5f) * nHeight;
+		GLfloat sz = p[2] * fInvW * 0.5f + 0.5f;
+		fMinX = std::min(fMinX, sx); fMaxX = std::max(fMaxX, sx);
+		fMinY = std::min(fMinY, sy); fMaxY = std::max(fMaxY, sy);
+		fNearZ = std::min(fNearZ, sz);
+		}
+
+	if(TestRect(fMinX, fMinY, fMaxX, fMaxY, fNearZ))
+		return true;
+
+	nOccluded++;
+	return false;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Any pixel the rectangle touches farther than fNearZ? Whole blocks whose
+// farthest depth is nearer are skipped without looking at their pixels.
+inline bool GLOcclusionCuller::TestRect(GLfloat fMinX, GLfloat fMinY, GLfloat fMaxX, GLfloat fMaxY, GLfloat fNearZ) const
+	{
+	int nWidth = depthRaster.GetWidth(), nHeight = depthRaster.GetHeight();
+	if(fMaxX < 0.0f || fMaxY < 0.0f || fMinX >= GLfloat(nWidth) || fMinY >= GLfloat(nHeight))
+		return true;				// Off screen, leave it to the frustum test
+
+	int x0 = std::max(int(fMinX), 0), x1 = std::min(int(fMaxX), nWidth - 1);
+	int y0 = std::max(int(fMinY), 0), y1 = std::min(int(fMaxY), nHeight - 1);
+
+	for(int by = y0 / GLT_DEPTH_BLOCK; by <= y1 / GLT_DEPTH_BLOCK; by++)
+		for(int bx = x0 / GLT_DEPTH_BLOCK; bx <= x1 / GLT_DEPTH_BLOCK; bx++) {
+			if(depthRaster.GetBlockMaxZ(bx, by) <= fNearZ)
+				continue;
+
+			int px0 = std::max(x0, bx * GLT_DEPTH_BLOCK), px1 = std::min(x1, bx * GLT_DEPTH_BLOCK + GLT_DEPTH_BLOCK - 1);
+			int py0 = std::max(y0, by * GLT_DEPTH_BLOCK), py1 = std::min(y1, by * GLT_DEPTH_BLOCK + GLT_DEPTH_BLOCK - 1);
+			for(int y = py0; y <= py1; y++)
+				for(int x = px0; x <= px1; x++)
+					if(depthRaster.GetDepth(x, y) > fNearZ)
+						return true;
+			}
+
+	return false;
+	}
+
+#endif
@@ -0,0 +1,514 @@
+// GLQuatFrame.h
+// A drop in alternative to GLFrame that keeps its orientation as a unit
+// quaternion instead of a forward and an up vector.
+//
+// GLFrame rebuilds its matrix with cross products on every GetMatrix() and
+// GetCameraMatrix(), every rotation builds a full 4x4 rotation matrix, and
+// WorldToLocal() does a general 4x4 inverse. This class instead:
+//   - rotates by multiplying quaternions (no trig matrix per call),
+//   - caches the 3x3 rotation and only rebuilds it when the orientation changed,
+//   - inverts with a transpose, since the rotation is always orthonormal,
+//   - renormalizes with one cheap Newton step after every rotation instead
+//     of needing an occasional Normalize() call.
+//
+// The public functions mirror GLFrame so a demo can switch by changing the
+// type of the variable. The one behavioral difference is that SetForwardVector()
+// and SetUpVector() orthonormalize against the other axis immediately; GLFrame
+// lets the two drift apart until Normalize() is called.
+//
+// gltQuatFrameBenchmark() at the bottom times both classes side by side.
+
+#include "math3d.h"
+#include "GLFrame.h"
+#include "StopWatch.h"
+
+#ifndef __GL_QUAT_FRAME__
+#define __GL_QUAT_FRAME__
+
+class GLQuatFrame
+    {
+	protected:
+        M3DVector3f vOrigin;		// Where am I?
+        M3DVector4f qRotation;		// Which way am I facing? (x, y, z, w)
+
+		// Cached rotation, columns are X (right), Y (up), Z (forward)
+		mutable M3DMatrix33f mRotation;
+		mutable bool		 bDirty;
+
+    public:
+		// Same default as GLFrame. At the origin, looking down the
+		// negative Z axis with +Y up. GLFrame's X axis is up cross forward,
+		// which makes this a half turn around Y.
+		GLQuatFrame(void) {
+            vOrigin[0] = 0.0f; vOrigin[1] = 0.0f; vOrigin[2] = 0.0f;
+			qRotation[0] = 0.0f; qRotation[1] = 1.0f; qRotation[2] = 0.0f; qRotation[3] = 0.0f;
+			bDirty = true;
+			UpdateRotation();		// Never leave the cache uninitialized
+			}
+
+		// Pick up the position and orientation of an existing frame
+		GLQuatFrame(GLFrame& frame) { SetFrame(frame); }
+
+		void SetFrame(GLFrame& frame) {
+			M3DVector3f vForward, vUp;
+			frame.GetOrigin(vOrigin);
+			frame.GetForwardVector(vForward);
+			frame.GetUpVector(vUp);
+			SetAxes(vForward, vUp);
+			}
+
+		void GetFrame(GLFrame& frame) const {
+			UpdateRotation();
+			frame.SetOrigin(vOrigin);
+			frame.SetForwardVector(&mRotation[6]);
+			frame.SetUpVector(&mRotation[3]);
+			}
+
+
+        /////////////////////////////////////////////////////////////
+        // Set Location
+        inline void SetOrigin(const M3DVector3f vPoint) {
+			m3dCopyVector3(vOrigin, vPoint); }
+
+        inline void SetOrigin(float x, float y, float z) {
+			vOrigin[0] = x; vOrigin[1] = y; vOrigin[2] = z; }
+
+		inline void GetOrigin(M3DVector3f vPoint) const {
+			m3dCopyVector3(vPoint, vOrigin); }
+
+		inline float GetOriginX(void) const { return vOrigin[0]; }
+		inline float GetOriginY(void) const { return vOrigin[1]; }
+		inline float GetOriginZ(void) const { return vOrigin[2]; }
+
+
+        /////////////////////////////////////////////////////////////
+        // Set Forward Direction. The up vector is kept as close to where
+		// it was as possible.
+        inline void SetForwardVector(const M3DVector3f vDirection) {
+			UpdateRotation();
+			M3DVector3f vUp;
+			m3dCopyVector3(vUp, &mRotation[3]);
+			SetAxes(vDirection, vUp);
+			}
+
+        inline void SetForwardVector(float x, float y, float z) {
+			M3DVector3f vDirection = { x, y, z };
+			SetForwardVector(vDirection);
+			}
+
+        inline void GetForwardVector(M3DVector3f vVector) const {
+			UpdateRotation(); m3dCopyVector3(vVector, &mRotation[6]); }
+
+
+        /////////////////////////////////////////////////////////////
+        // Set Up Direction. Forward wins, the up vector is made
+		// perpendicular to it.
+        inline void SetUpVector(const M3DVector3f vDirection) {
+			UpdateRotation();
+			M3DVector3f vForward;
+			m3dCopyVector3(vForward, &mRotation[6]);
+			SetAxes(vForward, vDirection);
+			}
+
+        inline void SetUpVector(float x, float y, float z) {
+			M3DVector3f vDirection = { x, y, z };
+			SetUpVector(vDirection);
+			}
+
+        inline void GetUpVector(M3DVector3f vVector) const {
+			UpdateRotation(); m3dCopyVector3(vVector, &mRotation[3]); }
+
+
+		/////////////////////////////////////////////////////////////
+		// Get Axes
+		inline void GetZAxis(M3DVector3f vVector) const { GetForwardVector(vVector); }
+		inline void GetYAxis(M3DVector3f vVector) const { GetUpVector(vVector); }
+		inline void GetXAxis(M3DVector3f vVector) const {
+			UpdateRotation(); m3dCopyVector3(vVector, &mRotation[0]); }
+
+		// The raw quaternion (x, y, z, w)
+		inline void GetQuaternion(M3DVector4f q) const { m3dCopyVector4(q, qRotation); }
+		inline void SetQuaternion(const M3DVector4f q) {
+			m3dCopyVector4(qRotation, q);
+			Normalize();
+			}
+
+
+		/////////////////////////////////////////////////////////////
+        // Translate along orthonormal axis... world or local
+        inline void TranslateWorld(float x, float y, float z)
+			{ vOrigin[0] += x; vOrigin[1] += y; vOrigin[2] += z; }
+
+        inline void TranslateLocal(float x, float y, float z)
+			{
+			UpdateRotation();
+			vOrigin[0] += mRotation[0] * x + mRotation[3] * y + mRotation[6] * z;
+			vOrigin[1] += mRotation[1] * x + mRotation[4] * y + mRotation[7] * z;
+			vOrigin[2] += mRotation[2] * x + mRotation[5] * y + mRotation[8] * z;
+			}
+
+		inline void MoveForward(float fDelta) { MoveAlong(6, fDelta); }
+		inline void MoveUp(float fDelta)      { MoveAlong(3, fDelta); }
+		inline void MoveRight(float fDelta)   { MoveAlong(0, fDelta); }
+
+
+		///////////////////////////////////////////////////////////////////////
+		// Assemble the matrix from the cached rotation
+        void GetMatrix(M3DMatrix44f matrix, bool bRotationOnly = false) const
+			{
+			UpdateRotation();
+			matrix[0] = mRotation[0]; matrix[1] = mRotation[1]; matrix[2] = mRotation[2];
+			matrix[3] = 0.0f;
+			matrix[4] = mRotation[3]; matrix[5] = mRotation[4]; matrix[6] = mRotation[5];
+			matrix[7] = 0.0f;
+			matrix[8] = mRotation[6]; matrix[9] = mRotation[7]; matrix[10] = mRotation[8];
+			matrix[11] = 0.0f;
+
+			if(bRotationOnly) {
+				matrix[12] = 0.0f;
+				matrix[13] = 0.0f;
+				matrix[14] = 0.0f;
+				}
+			else {
+				matrix[12] = vOrigin[0];
+				matrix[13] = vOrigin[1];
+				matrix[14] = vOrigin[2];
+				}
+
+			matrix[15] = 1.0f;
+			}
+
+
+		////////////////////////////////////////////////////////////////////////
+		// Assemble the camera matrix. This is the inverse of GetMatrix() with
+		// the X and Z axes flipped (the camera looks down its -Z). The
+		// rotation part is the transpose, the translation is three dot products.
+        void GetCameraMatrix(M3DMatrix44f m, bool bRotationOnly = false) const
+            {
+			UpdateRotation();
+			const float *x = &mRotation[0];
+			const float *y = &mRotation[3];
+			const float *z = &mRotation[6];
+
+			#define M(row,col)  m[col*4+row]
+			   M(0, 0) = -x[0];
+			   M(0, 1) = -x[1];
+			   M(0, 2) = -x[2];
+			   M(1, 0) = y[0];
+			   M(1, 1) = y[1];
+			   M(1, 2) = y[2];
+			   M(2, 0) = -z[0];
+			   M(2, 1) = -z[1];
+			   M(2, 2) = -z[2];
+			   M(3, 0) = 0.0f;
+			   M(3, 1) = 0.0f;
+			   M(3, 2) = 0.0f;
+			   M(3, 3) = 1.0f;
+
+			if(bRotationOnly) {
+			   M(0, 3) = 0.0f;
+			   M(1, 3) = 0.0f;
+			   M(2, 3) = 0.0f;
+			   }
+			else {
+			   M(0, 3) = m3dDotProduct3(x, vOrigin);
+			   M(1, 3) = -m3dDotProduct3(y, vOrigin);
+			   M(2, 3) = m3dDotProduct3(z, vOrigin);
+			   }
+			#undef M
+            }
+
+
+		/////////////////////////////////////////////////////////////
+		// Rotations. Angles are in radians, like GLFrame.
+        inline void RotateLocalX(float fAngle) { RotateLocal(fAngle, 1.0f, 0.0f, 0.0f); }
+        inline void RotateLocalY(float fAngle) { RotateLocal(fAngle, 0.0f, 1.0f, 0.0f); }
+        inline void RotateLocalZ(float fAngle) { RotateLocal(fAngle, 0.0f, 0.0f, 1.0f); }
+
+		// Rotate in world coordinates... pre multiply
+		void RotateWorld(float fAngle, float x, float y, float z)
+			{
+			M3DVector4f qDelta, qResult;
+			if(!MakeAxisAngle(qDelta, fAngle, x, y, z))
+				return;
+
+			Multiply(qResult, qDelta, qRotation);
+			Renormalize(qResult);
+			}
+
+        // Rotate around a local axis... post multiply
+        void RotateLocal(float fAngle, float x, float y, float z)
+            {
+			M3DVector4f qDelta, qResult;
+			if(!MakeAxisAngle(qDelta, fAngle, x, y, z))
+				return;
+
+			Multiply(qResult, qRotation, qDelta);
+			Renormalize(qResult);
+            }
+
+		// Full renormalization. Rotations already do an incremental one,
+		// so this is only needed after SetQuaternion() with unscaled data.
+		void Normalize(void)
+			{
+			float fLength = sqrtf(qRotation[0] * qRotation[0] + qRotation[1] * qRotation[1] +
+								  qRotation[2] * qRotation[2] + qRotation[3] * qRotation[3]);
+			if(fLength > 0.0f) {
+				float fScale = 1.0f / fLength;
+				qRotation[0] *= fScale; qRotation[1] *= fScale;
+				qRotation[2] *= fScale; qRotation[3] *= fScale;
+				}
+			bDirty = true;
+			}
+
+
+		/////////////////////////////////////////////////////////////
+		// Convert Coordinate Systems
+        void LocalToWorld(const M3DVector3f vLocal, M3DVector3f vWorld, bool bRotOnly = false) const
+            {
+			UpdateRotation();
+			m3dRotateVector(vWorld, vLocal, mRotation);
+
+            if(!bRotOnly) {
+                vWorld[0] += vOrigin[0];
+                vWorld[1] += vOrigin[1];
+                vWorld[2] += vOrigin[2];
+                }
+            }
+
+		// The inverse rotation is the transpose, so this is just three dot
+		// products against the axes.
+        void WorldToLocal(const M3DVector3f vWorld, M3DVector3f vLocal) const
+            {
+			UpdateRotation();
+			M3DVector3f vNewWorld;
+            vNewWorld[0] = vWorld[0] - vOrigin[0];
+            vNewWorld[1] = vWorld[1] - vOrigin[1];
+            vNewWorld[2] = vWorld[2] - vOrigin[2];
+
+			vLocal[0] = m3dDotProduct3(&mRotation[0], vNewWorld);
+			vLocal[1] = m3dDotProduct3(&mRotation[3], vNewWorld);
+			vLocal[2] = m3dDotProduct3(&mRotation[6], vNewWorld);
+            }
+
+        // Transform a point by frame matrix
+        void TransformPoint(const M3DVector3f vPointSrc, M3DVector3f vPointDst) const
+            { LocalToWorld(vPointSrc, vPointDst, false); }
+
+        // Rotate a vector by frame matrix
+        void RotateVector(const M3DVector3f vVectorSrc, M3DVector3f vVectorDst) const
+            { LocalToWorld(vVectorSrc, vVectorDst, true); }
+
+
+	protected:
+		inline void MoveAlong(int iColumn, float fDelta)
+			{
+			UpdateRotation();
+			vOrigin[0] += mRotation[iColumn] * fDelta;
+			vOrigin[1] += mRotation[iColumn + 1] * fDelta;
+			vOrigin[2] += mRotation[iColumn + 2] * fDelta;
+			}
+
+		// Rebuild the cached rotation only if the quaternion changed
+		inline void UpdateRotation(void) const
+			{
+			if(!bDirty)
+				return;
+
+			float x = qRotation[0], y = qRotation[1], z = qRotation[2], w = qRotation[3];
+			float xx = x * x, yy = y * y, zz = z * z;
+			float xy = x * y, xz = x * z, yz = y * z;
+			float wx = w * x, wy = w * y, wz = w * z;
+
+			mRotation[0] = 1.0f - 2.0f * (yy + zz);
+			mRotation[1] = 2.0f * (xy + wz);
+			mRotation[2] = 2.0f * (xz - wy);
+
+			mRotation[3] = 2.0f * (xy - wz);
+			mRotation[4] = 1.0f - 2.0f * (xx + zz);
+			mRotation[5] = 2.0f * (yz + wx);
+
+			mRotation[6] = 2.0f * (xz + wy);
+			mRotation[7] = 2.0f * (yz - wx);
+			mRotation[8] = 1.0f - 2.0f * (xx + yy);
+
+			bDirty = false;
+			}
+
+		// One Newton step toward unit length. Rotations only ever drift by
+		// a few ulps, so this keeps the length at 1 without a square root.
+		inline void Renormalize(const M3DVector4f q)
+			{
+			float fScale = 0.5f * (3.0f - (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]));
+			qRotation[0] = q[0] * fScale;
+			qRotation[1] = q[1] * fScale;
+			qRotation[2] = q[2] * fScale;
+			qRotation[3] = q[3] * fScale;
+			bDirty = true;
+			}
+
+		// Build the orientation from a forward and an up vector, making them
+		// orthonormal on the way in.
+		void SetAxes(const M3DVector3f vForward, const M3DVector3f vUp)
+			{
+			M3DMatrix33f m;
+			float *x = &m[0];
+			float *y = &m[3];
+			float *z = &m[6];
+
+			m3dCopyVector3(z, vForward);
+			m3dNormalizeVector3(z);
+			m3dCrossProduct3(x, vUp, z);
+
+			// Up parallel to forward, pick any perpendicular
+			if(m3dGetVectorLengthSquared3(x) < 1e-12f) {
+				M3DVector3f vAny = { 0.0f, 1.0f, 0.0f };
+				if(fabsf(z[1]) > 0.9f)
+					m3dLoadVector3(vAny, 1.0f, 0.0f, 0.0f);
+				m3dCrossProduct3(x, vAny, z);
+				}
+			m3dNormalizeVector3(x);
+			m3dCrossProduct3(y, z, x);
+
+			// Shepperd's method, branch on the largest diagonal term
+			float fTrace = m[0] + m[4] + m[8];
+			if(fTrace > 0.0f) {
+				float s = sqrtf(fTrace + 1.0f) * 2.0f;
+				qRotation[3] = 0.25f * s;
+				qRotation[0] = (m[5] - m[7]) / s;
+				qRotation[1] = (m[6] - m[2]) / s;
+				qRotation[2] = (m[1] - m[3]) / s;
+				}
+			else if(m[0] > m[4] && m[0] > m[8]) {
+				float s = sqrtf(1.0f + m[0] - m[4] - m[8]) * 2.0f;
+				qRotation[3] = (m[5] - m[7]) / s;
+				qRotation[0] = 0.25f * s;
+				qRotation[1] = (m[3] + m[1]) / s;
+				qRotation[2] = (m[6] + m[2]) / s;
+				}
+			else if(m[4] > m[8]) {
+				float s = sqrtf(1.0f + m[4] - m[0] - m[8]) * 2.0f;
+				qRotation[3] = (m[6] - m[2]) / s;
+				qRotation[0] = (m[3] + m[1]) / s;
+				qRotation[1] = 0.25f * s;
+				qRotation[2] = (m[7] + m[5]) / s;
+				}
+			else {
+				float s = sqrtf(1.0f + m[8] - m[0] - m[4]) * 2.0f;
+				qRotation[3] = (m[1] - m[3]) / s;
+				qRotation[0] = (m[6] + m[2]) / s;
+				qRotation[1] = (m[7] + m[5]) / s;
+				qRotation[2] = 0.25f * s;
+				}
+
+			// We already have the exact matrix, no need to rebuild it
+			m3dCopyMatrix33(mRotation, m);
+			bDirty = false;
+			}
+
+		// Same convention as m3dRotationMatrix44, the axis does not need to be
+		// unit length. Returns false for a zero axis.
+		static inline bool MakeAxisAngle(M3DVector4f q, float fAngle, float x, float y, float z)
+			{
+			float fLengthSq = x * x + y * y + z * z;
+			if(fLengthSq == 0.0f)
+				return false;
+
+			float fHalf = fAngle * 0.5f;
+			float fScale = sinf(fHalf) / sqrtf(fLengthSq);
+			q[0] = x * fScale;
+			q[1] = y * fScale;
+			q[2] = z * fScale;
+			q[3] = cosf(fHalf);
+			return true;
+			}
+
+		// r = a * b (apply b first, then a)
+		static inline void Multiply(M3DVector4f r, const M3DVector4f a, const M3DVector4f b)
+			{
+			r[0] = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+			r[1] = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+			r[2] = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+			r[3] = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+			}
+    };
+
+
+// Millions of calls per second, GLFrame against GLQuatFrame
+struct GLTQuatFrameBenchmark
+	{
+	float	fFrameRotateLocal, fQuatRotateLocal;
+	float	fFrameRotateWorld, fQuatRotateWorld;
+	float	fFrameGetMatrix, fQuatGetMatrix;				// Orientation unchanged between calls
+	float	fFrameRotateGetMatrix, fQuatRotateGetMatrix;	// RotateLocal() then GetMatrix(), as a moving object does
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Micro-benchmark. Runs each case nIterations times on both classes and
+// fills in the rates. Returns a sum of the matrices, only so the compiler
+// cannot drop the work; it has no meaning.
+inline float gltQuatFrameBenchmark(int nIterations, GLTQuatFrameBenchmark &result)
+	{
+	if(nIterations < 1)
+		nIterations = 1;
+
+	GLFrame frame;
+	GLQuatFrame quatFrame;
+	M3DMatrix44f m;
+	float fSink = 0.0f;
+	float fRate = float(nIterations) * 1e-6f;
+	const float fAngle = 0.001f;
+	CStopWatch timer;
+
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++)
+		frame.RotateLocal(fAngle, 0.3f, 1.0f, 0.2f);
+	result.fFrameRotateLocal = fRate / timer.GetElapsedSeconds();
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++)
+		quatFrame.RotateLocal(fAngle, 0.3f, 1.0f, 0.2f);
+	result.fQuatRotateLocal = fRate / timer.GetElapsedSeconds();
+
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++)
+		frame.RotateWorld(fAngle, 0.0f, 1.0f, 0.5f);
+	result.fFrameRotateWorld = fRate / timer.GetElapsedSeconds();
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++)
+		quatFrame.RotateWorld(fAngle, 0.0f, 1.0f, 0.5f);
+	result.fQuatRotateWorld = fRate / timer.GetElapsedSeconds();
+
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++) {
+		frame.GetMatrix(m);
+		fSink += m[i & 15];
+		}
+	result.fFrameGetMatrix = fRate / timer.GetElapsedSeconds();
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++) {
+		quatFrame.GetMatrix(m);
+		fSink += m[i & 15];
+		}
+	result.fQuatGetMatrix = fRate / timer.GetElapsedSeconds();
+
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++) {
+		frame.RotateLocal(fAngle, 1.0f, 0.0f, 0.0f);
+		frame.GetMatrix(m);
+		fSink += m[i & 15];
+		}
+	result.fFrameRotateGetMatrix = fRate / timer.GetElapsedSeconds();
+	timer.Reset();
+	for(int i = 0; i < nIterations; i++) {
+		quatFrame.RotateLocal(fAngle, 1.0f, 0.0f, 0.0f);
+		quatFrame.GetMatrix(m);
+		fSink += m[i & 15];
+		}
+	result.fQuatRotateGetMatrix = fRate / timer.GetElapsedSeconds();
+
+	return fSink;
+	}
+
+
+#endif
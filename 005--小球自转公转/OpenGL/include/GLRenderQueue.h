@@ -0,0 +1,312 @@
+// GLRenderQueue.h
+// Draws collected over a frame, sorted to change GL state as rarely as
+// possible.
+//
+// Submit() records a packet instead of drawing. A packet holds the batch,
+// the shader program, the uniforms the stock shaders take and a packed
+// render state. Flush() gives each packet a 64 bit key, radix sorts the
+// keys and draws in key order:
+//
+//	opaque		0 | program (8) | state (15) | depth (24) | packet (16)
+//	translucent	1 | far-to-near depth (24) | program (8) | state (15) | packet (16)
+//
+// Opaque packets are grouped by program, then by state, and drawn near to
+// far inside each group so early depth test rejects more. Translucent
+// packets come last, far to near, as blending needs.
+//
+// Uniforms are set by the names the stock shaders use (mvpMatrix, mvMatrix,
+// pMatrix, vLightPos, vColor), so a custom program that uses the same names
+// can be queued too. Each frame's stats count the program and state changes
+// made, and how many there would have been drawing in submission order.
+
+#ifndef __GLT_RENDER_QUEUE
+#define __GLT_RENDER_QUEUE
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLStateTracker.h"
+#include <vector>
+
+// Render state, packed into 15 bits
+#define GLT_STATE_DEPTH_TEST		0x0001
+#define GLT_STATE_BLEND				0x0002		// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+#define GLT_STATE_CULL_FACE			0x0004
+#define GLT_STATE_POLYGON_OFFSET	0x0008		// glPolygonOffset(-1.0f, -1.0f), lines and fill
+#define GLT_STATE_LINE_SMOOTH		0x0010
+#define GLT_STATE_POLYGON_LINE		0x0020
+#define GLT_STATE_POLYGON_POINT		0x0040
+#define GLT_STATE_LINE_WIDTH_SHIFT	7			// Line width in eighths of a pixel, 8 bits
+#define GLT_STATE_LINE_WIDTH_MASK	0x7F80
+
+#define GLT_QUEUE_MAX_PACKETS		65536
+#define GLT_QUEUE_MAX_PROGRAMS		256
+
+inline GLuint gltStateLineWidth(GLfloat fWidth)
+	{
+	int nEighths = int(fWidth * 8.0f + 0.5f);
+	if(nEighths < 1) nEighths = 1;
+	if(nEighths > 255) nEighths = 255;
+	return GLuint(nEighths) << GLT_STATE_LINE_WIDTH_SHIFT;
+	}
+
+struct GLTRenderQueueStats
+	{
+	GLuint	nPackets;
+	GLuint	nProgramChanges;			// glUseProgram() calls made
+	GLuint	nStateChanges;				// State calls made
+	GLuint	nUnsortedProgramChanges;	// The same, drawing in submission order
+	GLuint	nUnsortedStateChanges;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLRenderQueue
+	{
+	public:
+		GLRenderQueue(void) {
+			fFarDepth = 100.0f;
+			memset(&stats, 0, sizeof(stats));
+			unsortedTracker.SetRecordOnly(true);
+			}
+
+		// Depths are measured along -z in eye space, from 0 to fFar
+		inline void SetDepthRange(GLfloat fFar) { fFarDepth = fFar; }
+
+		// Queue pBatch to be drawn with program. mvMatrix and pMatrix are
+		// copied; vLightPos may be NULL for shaders without a light.
+		// nState is GLT_STATE_* bits and gltStateLineWidth().
+		void Submit(GLBatchBase *pBatch, GLuint program, const M3DMatrix44f mvMatrix, const M3DMatrix44f pMatrix,
+					const M3DVector4f vColor, const M3DVector3f vLightPos, GLuint nState, bool bTranslucent = false);
+
+		// Sort and draw everything queued, then empty the queue. GL state is
+		// not assumed from one flush to the next, so the first packet sets it
+		// all.
+		void Flush(void);
+
+		inline GLuint GetPacketCount(void) const { return GLuint(packets.size()); }
+		inline const GLTRenderQueueStats &GetStats(void) const { return stats; }
+
+	protected:
+		struct Packet
+			{
+			GLBatchBase		*pBatch;
+			GLuint			nProgram;		// Index in programs
+			GLuint			nState;
+			GLfloat			fDepth;
+			bool			bTranslucent;
+			M3DMatrix44f	mvMatrix;
+			M3DMatrix44f	pMatrix;
+			M3DVector4f		vColor;
+			M3DVector3f		vLightPos;
+			};
+
+		struct Program
+			{
+			GLuint	program;
+			GLint	mvpMatrix, mvMatrix, pMatrix, vLightPos, vColor;
+			};
+
+		GLuint FindProgram(GLuint program);
+		GLuint64 MakeKey(const Packet &packet, GLuint nPacket) const;
+		static void RadixSort(std::vector<GLuint64> &vKeys, std::vector<GLuint64> &vTemp);
+		static void ApplyState(GLStateTracker &tracker, GLuint nState);
+
+		GLfloat	fFarDepth;
+		std::vector<Packet>		packets;
+		std::vector<Program>	programs;
+		std::vector<GLuint64>	vKeys, vTemp;
+		GLTRenderQueueStats		stats;
+		GLStateTracker			stateTracker;
+		GLStateTracker			unsortedTracker;	// Record only
+
+	private:
+		GLRenderQueue(const GLRenderQueue&);
+		GLRenderQueue &operator=(const GLRenderQueue&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Programs are numbered in the order they are first seen. Uniform
+// locations are looked up once. When the table is full, what is queued is
+// drawn and numbering starts again.
+inline GLuint GLRenderQueue::FindProgram(GLuint program)
+	{
+	for(size_t i = 0; i < programs.size(); i++)
+		if(programs[i].program == program)
+			return GLuint(i);
+
+	if(programs.size() == GLT_QUEUE_MAX_PROGRAMS) {
+		Flush();
+		programs.clear();
+		}
+
+	Program entry;
+	entry.program = program;
+	entry.mvpMatrix = glGetUniformLocation(program, "mvpMatrix");
+	entry.mvMatrix = glGetUniformLocation(program, "mvMatrix");
+	entry.pMatrix = glGetUniformLocation(program, "pMatrix");
+	entry.vLightPos = glGetUniformLocation(program, "vLightPos");
+	entry.vColor = glGetUniformLocation(program, "vColor");
+	programs.push_back(entry);
+	return GLuint(programs.size() - 1);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLRenderQueue::Submit(GLBatchBase *pBatch, GLuint program, const M3DMatrix44f mvMatrix, const M3DMatrix44f pMatrix,
+								  const M3DVector4f vColor, const M3DVector3f vLightPos, GLuint nState, bool bTranslucent)
+	{
+	if(packets.size() == GLT_QUEUE_MAX_PACKETS)
+		Flush();
+
+	Packet packet;
+	packet.pBatch = pBatch;
+	packet.nProgram = FindProgram(program);
+	packet.nState = nState & 0x7FFF;
+	packet.fDepth = -mvMatrix[14];				// Eye space distance of the object's origin
+	packet.bTranslucent = bTranslucent;
+	m3dCopyMatrix44(packet.mvMatrix, mvMatrix);
+	m3dCopyMatrix44(packet.pMatrix, pMatrix);
+	m3dCopyVector4(packet.vColor, vColor);
+	if(vLightPos != NULL)
+		m3dCopyVector3(packet.vLightPos, vLightPos);
+	else
+		m3dLoadVector3(packet.vLightPos, 0.0f, 0.0f, 0.0f);
+	packets.push_back(packet);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLuint64 GLRenderQueue::MakeKey(const Packet &packet, GLuint nPacket) const
+	{
+	float fDepth = packet.fDepth / fFarDepth;
+	if(fDepth < 0.0f) fDepth = 0.0f;
+	if(fDepth > 1.0f) fDepth = 1.0f;
+	GLuint64 nDepth = GLuint64(fDepth * float(0xFFFFFF));
+
+	GLuint64 nKey;
+	if(!packet.bTranslucent)
+		nKey = (GLuint64(packet.nProgram) << 55) | (GLuint64(packet.nState) << 40) | (nDepth << 16);
+	else
+		nKey = (GLuint64(1) << 63) | ((0xFFFFFF - nDepth) << 39) | (GLuint64(packet.nProgram) << 31) |
+			   (GLuint64(packet.nState) << 16);
+	return nKey | nPacket;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Least significant byte first, eight counting passes. A pass where every
+// key has the same byte would not move anything, so it is skipped.
+inline void GLRenderQueue::RadixSort(std::vector<GLuint64> &vKeys, std::vector<GLuint64> &vTemp)
+	{
+	size_t nKeys = vKeys.size();
+	vTemp.resize(nKeys);
+
+	for(int nShift = 0; nShift < 64; nShift += 8) {
+		size_t nCounts[256];
+		memset(nCounts, 0, sizeof(nCounts));
+		for(size_t i = 0; i < nKeys; i++)
+			nCounts[(vKeys[i] >> nShift) & 0xFF]++;
+
+		if(nCounts[(vKeys[0] >> nShift) & 0xFF] == nKeys)
+			continue;
+
+		size_t nOffset = 0;
+		for(int b = 0; b < 256; b++) {
+			size_t nCount = nCounts[b];
+			nCounts[b] = nOffset;
+			nOffset += nCount;
+			}
+		for(size_t i = 0; i < nKeys; i++)
+			vTemp[nCounts[(vKeys[i] >> nShift) & 0xFF]++] = vKeys[i];
+		vKeys.swap(vTemp);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Set every piece of a packed state. The tracker drops what is already set.
+inline void GLRenderQueue::ApplyState(GLStateTracker &tracker, GLuint nState)
+	{
+	tracker.Set(GL_DEPTH_TEST, (nState & GLT_STATE_DEPTH_TEST) != 0);
+	tracker.Set(GL_BLEND, (nState & GLT_STATE_BLEND) != 0);
+	if(nState & GLT_STATE_BLEND)
+		tracker.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	tracker.Set(GL_CULL_FACE, (nState & GLT_STATE_CULL_FACE) != 0);
+	tracker.Set(GL_POLYGON_OFFSET_LINE, (nState & GLT_STATE_POLYGON_OFFSET) != 0);
+	tracker.Set(GL_POLYGON_OFFSET_FILL, (nState & GLT_STATE_POLYGON_OFFSET) != 0);
+	if(nState & GLT_STATE_POLYGON_OFFSET)
+		tracker.PolygonOffset(-1.0f, -1.0f);
+	tracker.Set(GL_LINE_SMOOTH, (nState & GLT_STATE_LINE_SMOOTH) != 0);
+
+	if(nState & GLT_STATE_POLYGON_LINE)
+		tracker.PolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	else if(nState & GLT_STATE_POLYGON_POINT)
+		tracker.PolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+	else
+		tracker.PolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	tracker.LineWidth(GLfloat((nState & GLT_STATE_LINE_WIDTH_MASK) >> GLT_STATE_LINE_WIDTH_SHIFT) / 8.0f);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLRenderQueue::Flush(void)
+	{
+	memset(&stats, 0, sizeof(stats));
+	stats.nPackets = GLuint(packets.size());
+	if(packets.empty())
+		return;
+
+	// What drawing in submission order would have cost
+	unsortedTracker.Invalidate();
+	unsortedTracker.ResetCounters();
+	for(size_t i = 0; i < packets.size(); i++) {
+		if(i == 0 || packets[i].nProgram != packets[i - 1].nProgram)
+			stats.nUnsortedProgramChanges++;
+		ApplyState(unsortedTracker, packets[i].nState);
+		}
+	stats.nUnsortedStateChanges = unsortedTracker.GetCallsMade();
+
+	vKeys.resize(packets.size());
+	for(size_t i = 0; i < packets.size(); i++)
+		vKeys[i] = MakeKey(packets[i], GLuint(i));
+	RadixSort(vKeys, vTemp);
+
+	stateTracker.Invalidate();
+	stateTracker.ResetCounters();
+	const Packet *pLast = NULL;
+	for(size_t k = 0; k < vKeys.size(); k++) {
+		const Packet &packet = packets[vKeys[k] & 0xFFFF];
+		const Program &program = programs[packet.nProgram];
+
+		if(pLast == NULL || packet.nProgram != pLast->nProgram) {
+			glUseProgram(program.program);
+			stats.nProgramChanges++;
+			}
+
+		ApplyState(stateTracker, packet.nState);
+
+		if(program.mvpMatrix != -1) {
+			M3DMatrix44f mvpMatrix;
+			m3dMatrixMultiply44(mvpMatrix, packet.pMatrix, packet.mvMatrix);
+			glUniformMatrix4fv(program.mvpMatrix, 1, GL_FALSE, mvpMatrix);
+			}
+		if(program.mvMatrix != -1)
+			glUniformMatrix4fv(program.mvMatrix, 1, GL_FALSE, packet.mvMatrix);
+		if(program.pMatrix != -1)
+			glUniformMatrix4fv(program.pMatrix, 1, GL_FALSE, packet.pMatrix);
+		if(program.vLightPos != -1)
+			glUniform3fv(program.vLightPos, 1, packet.vLightPos);
+		if(program.vColor != -1)
+			glUniform4fv(program.vColor, 1, packet.vColor);
+
+		packet.pBatch->Draw();
+		pLast = &packet;
+		}
+	stats.nStateChanges = stateTracker.GetCallsMade();
+
+	packets.clear();
+	}
+
+#endif
@@ -0,0 +1,882 @@
+// GLSoftRaster.h
+// Tile based CPU rasterizer for rendering the demo scenes without a GPU.
+//
+// GLBatch and GLTriangleBatch hand their vertices to buffer objects and free
+// the CPU copies in End(), so this backend keeps its own copy in a GLSoftMesh.
+// GLSoftMesh takes the same Begin()/Copy*() calls as GLBatch, and BeginMesh()
+// takes the output of the gltWrite*() generators, like GLCompactBatch.
+//
+// GLSoftRasterizer follows the stock shaders GLT_SHADER_FLAT, GLT_SHADER_SHADED
+// and GLT_SHADER_POINT_LIGHT_DIFF, a depth buffer (GL_LESS), back face culling
+// and glPolygonMode(), glPointSize() and glLineWidth(). Points, lines and
+// triangles of every primitive type are supported, indexed or not. Points
+// and lines become screen aligned quads; blending and smoothing are not
+// done.
+//
+// Draw calls transform their vertices on the shared job pool, clip in
+// homogeneous space (near, far and a guard band at x and y) and add each
+// triangle to a list per 64x64 tile. Flush() then rasterizes the tiles in
+// parallel. Within a tile, triangles are drawn in the order they were
+// submitted, so the result does not depend on the thread count. Four pixels
+// are evaluated at a time with SSE where available.
+//
+// The color buffer is RGBA8 with the first row at the bottom, as glReadPixels()
+// returns it. SaveTGA() writes it out for regression images and thumbnails.
+//
+// gltSoftRasterBenchmark() measures triangle and pixel throughput from one
+// thread up to the whole pool.
+
+#ifndef __GLT_SOFT_RASTER
+#define __GLT_SOFT_RASTER
+
+#include "GLTools.h"
+#include "GLShaderManager.h"
+#include "GLMeshGenerators.h"
+#include "GLJobSystem.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLT_SOFT_RASTER_SSE
+#endif
+
+#define GLT_SOFT_TILE_SIZE		64			// Multiple of 4
+#define GLT_SOFT_GUARD_BAND		2.0f		// Clip x and y at +-2 w instead of +-w
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CPU copy of one batch
+class GLSoftMesh
+	{
+	public:
+		GLSoftMesh(void) { primitive = GL_TRIANGLES; nVerts = 0; }
+
+		// Same as GLBatch. Copy*() expect nVerts entries.
+		void Begin(GLenum primitiveType, GLuint nVertCount) {
+			primitive = primitiveType;
+			nVerts = nVertCount;
+			vVerts.assign(nVerts * 3, 0.0f);
+			vNormals.clear();
+			vColors.clear();
+			vTexCoords.clear();
+			vIndexes.clear();
+			}
+
+		void CopyVertexData3f(const GLfloat *pVerts) { vVerts.assign(pVerts, pVerts + nVerts * 3); }
+		void CopyNormalDataf(const GLfloat *pNorms) { vNormals.assign(pNorms, pNorms + nVerts * 3); }
+		void CopyColorData4f(const GLfloat *pColors) { vColors.assign(pColors, pColors + nVerts * 4); }
+		inline void CopyVertexData3f(M3DVector3f *pVerts) { CopyVertexData3f(&pVerts[0][0]); }
+		inline void CopyNormalDataf(M3DVector3f *pNorms) { CopyNormalDataf(&pNorms[0][0]); }
+		inline void CopyColorData4f(M3DVector4f *pColors) { CopyColorData4f(&pColors[0][0]); }
+
+		// Indexed triangles, for the gltWrite*() generators
+		GLTMeshArrays BeginMesh(GLuint nVertCount, GLuint nIndexCount) {
+			Begin(GL_TRIANGLES, nVertCount);
+			vNormals.assign(nVerts * 3, 0.0f);
+			vTexCoords.assign(nVerts * 2, 0.0f);
+			vIndexes.assign(nIndexCount, 0);
+
+			GLTMeshArrays mesh;
+			mesh.pVerts = (M3DVector3f *)&vVerts[0];
+			mesh.pNorms = (M3DVector3f *)&vNormals[0];
+			mesh.pTexCoords = (M3DVector2f *)&vTexCoords[0];
+			mesh.pIndexes = &vIndexes[0];
+			return mesh;
+			}
+
+		inline GLenum GetPrimitive(void) const { return primitive; }
+		inline GLuint GetVertexCount(void) const { return nVerts; }
+		// Vertices in primitive order, through the indexes if there are any
+		inline GLuint GetElementCount(void) const { return vIndexes.empty() ? nVerts : GLuint(vIndexes.size()); }
+		inline GLuint GetElement(GLuint i) const { return vIndexes.empty() ? i : vIndexes[i]; }
+
+		inline const GLfloat *GetVerts(void) const { return vVerts.empty() ? NULL : &vVerts[0]; }
+		inline const GLfloat *GetNormals(void) const { return vNormals.empty() ? NULL : &vNormals[0]; }
+		inline const GLfloat *GetColors(void) const { return vColors.empty() ? NULL : &vColors[0]; }
+
+	protected:
+		GLenum					primitive;
+		GLuint					nVerts;
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNormals;
+		std::vector<GLfloat>	vColors;
+		std::vector<GLfloat>	vTexCoords;			// Written by the generators, not used
+		std::vector<GLushort>	vIndexes;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Work done since the last ResetStats()
+struct GLTSoftRasterStats
+	{
+	GLuint	nDraws;
+	GLuint	nTriangles;			// Set up and binned, after clipping and culling.
+								// Points and lines count two each.
+	GLuint	nTileTriangles;		// Summed over every tile a triangle touches
+	GLuint	nPixels;			// Written, after the depth test
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLSoftRasterizer
+	{
+	public:
+		GLSoftRasterizer(void) {
+			nWidth = nHeight = nStride = 0;
+			nTilesX = nTilesY = 0;
+			bDepthTest = true;
+			bCullFace = false;
+			polygonMode = GL_FILL;
+			fPointSize = fLineWidth = 1.0f;
+			nThreadLimit = 0;
+			ResetStats();
+			}
+
+		void SetSize(int nWidthPixels, int nHeightPixels);
+		inline int GetWidth(void) const { return nWidth; }
+		inline int GetHeight(void) const { return nHeight; }
+
+		// Like glClearColor() + glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT).
+		// Draws still waiting for Flush() are rasterized first.
+		void Clear(GLfloat r, GLfloat g, GLfloat b, GLfloat a, GLfloat fDepth = 1.0f);
+
+		inline void SetDepthTest(bool bEnable) { bDepthTest = bEnable; }
+		inline void SetCullFace(bool bEnable) { bCullFace = bEnable; }			// Back faces, CCW is front
+		inline void SetPolygonMode(GLenum mode) { polygonMode = mode; }			// GL_FILL, GL_LINE or GL_POINT
+		inline void SetPointSize(GLfloat fSize) { fPointSize = fSize; }
+		inline void SetLineWidth(GLfloat fWidth) { fLineWidth = fWidth; }
+
+		// Run on at most nThreads threads of the shared pool, 0 for all of it
+		inline void SetThreadCount(int nThreads) { nThreadLimit = nThreads > 0 ? nThreads : 0; }
+		inline int GetThreadCount(void) const {
+			int nPool = gltGetJobSystem().GetThreadCount();
+			return (nThreadLimit > 0 && nThreadLimit < nPool) ? nThreadLimit : nPool;
+			}
+
+		// The stock shaders, with the same arguments as UseStockShader()
+		inline void DrawFlat(const GLSoftMesh &mesh, const M3DMatrix44f mvpMatrix, const M3DVector4f vColor)
+			{ Draw(mesh, GLT_SHADER_FLAT, mvpMatrix, NULL, NULL, vColor); }
+		inline void DrawShaded(const GLSoftMesh &mesh, const M3DMatrix44f mvpMatrix)
+			{ Draw(mesh, GLT_SHADER_SHADED, mvpMatrix, NULL, NULL, NULL); }
+		void DrawPointLightDiff(const GLSoftMesh &mesh, const M3DMatrix44f mvMatrix, const M3DMatrix44f pMatrix,
+								const M3DVector3f vLightPos, const M3DVector4f vColor);
+
+		// Rasterize everything drawn since the last Flush()
+		void Flush(void);
+
+		// Flushes first
+		const GLuint *GetColorBuffer(void) { Flush(); return vColor.empty() ? NULL : &vColor[0]; }
+		const GLfloat *GetDepthBuffer(void) { Flush(); return vDepth.empty() ? NULL : &vDepth[0]; }
+		inline int GetStride(void) const { return nStride; }					// In pixels
+		bool SaveTGA(const char *szFileName);
+
+		inline const GLTSoftRasterStats &GetStats(void) const { return stats; }
+		inline void ResetStats(void) { stats.nDraws = stats.nTriangles = stats.nTileTriangles = stats.nPixels = 0; }
+
+	protected:
+		// After the vertex stage, in clip space
+		struct ClipVertex
+			{
+			GLfloat	p[4];
+			GLfloat	c[4];
+			};
+
+		// After the perspective divide, in pixels. z is window depth, 0..1.
+		struct ScreenVertex
+			{
+			GLfloat	x, y, z, fInvW;
+			GLfloat	c[4];
+			};
+
+		// A triangle ready for the tiles. E(x, y) = A x + B y + C is positive
+		// inside for each edge, and edge i is the one opposite vertex i.
+		struct Setup
+			{
+			GLfloat	A[3], B[3], C[3];
+			GLint	bTopLeft[3];
+			GLfloat	fInvArea;
+			GLfloat	z0, dz1, dz2;				// z = z0 + b1 dz1 + b2 dz2
+			GLfloat	w0, dw1, dw2;				// Same for 1/w
+			GLfloat	c0[4], dc1[4], dc2[4];		// Same for color/w
+			GLint	nMinX, nMinY, nMaxX, nMaxY;
+			bool	bDepthTest;
+			bool	bFlat;
+			GLuint	flatColor;
+			};
+
+		void Draw(const GLSoftMesh &mesh, GLT_STOCK_SHADER shader, const M3DMatrix44f mvp,
+				  const float *mv, const float *vLightPos, const float *vFlatColor);
+
+		void AddTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, bool bCanCull);
+		void AddLine(const ClipVertex &a, const ClipVertex &b);
+		void AddPoint(const ClipVertex &a);
+		void AddScreenTriangle(const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c, bool bCull);
+		void AddQuad(const ScreenVertex v[4]);
+		void Project(const ClipVertex &in, ScreenVertex &out) const;
+		void RasterTile(int nTile, GLuint &nPixels);
+
+		static inline GLfloat PlaneDistance(const GLfloat p[4], int nPlane);
+		static inline void Lerp(const ClipVertex &a, const ClipVertex &b, GLfloat t, ClipVertex &out);
+		static inline GLuint PackColor(const GLfloat c[4]);
+
+		int		nWidth, nHeight, nStride;
+		int		nTilesX, nTilesY;
+		std::vector<GLuint>				vColor;
+		std::vector<GLfloat>			vDepth;
+		std::vector<Setup>				vSetups;
+		std::vector<std::vector<GLuint> > vBins;		// Setup indexes per tile
+		std::vector<ClipVertex>			vClipVerts;		// Vertex stage output of the current draw
+
+		bool	bDepthTest;
+		bool	bCullFace;
+		GLenum	polygonMode;
+		GLfloat	fPointSize;
+		GLfloat	fLineWidth;
+		int		nThreadLimit;
+
+		GLTSoftRasterStats	stats;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::SetSize(int nWidthPixels, int nHeightPixels)
+	{
+	vSetups.clear();
+	nWidth = nWidthPixels;
+	nHeight = nHeightPixels;
+	nStride = (nWidth + 3) & ~3;		// Four pixel groups never cross a row
+	nTilesX = (nWidth + GLT_SOFT_TILE_SIZE - 1) / GLT_SOFT_TILE_SIZE;
+	nTilesY = (nHeight + GLT_SOFT_TILE_SIZE - 1) / GLT_SOFT_TILE_SIZE;
+
+	vColor.assign(size_t(nStride) * nHeight, 0);
+	vDepth.assign(size_t(nStride) * nHeight, 1.0f);
+	vBins.assign(nTilesX * nTilesY, std::vector<GLuint>());
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::Clear(GLfloat r, GLfloat g, GLfloat b, GLfloat a, GLfloat fDepth)
+	{
+	Flush();
+
+	GLfloat vClear[4] = { r, g, b, a };
+	std::fill(vColor.begin(), vColor.end(), PackColor(vClear));
+	std::fill(vDepth.begin(), vDepth.end(), fDepth);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLuint GLSoftRasterizer::PackColor(const GLfloat c[4])
+	{
+	GLuint packed = 0;
+	for(int i = 0; i < 4; i++) {
+		GLfloat f = (c[i] < 0.0f) ? 0.0f : (c[i] > 1.0f ? 1.0f : c[i]);
+		packed |= GLuint(f * 255.0f + 0.5f) << (i * 8);
+		}
+	return packed;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::DrawPointLightDiff(const GLSoftMesh &mesh, const M3DMatrix44f mvMatrix, const M3DMatrix44f pMatrix,
+												 const M3DVector3f vLightPos, const M3DVector4f vColor)
+	{
+	M3DMatrix44f mvp;
+	m3dMatrixMultiply44(mvp, pMatrix, mvMatrix);
+	Draw(mesh, GLT_SHADER_POINT_LIGHT_DIFF, mvp, mvMatrix, vLightPos, vColor);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex stage on the job pool, then primitive assembly. The point light
+// shader works like the stock one: the normal goes through the upper 3x3 of
+// the modelview matrix, the light position is in eye space, and the color is
+// max(N.L, 0) times vColor with vColor's alpha.
+inline void GLSoftRasterizer::Draw(const GLSoftMesh &mesh, GLT_STOCK_SHADER shader, const M3DMatrix44f mvp,
+								   const float *mv, const float *vLightPos, const float *vFlatColor)
+	{
+	if(nWidth == 0 || mesh.GetVerts() == NULL)
+		return;
+	stats.nDraws++;
+
+	GLuint nVerts = mesh.GetVertexCount();
+	vClipVerts.resize(nVerts);
+	const GLfloat *pVerts = mesh.GetVerts();
+	const GLfloat *pNormals = mesh.GetNormals();
+	const GLfloat *pColors = mesh.GetColors();
+
+	// No more ranges than threads allowed, so no more run at once
+	GLint nThreads = GetThreadCount();
+	GLint nGrain = std::max(GLint(4096), (GLint(nVerts) + nThreads - 1) / nThreads);
+	gltGetJobSystem().ParallelFor(GLint(nVerts), nGrain, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++) {
+			ClipVertex &out = vClipVerts[i];
+			const GLfloat *v = pVerts + i * 3;
+			for(int r = 0; r < 4; r++)
+				out.p[r] = mvp[r] * v[0] + mvp[4 + r] * v[1] + mvp[8 + r] * v[2] + mvp[12 + r];
+
+			if(shader == GLT_SHADER_SHADED) {
+				if(pColors != NULL)
+					m3dCopyVector4(out.c, pColors + i * 4);
+				else
+					m3dLoadVector4(out.c, 1.0f, 1.0f, 1.0f, 1.0f);
+				}
+			else if(shader == GLT_SHADER_POINT_LIGHT_DIFF) {
+				M3DVector3f vNormal = { 0.0f, 0.0f, 1.0f }, vEyeNormal, vEyePos, vToLight;
+				if(pNormals != NULL)
+					m3dCopyVector3(vNormal, pNormals + i * 3);
+				for(int r = 0; r < 3; r++) {
+					vEyeNormal[r] = mv[r] * vNormal[0] + mv[4 + r] * vNormal[1] + mv[8 + r] * vNormal[2];
+					vEyePos[r] = mv[r] * v[0] + mv[4 + r] * v[1] + mv[8 + r] * v[2] + mv[12 + r];
+					}
+				m3dNormalizeVector3(vEyeNormal);
+				m3dSubtractVectors3(vToLight, vLightPos, vEyePos);
+				m3dNormalizeVector3(vToLight);
+
+				GLfloat fDiffuse = m3dDotProduct3(vEyeNormal, vToLight);
+				if(fDiffuse < 0.0f)
+					fDiffuse = 0.0f;
+				m3dLoadVector4(out.c, vFlatColor[0] * fDiffuse, vFlatColor[1] * fDiffuse, vFlatColor[2] * fDiffuse, vFlatColor[3]);
+				}
+			else
+				m3dCopyVector4(out.c, vFlatColor);
+			}
+		});
+
+	// Primitive assembly
+	GLuint nElements = mesh.GetElementCount();
+	switch(mesh.GetPrimitive()) {
+		case GL_POINTS:
+			for(GLuint i = 0; i < nElements; i++)
+				AddPoint(vClipVerts[mesh.GetElement(i)]);
+			break;
+
+		case GL_LINES:
+			for(GLuint i = 0; i + 1 < nElements; i += 2)
+				AddLine(vClipVerts[mesh.GetElement(i)], vClipVerts[mesh.GetElement(i + 1)]);
+			break;
+
+		case GL_LINE_STRIP:
+		case GL_LINE_LOOP:
+			for(GLuint i = 0; i + 1 < nElements; i++)
+				AddLine(vClipVerts[mesh.GetElement(i)], vClipVerts[mesh.GetElement(i + 1)]);
+			if(mesh.GetPrimitive() == GL_LINE_LOOP && nElements > 2)
+				AddLine(vClipVerts[mesh.GetElement(nElements - 1)], vClipVerts[mesh.GetElement(0)]);
+			break;
+
+		case GL_TRIANGLES:
+			for(GLuint i = 0; i + 2 < nElements; i += 3)
+				AddTriangle(vClipVerts[mesh.GetElement(i)], vClipVerts[mesh.GetElement(i + 1)], vClipVerts[mesh.GetElement(i + 2)], true);
+			break;
+
+		case GL_TRIANGLE_STRIP:
+			// Every second triangle is flipped to keep the winding
+			for(GLuint i = 0; i + 2 < nElements; i++) {
+				GLuint a = mesh.GetElement(i), b = mesh.GetElement(i + 1), c = mesh.GetElement(i + 2);
+				if(i & 1)
+					AddTriangle(vClipVerts[b], vClipVerts[a], vClipVerts[c], true);
+				else
+					AddTriangle(vClipVerts[a], vClipVerts[b], vClipVerts[c], true);
+				}
+			break;
+
+		case GL_TRIANGLE_FAN:
+			for(GLuint i = 1; i + 1 < nElements; i++)
+				AddTriangle(vClipVerts[mesh.GetElement(0)], vClipVerts[mesh.GetElement(i)], vClipVerts[mesh.GetElement(i + 1)], true);
+			break;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Planes 0..5: near, far, left, right, bottom, top. Inside is >= 0.
+inline GLfloat GLSoftRasterizer::PlaneDistance(const GLfloat p[4], int nPlane)
+	{
+	switch(nPlane) {
+		case 0:  return p[3] + p[2];
+		case 1:  return p[3] - p[2];
+		case 2:  return GLT_SOFT_GUARD_BAND * p[3] + p[0];
+		case 3:  return GLT_SOFT_GUARD_BAND * p[3] - p[0];
+		case 4:  return GLT_SOFT_GUARD_BAND * p[3] + p[1];
+		default: return GLT_SOFT_GUARD_BAND * p[3] - p[1];
+		}
+	}
+
+
+inline void GLSoftRasterizer::Lerp(const ClipVertex &a, const ClipVertex &b, GLfloat t, ClipVertex &out)
+	{
+	for(int i = 0; i < 4; i++) {
+		out.p[i] = a.p[i] + (b.p[i] - a.p[i]) * t;
+		out.c[i] = a.c[i] + (b.c[i] - a.c[i]) * t;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::Project(const ClipVertex &in, ScreenVertex &out) const
+	{
+	out.fInvW = 1.0f / in.p[3];
+	out.x = (in.p[0] * out.fInvW * 0.5f + 0.5f) * nWidth;
+	out.y = (in.p[1] * out.fInvW * 0.5f + 0.5f) * nHeight;
+	out.z = in.p[2] * out.fInvW * 0.5f + 0.5f;
+	m3dCopyVector4(out.c, in.c);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Polygon mode and culling, then Sutherland-Hodgman clipping. A triangle
+// crosses each plane at most once per edge, so at most 9 vertices result.
+inline void GLSoftRasterizer::AddTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c, bool bCanCull)
+	{
+	bool bCull = bCanCull && bCullFace;
+
+	if(polygonMode != GL_FILL) {
+		// Facing is only known when all three vertices are in front of the eye
+		if(bCull && a.p[3] > 0.0f && b.p[3] > 0.0f && c.p[3] > 0.0f) {
+			ScreenVertex sa, sb, sc;
+			Project(a, sa); Project(b, sb); Project(c, sc);
+			if((sb.x - sa.x) * (sc.y - sa.y) - (sc.x - sa.x) * (sb.y - sa.y) <= 0.0f)
+				return;
+			}
+
+		if(polygonMode == GL_LINE) {
+			AddLine(a, b); AddLine(b, c); AddLine(c, a);
+			}
+		else {
+			AddPoint(a); AddPoint(b); AddPoint(c);
+			}
+		return;
+		}
+
+	ClipVertex poly[2][9];
+	int nCount = 3;
+	poly[0][0] = a; poly[0][1] = b; poly[0][2] = c;
+
+	int nIn = 0;
+	for(int nPlane = 0; nPlane < 6; nPlane++) {
+		// Skip the copy when every vertex is inside
+		bool bAllInside = true;
+		for(int i = 0; i < nCount && bAllInside; i++)
+			bAllInside = PlaneDistance(poly[nIn][i].p, nPlane) >= 0.0f;
+		if(bAllInside)
+			continue;
+
+		int nOut = 0;
+		const ClipVertex *pSrc = poly[nIn];
+		ClipVertex *pDst = poly[nIn ^ 1];
+		for(int i = 0; i < nCount; i++) {
+			const ClipVertex &v0 = pSrc[i];
+			const ClipVertex &v1 = pSrc[(i + 1) % nCount];
+			GLfloat d0 = PlaneDistance(v0.p, nPlane);
+			GLfloat d1 = PlaneDistance(v1.p, nPlane);
+
+			if(d0 >= 0.0f)
+				pDst[nOut++] = v0;
+			if((d0 >= 0.0f) != (d1 >= 0.0f))
+				Lerp(v0, v1, d0 / (d0 - d1), pDst[nOut++]);
+			}
+
+		nCount = nOut;
+		nIn ^= 1;
+		if(nCount < 3)
+			return;
+		}
+
+	ScreenVertex verts[9];
+	for(int i = 0; i < nCount; i++)
+		Project(poly[nIn][i], verts[i]);
+	for(int i = 1; i + 1 < nCount; i++)
+		AddScreenTriangle(verts[0], verts[i], verts[i + 1], bCull);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Clip the segment, then draw it as a quad fLineWidth pixels wide
+inline void GLSoftRasterizer::AddLine(const ClipVertex &a, const ClipVertex &b)
+	{
+	GLfloat t0 = 0.0f, t1 = 1.0f;
+	for(int nPlane = 0; nPlane < 6; nPlane++) {
+		GLfloat d0 = PlaneDistance(a.p, nPlane);
+		GLfloat d1 = PlaneDistance(b.p, nPlane);
+		if(d0 < 0.0f && d1 < 0.0f)
+			return;
+		if(d0 < 0.0f)
+			t0 = fmaxf(t0, d0 / (d0 - d1));
+		else if(d1 < 0.0f)
+			t1 = fminf(t1, d0 / (d0 - d1));
+		}
+	if(t0 >= t1)
+		return;
+
+	ClipVertex ca, cb;
+	Lerp(a, b, t0, ca);
+	Lerp(a, b, t1, cb);
+
+	ScreenVertex sa, sb;
+	Project(ca, sa);
+	Project(cb, sb);
+
+	GLfloat dx = sb.x - sa.x, dy = sb.y - sa.y;
+	GLfloat fLength = sqrtf(dx * dx + dy * dy);
+	if(fLength < 1e-6f)
+		return;
+	GLfloat nx = -dy / fLength * fLineWidth * 0.5f;
+	GLfloat ny = dx / fLength * fLineWidth * 0.5f;
+
+	ScreenVertex quad[4] = { sa, sb, sb, sa };
+	quad[0].x += nx; quad[0].y += ny;
+	quad[1].x += nx; quad[1].y += ny;
+	quad[2].x -= nx; quad[2].y -= ny;
+	quad[3].x -= nx; quad[3].y -= ny;
+	AddQuad(quad);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A square fPointSize pixels wide, dropped if the center is clipped
+inline void GLSoftRasterizer::AddPoint(const ClipVertex &a)
+	{
+	for(int nPlane = 0; nPlane < 6; nPlane++)
+		if(PlaneDistance(a.p, nPlane) < 0.0f)
+			return;
+
+	ScreenVertex center;
+	Project(a, center);
+	GLfloat h = fPointSize * 0.5f;
+
+	ScreenVertex quad[4] = { center, center, center, center };
+	quad[0].x -= h; quad[0].y -= h;
+	quad[1].x += h; quad[1].y -= h;
+	quad[2].x += h; quad[2].y += h;
+	quad[3].x -= h; quad[3].y += h;
+	AddQuad(quad);
+	}
+
+
+inline void GLSoftRasterizer::AddQuad(const ScreenVertex v[4])
+	{
+	AddScreenTriangle(v[0], v[1], v[2], false);
+	AddScreenTriangle(v[0], v[2], v[3], false);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Edge setup and binning. Window y points up, so counter clockwise triangles
+// have a positive area. Pixels exactly on an edge belong to the triangle when
+// the edge is a top or left one, so triangles sharing an edge do not both
+// write its pixels. For that to hold the two triangles must see exactly
+// opposite edge values, so each edge is set up with its end points in a
+// fixed order and negated afterwards if needed.
+inline void GLSoftRasterizer::AddScreenTriangle(const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c, bool bCull)
+	{
+	GLfloat fArea = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	if(fArea == 0.0f || (bCull && fArea < 0.0f))
+		return;
+
+	const ScreenVertex *v[3] = { &a, &b, &c };
+	if(fArea < 0.0f) {
+		v[1] = &c;
+		v[2] = &b;
+		fArea = -fArea;
+		}
+
+	Setup s;
+	GLfloat fMinX = v[0]->x, fMaxX = v[0]->x, fMinY = v[0]->y, fMaxY = v[0]->y;
+	for(int i = 0; i < 3; i++) {
+		const ScreenVertex &p = *v[(i + 1) % 3];
+		const ScreenVertex &q = *v[(i + 2) % 3];
+		bool bSwap = (q.y < p.y) || (q.y == p.y && q.x < p.x);
+		const ScreenVertex &e0 = bSwap ? q : p;
+		const ScreenVertex &e1 = bSwap ? p : q;
+		GLfloat fSign = bSwap ? -1.0f : 1.0f;
+		GLfloat fA = e0.y - e1.y, fB = e1.x - e0.x;
+		s.A[i] = fSign * fA;
+		s.B[i] = fSign * fB;
+		s.C[i] = -fSign * (fA * e0.x + fB * e0.y);
+		// Travelling from p to q counter clockwise: left edges go down, top
+		// edges go left. That is exactly when the end points were swapped.
+		s.bTopLeft[i] = bSwap;
+
+		fMinX = fminf(fMinX, v[i]->x); fMaxX = fmaxf(fMaxX, v[i]->x);
+		fMinY = fminf(fMinY, v[i]->y); fMaxY = fmaxf(fMaxY, v[i]->y);
+		}
+
+	// Pixel centers are at +0.5
+	s.nMinX = GLint(ceilf(fMinX - 0.5f)); s.nMaxX = GLint(floorf(fMaxX - 0.5f));
+	s.nMinY = GLint(ceilf(fMinY - 0.5f)); s.nMaxY = GLint(floorf(fMaxY - 0.5f));
+	if(s.nMinX < 0) s.nMinX = 0;
+	if(s.nMinY < 0) s.nMinY = 0;
+	if(s.nMaxX > nWidth - 1) s.nMaxX = nWidth - 1;
+	if(s.nMaxY > nHeight - 1) s.nMaxY = nHeight - 1;
+	if(s.nMinX > s.nMaxX || s.nMinY > s.nMaxY)
+		return;
+
+	s.fInvArea = 1.0f / fArea;
+	s.z0 = v[0]->z; s.dz1 = v[1]->z - v[0]->z; s.dz2 = v[2]->z - v[0]->z;
+	s.w0 = v[0]->fInvW; s.dw1 = v[1]->fInvW - s.w0; s.dw2 = v[2]->fInvW - s.w0;
+	for(int i = 0; i < 4; i++) {
+		s.c0[i] = v[0]->c[i] * v[0]->fInvW;
+		s.dc1[i] = v[1]->c[i] * v[1]->fInvW - s.c0[i];
+		s.dc2[i] = v[2]->c[i] * v[2]->fInvW - s.c0[i];
+		}
+	s.bDepthTest = bDepthTest;
+	s.bFlat = (m3dCloseEnough(a.c[0], b.c[0], 1e-6f) && m3dCloseEnough(a.c[0], c.c[0], 1e-6f) &&
+			   m3dCloseEnough(a.c[1], b.c[1], 1e-6f) && m3dCloseEnough(a.c[1], c.c[1], 1e-6f) &&
+			   m3dCloseEnough(a.c[2], b.c[2], 1e-6f) && m3dCloseEnough(a.c[2], c.c[2], 1e-6f) &&
+			   m3dCloseEnough(a.c[3], b.c[3], 1e-6f) && m3dCloseEnough(a.c[3], c.c[3], 1e-6f));
+	s.flatColor = PackColor(a.c);
+
+	GLuint nIndex = GLuint(vSetups.size());
+	vSetups.push_back(s);
+	stats.nTriangles++;
+
+	int nTileX0 = s.nMinX / GLT_SOFT_TILE_SIZE, nTileX1 = s.nMaxX / GLT_SOFT_TILE_SIZE;
+	int nTileY0 = s.nMinY / GLT_SOFT_TILE_SIZE, nTileY1 = s.nMaxY / GLT_SOFT_TILE_SIZE;
+	for(int ty = nTileY0; ty <= nTileY1; ty++)
+		for(int tx = nTileX0; tx <= nTileX1; tx++)
+			vBins[ty * nTilesX + tx].push_back(nIndex);
+	stats.nTileTriangles += (nTileX1 - nTileX0 + 1) * (nTileY1 - nTileY0 + 1);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::Flush(void)
+	{
+	if(vSetups.empty())
+		return;
+
+	// One job per thread, each taking the next tile until none are left
+	GLint nTiles = nTilesX * nTilesY;
+	std::vector<GLuint> vPixels(nTiles, 0);
+	std::atomic<GLint> nNextTile(0);
+	gltGetJobSystem().ParallelFor(std::min(GLint(GetThreadCount()), nTiles), 1, [&](GLint iFirst, GLint iLast) {
+		for(GLint i = iFirst; i < iLast; i++)
+			for(GLint t = nNextTile++; t < nTiles; t = nNextTile++)
+				RasterTile(t, vPixels[t]);
+		});
+
+	for(size_t i = 0; i < vPixels.size(); i++)
+		stats.nPixels += vPixels[i];
+	for(size_t i = 0; i < vBins.size(); i++)
+		vBins[i].clear();
+	vSetups.clear();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLSoftRasterizer::RasterTile(int nTile, GLuint &nPixels)
+	{
+	const std::vector<GLuint> &bin = vBins[nTile];
+	int nTileX = (nTile % nTilesX) * GLT_SOFT_TILE_SIZE;
+	int nTileY = (nTile / nTilesX) * GLT_SOFT_TILE_SIZE;
+
+	for(size_t n = 0; n < bin.size(); n++) {
+		const Setup &s = vSetups[bin[n]];
+		int nMinX = s.nMinX > nTileX ? s.nMinX : nTileX;
+		int nMinY = s.nMinY > nTileY ? s.nMinY : nTileY;
+		int nMaxX = s.nMaxX < nTileX + GLT_SOFT_TILE_SIZE - 1 ? s.nMaxX : nTileX + GLT_SOFT_TILE_SIZE - 1;
+		int nMaxY = s.nMaxY < nTileY + GLT_SOFT_TILE_SIZE - 1 ? s.nMaxY : nTileY + GLT_SOFT_TILE_SIZE - 1;
+
+#ifdef GLT_SOFT_RASTER_SSE
+		const __m128 vLane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 vZero = _mm_setzero_ps();
+		const __m128 vInvArea = _mm_set1_ps(s.fInvArea);
+		const __m128i vFlatColor = _mm_set1_epi32(int(s.flatColor));
+		__m128 vA[3], vTopLeft[3];
+		for(int e = 0; e < 3; e++) {
+			vA[e] = _mm_set1_ps(s.A[e]);
+			vTopLeft[e] = _mm_castsi128_ps(_mm_set1_epi32(s.bTopLeft[e] ? -1 : 0));
+			}
+
+		int nStartX = nMinX & ~3;
+		for(int y = nMinY; y <= nMaxY; y++) {
+			GLfloat fy = GLfloat(y) + 0.5f;
+			GLuint *pColorRow = &vColor[size_t(y) * nStride];
+			GLfloat *pDepthRow = &vDepth[size_t(y) * nStride];
+
+			for(int x = nStartX; x <= nMaxX; x += 4) {
+				__m128 vX = _mm_add_ps(_mm_set1_ps(GLfloat(x)), vLane);
+				__m128 vE[3];
+				__m128 vMask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for(int e = 0; e < 3; e++) {
+					vE[e] = _mm_add_ps(_mm_mul_ps(vA[e], vX), _mm_set1_ps(s.B[e] * fy + s.C[e]));
+					__m128 vInside = _mm_or_ps(_mm_cmpgt_ps(vE[e], vZero), _mm_and_ps(_mm_cmpeq_ps(vE[e], vZero), vTopLeft[e]));
+					vMask = _mm_and_ps(vMask, vInside);
+					}
+
+				// Pixels of the group outside the bounding box
+				__m128 vXi = _mm_sub_ps(vX, _mm_set1_ps(0.5f));
+				vMask = _mm_and_ps(vMask, _mm_cmpge_ps(vXi, _mm_set1_ps(GLfloat(nMinX))));
+				vMask = _mm_and_ps(vMask, _mm_cmple_ps(vXi, _mm_set1_ps(GLfloat(nMaxX))));
+				if(_mm_movemask_ps(vMask) == 0)
+					continue;
+
+				__m128 vB1 = _mm_mul_ps(vE[1], vInvArea);
+				__m128 vB2 = _mm_mul_ps(vE[2], vInvArea);
+				__m128 vZ = _mm_add_ps(_mm_set1_ps(s.z0), _mm_add_ps(_mm_mul_ps(vB1, _mm_set1_ps(s.dz1)), _mm_mul_ps(vB2, _mm_set1_ps(s.dz2))));
+				__m128 vOldZ = _mm_loadu_ps(pDepthRow + x);
+				if(s.bDepthTest)
+					vMask = _mm_and_ps(vMask, _mm_cmplt_ps(vZ, vOldZ));
+				int nBits = _mm_movemask_ps(vMask);
+				if(nBits == 0)
+					continue;
+
+				__m128i vNew;
+				if(s.bFlat)
+					vNew = vFlatColor;
+				else {
+					__m128 vW = _mm_add_ps(_mm_set1_ps(s.w0), _mm_add_ps(_mm_mul_ps(vB1, _mm_set1_ps(s.dw1)), _mm_mul_ps(vB2, _mm_set1_ps(s.dw2))));
+					__m128 vInvW = _mm_div_ps(_mm_set1_ps(255.0f), vW);
+					vNew = _mm_setzero_si128();
+					for(int i = 0; i < 4; i++) {
+						__m128 vC = _mm_add_ps(_mm_set1_ps(s.c0[i]), _mm_add_ps(_mm_mul_ps(vB1, _mm_set1_ps(s.dc1[i])), _mm_mul_ps(vB2, _mm_set1_ps(s.dc2[i]))));
+						vC = _mm_min_ps(_mm_max_ps(_mm_mul_ps(vC, vInvW), vZero), _mm_set1_ps(255.0f));
+						__m128i vByte = _mm_cvtps_epi32(vC);
+						vNew = _mm_or_si128(vNew, _mm_slli_epi32(vByte, i * 8));
+						}
+					}
+
+				__m128i vIntMask = _mm_castps_si128(vMask);
+				__m128i vOld = _mm_loadu_si128((const __m128i *)(pColorRow + x));
+				_mm_storeu_si128((__m128i *)(pColorRow + x), _mm_or_si128(_mm_and_si128(vIntMask, vNew), _mm_andnot_si128(vIntMask, vOld)));
+				_mm_storeu_ps(pDepthRow + x, _mm_or_ps(_mm_and_ps(vMask, vZ), _mm_andnot_ps(vMask, vOldZ)));
+
+				nPixels += (nBits & 1) + ((nBits >> 1) & 1) + ((nBits >> 2) & 1) + ((nBits >> 3) & 1);
+				}
+			}
+#else
+		for(int y = nMinY; y <= nMaxY; y++) {
+			GLfloat fy = GLfloat(y) + 0.5f;
+			GLuint *pColorRow = &vColor[size_t(y) * nStride];
+			GLfloat *pDepthRow = &vDepth[size_t(y) * nStride];
+
+			for(int x = nMinX; x <= nMaxX; x++) {
+				GLfloat fx = GLfloat(x) + 0.5f;
+				GLfloat E[3];
+				bool bInside = true;
+				for(int e = 0; e < 3 && bInside; e++) {
+					E[e] = s.A[e] * fx + s.B[e] * fy + s.C[e];
+					bInside = E[e] > 0.0f || (E[e] == 0.0f && s.bTopLeft[e]);
+					}
+				if(!bInside)
+					continue;
+
+				GLfloat b1 = E[1] * s.fInvArea, b2 = E[2] * s.fInvArea;
+				GLfloat z = s.z0 + b1 * s.dz1 + b2 * s.dz2;
+				if(s.bDepthTest && !(z < pDepthRow[x]))
+					continue;
+
+				if(s.bFlat)
+					pColorRow[x] = s.flatColor;
+				else {
+					GLfloat fInvW = 1.0f / (s.w0 + b1 * s.dw1 + b2 * s.dw2);
+					GLfloat c[4];
+					for(int i = 0; i < 4; i++)
+						c[i] = (s.c0[i] + b1 * s.dc1[i] + b2 * s.dc2[i]) * fInvW;
+					pColorRow[x] = PackColor(c);
+					}
+				pDepthRow[x] = z;
+				nPixels++;
+				}
+			}
+#endif
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Uncompressed 32 bit TGA, bottom row first like gltWriteTGA()
+inline bool GLSoftRasterizer::SaveTGA(const char *szFileName)
+	{
+	Flush();
+	if(nWidth == 0)
+		return false;
+
+	FILE *pFile = fopen(szFileName, "wb");
+	if(pFile == NULL)
+		return false;
+
+	unsigned char header[18] = { 0 };
+	header[2] = 2;									// Uncompressed true color
+	header[12] = (unsigned char)(nWidth & 0xFF);
+	header[13] = (unsigned char)(nWidth >> 8);
+	header[14] = (unsigned char)(nHeight & 0xFF);
+	header[15] = (unsigned char)(nHeight >> 8);
+	header[16] = 32;
+	header[17] = 8;									// Alpha bits
+	bool bOk = fwrite(header, sizeof(header), 1, pFile) == 1;
+
+	std::vector<unsigned char> vRow(nWidth * 4);
+	for(int y = 0; y < nHeight && bOk; y++) {
+		const GLuint *pRow = &vColor[size_t(y) * nStride];
+		for(int x = 0; x < nWidth; x++) {
+			vRow[x * 4 + 0] = (unsigned char)(pRow[x] >> 16);		// BGRA
+			vRow[x * 4 + 1] = (unsigned char)(pRow[x] >> 8);
+			vRow[x * 4 + 2] = (unsigned char)(pRow[x]);
+			vRow[x * 4 + 3] = (unsigned char)(pRow[x] >> 24);
+			}
+		bOk = fwrite(&vRow[0], vRow.size(), 1, pFile) == 1;
+		}
+
+	fclose(pFile);
+	return bOk;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// One row of gltSoftRasterBenchmark()
+struct GLTSoftRasterBenchmark
+	{
+	int		nThreads;
+	float	fSeconds;				// Per frame, best of the repeats
+	float	fMTrianglesPerSecond;	// GLTSoftRasterStats::nTriangles
+	float	fMPixelsPerSecond;		// GLTSoftRasterStats::nPixels
+	};
+
+///////////////////////////////////////////////////////////////////////////////
+// Throughput and scaling benchmark. A frame clears, draws mesh with the flat
+// shader once per matrix in pMVPs and flushes. Each thread count from 1 to
+// nMaxThreads (at most the shared pool) is timed over nFrames frames, best
+// of nRepeats, with gltJobScaling(). vResults[n - 1] is for n threads.
+// The thread limit is set back to the whole pool afterwards.
+inline void gltSoftRasterBenchmark(GLSoftRasterizer &raster, const GLSoftMesh &mesh, const M3DMatrix44f *pMVPs,
+								   int nInstances, int nFrames, int nMaxThreads, int nRepeats,
+								   std::vector<GLTSoftRasterBenchmark> &vResults)
+	{
+	static const M3DVector4f vColor = { 0.0f, 0.0f, 1.0f, 1.0f };
+	if(nFrames < 1)
+		nFrames = 1;
+
+	// Every frame does the same work, so the last frame's stats stand for all
+	std::vector<GLTSoftRasterStats> vStats;
+	std::vector<float> vSeconds;
+	gltJobScaling(nMaxThreads, nRepeats, [&](int nThreads) {
+		raster.SetThreadCount(nThreads);
+		for(int f = 0; f < nFrames; f++) {
+			raster.Clear(1.0f, 1.0f, 1.0f, 1.0f);
+			raster.ResetStats();
+			for(int i = 0; i < nInstances; i++)
+				raster.DrawFlat(mesh, pMVPs[i], vColor);
+			raster.Flush();
+			}
+		vStats.resize(nThreads);
+		vStats[nThreads - 1] = raster.GetStats();
+		}, vSeconds);
+	raster.SetThreadCount(0);
+
+	vResults.resize(vSeconds.size());
+	for(size_t n = 0; n < vSeconds.size(); n++) {
+		GLTSoftRasterBenchmark &result = vResults[n];
+		result.nThreads = int(n) + 1;
+		result.fSeconds = vSeconds[n] / float(nFrames);
+		float fPerSecond = (result.fSeconds > 0.0f) ? 1e-6f / result.fSeconds : 0.0f;
+		result.fMTrianglesPerSecond = float(vStats[n].nTriangles) * fPerSecond;
+		result.fMPixelsPerSecond = float(vStats[n].nPixels) * fPerSecond;
+		}
+	}
+
+#endif
@@ -0,0 +1,495 @@
+// GLStreamBatch.h
+// Immediate mode emulation for geometry that is rebuilt every frame.
+//
+// GLBatch needs the exact vertex count in Begin(), and Reset() throws the
+// arrays away. GLStreamBatch grows its client arrays geometrically as
+// vertices arrive. Reset() and Begin() keep both the client arrays and the
+// buffer object, so a batch rebuilt each frame with about the same amount
+// of geometry stops allocating after the first few frames.
+//
+// The calls are the same as GLBatch. Normal, color and texture coordinates
+// are current values, so set them before the Vertex3f() they belong to, as
+// with GLBatch. An attribute that is never set is not stored or uploaded.
+//
+// All attributes share one buffer object, one block per attribute, sized
+// for the current capacity. The vertex array object only has to be
+// rebuilt when that capacity or the set of attributes changes.
+//
+// With SetStreamBuffer(), the first Vertex3f() after Begin() maps a range of
+// this frame's region of a GLStreamBuffer, and each vertex is written into
+// it interleaved as it arrives. The client arrays are not touched, End()
+// only unmaps, and there is no buffer object of its own. The mapping starts
+// at the hint or last End()'s count and doubles when full. Vertices past the
+// end of the region are dropped and counted by GetDroppedVertexCount(). If
+// nothing can be mapped at all the batch falls back to its client arrays.
+// The layout is fixed by the attributes set before that first vertex; one
+// set for the first time later is left out until the next Begin(). The
+// batch must be rebuilt every frame it is drawn, since the region is reused
+// a few frames later.
+
+#ifndef __GLT_STREAM_BATCH
+#define __GLT_STREAM_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLShaderManager.h"
+#include "GLStreamBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GLT_STREAM_MAX_TEXTURES	4
+
+// Smallest capacity a batch grows to
+#define GLT_STREAM_MIN_VERTS	64
+
+class GLStreamBatch : public GLBatchBase
+	{
+	public:
+		GLStreamBatch(void) {
+			primitiveType = GL_TRIANGLES;
+			nNumVerts = 0;
+			nCapacity = 0;
+			nNumTextureUnits = 0;
+			pVerts = NULL;
+			pNormals = NULL;
+			pColors = NULL;
+			for(int i = 0; i < GLT_STREAM_MAX_TEXTURES; i++)
+				pTexCoords[i] = NULL;
+
+			m3dLoadVector3(vNormal, 0.0f, 0.0f, 1.0f);
+			m3dLoadVector4(vColor, 1.0f, 1.0f, 1.0f, 1.0f);
+			memset(vTexCoord, 0, sizeof(vTexCoord));
+
+			uiBuffer = 0;
+			vertexArrayObject = 0;
+			nBufferVerts = 0;
+			nUploadedVerts = 0;
+			nFirstVert = 0;
+			uiArraySource = 0;
+			nArrayBlockVerts = 0;
+			nArrayLayout = 0;
+			pStream = NULL;
+
+			nAttribs = 1;
+			nVertsHint = 0;
+			bStreamOpen = false;
+			pWrite = NULL;
+			nWriteCapacity = 0;
+			nWriteStride = 0;
+			nWriteLayout = 0;
+			nWriteOffset = 0;
+			nDroppedVerts = 0;
+			}
+
+		virtual ~GLStreamBatch(void) {
+			free(pVerts);
+			free(pNormals);
+			free(pColors);
+			for(int i = 0; i < GLT_STREAM_MAX_TEXTURES; i++)
+				free(pTexCoords[i]);
+
+			if(uiBuffer != 0)
+				glDeleteBuffers(1, &uiBuffer);
+			if(vertexArrayObject != 0)
+				glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		// Start a new batch. nHint only reserves space, the batch still
+		// takes as many vertices as it is given.
+		void Begin(GLenum primitive, GLuint nHint = 0, GLuint nTextureUnits = 0) {
+			primitiveType = primitive;
+			if(nTextureUnits > GLT_STREAM_MAX_TEXTURES)
+				nTextureUnits = GLT_STREAM_MAX_TEXTURES;
+			nNumTextureUnits = nTextureUnits;
+			Reset();
+			nVertsHint = nHint;
+			nDroppedVerts = 0;
+			bStreamOpen = (pStream != NULL);
+			if(!bStreamOpen)
+				Reserve(nHint);
+			}
+
+		// Upload what has been built so far
+		void End(void);
+
+		// Forget the vertices but keep the storage. A stream range mapped
+		// so far stays used until the end of the frame.
+		inline void Reset(void) {
+			nNumVerts = 0;
+			if(pWrite != NULL) {
+				pStream->Unmap();
+				pWrite = NULL;
+				nWriteCapacity = 0;
+				}
+			}
+
+		// Make room for at least nVerts without further allocation
+		void Reserve(GLuint nVerts) {
+			if(nVerts > nCapacity)
+				Resize(nVerts);
+			}
+
+		virtual void Draw(void) {
+			if(nUploadedVerts == 0)
+				return;
+
+			glBindVertexArray(vertexArrayObject);
+			glDrawArrays(primitiveType, nFirstVert, nUploadedVerts);
+			glBindVertexArray(0);
+			}
+
+		// Write into pBuffer from the next Begin() on. NULL goes back to the
+		// batch's own buffer. Not between Begin() and End().
+		inline void SetStreamBuffer(GLStreamBuffer *pBuffer) { pStream = pBuffer; }
+
+		inline GLuint GetVertexCount(void) const { return nNumVerts; }
+		inline GLuint GetCapacity(void) const { return nCapacity; }
+		inline GLuint GetDroppedVertexCount(void) const { return nDroppedVerts; }
+
+		inline void Vertex3f(GLfloat x, GLfloat y, GLfloat z) {
+			if(bStreamOpen) {
+				StreamVertex(x, y, z);
+				return;
+				}
+
+			if(nNumVerts == nCapacity)
+				Resize(nCapacity * 2 > GLT_STREAM_MIN_VERTS ? nCapacity * 2 : GLT_STREAM_MIN_VERTS);
+
+			m3dLoadVector3(pVerts[nNumVerts], x, y, z);
+			if(pNormals != NULL)
+				m3dCopyVector3(pNormals[nNumVerts], vNormal);
+			if(pColors != NULL)
+				m3dCopyVector4(pColors[nNumVerts], vColor);
+			for(GLuint i = 0; i < nNumTextureUnits; i++)
+				if(pTexCoords[i] != NULL)
+					m3dCopyVector2(pTexCoords[i][nNumVerts], vTexCoord[i]);
+			nNumVerts++;
+			}
+		inline void Vertex3fv(M3DVector3f vVertex) { Vertex3f(vVertex[0], vVertex[1], vVertex[2]); }
+
+		inline void Normal3f(GLfloat x, GLfloat y, GLfloat z) {
+			if(pNormals == NULL && !bStreamOpen)
+				pNormals = (M3DVector3f *)EnableArray(sizeof(M3DVector3f), vNormal);
+			nAttribs |= 2;
+			m3dLoadVector3(vNormal, x, y, z);
+			}
+		inline void Normal3fv(M3DVector3f vNorm) { Normal3f(vNorm[0], vNorm[1], vNorm[2]); }
+
+		inline void Color4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+			if(pColors == NULL && !bStreamOpen)
+				pColors = (M3DVector4f *)EnableArray(sizeof(M3DVector4f), vColor);
+			nAttribs |= 4;
+			m3dLoadVector4(vColor, r, g, b, a);
+			}
+		inline void Color4fv(M3DVector4f vColor) { Color4f(vColor[0], vColor[1], vColor[2], vColor[3]); }
+
+		inline void MultiTexCoord2f(GLuint texture, GLclampf s, GLclampf t) {
+			if(texture >= nNumTextureUnits)
+				return;
+			if(pTexCoords[texture] == NULL && !bStreamOpen)
+				pTexCoords[texture] = (M3DVector2f *)EnableArray(sizeof(M3DVector2f), vTexCoord[texture]);
+			nAttribs |= 8 << texture;
+			vTexCoord[texture][0] = s;
+			vTexCoord[texture][1] = t;
+			}
+		inline void MultiTexCoord2fv(GLuint texture, M3DVector2f vTex) { MultiTexCoord2f(texture, vTex[0], vTex[1]); }
+
+	protected:
+		// Grow every enabled array to nNewCapacity vertices
+		void Resize(GLuint nNewCapacity) {
+			pVerts = (M3DVector3f *)realloc(pVerts, nNewCapacity * sizeof(M3DVector3f));
+			if(pNormals != NULL)
+				pNormals = (M3DVector3f *)realloc(pNormals, nNewCapacity * sizeof(M3DVector3f));
+			if(pColors != NULL)
+				pColors = (M3DVector4f *)realloc(pColors, nNewCapacity * sizeof(M3DVector4f));
+			for(int i = 0; i < GLT_STREAM_MAX_TEXTURES; i++)
+				if(pTexCoords[i] != NULL)
+					pTexCoords[i] = (M3DVector2f *)realloc(pTexCoords[i], nNewCapacity * sizeof(M3DVector2f));
+			nCapacity = nNewCapacity;
+			}
+
+		// Allocate an attribute the first time it is used. Vertices already
+		// emitted get the current (default) value.
+		void *EnableArray(size_t nElementSize, const GLfloat *pCurrent) {
+			GLuint nSize = (nCapacity > 0) ? nCapacity : 1;
+			unsigned char *pArray = (unsigned char *)malloc(nSize * nElementSize);
+			for(GLuint i = 0; i < nNumVerts; i++)
+				memcpy(pArray + i * nElementSize, pCurrent, nElementSize);
+			return pArray;
+			}
+
+		// Bit per attribute currently stored in the client arrays
+		GLuint GetLayout(void) const {
+			GLuint nLayout = 1;
+			if(pNormals != NULL) nLayout |= 2;
+			if(pColors != NULL) nLayout |= 4;
+			for(GLuint i = 0; i < nNumTextureUnits; i++)
+				if(pTexCoords[i] != NULL)
+					nLayout |= 8 << i;
+			return nLayout;
+			}
+
+		// Bytes per vertex for a layout
+		static GLuint GetStride(GLuint nLayout) {
+			GLuint nStride = sizeof(M3DVector3f);
+			if(nLayout & 2) nStride += sizeof(M3DVector3f);
+			if(nLayout & 4) nStride += sizeof(M3DVector4f);
+			for(GLuint i = 0; i < GLT_STREAM_MAX_TEXTURES; i++)
+				if(nLayout & (8 << i))
+					nStride += sizeof(M3DVector2f);
+			return nStride;
+			}
+
+		void SetupVertexArray(GLuint uiSource, GLuint nBlockVerts, GLuint nLayout);
+		void StreamVertex(GLfloat x, GLfloat y, GLfloat z);
+		bool GrowStream(void);
+
+		GLenum		primitiveType;
+
+		GLuint		nNumVerts;			// Vertices built since Begin()/Reset()
+		GLuint		nCapacity;			// Vertices the client arrays hold
+		GLuint		nNumTextureUnits;
+
+		M3DVector3f	*pVerts;
+		M3DVector3f	*pNormals;
+		M3DVector4f	*pColors;
+		M3DVector2f	*pTexCoords[GLT_STREAM_MAX_TEXTURES];
+
+		// Current attribute values
+		M3DVector3f	vNormal;
+		M3DVector4f	vColor;
+		M3DVector2f	vTexCoord[GLT_STREAM_MAX_TEXTURES];
+
+		GLuint		uiBuffer;
+		GLuint		vertexArrayObject;
+		GLuint		nBufferVerts;		// Vertices each block of the buffer holds
+		GLuint		nUploadedVerts;		// Vertices Draw() will draw
+		GLint		nFirstVert;			// Where they start in the source buffer
+
+		// What the vertex array object currently points at
+		GLuint		uiArraySource;
+		GLuint		nArrayBlockVerts;	// 0 when interleaved
+		GLuint		nArrayLayout;
+
+		GLStreamBuffer	*pStream;
+
+		GLuint		nAttribs;			// Bit per attribute ever set
+		GLuint		nVertsHint;
+		bool		bStreamOpen;		// Begin() with a stream buffer, until End()
+
+		// Range mapped in the stream buffer, NULL before the first vertex
+		unsigned char	*pWrite;
+		GLuint		nWriteCapacity;		// Vertices it holds
+		GLuint		nWriteStride;
+		GLuint		nWriteLayout;
+		GLintptr	nWriteOffset;
+		GLuint		nDroppedVerts;
+
+	private:
+		GLStreamBatch(const GLStreamBatch&);
+		GLStreamBatch &operator=(const GLStreamBatch&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Point the vertex array object at uiSource. With nBlockVerts the
+// attributes in nLayout are blocks of that many vertices: verts, normals,
+// colors, then texture units. With 0 they are interleaved in the same order.
+inline void GLStreamBatch::SetupVertexArray(GLuint uiSource, GLuint nBlockVerts, GLuint nLayout)
+	{
+	if(vertexArrayObject == 0)
+		glGenVertexArrays(1, &vertexArrayObject);
+
+	glBindVertexArray(vertexArrayObject);
+	glBindBuffer(GL_ARRAY_BUFFER, uiSource);
+
+	GLsizei nStride = (nBlockVerts == 0) ? GetStride(nLayout) : 0;
+	GLuint nAdvance = (nBlockVerts == 0) ? 1 : nBlockVerts;
+	GLubyte *pOffset = NULL;
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nStride, pOffset);
+	pOffset += nAdvance * sizeof(M3DVector3f);
+
+	if(nLayout & 2) {
+		glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+		glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nStride, pOffset);
+		pOffset += nAdvance * sizeof(M3DVector3f);
+		}
+	else
+		glDisableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+
+	if(nLayout & 4) {
+		glEnableVertexAttribArray(GLT_ATTRIBUTE_COLOR);
+		glVertexAttribPointer(GLT_ATTRIBUTE_COLOR, 4, GL_FLOAT, GL_FALSE, nStride, pOffset);
+		pOffset += nAdvance * sizeof(M3DVector4f);
+		}
+	else
+		glDisableVertexAttribArray(GLT_ATTRIBUTE_COLOR);
+
+	for(GLuint i = 0; i < GLT_STREAM_MAX_TEXTURES; i++) {
+		if(nLayout & (8 << i)) {
+			glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0 + i);
+			glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0 + i, 2, GL_FLOAT, GL_FALSE, nStride, pOffset);
+			pOffset += nAdvance * sizeof(M3DVector2f);
+			}
+		else
+			glDisableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0 + i);
+		}
+
+	glBindVertexArray(0);
+	uiArraySource = uiSource;
+	nArrayBlockVerts = nBlockVerts;
+	nArrayLayout = nLayout;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Write one vertex, with the current attributes, straight into the mapped
+// stream range
+inline void GLStreamBatch::StreamVertex(GLfloat x, GLfloat y, GLfloat z)
+	{
+	if(nNumVerts == nWriteCapacity && !GrowStream()) {
+		if(bStreamOpen)
+			nDroppedVerts++;
+		else
+			Vertex3f(x, y, z);			// Fell back to the client arrays
+		return;
+		}
+
+	GLfloat *pDst = (GLfloat *)(pWrite + nNumVerts * nWriteStride);
+	m3dLoadVector3(pDst, x, y, z);
+	pDst += 3;
+	if(nWriteLayout & 2) {
+		m3dCopyVector3(pDst, vNormal);
+		pDst += 3;
+		}
+	if(nWriteLayout & 4) {
+		m3dCopyVector4(pDst, vColor);
+		pDst += 4;
+		}
+	for(GLuint i = 0; i < nNumTextureUnits; i++)
+		if(nWriteLayout & (8 << i)) {
+			m3dCopyVector2(pDst, vTexCoord[i]);
+			pDst += 2;
+			}
+	nNumVerts++;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Map the range at the first vertex, or double it when full. The offset is a
+// multiple of the stride, so Draw() can start at a vertex index and the
+// vertex array object stays valid from frame to frame. Returns false when
+// there is no more room; at the first vertex that also closes the stream
+// and readies the client arrays.
+inline bool GLStreamBatch::GrowStream(void)
+	{
+	if(pWrite == NULL) {
+		GLuint nTexMask = ((1 << nNumTextureUnits) - 1) << 3;
+		nWriteLayout = nAttribs & (7 | nTexMask);
+		nWriteStride = GetStride(nWriteLayout);
+
+		GLuint nVerts = (nVertsHint > nUploadedVerts) ? nVertsHint : nUploadedVerts;
+		if(nVerts < GLT_STREAM_MIN_VERTS)
+			nVerts = GLT_STREAM_MIN_VERTS;
+		pWrite = (unsigned char *)pStream->Map(GLsizeiptr(nVerts) * nWriteStride, nWriteStride, &nWriteOffset);
+		if(pWrite == NULL) {
+			bStreamOpen = false;
+			if((nAttribs & 2) && pNormals == NULL)
+				pNormals = (M3DVector3f *)EnableArray(sizeof(M3DVector3f), vNormal);
+			if((nAttribs & 4) && pColors == NULL)
+				pColors = (M3DVector4f *)EnableArray(sizeof(M3DVector4f), vColor);
+			for(GLuint i = 0; i < nNumTextureUnits; i++)
+				if((nAttribs & (8 << i)) && pTexCoords[i] == NULL)
+					pTexCoords[i] = (M3DVector2f *)EnableArray(sizeof(M3DVector2f), vTexCoord[i]);
+			Reserve(nVerts);
+			return false;
+			}
+		nWriteCapacity = nVerts;
+		return true;
+		}
+
+	// Once Extend() has failed the old pointer may not be written again
+	if(nDroppedVerts > 0)
+		return false;
+
+	// Double, or take what is left of the region
+	GLuint nGrow = nWriteCapacity;
+	GLuint nFree = GLuint(pStream->GetBytesFree() / nWriteStride);
+	if(nGrow > nFree)
+		nGrow = nFree;
+	if(nGrow == 0)
+		return false;
+
+	unsigned char *pGrown = (unsigned char *)pStream->Extend(GLsizeiptr(nWriteCapacity + nGrow) * nWriteStride);
+	if(pGrown == NULL)
+		return false;
+	pWrite = pGrown;
+	nWriteCapacity += nGrow;
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Streamed vertices are already in place, so End() only unmaps them.
+// Without a stream buffer, or when it was full, the batch uses its own
+// buffer. That buffer only grows, to the client capacity. Otherwise it is
+// orphaned with glBufferData(NULL) so the driver can hand back fresh
+// storage rather than wait for last frame's draw, then each block is
+// written with glBufferSubData().
+inline void GLStreamBatch::End(void)
+	{
+	nUploadedVerts = nNumVerts;
+	if(bStreamOpen) {
+		bStreamOpen = false;
+		if(pWrite == NULL)
+			return;
+
+		pStream->Unmap();
+		pWrite = NULL;
+		nWriteCapacity = 0;
+		nFirstVert = GLint(nWriteOffset / nWriteStride);
+		if(uiArraySource != pStream->GetBuffer() || nArrayBlockVerts != 0 || nArrayLayout != nWriteLayout)
+			SetupVertexArray(pStream->GetBuffer(), 0, nWriteLayout);
+		return;
+		}
+
+	if(nNumVerts == 0)
+		return;
+
+	nFirstVert = 0;
+	if(uiBuffer == 0)
+		glGenBuffers(1, &uiBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+
+	bool bRebuild = (uiArraySource != uiBuffer || nArrayBlockVerts != nBufferVerts || nArrayLayout != GetLayout());
+	if(nNumVerts > nBufferVerts) {
+		nBufferVerts = nCapacity;
+		bRebuild = true;
+		}
+	glBufferData(GL_ARRAY_BUFFER, nBufferVerts * GetStride(GetLayout()), NULL, GL_DYNAMIC_DRAW);
+
+	GLintptr nOffset = 0;
+	glBufferSubData(GL_ARRAY_BUFFER, nOffset, nNumVerts * sizeof(M3DVector3f), pVerts);
+	nOffset += nBufferVerts * sizeof(M3DVector3f);
+	if(pNormals != NULL) {
+		glBufferSubData(GL_ARRAY_BUFFER, nOffset, nNumVerts * sizeof(M3DVector3f), pNormals);
+		nOffset += nBufferVerts * sizeof(M3DVector3f);
+		}
+	if(pColors != NULL) {
+		glBufferSubData(GL_ARRAY_BUFFER, nOffset, nNumVerts * sizeof(M3DVector4f), pColors);
+		nOffset += nBufferVerts * sizeof(M3DVector4f);
+		}
+	for(GLuint i = 0; i < nNumTextureUnits; i++)
+		if(pTexCoords[i] != NULL) {
+			glBufferSubData(GL_ARRAY_BUFFER, nOffset, nNumVerts * sizeof(M3DVector2f), pTexCoords[i]);
+			nOffset += nBufferVerts * sizeof(M3DVector2f);
+			}
+
+	if(bRebuild)
+		SetupVertexArray(uiBuffer, nBufferVerts, GetLayout());
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+#endif
@@ -0,0 +1,304 @@
+// GLStreamBuffer.h
+// Ring buffer for vertex data written every frame.
+//
+// The buffer is split into one region per frame in flight (three by
+// default). Each frame's data is suballocated from the current region.
+// EndFrame() fences the region and moves to the next one, waiting only if
+// the GPU has not finished the frame that last used it. With the first two
+// ways below, writes go straight into mapped buffer memory, so there is no
+// client copy to upload and no implicit sync in glBufferData(). The third
+// still copies, but only once per Map() and without stalling.
+//
+// How the memory is reached depends on what the context and GLEW offer:
+//	- GL_MAP_PERSISTENT_BIT and glBufferStorage: mapped once, never unmapped.
+//	  Only compiled with a GLEW new enough to define them, which the bundled
+//	  one (4.2) is not.
+//	- glMapBufferRange and sync objects: each Map() maps just the requested
+//	  range with GL_MAP_UNSYNCHRONIZED_BIT. The fences do the syncing.
+//	- Neither: Map() hands out client memory, and Unmap() copies it with
+//	  glBufferSubData(). The buffer is orphaned at the start of each frame
+//	  so the driver does not stall on the previous one.
+//
+// Data lives for the frame it was written in. Anything drawn again in a
+// later frame has to be written again.
+
+#ifndef __GLT_STREAM_BUFFER
+#define __GLT_STREAM_BUFFER
+
+#include "GLTools.h"
+#include <stdlib.h>
+
+#define GLT_STREAM_MAX_FRAMES	4
+
+class GLStreamBuffer
+	{
+	public:
+		enum MODE { MODE_NONE, MODE_PERSISTENT, MODE_UNSYNCHRONIZED, MODE_ORPHAN };
+
+		GLStreamBuffer(void) {
+			uiBuffer = 0;
+			nMode = MODE_NONE;
+			nRegionBytes = 0;
+			nFrames = 0;
+			nFrame = 0;
+			nUsed = 0;
+			pPersistent = NULL;
+			pClient = NULL;
+			pMapped = NULL;
+			nMapOffset = 0;
+			nMapBytes = 0;
+			bOrphan = false;
+			for(int i = 0; i < GLT_STREAM_MAX_FRAMES; i++)
+				fences[i] = 0;
+			}
+
+		~GLStreamBuffer(void) { Shutdown(); }
+
+		// Allocate nBytesPerFrame for each of nFramesInFlight frames
+		bool Init(GLsizeiptr nBytesPerFrame, int nFramesInFlight = 3);
+		void Shutdown(void);
+
+		// Reserve nBytes in this frame's region, starting at a multiple of
+		// nAlign from the start of the buffer. Returns where to write, and the
+		// buffer offset in *pOffset, or NULL when the region is full. Every
+		// successful Map() must be followed by Unmap() before drawing.
+		void *Map(GLsizeiptr nBytes, GLsizeiptr nAlign, GLintptr *pOffset);
+		void Unmap(void);
+
+		// Grow the outstanding Map() to nBytes in place, keeping what has
+		// been written. Returns its start, which may have moved, or NULL if
+		// the region has no room or something else was mapped since. After
+		// NULL what was written is still kept and drawn, but nothing more may
+		// be written through the old pointer.
+		void *Extend(GLsizeiptr nBytes);
+
+		// Call once per frame after the frame's draws have been issued
+		void EndFrame(void);
+
+		inline GLuint GetBuffer(void) const { return uiBuffer; }
+		inline MODE GetMode(void) const { return nMode; }
+		inline GLsizeiptr GetBytesFree(void) const { return nRegionBytes - nUsed; }
+
+	protected:
+		GLuint			uiBuffer;
+		MODE			nMode;
+		GLsizeiptr		nRegionBytes;
+		int				nFrames;
+		int				nFrame;			// Region being written
+		GLsizeiptr		nUsed;			// Bytes used in it
+		GLsync			fences[GLT_STREAM_MAX_FRAMES];
+
+		unsigned char	*pPersistent;	// MODE_PERSISTENT mapping of the whole buffer
+		unsigned char	*pClient;		// MODE_ORPHAN staging copy of the whole buffer
+		void			*pMapped;		// What the outstanding Map() returned
+		GLintptr		nMapOffset;		// Range of the outstanding Map()
+		GLsizeiptr		nMapBytes;
+		bool			bOrphan;		// MODE_ORPHAN, nothing written yet this frame
+
+	private:
+		GLStreamBuffer(const GLStreamBuffer&);
+		GLStreamBuffer &operator=(const GLStreamBuffer&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLStreamBuffer::Init(GLsizeiptr nBytesPerFrame, int nFramesInFlight)
+	{
+	Shutdown();
+
+	if(nFramesInFlight < 1)
+		nFramesInFlight = 1;
+	if(nFramesInFlight > GLT_STREAM_MAX_FRAMES)
+		nFramesInFlight = GLT_STREAM_MAX_FRAMES;
+
+	nFrames = nFramesInFlight;
+	nRegionBytes = nBytesPerFrame;
+	nFrame = 0;
+	nUsed = 0;
+	bOrphan = false;
+	GLsizeiptr nTotal = nRegionBytes * nFrames;
+
+	glGenBuffers(1, &uiBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+
+	bool bSync = (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+#ifdef GL_MAP_PERSISTENT_BIT
+	if(bSync && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, nTotal, NULL, flags);
+		pPersistent = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, nTotal, flags);
+		if(pPersistent != NULL)
+			nMode = MODE_PERSISTENT;
+		else {
+			// Storage from glBufferStorage() is immutable, so the fallback
+			// below needs a buffer object of its own
+			glDeleteBuffers(1, &uiBuffer);
+			glGenBuffers(1, &uiBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+			}
+		}
+#endif
+
+	if(nMode == MODE_NONE) {
+		glBufferData(GL_ARRAY_BUFFER, nTotal, NULL, GL_STREAM_DRAW);
+		if(bSync && (GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range))
+			nMode = MODE_UNSYNCHRONIZED;
+		else {
+			pClient = (unsigned char *)malloc(nTotal);
+			nMode = MODE_ORPHAN;
+			}
+		}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStreamBuffer::Shutdown(void)
+	{
+	for(int i = 0; i < GLT_STREAM_MAX_FRAMES; i++)
+		if(fences[i] != 0) {
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+			}
+
+	if(uiBuffer != 0) {
+		if(pPersistent != NULL) {
+			glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+		glDeleteBuffers(1, &uiBuffer);
+		uiBuffer = 0;
+		}
+
+	free(pClient);
+	pClient = NULL;
+	pPersistent = NULL;
+	pMapped = NULL;
+	nMapBytes = 0;
+	nMode = MODE_NONE;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void *GLStreamBuffer::Map(GLsizeiptr nBytes, GLsizeiptr nAlign, GLintptr *pOffset)
+	{
+	if(nMode == MODE_NONE)
+		return NULL;
+
+	// Align the absolute offset, since that is what vertex attributes see
+	GLintptr nBase = GLintptr(nFrame) * nRegionBytes;
+	GLintptr nStart = nBase + nUsed;
+	if(nAlign > 1)
+		nStart = ((nStart + nAlign - 1) / nAlign) * nAlign;
+	if(nStart + nBytes > nBase + nRegionBytes)
+		return NULL;
+
+	nUsed = (nStart + nBytes) - nBase;
+	nMapOffset = nStart;
+	nMapBytes = nBytes;
+	*pOffset = nStart;
+
+	switch(nMode) {
+		case MODE_PERSISTENT:
+			pMapped = pPersistent + nStart;
+			break;
+
+		case MODE_UNSYNCHRONIZED:
+			glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+			pMapped = glMapBufferRange(GL_ARRAY_BUFFER, nStart, nBytes,
+									   GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			break;
+
+		default:
+			pMapped = pClient + nStart;
+			break;
+		}
+	return pMapped;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStreamBuffer::Unmap(void)
+	{
+	if(pMapped == NULL)
+		return;
+
+	if(nMode == MODE_UNSYNCHRONIZED) {
+		glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+	else if(nMode == MODE_ORPHAN) {
+		glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+
+		// First write of the frame gets fresh storage from the driver
+		if(bOrphan) {
+			glBufferData(GL_ARRAY_BUFFER, nRegionBytes * nFrames, NULL, GL_STREAM_DRAW);
+			bOrphan = false;
+			}
+		glBufferSubData(GL_ARRAY_BUFFER, nMapOffset, nMapBytes, pClient + nMapOffset);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+	pMapped = NULL;
+	nMapBytes = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void *GLStreamBuffer::Extend(GLsizeiptr nBytes)
+	{
+	GLintptr nBase = GLintptr(nFrame) * nRegionBytes;
+	if(pMapped == NULL || nMapOffset + nMapBytes != nBase + nUsed)
+		return NULL;
+	if(nBytes <= nMapBytes)
+		return pMapped;
+	if(nMapOffset + nBytes > nBase + nRegionBytes)
+		return NULL;
+
+	if(nMode == MODE_UNSYNCHRONIZED) {
+		// Without GL_MAP_INVALIDATE_RANGE_BIT the new mapping keeps what the
+		// unmap wrote
+		glBindBuffer(GL_ARRAY_BUFFER, uiBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		pMapped = glMapBufferRange(GL_ARRAY_BUFFER, nMapOffset, nBytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if(pMapped == NULL) {
+			nMapBytes = 0;
+			return NULL;
+			}
+		}
+
+	nUsed = (nMapOffset + nBytes) - nBase;
+	nMapBytes = nBytes;
+	return pMapped;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStreamBuffer::EndFrame(void)
+	{
+	if(nMode == MODE_NONE)
+		return;
+
+	if(nMode != MODE_ORPHAN)
+		fences[nFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	nFrame = (nFrame + 1) % nFrames;
+	nUsed = 0;
+	bOrphan = true;
+
+	// Wait until the GPU is done with what was last written to this region
+	if(fences[nFrame] != 0) {
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while(glClientWaitSync(fences[nFrame], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(fences[nFrame]);
+		fences[nFrame] = 0;
+		}
+	}
+
+#endif
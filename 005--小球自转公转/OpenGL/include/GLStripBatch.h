@@ -0,0 +1,355 @@
+// GLStripBatch.h
+// Indexed triangle list turned into triangle strips.
+//
+// A strip spends about one index per triangle where a list spends three.
+// gltStripify() grows strips greedily across shared edges, keeping the
+// winding of every triangle. Strips are joined with the primitive restart
+// index when the context has primitive restart (GL 3.1 or
+// NV_primitive_restart). Otherwise they are joined with degenerate
+// triangles, which every context can draw.
+//
+// gltStripReport() compares the two forms: index count and bytes, and the
+// vertices a post-transform cache of a given size would still have to
+// shade per triangle (ACMR).
+
+#ifndef __GLT_STRIP_BATCH
+#define __GLT_STRIP_BATCH
+
+#include "GLTools.h"
+#include "GLBatchBase.h"
+#include "GLMeshGenerators.h"
+#include <vector>
+#include <unordered_map>
+
+#define GLT_STRIP_RESTART_INDEX		0xFFFF
+
+struct GLTStripReport
+	{
+	GLuint	nTriangles;
+	GLuint	nStrips;
+	GLuint	nListIndexes;
+	GLuint	nStripIndexes;		// Including restart indexes or degenerates
+	float	fListACMR;			// Vertices shaded per triangle
+	float	fStripACMR;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Strip triangle k is (s[k], s[k+1], s[k+2]) when k is even and
+// (s[k+1], s[k], s[k+2]) when it is odd, so the edge the next triangle has
+// to share, in its own winding order, flips direction every step.
+// Triangles walked are stamped with nStamp, and a triangle stamped 1 or
+// nStamp is taken. Committing stamps 1 and writes pStrip. A trial walk uses
+// a fresh stamp, so it stops where the strip loops back on itself and
+// leaves nothing to clear.
+inline GLuint gltWalkStrip(const GLushort *pIndexes, const std::unordered_map<GLuint, GLuint> &edges,
+						   std::vector<GLuint> &vUsed, GLuint nStamp, GLuint nTriangle, int nRotation,
+						   std::vector<GLushort> *pStrip)
+	{
+	const GLushort *pTri = &pIndexes[nTriangle * 3];
+	GLushort a = pTri[nRotation], b = pTri[(nRotation + 1) % 3], c = pTri[(nRotation + 2) % 3];
+
+	vUsed[nTriangle] = nStamp;
+	if(pStrip != NULL) {
+		pStrip->push_back(a);
+		pStrip->push_back(b);
+		pStrip->push_back(c);
+		}
+
+	GLuint nLength = 1;
+	GLushort s0 = b, s1 = c;
+	for(;;) {
+		// Odd next triangle needs directed edge (s1, s0), even needs (s0, s1)
+		GLuint nKey = (nLength & 1) ? (GLuint(s1) << 16 | s0) : (GLuint(s0) << 16 | s1);
+		std::unordered_map<GLuint, GLuint>::const_iterator it = edges.find(nKey);
+		if(it == edges.end() || vUsed[it->second / 3] == 1 || vUsed[it->second / 3] == nStamp)
+			break;
+
+		// Third vertex is the one after the shared edge in that triangle
+		GLuint nNext = it->second / 3;
+		GLushort x = pIndexes[nNext * 3 + (it->second % 3 + 2) % 3];
+
+		vUsed[nNext] = nStamp;
+		if(pStrip != NULL)
+			pStrip->push_back(x);
+		s0 = s1;
+		s1 = x;
+		nLength++;
+		}
+	return nLength;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Convert an indexed triangle list into strips joined by
+// GLT_STRIP_RESTART_INDEX (bRestart) or by degenerate triangles. Returns
+// the number of strips. Meshes using index 0xFFFF itself must be joined
+// with degenerates.
+inline GLuint gltStripify(const GLushort *pIndexes, GLuint nIndexes, std::vector<GLushort> &vOut, bool bRestart)
+	{
+	GLuint nTriangles = nIndexes / 3;
+	vOut.clear();
+
+	// Directed edge (from << 16 | to) to the triangle corner it leaves from.
+	// The neighbour across an edge holds it reversed.
+	std::unordered_map<GLuint, GLuint> edges;
+	edges.reserve(nTriangles * 3);
+	for(GLuint i = 0; i < nTriangles * 3; i++) {
+		GLuint t = i / 3;
+		GLushort from = pIndexes[i], to = pIndexes[t * 3 + (i + 1) % 3];
+		if(from != to)
+			edges.insert(std::make_pair(GLuint(from) << 16 | to, i));
+		}
+
+	// 1 is committed, anything else is free
+	std::vector<GLuint> vUsed(nTriangles, 0);
+	std::vector<GLushort> vStrip;
+	GLuint nStamp = 1;
+	GLuint nStrips = 0;
+
+	for(GLuint t = 0; t < nTriangles; t++) {
+		if(vUsed[t] == 1)
+			continue;
+
+		const GLushort *pTri = &pIndexes[t * 3];
+		if(pTri[0] == pTri[1] || pTri[1] == pTri[2] || pTri[2] == pTri[0]) {
+			vUsed[t] = 1;									// Degenerate, never drawn
+			continue;
+			}
+
+		// Try starting on each of the three edges, keep the longest
+		int nBest = 0;
+		GLuint nBestLength = 0;
+		for(int r = 0; r < 3; r++) {
+			GLuint nLength = gltWalkStrip(pIndexes, edges, vUsed, ++nStamp, t, r, NULL);
+			if(nLength > nBestLength) {
+				nBestLength = nLength;
+				nBest = r;
+				}
+			}
+
+		vStrip.clear();
+		gltWalkStrip(pIndexes, edges, vUsed, 1, t, nBest, &vStrip);
+
+		if(nStrips > 0) {
+			if(bRestart)
+				vOut.push_back(GLT_STRIP_RESTART_INDEX);
+			else {
+				// Repeat the last and first vertex. The next strip must begin on
+				// an even triangle to keep its winding.
+				GLushort nLast = vOut.back();
+				vOut.push_back(nLast);
+				if((vOut.size() & 1) == 0)
+					vOut.push_back(vStrip[0]);
+				vOut.push_back(vStrip[0]);
+				}
+			}
+		vOut.insert(vOut.end(), vStrip.begin(), vStrip.end());
+		nStrips++;
+		}
+
+	return nStrips;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertices a FIFO post-transform cache of nCacheSize entries misses, per
+// non-degenerate triangle. Restart indexes are not vertices.
+inline float gltCacheMissRatio(const GLushort *pIndexes, GLuint nIndexes, bool bStrip, GLuint nCacheSize = 16)
+	{
+	std::vector<GLushort> vCache(nCacheSize, GLT_STRIP_RESTART_INDEX);
+	GLuint nHead = 0, nMisses = 0, nTriangles = 0, nRun = 0;
+
+	for(GLuint i = 0; i < nIndexes; i++) {
+		GLushort v = pIndexes[i];
+		if(bStrip && v == GLT_STRIP_RESTART_INDEX) {
+			nRun = 0;
+			continue;
+			}
+
+		bool bHit = false;
+		for(GLuint c = 0; c < nCacheSize; c++)
+			if(vCache[c] == v) {
+				bHit = true;
+				break;
+				}
+		if(!bHit) {
+			vCache[nHead] = v;
+			nHead = (nHead + 1) % nCacheSize;
+			nMisses++;
+			}
+
+		// Count triangles that would be rasterized
+		nRun++;
+		bool bTriangle = bStrip ? (nRun >= 3) : (nRun % 3 == 0);
+		if(bTriangle) {
+			GLushort a = pIndexes[i - 2], b = pIndexes[i - 1];
+			if(a != b && b != v && v != a)
+				nTriangles++;
+			}
+		}
+
+	return nTriangles > 0 ? float(nMisses) / float(nTriangles) : 0.0f;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void gltStripReport(GLTStripReport &report, const GLushort *pList, GLuint nListIndexes,
+						   const GLushort *pStrip, GLuint nStripIndexes, GLuint nStrips, GLuint nCacheSize = 16)
+	{
+	report.nTriangles = nListIndexes / 3;
+	report.nStrips = nStrips;
+	report.nListIndexes = nListIndexes;
+	report.nStripIndexes = nStripIndexes;
+	report.fListACMR = gltCacheMissRatio(pList, nListIndexes, false, nCacheSize);
+	report.fStripACMR = gltCacheMissRatio(pStrip, nStripIndexes, true, nCacheSize);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch drawn as one GL_TRIANGLE_STRIP call. Fill the arrays from
+// BeginMesh() as an indexed list, for instance with gltWriteSphere().
+class GLStripBatch : public GLBatchBase
+	{
+	public:
+		GLStripBatch(void) {
+			uiVertexBuffer = 0;
+			uiIndexBuffer = 0;
+			vertexArrayObject = 0;
+			nNumVerts = 0;
+			nNumIndexes = 0;
+			bRestart = false;
+			memset(&report, 0, sizeof(report));
+			}
+
+		virtual ~GLStripBatch(void) {
+			if(uiVertexBuffer != 0) glDeleteBuffers(1, &uiVertexBuffer);
+			if(uiIndexBuffer != 0) glDeleteBuffers(1, &uiIndexBuffer);
+			if(vertexArrayObject != 0) glDeleteVertexArrays(1, &vertexArrayObject);
+			}
+
+		GLTMeshArrays BeginMesh(GLuint nVerts, GLuint nIndexes) {
+			nNumVerts = nVerts;
+			vVerts.assign(nVerts * 3, 0.0f);
+			vNorms.assign(nVerts * 3, 0.0f);
+			vTexCoords.assign(nVerts * 2, 0.0f);
+			vSource.assign(nIndexes, 0);
+
+			GLTMeshArrays mesh;
+			mesh.pVerts = (M3DVector3f *)&vVerts[0];
+			mesh.pNorms = (M3DVector3f *)&vNorms[0];
+			mesh.pTexCoords = (M3DVector2f *)&vTexCoords[0];
+			mesh.pIndexes = &vSource[0];
+			return mesh;
+			}
+
+		// Stripify and upload
+		void End(void);
+
+		virtual void Draw(void);
+
+		// Filled in by End()
+		inline const GLTStripReport &GetReport(void) const { return report; }
+		inline bool UsesRestart(void) const { return bRestart; }
+
+	protected:
+		GLuint	uiVertexBuffer;
+		GLuint	uiIndexBuffer;
+		GLuint	vertexArrayObject;
+		GLuint	nNumVerts;
+		GLuint	nNumIndexes;
+		bool	bRestart;
+		GLTStripReport	report;
+
+		// Client copies until End()
+		std::vector<GLfloat>	vVerts;
+		std::vector<GLfloat>	vNorms;
+		std::vector<GLfloat>	vTexCoords;
+		std::vector<GLushort>	vSource;
+
+	private:
+		GLStripBatch(const GLStripBatch&);
+		GLStripBatch &operator=(const GLStripBatch&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStripBatch::End(void)
+	{
+	// Restart needs index 0xFFFF free. Up to 0xFFFF vertices the highest one is 0xFFFE.
+	bRestart = (GLEW_VERSION_3_1 || GLEW_NV_primitive_restart) && nNumVerts <= GLT_STRIP_RESTART_INDEX;
+
+	std::vector<GLushort> vStrips;
+	GLuint nStrips = gltStripify(vSource.empty() ? NULL : &vSource[0], GLuint(vSource.size()), vStrips, bRestart);
+	gltStripReport(report, vSource.empty() ? NULL : &vSource[0], GLuint(vSource.size()),
+				   vStrips.empty() ? NULL : &vStrips[0], GLuint(vStrips.size()), nStrips);
+	nNumIndexes = GLuint(vStrips.size());
+
+	std::vector<GLfloat> vInterleaved(nNumVerts * 8);
+	for(GLuint v = 0; v < nNumVerts; v++) {
+		memcpy(&vInterleaved[v * 8], &vVerts[v * 3], sizeof(GLfloat) * 3);
+		memcpy(&vInterleaved[v * 8 + 3], &vNorms[v * 3], sizeof(GLfloat) * 3);
+		memcpy(&vInterleaved[v * 8 + 6], &vTexCoords[v * 2], sizeof(GLfloat) * 2);
+		}
+
+	if(vertexArrayObject == 0) {
+		glGenVertexArrays(1, &vertexArrayObject);
+		glGenBuffers(1, &uiVertexBuffer);
+		glGenBuffers(1, &uiIndexBuffer);
+		}
+	glBindVertexArray(vertexArrayObject);
+
+	glBindBuffer(GL_ARRAY_BUFFER, uiVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vInterleaved.size(), vInterleaved.empty() ? NULL : &vInterleaved[0], GL_STATIC_DRAW);
+
+	GLsizei nStride = sizeof(GLfloat) * 8;
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_VERTEX);
+	glVertexAttribPointer(GLT_ATTRIBUTE_VERTEX, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)0);
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_NORMAL);
+	glVertexAttribPointer(GLT_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(GLT_ATTRIBUTE_TEXTURE0);
+	glVertexAttribPointer(GLT_ATTRIBUTE_TEXTURE0, 2, GL_FLOAT, GL_FALSE, nStride, (const GLvoid *)(sizeof(GLfloat) * 6));
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uiIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * vStrips.size(), vStrips.empty() ? NULL : &vStrips[0], GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	std::vector<GLfloat>().swap(vVerts);
+	std::vector<GLfloat>().swap(vNorms);
+	std::vector<GLfloat>().swap(vTexCoords);
+	std::vector<GLushort>().swap(vSource);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLStripBatch::Draw(void)
+	{
+	if(nNumIndexes == 0)
+		return;
+
+	if(bRestart) {
+		if(GLEW_VERSION_3_1) {
+			glPrimitiveRestartIndex(GLT_STRIP_RESTART_INDEX);
+			glEnable(GL_PRIMITIVE_RESTART);
+			}
+		else {
+			glPrimitiveRestartIndexNV(GLT_STRIP_RESTART_INDEX);
+			glEnableClientState(GL_PRIMITIVE_RESTART_NV);
+			}
+		}
+
+	glBindVertexArray(vertexArrayObject);
+	glDrawElements(GL_TRIANGLE_STRIP, nNumIndexes, GL_UNSIGNED_SHORT, 0);
+	glBindVertexArray(0);
+
+	if(bRestart) {
+		if(GLEW_VERSION_3_1)
+			glDisable(GL_PRIMITIVE_RESTART);
+		else
+			glDisableClientState(GL_PRIMITIVE_RESTART_NV);
+		}
+	}
+
+#endif
@@ -0,0 +1,439 @@
+// GLTextureAtlas.h
+// Packs many small images into a few large textures.
+//
+// Loading each small image with gltReadTGABits() and glTexImage2D() gives
+// one texture object per image, and every draw using a different one has
+// to rebind. GLTextureAtlas collects the images and then packs them:
+//	- Build() places every image on fixed size pages with a skyline packer
+//	  (bottom left first, tallest images first), then uploads the pages.
+//	  The pages can be separate GL_TEXTURE_2D textures or the layers of one
+//	  GL_TEXTURE_2D_ARRAY, which needs a shader with a sampler2DArray.
+//	- RemapTexCoords() moves an image's 0..1 texture coordinates to where
+//	  it ended up, and CopyTexCoordData2f() does that straight into a
+//	  GLBatch. Batches using images on the same page can then be drawn with
+//	  one bind and one shader setup. Coordinates outside 0..1 would read the
+//	  neighbours, so tiling images (GL_REPEAT) do not belong in an atlas.
+//
+// Each image gets a border of nPadding pixels copied from its own edges,
+// so bilinear filtering at the edges behaves like GL_CLAMP_TO_EDGE. The
+// padding is a power of two, and each image's cell is rounded up to
+// multiples of it; the rounding slack is filled from the edges too. No
+// texel of mip levels up to log2(nPadding) then straddles two cells, and
+// each image still has at least a texel of its own edge around it there. Build() limits
+// GL_TEXTURE_MAX_LEVEL to that, so a padding of 0 or 1 means no mipmaps.
+//
+// Pixels are stored as BGRA on the pages, whatever they came in as.
+// GL_LUMINANCE images are spread to grey. Images with GL_RGB components
+// are opaque, even when their pixels carry a fourth (padding) byte.
+
+#ifndef __GLT_TEXTURE_ATLAS
+#define __GLT_TEXTURE_ATLAS
+
+#include "GLTools.h"
+#include "GLBatch.h"
+#include "GLImageFile.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+struct GLTAtlasRegion
+	{
+	int			nPage;				// Texture, or layer of the array texture
+	int			x, y;				// Lower left corner on the page, in pixels
+	int			nWidth, nHeight;
+	GLfloat		vScale[2];			// s' = s * vScale[0] + vOffset[0]
+	GLfloat		vOffset[2];
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLTextureAtlas
+	{
+	public:
+		GLTextureAtlas(int nPageWidth = 1024, int nPageHeight = 1024, int nPadding = 2);
+		~GLTextureAtlas(void) { DeleteTextures(); }
+
+		// Add an image as gltReadTGABits() returns it: GL_BGR, GL_BGRA,
+		// GL_RGB, GL_RGBA or GL_LUMINANCE bytes, bottom row first, rows
+		// padded to nAlignment. nComponents of GL_RGB makes a four byte
+		// format's last byte padding, as in a 32 bit BMP, and 0 goes by the
+		// format. Returns the region index, or -1 if it can never fit on a
+		// page.
+		int AddImage(const GLbyte *pBits, int nWidth, int nHeight, GLenum eFormat, int nAlignment = 1,
+					 GLint nComponents = 0);
+
+		// Add a .tga or .bmp file. Returns -1 if it cannot be read.
+		int AddFile(const char *szFileName);
+
+		// Pack everything added so far and upload it, replacing any earlier
+		// textures. bArray asks for one GL_TEXTURE_2D_ARRAY, and falls back
+		// to separate pages when the context has no array textures.
+		bool Build(bool bArray = false);
+
+		// Free the images once the atlas is final. The textures and regions
+		// stay valid, but nothing more can be added or built.
+		void ClearImages(void);
+
+		inline int GetRegionCount(void) const { return int(regions.size()); }
+		inline const GLTAtlasRegion &GetRegion(int nRegion) const { return regions[nRegion]; }
+		inline int GetPageCount(void) const { return nPages; }
+		inline int GetPageWidth(void) const { return nPageWidth; }
+		inline int GetPageHeight(void) const { return nPageHeight; }
+
+		// GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D, and the texture holding a page
+		inline GLenum GetTarget(void) const { return uiArrayTexture != 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D; }
+		inline GLuint GetTexture(int nPage) const { return uiArrayTexture != 0 ? uiArrayTexture : pageTextures[nPage]; }
+		inline GLuint GetRegionTexture(int nRegion) const { return GetTexture(regions[nRegion].nPage); }
+
+		// Map nCount texture coordinates of an image onto its region. vIn and
+		// vOut may be the same array.
+		void RemapTexCoords(int nRegion, const M3DVector2f *vIn, M3DVector2f *vOut, int nCount) const;
+
+		// Remap and hand them to the batch. nVerts must match the batch.
+		void CopyTexCoordData2f(GLBatch &batch, int nRegion, const M3DVector2f *vTexCoords, int nVerts, GLuint uiTextureLayer = 0) const;
+
+	protected:
+		struct Image
+			{
+			int							nWidth, nHeight;
+			int							nCellWidth, nCellHeight;	// With padding and rounding, set by Build()
+			std::vector<unsigned char>	vPixels;		// BGRA, bottom row first
+			};
+
+		struct SkylineNode
+			{
+			int x, y, nWidth;
+			};
+
+		bool Place(std::vector<SkylineNode> &skyline, int nWidth, int nHeight, int *pX, int *pY) const;
+		void Blit(unsigned char *pPage, const Image &image, int x, int y) const;
+		void DeleteTextures(void);
+
+		int							nPageWidth;
+		int							nPageHeight;
+		int							nPadding;		// Power of two, or 0
+		int							nMaxLevel;		// log2(nPadding)
+		int							nPages;
+		std::vector<Image>			images;			// One per region
+		std::vector<GLTAtlasRegion>	regions;
+		std::vector<GLuint>			pageTextures;
+		GLuint						uiArrayTexture;
+		mutable std::vector<GLfloat>	vScratch;		// Remapped coordinates for the batch
+
+	private:
+		GLTextureAtlas(const GLTextureAtlas&);
+		GLTextureAtlas &operator=(const GLTextureAtlas&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLTextureAtlas::GLTextureAtlas(int nWidth, int nHeight, int nPaddingPixels)
+	{
+	nPageWidth = nWidth;
+	nPageHeight = nHeight;
+
+	// Round the padding up to a power of two
+	nPadding = 0;
+	nMaxLevel = 0;
+	if(nPaddingPixels > 0) {
+		nPadding = 1;
+		while(nPadding < nPaddingPixels) {
+			nPadding <<= 1;
+			nMaxLevel++;
+			}
+		}
+
+	nPages = 0;
+	uiArrayTexture = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline int GLTextureAtlas::AddImage(const GLbyte *pBits, int nWidth, int nHeight, GLenum eFormat, int nAlignment,
+									GLint nComponents)
+	{
+	if(images.size() != regions.size() || pBits == NULL || nWidth <= 0 || nHeight <= 0 ||
+	   nWidth + 2 * nPadding > nPageWidth || nHeight + 2 * nPadding > nPageHeight)
+		return -1;
+
+	int nBytes;
+	switch(eFormat) {
+		case GL_LUMINANCE: nBytes = 1; break;
+		case GL_BGR: case GL_RGB: nBytes = 3; break;
+		case GL_BGRA: case GL_RGBA: nBytes = 4; break;
+		default: return -1;
+		}
+	bool bRGB = (eFormat == GL_RGB || eFormat == GL_RGBA);
+	bool bAlpha = (nBytes == 4 && nComponents != GL_RGB && nComponents != GL_RGB8);
+	size_t nStride = ((size_t(nWidth) * nBytes + nAlignment - 1) / nAlignment) * nAlignment;
+
+	images.push_back(Image());
+	Image &image = images.back();
+	image.nWidth = nWidth;
+	image.nHeight = nHeight;
+	image.nCellWidth = image.nCellHeight = 0;
+	image.vPixels.resize(size_t(nWidth) * nHeight * 4);
+
+	const unsigned char *pIn = (const unsigned char *)pBits;
+	unsigned char *pOut = &image.vPixels[0];
+	for(int y = 0; y < nHeight; y++, pIn += nStride) {
+		const unsigned char *pRow = pIn;
+		if(bAlpha && !bRGB) {
+			memcpy(pOut, pRow, size_t(nWidth) * 4);
+			pOut += size_t(nWidth) * 4;
+			continue;
+			}
+		for(int x = 0; x < nWidth; x++, pRow += nBytes, pOut += 4) {
+			if(nBytes == 1) {
+				pOut[0] = pOut[1] = pOut[2] = pRow[0];
+				pOut[3] = 255;
+				}
+			else {
+				pOut[0] = pRow[bRGB ? 2 : 0];
+				pOut[1] = pRow[1];
+				pOut[2] = pRow[bRGB ? 0 : 2];
+				pOut[3] = bAlpha ? pRow[3] : 255;
+				}
+			}
+		}
+
+	GLTAtlasRegion region;
+	memset(&region, 0, sizeof(region));
+	region.nPage = -1;
+	region.nWidth = nWidth;
+	region.nHeight = nHeight;
+	regions.push_back(region);
+	return int(regions.size()) - 1;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline int GLTextureAtlas::AddFile(const char *szFileName)
+	{
+	GLImageFile file;
+	if(!file.Open(szFileName))
+		return -1;
+	return AddImage(file.GetPixels(), file.GetWidth(), file.GetHeight(), file.GetFormat(), file.GetAlignment(),
+					file.GetComponents());
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureAtlas::ClearImages(void)
+	{
+	std::vector<Image>().swap(images);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Lowest spot on the skyline that fits, leftmost among equals. Widths and
+// heights are multiples of the padding, so every spot is aligned to it.
+inline bool GLTextureAtlas::Place(std::vector<SkylineNode> &skyline, int nWidth, int nHeight, int *pX, int *pY) const
+	{
+	int iBest = -1, nBestY = nPageHeight, nBestX = 0;
+	for(size_t i = 0; i < skyline.size(); i++) {
+		int x = skyline[i].x;
+		if(x + nWidth > nPageWidth)
+			break;
+
+		// Rests on the highest node under its width
+		int y = 0;
+		for(size_t j = i; j < skyline.size() && skyline[j].x < x + nWidth; j++)
+			y = std::max(y, skyline[j].y);
+		if(y + nHeight <= nPageHeight && y < nBestY) {
+			iBest = int(i);
+			nBestY = y;
+			nBestX = x;
+			}
+		}
+	if(iBest < 0)
+		return false;
+
+	// New node on top, then cut back or remove the ones it covers
+	SkylineNode node = { nBestX, nBestY + nHeight, nWidth };
+	skyline.insert(skyline.begin() + iBest, node);
+	size_t i = size_t(iBest) + 1;
+	while(i < skyline.size() && skyline[i].x < nBestX + nWidth) {
+		int nCut = nBestX + nWidth - skyline[i].x;
+		if(skyline[i].nWidth <= nCut) {
+			skyline.erase(skyline.begin() + i);
+			continue;
+			}
+		skyline[i].x += nCut;
+		skyline[i].nWidth -= nCut;
+		break;
+		}
+
+	// Merge neighbours at the same height
+	for(i = 0; i + 1 < skyline.size(); ) {
+		if(skyline[i].y == skyline[i + 1].y) {
+			skyline[i].nWidth += skyline[i + 1].nWidth;
+			skyline.erase(skyline.begin() + i + 1);
+			}
+		else
+			i++;
+		}
+
+	*pX = nBestX;
+	*pY = nBestY;
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy the image to (x, y) and smear its edges over the rest of its cell:
+// the padding below and left, and the padding plus rounding above and right
+inline void GLTextureAtlas::Blit(unsigned char *pPage, const Image &image, int x, int y) const
+	{
+	size_t nPageStride = size_t(nPageWidth) * 4;
+	size_t nRowBytes = size_t(image.nWidth) * 4;
+	int nRight = image.nCellWidth - nPadding - image.nWidth;
+	int nTop = image.nCellHeight - nPadding - image.nHeight;
+
+	for(int row = -nPadding; row < image.nHeight + nTop; row++) {
+		int nSource = std::min(std::max(row, 0), image.nHeight - 1);
+		const unsigned char *pIn = &image.vPixels[size_t(nSource) * nRowBytes];
+		unsigned char *pOut = pPage + size_t(y + row) * nPageStride + size_t(x) * 4;
+
+		memcpy(pOut, pIn, nRowBytes);
+		for(int i = 1; i <= nPadding; i++)
+			memcpy(pOut - i * 4, pIn, 4);
+		for(int i = 0; i < nRight; i++)
+			memcpy(pOut + nRowBytes + i * 4, pIn + nRowBytes - 4, 4);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLTextureAtlas::Build(bool bArray)
+	{
+	DeleteTextures();
+	if(images.size() != regions.size() || images.empty())
+		return false;
+
+	// Tallest first packs a skyline tightest
+	std::vector<int> order(images.size());
+	for(size_t i = 0; i < order.size(); i++)
+		order[i] = int(i);
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		return images[a].nHeight > images[b].nHeight ||
+			  (images[a].nHeight == images[b].nHeight && images[a].nWidth > images[b].nWidth);
+		});
+
+	// Cells are rounded up to the padding so images stay aligned to it
+	int nAlign = std::max(nPadding, 1);
+	std::vector<std::vector<SkylineNode> > skylines;
+	for(size_t n = 0; n < order.size(); n++) {
+		GLTAtlasRegion &region = regions[order[n]];
+		int nCellWidth = ((region.nWidth + 2 * nPadding + nAlign - 1) / nAlign) * nAlign;
+		int nCellHeight = ((region.nHeight + 2 * nPadding + nAlign - 1) / nAlign) * nAlign;
+		nCellWidth = std::min(nCellWidth, nPageWidth);
+		nCellHeight = std::min(nCellHeight, nPageHeight);
+		images[order[n]].nCellWidth = nCellWidth;
+		images[order[n]].nCellHeight = nCellHeight;
+
+		int x = 0, y = 0;
+		size_t iPage = 0;
+		while(iPage < skylines.size() && !Place(skylines[iPage], nCellWidth, nCellHeight, &x, &y))
+			iPage++;
+		if(iPage == skylines.size()) {
+			SkylineNode ground = { 0, 0, nPageWidth };
+			skylines.push_back(std::vector<SkylineNode>(1, ground));
+			Place(skylines[iPage], nCellWidth, nCellHeight, &x, &y);
+			}
+
+		region.nPage = int(iPage);
+		region.x = x + nPadding;
+		region.y = y + nPadding;
+		region.vScale[0] = GLfloat(region.nWidth) / nPageWidth;
+		region.vScale[1] = GLfloat(region.nHeight) / nPageHeight;
+		region.vOffset[0] = GLfloat(region.x) / nPageWidth;
+		region.vOffset[1] = GLfloat(region.y) / nPageHeight;
+		}
+	nPages = int(skylines.size());
+
+	bArray = bArray && (GLEW_VERSION_3_0 || GLEW_EXT_texture_array);
+	if(bArray) {
+		GLint nMaxLayers = 0;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &nMaxLayers);
+		bArray = nPages <= nMaxLayers;
+		}
+
+	// Compose every page before uploading, the array takes them all at once
+	size_t nPageBytes = size_t(nPageWidth) * nPageHeight * 4;
+	std::vector<unsigned char> vPages(nPageBytes * nPages, 0);
+	for(size_t i = 0; i < images.size(); i++)
+		Blit(&vPages[nPageBytes * regions[i].nPage], images[i], regions[i].x, regions[i].y);
+
+	GLint nOldAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &nOldAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	GLenum target = bArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	GLint nOldTexture;
+	glGetIntegerv(bArray ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D, &nOldTexture);
+
+	int nTextures = bArray ? 1 : nPages;
+	pageTextures.resize(nTextures);
+	glGenTextures(nTextures, &pageTextures[0]);
+	for(int i = 0; i < nTextures; i++) {
+		glBindTexture(target, pageTextures[i]);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, nMaxLevel > 0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nMaxLevel);
+		if(bArray)
+			glTexImage3D(target, 0, GL_RGBA8, nPageWidth, nPageHeight, nPages, 0, GL_BGRA, GL_UNSIGNED_BYTE, &vPages[0]);
+		else
+			glTexImage2D(target, 0, GL_RGBA8, nPageWidth, nPageHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, &vPages[nPageBytes * i]);
+		if(nMaxLevel > 0)
+			glGenerateMipmap(target);
+		}
+
+	glBindTexture(target, GLuint(nOldTexture));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, nOldAlignment);
+
+	if(bArray) {
+		uiArrayTexture = pageTextures[0];
+		pageTextures.clear();
+		}
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureAtlas::DeleteTextures(void)
+	{
+	if(!pageTextures.empty())
+		glDeleteTextures(GLsizei(pageTextures.size()), &pageTextures[0]);
+	pageTextures.clear();
+	if(uiArrayTexture != 0)
+		glDeleteTextures(1, &uiArrayTexture);
+	uiArrayTexture = 0;
+	nPages = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureAtlas::RemapTexCoords(int nRegion, const M3DVector2f *vIn, M3DVector2f *vOut, int nCount) const
+	{
+	const GLTAtlasRegion &region = regions[nRegion];
+	for(int i = 0; i < nCount; i++) {
+		vOut[i][0] = vIn[i][0] * region.vScale[0] + region.vOffset[0];
+		vOut[i][1] = vIn[i][1] * region.vScale[1] + region.vOffset[1];
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureAtlas::CopyTexCoordData2f(GLBatch &batch, int nRegion, const M3DVector2f *vTexCoords, int nVerts, GLuint uiTextureLayer) const
+	{
+	if(nVerts <= 0)
+		return;
+	vScratch.resize(size_t(nVerts) * 2);
+	RemapTexCoords(nRegion, vTexCoords, (M3DVector2f *)&vScratch[0], nVerts);
+	batch.CopyTexCoordData2f(&vScratch[0], uiTextureLayer);
+	}
+
+#endif
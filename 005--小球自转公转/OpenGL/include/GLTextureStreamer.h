@@ -0,0 +1,559 @@
+// GLTextureStreamer.h
+// Textures that load in the background while the scene keeps drawing.
+//
+// Loading a texture the usual way (gltReadTGABits() then glTexImage2D())
+// stops the frame for the disk read, the decode and the whole upload.
+// GLTextureStreamer spreads that work out:
+//	- Request() registers a file and returns a handle. Decoder threads open
+//	  it with GLImageFile and pull its pages in, most wanted first.
+//	- Use() returns the texture to bind. Until it is resident that is a
+//	  small checkerboard placeholder, so drawing never waits. Use() also
+//	  records how many pixels the texture covers on screen this frame.
+//	- Update(), once per frame on the GL thread, uploads decoded images a
+//	  slice of rows at a time. Each slice is copied into a GLStreamBuffer
+//	  bound as GL_PIXEL_UNPACK_BUFFER, so glTexSubImage2D() sources a buffer
+//	  object and returns without waiting for the copy. Uploads stop when
+//	  the frame's staging region is full or the time budget is spent, and
+//	  pick up where they left off next frame.
+//	- Update() also keeps texture memory under the budget. Textures not used
+//	  this frame are deleted, least recently used first, then smallest on
+//	  screen. Using an evicted texture again queues it again.
+//
+// Decode and upload order both follow the last frame a texture was used
+// in, then its on-screen size, so what is visible and large arrives first.
+// At most nMaxDecoded images are held between decode and upload.
+//
+// Without pixel buffer objects the slices are uploaded from client memory,
+// still within the time budget. All calls are GL thread only.
+
+#ifndef __GLT_TEXTURE_STREAMER
+#define __GLT_TEXTURE_STREAMER
+
+#include "GLTools.h"
+#include "GLImageFile.h"
+#include "GLStreamBuffer.h"
+#include "StopWatch.h"
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GLT_STREAMER_MAX_DECODERS	8
+
+enum GLT_TEXTURE_STATE { GLT_TEXTURE_UNLOADED, GLT_TEXTURE_QUEUED, GLT_TEXTURE_DECODING,
+						 GLT_TEXTURE_DECODED, GLT_TEXTURE_UPLOADING, GLT_TEXTURE_RESIDENT,
+						 GLT_TEXTURE_FAILED };
+
+struct GLTStreamerStats
+	{
+	GLuint		nRequested;			// Files registered
+	GLuint		nDecoded;			// Images decoded, counting reloads
+	GLuint		nUploaded;			// Textures made resident, counting reloads
+	GLuint		nEvicted;			// Textures deleted to stay in budget
+	GLuint		nFailed;			// Files that could not be read
+	GLuint		nOverBudget;		// Update() calls that ran past their time budget
+	GLuint		nOverMemory;		// Frames still over the memory budget after evicting
+	float		fMaxUpdateMs;		// Longest Update()
+	float		fDecodeSeconds;		// Decoder time, summed over the threads
+	double		dBytesUploaded;
+	size_t		nResidentBytes;		// Estimated texture memory in use
+	size_t		nPeakResidentBytes;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLTextureStreamer
+	{
+	public:
+		GLTextureStreamer(void) {
+			uiPlaceholder = 0;
+			nStagingBytes = 0;
+			nMemoryBudget = 0;
+			nMaxDecoded = 0;
+			nHeld = 0;
+			nFrame = 1;
+			bDirect = true;
+			bQuit = false;
+			pUploading = NULL;
+			memset(&stats, 0, sizeof(stats));
+			}
+
+		~GLTextureStreamer(void) { Shutdown(); }
+
+		// nStagingBytes is the most uploaded per frame. nMaxDecoded images can
+		// wait between decode and upload. nDecoders of 0 uses one thread per
+		// core beyond the first.
+		bool Init(GLsizeiptr nStagingBytes = 4 << 20, size_t nMemoryBudgetBytes = 64 << 20,
+				  int nMaxDecoded = 4, int nDecoders = 0);
+
+		// Deletes every texture, including ones handed out by Use()
+		void Shutdown(void);
+
+		// Register a .tga or .bmp file and start loading it. Returns the
+		// handle for Use(), or -1 before Init().
+		int Request(const char *szFileName, GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR,
+					GLenum magFilter = GL_LINEAR, GLenum wrapMode = GL_CLAMP_TO_EDGE);
+
+		// The texture to bind for this draw, or the placeholder. fScreenPixels
+		// is roughly how much of the screen it covers; the largest use in a
+		// frame counts.
+		GLuint Use(int nHandle, GLfloat fScreenPixels = 1.0f);
+
+		// Once per frame, after the frame's draws
+		void Update(GLfloat fBudgetMs = 2.0f);
+
+		inline void SetMemoryBudget(size_t nBytes) { nMemoryBudget = nBytes; }
+		inline size_t GetMemoryBudget(void) const { return nMemoryBudget; }
+		inline GLuint GetPlaceholder(void) const { return uiPlaceholder; }
+		inline int GetCount(void) const { return int(entries.size()); }
+		inline bool IsPBO(void) const { return !bDirect; }
+
+		GLT_TEXTURE_STATE GetState(int nHandle) const;
+		inline bool IsResident(int nHandle) const { return GetState(nHandle) == GLT_TEXTURE_RESIDENT; }
+		GLTStreamerStats GetStats(void);
+
+	protected:
+		struct Entry
+			{
+			std::string			sFileName;
+			GLenum				minFilter;
+			GLenum				magFilter;
+			GLenum				wrapMode;
+			std::atomic<int>	nState;			// GLT_TEXTURE_STATE
+			GLuint				uiTexture;
+			GLuint				nLastUsed;		// Frame number, guarded by lock while queued
+			GLfloat				fPriority;		// Screen pixels, guarded by lock while queued
+			size_t				nBytes;			// Texture memory estimate, once allocated
+			GLint				nRowsDone;		// Rows uploaded so far
+			GLImageFile			image;			// Between decode and upload
+			};
+
+		void Queue(Entry *pEntry);
+		bool UploadSlice(Entry *pEntry, GLfloat fBudgetMs);
+		void Evict(void);
+		void DecoderMain(void);
+
+		static inline bool Before(const Entry *pA, const Entry *pB) {
+			return pA->nLastUsed > pB->nLastUsed ||
+				  (pA->nLastUsed == pB->nLastUsed && pA->fPriority > pB->fPriority);
+			}
+
+		static inline bool NeedsMipmaps(GLenum filter) {
+			return filter != GL_NEAREST && filter != GL_LINEAR;
+			}
+
+		GLStreamBuffer				staging;
+		GLsizeiptr					nStagingBytes;	// Per frame
+		GLuint						uiPlaceholder;
+		size_t						nMemoryBudget;
+		int							nMaxDecoded;
+		GLuint						nFrame;
+		bool						bDirect;		// No PBOs, upload from client memory
+		std::vector<Entry *>		entries;		// Indexed by handle, GL thread only
+		Entry						*pUploading;
+
+		std::vector<std::thread>	decoders;
+		std::mutex					lock;
+		std::condition_variable		wakeDecoder;
+		std::vector<Entry *>		queued;
+		int							nHeld;			// Decoding or decoded, not yet uploaded
+		bool						bQuit;
+		GLTStreamerStats			stats;
+
+	private:
+		GLTextureStreamer(const GLTextureStreamer&);
+		GLTextureStreamer &operator=(const GLTextureStreamer&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline bool GLTextureStreamer::Init(GLsizeiptr nStagingBytesPerFrame, size_t nMemoryBudgetBytes, int nMaxDecodedImages, int nDecoders)
+	{
+	Shutdown();
+
+	if(nDecoders <= 0)
+		nDecoders = int(std::thread::hardware_concurrency()) - 1;
+	if(nDecoders < 1)
+		nDecoders = 1;
+	if(nDecoders > GLT_STREAMER_MAX_DECODERS)
+		nDecoders = GLT_STREAMER_MAX_DECODERS;
+
+	nMemoryBudget = nMemoryBudgetBytes;
+	nMaxDecoded = (nMaxDecodedImages < 1) ? 1 : nMaxDecodedImages;
+	nHeld = 0;
+	nFrame = 1;
+	bQuit = false;
+	pUploading = NULL;
+	memset(&stats, 0, sizeof(stats));
+
+	// Two frames in flight: a slice's copy is long done by the time the
+	// region comes around again
+	bDirect = true;
+	nStagingBytes = nStagingBytesPerFrame;
+	if((GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) && staging.Init(nStagingBytesPerFrame, 2))
+		bDirect = staging.GetMode() == GLStreamBuffer::MODE_NONE;
+
+	// Grey and white checkerboard until the real thing arrives
+	static const GLubyte checker[16] = { 160, 160, 160, 255,	224, 224, 224, 255,
+										 224, 224, 224, 255,	160, 160, 160, 255 };
+	GLint nOldTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &nOldTexture);
+	glGenTextures(1, &uiPlaceholder);
+	glBindTexture(GL_TEXTURE_2D, uiPlaceholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+	glBindTexture(GL_TEXTURE_2D, GLuint(nOldTexture));
+
+	// Own threads rather than the job system, since they block on the disk
+	for(int i = 0; i < nDecoders; i++)
+		decoders.push_back(std::thread(&GLTextureStreamer::DecoderMain, this));
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureStreamer::Shutdown(void)
+	{
+	if(uiPlaceholder == 0)
+		return;
+
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	bQuit = true;
+	queued.clear();
+	}
+	wakeDecoder.notify_all();
+	for(size_t i = 0; i < decoders.size(); i++)
+		decoders[i].join();
+	decoders.clear();
+
+	for(size_t i = 0; i < entries.size(); i++) {
+		if(entries[i]->uiTexture != 0)
+			glDeleteTextures(1, &entries[i]->uiTexture);
+		delete entries[i];
+		}
+	entries.clear();
+	pUploading = NULL;
+	nHeld = 0;
+
+	staging.Shutdown();
+	glDeleteTextures(1, &uiPlaceholder);
+	uiPlaceholder = 0;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline int GLTextureStreamer::Request(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode)
+	{
+	if(uiPlaceholder == 0)
+		return -1;
+
+	Entry *pEntry = new Entry;
+	pEntry->sFileName = szFileName;
+	pEntry->minFilter = minFilter;
+	pEntry->magFilter = magFilter;
+	pEntry->wrapMode = wrapMode;
+	pEntry->nState = GLT_TEXTURE_UNLOADED;
+	pEntry->uiTexture = 0;
+	pEntry->nLastUsed = 0;
+	pEntry->fPriority = 0.0f;
+	pEntry->nBytes = 0;
+	pEntry->nRowsDone = 0;
+	entries.push_back(pEntry);
+
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	stats.nRequested++;
+	}
+	Queue(pEntry);
+	return int(entries.size()) - 1;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureStreamer::Queue(Entry *pEntry)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	pEntry->nState = GLT_TEXTURE_QUEUED;
+	queued.push_back(pEntry);
+	wakeDecoder.notify_one();
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLuint GLTextureStreamer::Use(int nHandle, GLfloat fScreenPixels)
+	{
+	if(nHandle < 0 || nHandle >= int(entries.size()))
+		return uiPlaceholder;
+	Entry *pEntry = entries[nHandle];
+
+	// Only this thread moves a texture out of RESIDENT, and the decoders
+	// never look at a resident entry, so no lock is needed here
+	if(pEntry->nState == GLT_TEXTURE_RESIDENT) {
+		if(pEntry->nLastUsed != nFrame)
+			pEntry->fPriority = 0.0f;
+		pEntry->nLastUsed = nFrame;
+		pEntry->fPriority = std::max(pEntry->fPriority, fScreenPixels);
+		return pEntry->uiTexture;
+		}
+
+	bool bQueue = false;
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	if(pEntry->nLastUsed != nFrame)
+		pEntry->fPriority = 0.0f;
+	pEntry->nLastUsed = nFrame;
+	pEntry->fPriority = std::max(pEntry->fPriority, fScreenPixels);
+	bQueue = pEntry->nState == GLT_TEXTURE_UNLOADED;
+	}
+	if(bQueue)
+		Queue(pEntry);
+	return uiPlaceholder;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLT_TEXTURE_STATE GLTextureStreamer::GetState(int nHandle) const
+	{
+	if(nHandle < 0 || nHandle >= int(entries.size()))
+		return GLT_TEXTURE_FAILED;
+	return GLT_TEXTURE_STATE(entries[nHandle]->nState.load());
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline GLTStreamerStats GLTextureStreamer::GetStats(void)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureStreamer::Update(GLfloat fBudgetMs)
+	{
+	if(uiPlaceholder == 0)
+		return;
+
+	CStopWatch timer;
+	Evict();
+
+	GLint nOldTexture, nOldAlignment;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &nOldTexture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &nOldAlignment);
+
+	for(;;) {
+		if(timer.GetElapsedSeconds() * 1000.0f >= fBudgetMs)
+			break;
+
+		// Finish what was started before starting anything else, since its
+		// memory is already allocated
+		if(pUploading == NULL) {
+			for(size_t i = 0; i < entries.size(); i++)
+				if(entries[i]->nState == GLT_TEXTURE_DECODED &&
+				   (pUploading == NULL || Before(entries[i], pUploading)))
+					pUploading = entries[i];
+			if(pUploading == NULL)
+				break;
+			}
+
+		if(!UploadSlice(pUploading, fBudgetMs))
+			break;
+
+		if(pUploading->nRowsDone == pUploading->image.GetHeight()) {
+			if(NeedsMipmaps(pUploading->minFilter))
+				glGenerateMipmap(GL_TEXTURE_2D);
+			pUploading->image.Close();
+			pUploading->nState = GLT_TEXTURE_RESIDENT;
+			pUploading = NULL;
+
+			std::lock_guard<std::mutex> guard(lock);
+			stats.nUploaded++;
+			nHeld--;
+			wakeDecoder.notify_one();
+			}
+		}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, nOldAlignment);
+	glBindTexture(GL_TEXTURE_2D, GLuint(nOldTexture));
+	if(!bDirect)
+		staging.EndFrame();
+	nFrame++;
+
+	float fMs = timer.GetElapsedSeconds() * 1000.0f;
+	std::lock_guard<std::mutex> guard(lock);
+	if(fMs > fBudgetMs)
+		stats.nOverBudget++;
+	stats.fMaxUpdateMs = std::max(stats.fMaxUpdateMs, fMs);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Upload the next rows of pEntry, allocating the texture on the first call.
+// False when nothing more fits in this frame.
+inline bool GLTextureStreamer::UploadSlice(Entry *pEntry, GLfloat fBudgetMs)
+	{
+	const GLImageFile &image = pEntry->image;
+	GLint nWidth = image.GetWidth(), nHeight = image.GetHeight();
+	size_t nStride = image.GetSize() / size_t(nHeight);
+
+	if(pEntry->nState == GLT_TEXTURE_DECODED) {
+		glGenTextures(1, &pEntry->uiTexture);
+		glBindTexture(GL_TEXTURE_2D, pEntry->uiTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, pEntry->minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, pEntry->magFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, pEntry->wrapMode);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, pEntry->wrapMode);
+		glTexImage2D(GL_TEXTURE_2D, 0, image.GetComponents(), nWidth, nHeight, 0,
+					 image.GetFormat(), GL_UNSIGNED_BYTE, NULL);
+
+		// Drivers keep RGB as RGBA, mipmaps add a third
+		pEntry->nBytes = size_t(nWidth) * nHeight * (image.GetComponents() == GL_LUMINANCE ? 1 : 4);
+		if(NeedsMipmaps(pEntry->minFilter))
+			pEntry->nBytes += pEntry->nBytes / 3;
+		pEntry->nRowsDone = 0;
+		pEntry->nState = GLT_TEXTURE_UPLOADING;
+
+		std::lock_guard<std::mutex> guard(lock);
+		stats.nResidentBytes += pEntry->nBytes;
+		stats.nPeakResidentBytes = std::max(stats.nPeakResidentBytes, stats.nResidentBytes);
+		}
+	else
+		glBindTexture(GL_TEXTURE_2D, pEntry->uiTexture);
+
+	// Rows are contiguous with their padding, so a slice is one copy
+	glPixelStorei(GL_UNPACK_ALIGNMENT, image.GetAlignment());
+	const unsigned char *pRows = (const unsigned char *)image.GetPixels() + nStride * pEntry->nRowsDone;
+	GLint nRows = nHeight - pEntry->nRowsDone;
+
+	// Without a staging ring, or with rows too long for it, the time budget
+	// alone bounds the slices
+	if(bDirect || GLsizeiptr(nStride) + 16 > nStagingBytes) {
+		// Aim for about a tenth of the budget per slice at a conservative 1 GB/s
+		size_t nSliceBytes = size_t(std::max(fBudgetMs, 0.1f) * 100000.0f);
+		nRows = std::min(nRows, std::max(GLint(nSliceBytes / nStride), 1));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, pEntry->nRowsDone, nWidth, nRows,
+						image.GetFormat(), GL_UNSIGNED_BYTE, pRows);
+		}
+	else {
+		GLsizeiptr nFree = staging.GetBytesFree() - 16;
+		nRows = std::min(nRows, GLint(std::max(nFree, GLsizeiptr(0)) / GLsizeiptr(nStride)));
+		if(nRows <= 0)
+			return false;
+
+		GLintptr nOffset;
+		void *pStage = staging.Map(GLsizeiptr(nStride) * nRows, 16, &nOffset);
+		if(pStage == NULL)
+			return false;
+		memcpy(pStage, pRows, nStride * nRows);
+		staging.Unmap();
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.GetBuffer());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, pEntry->nRowsDone, nWidth, nRows,
+						image.GetFormat(), GL_UNSIGNED_BYTE, (const GLvoid *)nOffset);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+	pEntry->nRowsDone += nRows;
+	std::lock_guard<std::mutex> guard(lock);
+	stats.dBytesUploaded += double(nStride) * nRows;
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Delete resident textures not used this frame until back under budget.
+// The oldest go first, then the smallest on screen when they were last used.
+inline void GLTextureStreamer::Evict(void)
+	{
+	size_t nResident;
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	nResident = stats.nResidentBytes;
+	}
+
+	while(nResident > nMemoryBudget) {
+		Entry *pVictim = NULL;
+		for(size_t i = 0; i < entries.size(); i++) {
+			Entry *pEntry = entries[i];
+			if(pEntry->nState != GLT_TEXTURE_RESIDENT || pEntry->nLastUsed == nFrame)
+				continue;
+			if(pVictim == NULL || Before(pVictim, pEntry))
+				pVictim = pEntry;
+			}
+
+		if(pVictim == NULL) {
+			std::lock_guard<std::mutex> guard(lock);
+			stats.nOverMemory++;
+			return;
+			}
+
+		glDeleteTextures(1, &pVictim->uiTexture);
+		pVictim->uiTexture = 0;
+		pVictim->nState = GLT_TEXTURE_UNLOADED;
+		nResident -= pVictim->nBytes;
+
+		std::lock_guard<std::mutex> guard(lock);
+		stats.nResidentBytes -= pVictim->nBytes;
+		stats.nEvicted++;
+		pVictim->nBytes = 0;
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void GLTextureStreamer::DecoderMain(void)
+	{
+	CStopWatch timer;
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		wakeDecoder.wait(guard, [this]() { return (!queued.empty() && nHeld < nMaxDecoded) || bQuit; });
+		if(bQuit)
+			return;
+
+		// Most wanted first. The queue is short, a scan is fine.
+		size_t iBest = 0;
+		for(size_t i = 1; i < queued.size(); i++)
+			if(Before(queued[i], queued[iBest]))
+				iBest = i;
+		Entry *pEntry = queued[iBest];
+		queued[iBest] = queued.back();
+		queued.pop_back();
+		pEntry->nState = GLT_TEXTURE_DECODING;
+		nHeld++;
+		guard.unlock();
+
+		timer.Reset();
+		bool bOk = pEntry->image.Open(pEntry->sFileName.c_str());
+		if(bOk && pEntry->image.IsMapped()) {
+			// Touch every page, so the disk reads happen here and not in
+			// the upload's copy on the GL thread
+			const volatile unsigned char *pPage = (const unsigned char *)pEntry->image.GetPixels();
+			unsigned char nSum = 0;
+			for(size_t i = 0; i < pEntry->image.GetSize(); i += 4096)
+				nSum += pPage[i];
+			(void)nSum;
+			}
+		float fSeconds = timer.GetElapsedSeconds();
+
+		guard.lock();
+		stats.fDecodeSeconds += fSeconds;
+		if(bOk) {
+			stats.nDecoded++;
+			pEntry->nState = GLT_TEXTURE_DECODED;
+			}
+		else {
+			stats.nFailed++;
+			pEntry->nState = GLT_TEXTURE_FAILED;
+			nHeld--;
+			}
+		}
+	}
+
+#endif
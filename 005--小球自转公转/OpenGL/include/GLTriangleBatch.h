@@ -101,6 +101,20 @@ class GLTriangleBatch : public GLBatchBase
         inline GLuint GetIndexCount(void) { return nNumIndexes; }
         inline GLuint GetVertexCount(void) { return nNumVerts; }
 
+        // Direct fill, for generators that know their topology up front
+        // (see GLMeshGenerators.h). Call BeginMesh() with at least as many
+        // slots as the larger of the vertex and index counts, write straight
+        // into these arrays, set the counts and call End(). No duplicate
+        // search is done, so the caller's indexes are used as is.
+        inline GLushort *GetIndexArray(void) { return pIndexes; }
+        inline M3DVector3f *GetVertexArray(void) { return pVerts; }
+        inline M3DVector3f *GetNormalArray(void) { return pNorms; }
+        inline M3DVector2f *GetTexCoordArray(void) { return pTexCoords; }
+        inline void SetMeshCounts(GLuint nVerts, GLuint nIndexes) {
+            nNumVerts = nVerts;
+            nNumIndexes = nIndexes;
+            }
+
         
         // Draw - make sure you call glEnableClientState for these arrays
         virtual void Draw(void);
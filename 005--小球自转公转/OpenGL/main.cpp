@@ -4,7 +4,18 @@
 #include "GLMatrixStack.h"
 #include "GLShaderManager.h"
 #include "GLGeometryTransform.h"
+#include "GLFramePool.h"
+#include "GLMeshGenerators.h"
+#include "GLLODBatch.h"
+#include "GLMeshArena.h"
+#include "GLCompactBatch.h"
+#include "GLRenderQueue.h"
+#include "GLCommandBuffer.h"
+#include "GLOcclusionCuller.h"
+#include "GLFrameCapture.h"
+#include "GLStaticBatch.h"
 #include <GLUT/GLUT.h>
+#include <string.h>
 
 //定义一个，着色管理器
 GLShaderManager shaderManager;
@@ -19,22 +30,50 @@ GLMatrixStack          modelViewMatrix;
 // 投影矩阵
 GLFrustum              viewFrustum;
 
-// 视图参考帧
-GLFrame                cameraFrame;
+// 视图参考帧（四元数实现，接口与GLFrame相同，矩阵有缓存）
+GLQuatFrame            cameraFrame;
 // 模型参考帧
 GLFrame                objectFrame;
 
-// 地板
-GLBatch                floorBatch;
-// 大球
-GLTriangleBatch        torusBatch;
-// 小球
-GLTriangleBatch        sphereBatch;
+// 地板（静态几何，启动时合并进一个顶点缓冲区；只有位置，用平面着色器）
+GLStaticBatch          floorBatch;
+// 大球（压缩顶点格式，每个顶点16字节）
+GLCompactBatch         torusBatch;
+// 小球（按屏幕大小切换细节层次）
+GLLODBatch             sphereLOD;
+// 随机小球的各级网格放在同一个网格池里，一次提交
+GLMeshArena            sphereArena;
+// 网格池用的着色器（点光源漫反射，按每次绘制的偏移放置小球）
+GLuint                 arenaShader;
+
+// 渲染队列：一帧的绘制先收集起来，按着色器和渲染状态排序后再提交
+GLRenderQueue          renderQueue;
+// 线框模式（大球线宽1.5，其余2.0）
+GLuint                 wireState = GLT_STATE_DEPTH_TEST | GLT_STATE_POLYGON_LINE | gltStateLineWidth(2.0f);
+GLuint                 torusState = GLT_STATE_DEPTH_TEST | GLT_STATE_POLYGON_LINE | gltStateLineWidth(1.5f);
+// 多线程录制：每个线程把选好的小球写进自己的命令缓冲区，再在主线程统一回放
+GLCommandRecorder      recorder;
+// 遮挡剔除：把遮挡体画进一张小的CPU深度图，被挡住的小球不再提交
+GLOcclusionCuller      occlusion;
+// 遮挡体用低细分的球（顶点都在球面上，比原球略小，不会多挡）
+GLSoftMesh             torusOccluder;
+GLSoftMesh             sphereOccluder;
+// 连续截图：按 c 存成逐帧 QOI 文件，按 v 录成 Y4M 视频；读回是异步的，编码和写文件在后台线程里做
+GLFrameCapture         frameCapture;
+bool                   capturing = false;
+bool                   recording = false;
+int                    captureFrame = 0;
 
 // 随机球个数
 #define NUM_SPHERES 50
-// 记录随机球位置
-GLFrame spheres[NUM_SPHERES];
+// 记录随机球位置（按分量连续存储，批量生成矩阵）
+GLFramePool spheres;
+// 每个小球当前使用的细节层次（最后一个留给公转小球），-1 表示尚未选择
+int sphereLevels[NUM_SPHERES + 1];
+
+// 窗口大小（像素），高度用于计算屏幕大小
+int windowWidth = 800;
+int windowHeight = 600;
 
 
 // 绿色
@@ -47,15 +86,59 @@ GLfloat vBlue[] = { 0.0f, 0.0f, 1.0f, 1.0f };
 
 GLfloat vTranparent[] = { 0.0f, 0.0f, 0.0f, .0f };
 
+// 按填充模式画的物体才能当遮挡体
+bool isSolidState(GLuint state) {
+    return (state & (GLT_STATE_POLYGON_LINE | GLT_STATE_POLYGON_POINT)) == 0;
+}
+
 /// 在窗口大小改变时，接收新的宽度&高度。
 void changeSize(int w,int h) {
 //    glViewport(0, 0, w, h);
+    windowWidth = w;
+    windowHeight = h;
+    // 截图尺寸跟着窗口变（视频中途不能改尺寸，先停止录制）
+    if (recording) {
+        frameCapture.CloseStream();
+        recording = false;
+    }
+    if (capturing)
+        frameCapture.Init(w, h);
     
     viewFrustum.SetPerspective(35.0f, float(w) / float(h), 1.0f, 100.0f);
+    // 遮挡深度图宽256，高按窗口比例
+    occlusion.SetSize(256, (w > 0 && h > 0) ? 256 * h / w : 128);
     // 重新加载投影矩阵
     projectionMatrix.LoadMatrix(viewFrustum.GetProjectionMatrix());
 }
 
+// 普通按键：c 开始/停止逐帧截图，v 开始/停止录视频
+void keyboard(unsigned char key, int x, int y) {
+    bool wasBusy = capturing || recording;
+    if (key == 'c' || key == 'C')
+        capturing = !capturing;
+    else if (key == 'v' || key == 'V')
+        recording = !recording;
+    else
+        return;
+    
+    if (!wasBusy)
+        frameCapture.Init(windowWidth, windowHeight);
+    if (recording && !frameCapture.IsStreamOpen())
+        frameCapture.OpenStream("capture.y4m", 60);
+    else if (!recording)
+        frameCapture.CloseStream();
+    
+    if (!capturing && !recording) {
+        // 等所有帧写完再报告（编码器跟不上时渲染线程要等，等待次数和时间就是背压）
+        frameCapture.Flush();
+        GLTCaptureStats stats = frameCapture.GetStats();
+        printf("capture: %u frames, %u written, %u failed, %.1f MB\n",
+               stats.nCaptured, stats.nWritten, stats.nFailed, stats.dBytesWritten / (1024.0 * 1024.0));
+        printf("         %u readback waits, %u encoder waits (%.2f s), peak %u frames queued, %.2f s encoding\n",
+               stats.nReadbackWaits, stats.nWriterWaits, stats.fWaitSeconds, stats.nPeakQueued, stats.fEncodeSeconds);
+    }
+}
+
 //特殊键位处理（上、下、左、右移动）
 void specialKeys(int key, int x, int y) {
     float linear = 0.1f;
@@ -90,9 +173,10 @@ void renderScene(void) {
     //2.基于时间动画
     static CStopWatch rotTimer;
     float yRot = rotTimer.GetElapsedSeconds() * 60.0f;
-     
-    // 开启深度测试
-    glEnable(GL_DEPTH_TEST);
+    
+    // 深度测试、线框等渲染状态都交给渲染队列设置
+    GLuint flatShader = shaderManager.GetStockShader(GLT_SHADER_FLAT);
+    GLuint pointLightShader = shaderManager.GetStockShader(GLT_SHADER_POINT_LIGHT_DIFF);
 
     modelViewMatrix.PushMatrix();
     // 模型变换
@@ -100,9 +184,9 @@ void renderScene(void) {
     cameraFrame.GetCameraMatrix(mCamera);
     modelViewMatrix.PushMatrix(mCamera);
       
-    // 绘制地板
-    shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), vGreen);
-    floorBatch.Draw();
+    // 绘制地板（顶点已在世界空间，模型视图矩阵只含相机）
+    renderQueue.Submit(&floorBatch, flatShader, transformPipeline.GetModelViewMatrix(), transformPipeline.GetProjectionMatrix(),
+                       vGreen, NULL, wireState);
     
     // 平移（z轴）让小球显示到观察者前面，
     modelViewMatrix.Translate(0.0f, 0.0f, -3.0f);
@@ -110,56 +194,95 @@ void renderScene(void) {
     // 1. 获取光源位置
     M3DVector4f vLightPos = {0.0f,10.0f,5.0f,1.0f};
     
-    // 小球
-    for (int i = 0; i < NUM_SPHERES; i++) {
-        modelViewMatrix.PushMatrix();
-        modelViewMatrix.MultMatrix(spheres[i]);
-        shaderManager.UseStockShader(
-                                     GLT_SHADER_POINT_LIGHT_DIFF,
-                                     transformPipeline.GetModelViewMatrix(),
-                                     transformPipeline.GetProjectionMatrix(),
-                                     vLightPos,
-                                     vBlue);
-        sphereBatch.Draw();
-        modelViewMatrix.PopMatrix();
+    // 小球（一次性算出所有小球的模型矩阵，分到几个线程里选细节层次，主线程再一次性提交）
+    spheres.UpdateMatrices();
+    const float *mView = transformPipeline.GetModelViewMatrix();
+    const float *mProjection = transformPipeline.GetProjectionMatrix();
+    M3DMatrix44f mViewProjection;
+    m3dMatrixMultiply44(mViewProjection, mProjection, mView);
+
+    // 先画遮挡体。线框挡不住后面的东西，只有实心（非线框、非点）的物体才算遮挡体
+    occlusion.BeginFrame();
+    if (isSolidState(torusState))
+        occlusion.AddOccluder(torusOccluder, transformPipeline.GetModelViewProjectionMatrix());
+    if (isSolidState(wireState)) {
+        for (int i = 0; i < spheres.GetCount(); i++) {
+            M3DMatrix44f mSphereMVP;
+            m3dMatrixMultiply44(mSphereMVP, mViewProjection, spheres.GetMatrix(i));
+            occlusion.AddOccluder(sphereOccluder, mSphereMVP);
+        }
     }
+
+    static const M3DVector3f vSphereMin = { -0.2f, -0.2f, -0.2f };
+    static const M3DVector3f vSphereMax = { 0.2f, 0.2f, 0.2f };
+    recorder.Record(spheres.GetCount(), 16, [&](GLCommandBuffer &commands, GLuint first, GLuint last) {
+        for (GLuint i = first; i < last; i++) {
+            M3DMatrix44f mSphere;
+            m3dMatrixMultiply44(mSphere, mView, spheres.GetMatrix(i));
+            float pixels = sphereLOD.GetScreenRadius(mSphere, mProjection, windowHeight);
+            sphereLevels[i] = sphereLOD.SelectLevel(pixels, sphereLevels[i]);
+
+            // 包围盒被遮挡体完全挡住就不画
+            if (occlusion.GetOccluderCount() > 0) {
+                M3DMatrix44f mSphereMVP;
+                m3dMatrixMultiply44(mSphereMVP, mProjection, mSphere);
+                if (!occlusion.IsVisible(vSphereMin, vSphereMax, mSphereMVP))
+                    continue;
+            }
+
+            // 网格编号就是细节层次，偏移取小球矩阵的平移部分
+            const float *pOrigin = spheres.GetMatrix(i) + 12;
+            commands.RecordArenaDraw(&sphereArena, sphereLevels[i], pOrigin[0], pOrigin[1], pOrigin[2]);
+        }
+    });
+    // 回放只在主线程（拥有 OpenGL 上下文）里做
+    sphereArena.ClearDraws();
+    recorder.Replay(renderQueue);
+    renderQueue.Submit(&sphereArena, arenaShader, transformPipeline.GetModelViewMatrix(), transformPipeline.GetProjectionMatrix(),
+                       vBlue, vLightPos, wireState);
     
     // 绘制大球
     // 旋转
     modelViewMatrix.PushMatrix();
     modelViewMatrix.Rotate(yRot, 0.0f, 1.0f, 0.0f);
+    // 顶点坐标是相对包围盒量化的，乘上解码矩阵还原
+    modelViewMatrix.MultMatrix(torusBatch.GetDecodeMatrix());
     
-    // 划线
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glLineWidth(1.5f);
-    
-    // 8.指定合适的着色器(点光源着色器)
-    shaderManager.UseStockShader(
-                                 GLT_SHADER_POINT_LIGHT_DIFF,
-                                 transformPipeline.GetModelViewMatrix(),
-                                 transformPipeline.GetProjectionMatrix(),
-                                 vLightPos,
-                                 vRed);
-    torusBatch.Draw();
+    // 8.指定合适的着色器(点光源着色器)，划线
+    renderQueue.Submit(&torusBatch, pointLightShader, transformPipeline.GetModelViewMatrix(), transformPipeline.GetProjectionMatrix(),
+                       vRed, vLightPos, torusState);
     modelViewMatrix.PopMatrix();
     
     
     // 小球（先旋转再平移，顺序不能变）
-    glLineWidth(2.0f);
-    
     // 公转
     modelViewMatrix.Rotate(yRot * -1.0f, 0.0f, 1.0f, 0.0f);
     // 公转半径
     modelViewMatrix.Translate(0.8f, 0.0f, 0.0f);
     
-    shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF,transformPipeline.GetModelViewMatrix(),transformPipeline.GetProjectionMatrix(),vLightPos, vBlue);
-    sphereBatch.Draw();
+    float pixels = sphereLOD.GetScreenRadius(transformPipeline.GetModelViewMatrix(), transformPipeline.GetProjectionMatrix(), windowHeight);
+    sphereLevels[NUM_SPHERES] = sphereLOD.SelectLevel(pixels, sphereLevels[NUM_SPHERES]);
+    if (sphereLevels[NUM_SPHERES] >= 0 &&
+        occlusion.IsVisible(vSphereMin, vSphereMax, transformPipeline.GetModelViewProjectionMatrix()))
+        renderQueue.Submit(&sphereLOD.GetLevel(sphereLevels[NUM_SPHERES]), pointLightShader,
+                           transformPipeline.GetModelViewMatrix(), transformPipeline.GetProjectionMatrix(),
+                           vBlue, vLightPos, wireState);
        
     modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
-        
-    glDisable(GL_DEPTH_TEST);
+    
+    // 排序后一次性提交
+    renderQueue.Flush();
+    
+    // 交换前读回后台缓冲区，几帧之后才写成文件
+    if (capturing) {
+        char fileName[64];
+        sprintf(fileName, "capture_%05d.qoi", captureFrame++);
+        frameCapture.Capture(fileName);
+    }
+    if (recording)
+        frameCapture.CaptureStream();
     
     // 进行缓冲区交换
     glutSwapBuffers();
@@ -176,23 +299,51 @@ void setupRC() {
     transformPipeline.SetMatrixStacks(modelViewMatrix, projectionMatrix);
 
     //3. 设置地板顶点数据
-    floorBatch.Begin(GL_LINES, 324);
+    //   网格画在 y = 0 平面上，由世界矩阵下移到 -0.55
+    M3DMatrix44f mFloor;
+    m3dTranslationMatrix44(mFloor, 0.0f, -0.55f, 0.0f);
+    floorBatch.Begin(GL_LINES, GLT_SHADER_FLAT, vGreen, mFloor);
     for(GLfloat x = -20.0; x <= 20.0f; x+= 0.5) {
-        floorBatch.Vertex3f(x, -0.55f, 20.0f);
-        floorBatch.Vertex3f(x, -0.55f, -20.0f);
+        floorBatch.Vertex3f(x, 0.0f, 20.0f);
+        floorBatch.Vertex3f(x, 0.0f, -20.0f);
         
-        floorBatch.Vertex3f(20.0f, -0.55f, x);
-        floorBatch.Vertex3f(-20.0f, -0.55f, x);
+        floorBatch.Vertex3f(20.0f, 0.0f, x);
+        floorBatch.Vertex3f(-20.0f, 0.0f, x);
     }
     floorBatch.End();
+    floorBatch.Build();
     
     // 4.设置大球模型
-    gltMakeSphere(torusBatch, 0.4f, 20, 40);
+    GLuint nVerts, nIndexes;
+    gltSphereMeshSize(20, 40, &nVerts, &nIndexes);
+    gltWriteSphere(torusBatch.BeginMesh(nVerts, nIndexes), 0.4f, 20, 40);
+    torusBatch.End();
+
+    // 遮挡体：大球 12x6，小球 8x4
+    gltSphereMeshSize(6, 12, &nVerts, &nIndexes);
+    gltWriteSphere(torusOccluder.BeginMesh(nVerts, nIndexes), 0.4f, 6, 12);
+    gltSphereMeshSize(4, 8, &nVerts, &nIndexes);
+    gltWriteSphere(sphereOccluder.BeginMesh(nVerts, nIndexes), 0.2f, 4, 8);
     
-    // 5. 设置小球球模型
-    gltMakeSphere(sphereBatch, 0.2f, 12, 24);
+    // 5. 设置小球球模型（近处与原来一样 12x24，远处依次减半）
+    sphereLOD.BuildSphere(0.2f, 12, 24, 3, 1.0f);
+    for (int i = 0; i <= NUM_SPHERES; i++)
+        sphereLevels[i] = -1;
+    
+    // 各级网格按同样的细分放进网格池，网格编号与细节层次一致
+    for (int level = 0; level < sphereLOD.GetLevelCount(); level++)
+        sphereArena.AddSphere(0.2f, 12 >> level, 24 >> level);
+    sphereArena.Build();
+    arenaShader = shaderManager.LoadShaderPairSrcWithAttributes("ArenaPointLightDiff",
+                                                                GLT_ARENA_SHADER_POINT_LIGHT_DIFF_VP,
+                                                                GLT_ARENA_SHADER_POINT_LIGHT_DIFF_FP,
+                                                                3,
+                                                                GLT_ATTRIBUTE_VERTEX, "vVertex",
+                                                                GLT_ATTRIBUTE_NORMAL, "vNormal",
+                                                                GLT_ARENA_ATTRIBUTE_DRAW, "vDraw");
     
     //6. 随机位置放置小球球
+    spheres.Reserve(NUM_SPHERES);
     for (int i = 0; i < NUM_SPHERES; i++) {
         //y轴不变，X,Z产生随机值
         GLfloat x = ((GLfloat)((rand() % 400) - 200 ) * 0.1f);
@@ -200,10 +351,133 @@ void setupRC() {
         
         //在y方向，将球体设置为0.0的位置，这使得它们看起来是飘浮在眼睛的高度
         //对spheres数组中的每一个顶点，设置顶点数据
-        spheres[i].SetOrigin(x, 0.0f, z);
+        spheres.SetOrigin(spheres.Add(), x, 0.0f, z);
     }
 }
 
+// 基准测试场景：16 个大球（20x40）排成 4x4，透视与窗口相同，都在视野之内
+#define BENCH_INSTANCES 16
+void setupBenchScene(GLSoftMesh &mesh, M3DMatrix44f *mvps) {
+    GLuint nVerts, nIndexes;
+    gltSphereMeshSize(20, 40, &nVerts, &nIndexes);
+    gltWriteSphere(mesh.BeginMesh(nVerts, nIndexes), 0.4f, 20, 40);
+    
+    GLFrustum frustum;
+    frustum.SetPerspective(35.0f, 800.0f / 600.0f, 1.0f, 100.0f);
+    for (int i = 0; i < BENCH_INSTANCES; i++) {
+        M3DMatrix44f mv;
+        m3dTranslationMatrix44(mv, float(i % 4) - 1.5f, float(i / 4) - 1.5f, -6.0f);
+        m3dMatrixMultiply44(mvps[i], frustum.GetProjectionMatrix(), mv);
+    }
+}
+
+// 软件光栅化 800x600：每秒三角形数和像素数，线程数从1个加到全部
+void benchSoftRaster(const GLSoftMesh &mesh, const M3DMatrix44f *mvps) {
+    GLSoftRasterizer raster;
+    raster.SetSize(800, 600);
+    std::vector<GLTSoftRasterBenchmark> results;
+    gltSoftRasterBenchmark(raster, mesh, mvps, BENCH_INSTANCES, 20, gltGetJobSystem().GetThreadCount(), 3, results);
+    
+    printf("软件光栅化 800x600，%d 个球：\n", BENCH_INSTANCES);
+    for (size_t i = 0; i < results.size(); i++)
+        printf("  %2d 线程 %8.2f ms/帧 %8.2f Mtri/s %8.1f Mpix/s  加速 %.2fx\n",
+               results[i].nThreads, results[i].fSeconds * 1000.0f,
+               results[i].fMTrianglesPerSecond, results[i].fMPixelsPerSecond,
+               results[0].fSeconds / results[i].fSeconds);
+}
+
+// 遮挡用的深度图 256x192：AVX2 与标量，从前往后与从后往前画
+// 球沿视线方向一个比一个远、略微错开，前面的球会挡住后面大部分
+void benchDepthRaster(const GLSoftMesh &mesh) {
+    GLFrustum frustum;
+    frustum.SetPerspective(35.0f, 800.0f / 600.0f, 1.0f, 100.0f);
+    M3DMatrix44f frontToBack[BENCH_INSTANCES], backToFront[BENCH_INSTANCES];
+    for (int i = 0; i < BENCH_INSTANCES; i++) {
+        M3DMatrix44f mv;
+        m3dTranslationMatrix44(mv, float(i % 4) * 0.1f - 0.15f, float(i / 4) * 0.1f - 0.15f, -3.0f - float(i) * 0.4f);
+        m3dMatrixMultiply44(frontToBack[i], frustum.GetProjectionMatrix(), mv);
+        m3dCopyMatrix44(backToFront[BENCH_INSTANCES - 1 - i], frontToBack[i]);
+    }
+    
+    GLDepthRaster raster;
+    raster.SetSize(256, 192);
+    printf("遮挡深度图 256x192，%d 个球：\n", BENCH_INSTANCES);
+    for (int avx2 = 1; avx2 >= 0; avx2--) {
+        if (raster.SetAVX2(avx2 != 0) != (avx2 != 0))
+            continue;
+        for (int order = 0; order < 2; order++) {
+            GLTDepthRasterStats stats;
+            float seconds = gltDepthRasterBenchmark(raster, mesh, order == 0 ? frontToBack : backToFront,
+                                                    BENCH_INSTANCES, 200, &stats);
+            printf("  %-4s %s %8.3f ms/帧  三角形 %5u  块：挡住 %5u 整块 %5u 逐像素 %5u\n",
+                   avx2 ? "AVX2" : "标量", order == 0 ? "从前往后" : "从后往前", seconds * 1000.0f,
+                   stats.nTriangles, stats.nBlocksHidden, stats.nBlocksAccepted, stats.nBlocksPartial);
+        }
+    }
+}
+
+// 线程池的扩展性：生成网格、批量计算矩阵，线程数从1个加到全部
+void printScaling(const char *name, const std::vector<float> &seconds) {
+    printf("  %s\n", name);
+    for (size_t i = 0; i < seconds.size(); i++)
+        printf("  %2d 线程 %8.2f ms  加速 %.2fx\n", int(i) + 1, seconds[i] * 1000.0f, seconds[0] / seconds[i]);
+}
+
+void benchJobScaling() {
+    int maxThreads = gltGetJobSystem().GetThreadCount();
+    std::vector<float> seconds;
+    printf("线程池扩展性：\n");
+    
+    // 球 255x254，65280 个顶点（16位索引的上限之内）
+    GLuint nVerts, nIndexes;
+    gltSphereMeshSize(255, 254, &nVerts, &nIndexes);
+    GLSoftMesh mesh;
+    GLTMeshArrays arrays = mesh.BeginMesh(nVerts, nIndexes);
+    gltJobScaling(maxThreads, 5, [&](int threads) {
+        gltWriteSphere(arrays, 1.0f, 255, 254, threads);
+    }, seconds);
+    printScaling("gltWriteSphere 255x254", seconds);
+    
+    // 10万个参考帧，乘上视图投影矩阵
+    GLFramePool frames;
+    frames.Reserve(100000);
+    for (int i = 0; i < 100000; i++)
+        frames.SetOrigin(frames.Add(), float(i % 100), 0.0f, float(i / 100));
+    GLFrustum frustum;
+    frustum.SetPerspective(35.0f, 800.0f / 600.0f, 1.0f, 100.0f);
+    gltJobScaling(maxThreads, 5, [&](int threads) {
+        frames.UpdateMatrices(frustum.GetProjectionMatrix(), threads);
+    }, seconds);
+    printScaling("GLFramePool::UpdateMatrices 100000", seconds);
+}
+
+// 参考帧：GLFrame 与 GLQuatFrame 各操作每秒调用次数（百万次）
+void benchQuatFrame() {
+    GLTQuatFrameBenchmark result;
+    float sink = gltQuatFrameBenchmark(2000000, result);
+    
+    printf("参考帧（百万次/秒）         GLFrame  GLQuatFrame\n");
+    printf("  RotateLocal             %8.1f %8.1f\n", result.fFrameRotateLocal, result.fQuatRotateLocal);
+    printf("  RotateWorld             %8.1f %8.1f\n", result.fFrameRotateWorld, result.fQuatRotateWorld);
+    printf("  GetMatrix               %8.1f %8.1f\n", result.fFrameGetMatrix, result.fQuatGetMatrix);
+    printf("  RotateLocal+GetMatrix   %8.1f %8.1f\n", result.fFrameRotateGetMatrix, result.fQuatRotateGetMatrix);
+    // 打印出来，免得编译器把计算优化掉
+    printf("  (%g)\n", sink);
+}
+
+// 依次运行各项基准测试，结果打印到控制台
+void runBenchmarks() {
+    printf("线程池：%d 个线程\n", gltGetJobSystem().GetThreadCount());
+    
+    GLSoftMesh benchMesh;
+    M3DMatrix44f benchMVPs[BENCH_INSTANCES];
+    setupBenchScene(benchMesh, benchMVPs);
+    benchSoftRaster(benchMesh, benchMVPs);
+    benchDepthRaster(benchMesh);
+    benchJobScaling();
+    benchQuatFrame();
+}
+
 int main(int argc,char *argv[]) {
     //初始化GLUT库,这个函数只是传说命令参数并且初始化glut库
     glutInit(&argc, argv);
@@ -219,6 +493,8 @@ int main(int argc,char *argv[]) {
     glutDisplayFunc(renderScene);
     // 特殊键位函数（上下左右）
     glutSpecialFunc(specialKeys);
+    // 普通按键（截图）
+    glutKeyboardFunc(keyboard);
 
     GLenum status = glewInit();
     if (GLEW_OK != status) {
@@ -226,6 +502,18 @@ int main(int argc,char *argv[]) {
         return 1;
     }
     
+    // 命令行参数 -check：检查各种压缩顶点格式的误差是否在精度之内，打印结果后退出，超出时返回1
+    // 命令行参数 -bench：运行基准测试（见 runBenchmarks），打印结果后退出，计时请用 Release 配置
+    //（Xcode 里在 Scheme 的 Arguments Passed On Launch 中添加）
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-check") == 0)
+            return gltCheckCompactFormats() ? 0 : 1;
+        if (strcmp(argv[i], "-bench") == 0) {
+            runBenchmarks();
+            return 0;
+        }
+    }
+    
     //设置我们的渲染环境
     setupRC();
     